@@ -1,15 +1,30 @@
 #include <memory>
+#include <algorithm>
 #include "audio_encoder.h"
 #include "mov_container.h"
+#include "plugin_log.h"
+#include "pipeline_trace.h"
+#include "prores_props.h"
+extern "C" {
+#include <libavutil/channel_layout.h>
+}
 
 
 const uint8_t AudioEncoder::s_UUID[] = { 0xad, 0x90, 0x3d, 0x57, 0x02, 0xf2, 0x4a, 0xc1, 0x9d, 0xde, 0x8f, 0xac, 0xa3, 0x48, 0x80, 0x51 };
+const uint8_t AudioEncoder::s_AacUUID[] = { 0x5b, 0x1e, 0x86, 0x0c, 0x7a, 0x43, 0x4f, 0x29, 0xb6, 0x0e, 0x31, 0xd2, 0x94, 0xc8, 0x5f, 0x17 };
+
 
+// packets of about this length, QuickTime players read LPCM in chunks of this order
+static const double s_PacketSeconds = 0.5;
+
+// AAC input queued ahead of the encoder, the host only waits once this much is backed up
+static const double s_FifoSeconds = 2.0;
 
 class UIAudioSettingsController
 {
 public:
-    UIAudioSettingsController()
+    explicit UIAudioSettingsController(bool p_IsAac)
+        : m_IsAac(p_IsAac)
     {
         InitDefaults();
     }
@@ -21,23 +36,87 @@ public:
     void Load(IPropertyProvider* p_pValues)
     {
         p_pValues->GetINT32("aud_enc_bitrate", m_BitRate);
+        p_pValues->GetINT32(pIOPropPCMFormat, m_PCMFormat);
+        p_pValues->GetUINT8(pIOPropByteOrder, m_IsBigEndian);
+        p_pValues->GetUINT8(pIOPropDiscreteMono, m_IsDiscreteMono);
     }
 
     StatusCode Render(HostListRef* p_pSettingsList)
     {
-        HostUIConfigEntryRef item("aud_enc_bitrate");
-        item.MakeSlider("Bit Rate", "kbps", m_BitRate, 128, 512, 128);
+        if (m_IsAac)
+        {
+            HostUIConfigEntryRef item("aud_enc_bitrate");
+            item.MakeSlider("Bit Rate", "kbps", m_BitRate, 128, 512, 128);
+
+            item.SetTriggersUpdate(true);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "Audio Plugin :: Failed to populate bitrate slider UI entry");
+                return errFail;
+            }
+
+            return errNone;
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropPCMFormat);
+
+            std::vector<std::string> textsVec;
+            std::vector<int> valuesVec;
+            static const char* s_FormatNames[] = { "Same as Source", "16 bit", "24 bit", "32 bit", "32 bit Float" };
+            for (int i = 0; i < static_cast<int>(sizeof(s_FormatNames) / sizeof(s_FormatNames[0])); ++i)
+            {
+                textsVec.push_back(s_FormatNames[i]);
+                valuesVec.push_back(i);
+            }
+
+            item.MakeComboBox("Sample Format", textsVec, valuesVec, m_PCMFormat);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "Audio Plugin :: Failed to populate sample format UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropByteOrder);
+            item.MakeCheckBox("Big Endian", "Store the samples big endian", m_IsBigEndian != 0);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "Audio Plugin :: Failed to populate byte order UI entry");
+                return errFail;
+            }
+        }
 
-        item.SetTriggersUpdate(true);
-        if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
         {
-            g_Log(logLevelError, "Audio Plugin :: Failed to populate bitrate slider UI entry");
-            return errFail;
+            HostUIConfigEntryRef item(pIOPropDiscreteMono);
+            item.MakeCheckBox("Discrete Mono Tracks", "Write each channel as a mono track", m_IsDiscreteMono != 0);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "Audio Plugin :: Failed to populate discrete mono UI entry");
+                return errFail;
+            }
         }
 
         return errNone;
     }
 
+    // the format to store, p_SrcFormat when the source format is kept
+    PCMSampleFormat GetFormat(PCMSampleFormat p_SrcFormat) const
+    {
+        return ((m_PCMFormat > 0) && (m_PCMFormat <= pcmFormatF32 + 1)) ? static_cast<PCMSampleFormat>(m_PCMFormat - 1) : p_SrcFormat;
+    }
+
+    bool IsBigEndian() const
+    {
+        return (m_IsBigEndian != 0);
+    }
+
+    bool IsDiscreteMono() const
+    {
+        return (m_IsDiscreteMono != 0);
+    }
+
     int32_t GetBitRate() const
     {
         return m_BitRate;
@@ -47,27 +126,31 @@ private:
     void InitDefaults()
     {
         m_BitRate = 128;
+        m_PCMFormat = 0;
+        m_IsBigEndian = 0;
+        m_IsDiscreteMono = 0;
     }
 
 private:
+    bool m_IsAac;
     int32_t m_BitRate;
+    int32_t m_PCMFormat;
+    uint8_t m_IsBigEndian;
+    uint8_t m_IsDiscreteMono;
 };
 
-StatusCode AudioEncoder::s_RegisterCodecs(HostListRef* p_pList)
+static StatusCode s_RegisterCodec(HostListRef* p_pList, const uint8_t* p_pUUID, const char* p_pCodecName, uint32_t p_FourCC)
 {
-    // add audio encoder
     HostPropertyCollectionRef codecInfo;
     if (!codecInfo.IsValid())
     {
         return errAlloc;
     }
 
-    codecInfo.SetProperty(pIOPropUUID, propTypeUInt8, AudioEncoder::s_UUID, 16);
+    codecInfo.SetProperty(pIOPropUUID, propTypeUInt8, p_pUUID, 16);
+    codecInfo.SetProperty(pIOPropName, propTypeString, p_pCodecName, strlen(p_pCodecName));
 
-    const char* pCodecName = "Audio Plugin";
-    codecInfo.SetProperty(pIOPropName, propTypeString, pCodecName, strlen(pCodecName));
-
-    uint32_t val = ' aac';
+    uint32_t val = p_FourCC;
     codecInfo.SetProperty(pIOPropFourCC, propTypeUInt32, &val, 1);
 
     val = mediaAudio;
@@ -76,10 +159,10 @@ StatusCode AudioEncoder::s_RegisterCodecs(HostListRef* p_pList)
     val = dirEncode;
     codecInfo.SetProperty(pIOPropCodecDirection, propTypeUInt32, &val, 1);
 
-    // if need ieeefloat, set pIOPropIsFloat to 1 with bitdepth 32, supports only single bitdepth option of 32
+    // if need ieeefloat, set pIOPropIsFloat to 1 with bitdepth 32, supports only single bitdepth option of 32.
+    // This is the input depth, the encoder converts from it
     std::vector<uint32_t> bitDepths({16, 24});
     codecInfo.SetProperty(pIOPropBitDepth, propTypeUInt32, bitDepths.data(), bitDepths.size());
-    codecInfo.SetProperty(pIOPropBitsPerSample, propTypeUInt32, &val, 1);
 
     // supported sampling rates, or empty
     std::vector<uint32_t> samplingRates({44100, 48000});
@@ -108,111 +191,539 @@ StatusCode AudioEncoder::s_RegisterCodecs(HostListRef* p_pList)
     return errNone;
 }
 
-StatusCode AudioEncoder::s_GetEncoderSettings(HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList)
+StatusCode AudioEncoder::s_RegisterCodecs(HostListRef* p_pList)
 {
-    UIAudioSettingsController settings;
+    // add audio encoders
+    const StatusCode err = s_RegisterCodec(p_pList, AudioEncoder::s_UUID, "Linear PCM", 'lpcm');
+    if (err != errNone)
+    {
+        return err;
+    }
+
+    return s_RegisterCodec(p_pList, AudioEncoder::s_AacUUID, "AAC", ' aac');
+}
+
+StatusCode AudioEncoder::s_GetEncoderSettings(bool p_IsAac, HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList)
+{
+    UIAudioSettingsController settings(p_IsAac);
     settings.Load(p_pValues);
 
     return settings.Render(p_pSettingsList);
 }
 
-AudioEncoder::AudioEncoder()
+AudioEncoder::AudioEncoder(bool p_IsAac)
+    : m_IsAac(p_IsAac)
+    , m_SrcFormat(pcmFormatS16)
+    , m_DstFormat(pcmFormatS16)
+    , m_IsBigEndian(false)
+    , m_IsDiscreteMono(false)
+    , m_SamplingRate(0)
+    , m_NumChannels(0)
+    , m_NumPendingFrames(0)
+    , m_FramesPerPacket(0)
+    , m_NextPts(0)
+    , m_pCodecContext(NULL)
+    , m_pFrame(NULL)
+    , m_IsFlushing(false)
+    , m_IsDrained(false)
+    , m_IsStopping(false)
+    , m_HasError(false)
 {
 }
 
 AudioEncoder::~AudioEncoder()
 {
+    if (m_Worker.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_IsStopping = true;
+        }
+        m_WorkCond.notify_all();
+        m_Worker.join();
+    }
+
+    for (size_t i = 0; i < m_Packets.size(); ++i)
+    {
+        av_packet_free(&m_Packets[i]);
+    }
+
+    av_frame_free(&m_pFrame);
+    avcodec_free_context(&m_pCodecContext);
 }
 
 StatusCode AudioEncoder::DoInit(HostPropertyCollectionRef* p_pProps)
 {
-    uint32_t bitDepth = 0;
-    p_pProps->GetUINT32(pIOPropBitDepth, bitDepth);
+    // the stream format is read once here, the buffers themselves carry no properties the encoder needs
+    m_CommonProps.Load(p_pProps);
 
-    uint8_t isFloat = 0;
-    p_pProps->GetUINT8(pIOPropIsFloat, isFloat);
+    const uint32_t bitDepth = m_CommonProps.GetBitDepth();
+    const bool isFloat = m_CommonProps.IsFloat();
+    if (!g_PCMFormatFromBitDepth(bitDepth, isFloat, &m_SrcFormat) || (m_CommonProps.GetSamplingRate() == 0) || (m_CommonProps.GetNumChannels() == 0))
+    {
+        g_Log(logLevelError, "Audio Plugin :: Unsupported input: %u bits%s, %u Hz, %u channels", bitDepth, isFloat ? " float" : "", m_CommonProps.GetSamplingRate(),
+              m_CommonProps.GetNumChannels());
+        return errUnsupported;
+    }
+
+    m_SamplingRate = m_CommonProps.GetSamplingRate();
+    m_NumChannels = m_CommonProps.GetNumChannels();
+    return errNone;
+}
+
+void AudioEncoder::DoFlush()
+{
+    if (m_IsAac)
+    {
+        DrainAac();
+        return;
+    }
+
+    // a flush ends the stream, whatever is left goes out as a short packet
+    if (m_NumPendingFrames > 0)
+    {
+        SendPending(m_NumPendingFrames);
+    }
+}
 
-    uint32_t samplingRate = 0;
-    p_pProps->GetUINT32(pIOPropSamplingRate, samplingRate);
+StatusCode AudioEncoder::DoOpen(HostBufferRef* p_pBuff)
+{
+    m_pSettings.reset(new UIAudioSettingsController(m_IsAac));
+    m_pSettings->Load(p_pBuff);
 
-    uint32_t numChannels = 0;
-    p_pProps->GetUINT32(pIOPropNumChannels, numChannels);
+    if (m_IsAac)
+    {
+        return OpenAac(p_pBuff);
+    }
 
-    uint32_t trackIdx = 0xFFFFFFFF;
-    p_pProps->GetUINT32(pIOPropTrackIdx, trackIdx);
+    m_DstFormat = m_pSettings->GetFormat(m_SrcFormat);
+    m_IsBigEndian = m_pSettings->IsBigEndian();
+    m_IsDiscreteMono = m_pSettings->IsDiscreteMono() && (m_NumChannels > 1);
+
+    // tell the container what it gets, it sets up the sound description from these
+    const uint32_t bitDepth = g_PCMBytesPerSample(m_DstFormat) * 8;
+    const uint8_t isFloat = (m_DstFormat == pcmFormatF32) ? 1 : 0;
+    const uint8_t byteOrder = m_IsBigEndian ? 1 : 0;
+    const uint8_t isDiscreteMono = m_IsDiscreteMono ? 1 : 0;
+    const uint32_t bitRate = bitDepth * m_SamplingRate * m_NumChannels;
+    if ((p_pBuff->SetProperty(pIOPropDiscreteMono, propTypeUInt8, &isDiscreteMono, 1) != errNone) ||
+        (p_pBuff->SetProperty(pIOPropBitDepth, propTypeUInt32, &bitDepth, 1) != errNone) ||
+        (p_pBuff->SetProperty(pIOPropBitsPerSample, propTypeUInt32, &bitDepth, 1) != errNone) ||
+        (p_pBuff->SetProperty(pIOPropIsFloat, propTypeUInt8, &isFloat, 1) != errNone) ||
+        (p_pBuff->SetProperty(pIOPropByteOrder, propTypeUInt8, &byteOrder, 1) != errNone) ||
+        (p_pBuff->SetProperty(pIOPropBitRate, propTypeUInt32, &bitRate, 1) != errNone))
+    {
+        return errFail;
+    }
 
-    g_Log(logLevelWarn, "Dummy Audio Plugin :: Init Bit Depth: %d, isFloat: %d, Sampling Rate: %d, Num Channels: %d, Track Index: %d", bitDepth, isFloat, samplingRate, numChannels, trackIdx);
+    m_FramesPerPacket = std::max<size_t>(1, static_cast<size_t>(m_SamplingRate * s_PacketSeconds));
+    m_Pending.resize(m_FramesPerPacket * m_NumChannels * g_PCMBytesPerSample(m_DstFormat));
+    m_NumPendingFrames = 0;
+    m_NextPts = 0;
 
+    g_Log(logLevelInfo, "Audio Plugin :: Writing %u channels%s at %u Hz as %u bit%s %s endian", m_NumChannels, m_IsDiscreteMono ? " as mono tracks" : "",
+          m_SamplingRate, bitDepth, (isFloat != 0) ? " float" : "", m_IsBigEndian ? "big" : "little");
     return errNone;
 }
 
-void AudioEncoder::DoFlush()
+StatusCode AudioEncoder::DoProcess(HostBufferRef* p_pBuff)
 {
-    // Flush codec if needed
-    g_Log(logLevelWarn, "Dummy Audio Plugin :: Flush");
+    if ((p_pBuff == NULL) || !p_pBuff->IsValid())
+    {
+        // flushing
+        DoFlush();
+        return errMoreData;
+    }
+
+    char* pBuf = NULL;
+    size_t bufSize = 0;
+    if (!p_pBuff->LockBuffer(&pBuf, &bufSize))
+    {
+        PLUGIN_LOG(logLevelError, "Audio Plugin :: Failed to lock the input buffer");
+        return errFail;
+    }
+
+    const size_t srcFrameSize = m_NumChannels * g_PCMBytesPerSample(m_SrcFormat);
+    const size_t dstFrameSize = m_NumChannels * g_PCMBytesPerSample(m_DstFormat);
+    if ((bufSize % srcFrameSize) != 0)
+    {
+        PLUGIN_LOG(logLevelWarn, "Audio Plugin :: Input buffer of %zu bytes is not a whole number of frames", bufSize);
+    }
+
+    if (m_IsAac)
+    {
+        const StatusCode err = ProcessAac(pBuf, bufSize / srcFrameSize);
+        p_pBuff->UnlockBuffer();
+        return err;
+    }
+
+    // convert straight into the pending packet, sending it whenever it fills up
+    const char* pSrc = pBuf;
+    size_t numFrames = bufSize / srcFrameSize;
+    StatusCode err = errNone;
+    std::vector<void*> planes(m_IsDiscreteMono ? m_NumChannels : 0);
+    while ((numFrames > 0) && (err == errNone))
+    {
+        const size_t numCopied = std::min(numFrames, m_FramesPerPacket - m_NumPendingFrames);
+        if (m_IsDiscreteMono)
+        {
+            const size_t sampleSize = g_PCMBytesPerSample(m_DstFormat);
+            for (uint32_t c = 0; c < m_NumChannels; ++c)
+            {
+                planes[c] = m_Pending.data() + (c * m_FramesPerPacket + m_NumPendingFrames) * sampleSize;
+            }
+            g_DeinterleavePCM(pSrc, m_SrcFormat, planes.data(), m_DstFormat, m_IsBigEndian, numCopied, m_NumChannels);
+        }
+        else
+        {
+            g_ConvertPCM(pSrc, m_SrcFormat, m_Pending.data() + m_NumPendingFrames * dstFrameSize, m_DstFormat, m_IsBigEndian, numCopied * m_NumChannels);
+        }
+
+        m_NumPendingFrames += numCopied;
+        pSrc += numCopied * srcFrameSize;
+        numFrames -= numCopied;
+
+        if (m_NumPendingFrames == m_FramesPerPacket)
+        {
+            err = SendPending(m_NumPendingFrames);
+        }
+    }
+
+    p_pBuff->UnlockBuffer();
+    return err;
 }
 
-StatusCode AudioEncoder::DoOpen(HostBufferRef* p_pBuff)
+StatusCode AudioEncoder::SendPending(size_t p_NumFrames)
 {
-    m_pSettings.reset(new UIAudioSettingsController());
-    m_pSettings->Load(p_pBuff);
+    if (!m_pCallback)
+    {
+        return errInvalidOperation;
+    }
+
+    const size_t bytes = p_NumFrames * m_NumChannels * g_PCMBytesPerSample(m_DstFormat);
+
+    HostBufferRef outBuf(false);
+    if (!outBuf.IsValid() || !outBuf.Resize(bytes))
+    {
+        return errAlloc;
+    }
 
-    // fill bitrate for output
-    if (m_pSettings->GetBitRate() > 0)
+    char* pOutBuf = NULL;
+    size_t outBufSize = 0;
+    if (!outBuf.LockBuffer(&pOutBuf, &outBufSize))
     {
-        const uint64_t bitRate = static_cast<uint64_t>(m_pSettings->GetBitRate()) * 1000;
-        StatusCode sts = p_pBuff->SetProperty(pIOPropBitRate, propTypeUInt32, &bitRate, 1);
-        if (sts != errNone)
+        return errAlloc;
+    }
+
+    if (m_IsDiscreteMono)
+    {
+        // the planes go out back to back, a short last packet closes the gaps between them
+        const size_t planeSize = p_NumFrames * g_PCMBytesPerSample(m_DstFormat);
+        for (uint32_t c = 0; c < m_NumChannels; ++c)
         {
-            return sts;
+            memcpy(pOutBuf + c * planeSize, m_Pending.data() + c * m_FramesPerPacket * g_PCMBytesPerSample(m_DstFormat), planeSize);
         }
     }
+    else
+    {
+        memcpy(pOutBuf, m_Pending.data(), bytes);
+    }
 
-    uint32_t bitDepth = 0;
-    p_pBuff->GetUINT32(pIOPropBitDepth, bitDepth);
+    int64_t pts = m_NextPts;
+    int64_t duration = static_cast<int64_t>(p_NumFrames);
+    outBuf.SetProperty(pIOPropPTS, propTypeInt64, &pts, 1);
+    outBuf.SetProperty(pIOPropDTS, propTypeInt64, &pts, 1);
+    outBuf.SetProperty(pIOPropDuration, propTypeInt64, &duration, 1);
+    const StatusCode err = m_pCallback->SendOutput(&outBuf);
+    outBuf.UnlockBuffer();
+
+    m_NextPts += duration;
+    m_NumPendingFrames = 0;
+    return err;
+}
 
-    uint8_t isFloat = 0;
-    p_pBuff->GetUINT8(pIOPropIsFloat, isFloat);
+StatusCode AudioEncoder::OpenAac(HostBufferRef* p_pBuff)
+{
+    const AVCodec* pCodec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (pCodec == NULL)
+    {
+        g_Log(logLevelError, "Audio Plugin :: No AAC encoder available");
+        return errNoCodec;
+    }
 
-    uint32_t samplingRate = 0;
-    p_pBuff->GetUINT32(pIOPropSamplingRate, samplingRate);
+    m_pCodecContext = avcodec_alloc_context3(pCodec);
+    m_pFrame = av_frame_alloc();
+    if ((m_pCodecContext == NULL) || (m_pFrame == NULL))
+    {
+        return errAlloc;
+    }
+
+    // the movie carries the decoder config once in its sample description
+    m_pCodecContext->sample_fmt = AV_SAMPLE_FMT_FLTP;
+    m_pCodecContext->sample_rate = m_SamplingRate;
+    m_pCodecContext->channels = m_NumChannels;
+    m_pCodecContext->channel_layout = av_get_default_channel_layout(m_NumChannels);
+    m_pCodecContext->bit_rate = static_cast<int64_t>(m_pSettings->GetBitRate()) * 1000;
+    m_pCodecContext->time_base = AVRational{ 1, static_cast<int>(m_SamplingRate) };
+    m_pCodecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    const int ret = avcodec_open2(m_pCodecContext, pCodec, NULL);
+    if (ret < 0)
+    {
+        g_Log(logLevelError, "Audio Plugin :: Could not open the AAC encoder for %u channels at %u Hz, error %d", m_NumChannels, m_SamplingRate, ret);
+        return errFail;
+    }
 
-    uint32_t numChannels = 0;
-    p_pBuff->GetUINT32(pIOPropNumChannels, numChannels);
+    m_pFrame->format = m_pCodecContext->sample_fmt;
+    m_pFrame->channels = m_pCodecContext->channels;
+    m_pFrame->channel_layout = m_pCodecContext->channel_layout;
+    m_pFrame->nb_samples = m_pCodecContext->frame_size;
+    if ((av_frame_get_buffer(m_pFrame, 0) < 0) ||
+        !m_Fifo.Init(std::max<size_t>(m_pCodecContext->frame_size * 4, static_cast<size_t>(m_SamplingRate * s_FifoSeconds)), m_NumChannels))
+    {
+        return errAlloc;
+    }
 
-    uint32_t trackIdx = 0xFFFFFFFF;
-    p_pBuff->GetUINT32(pIOPropTrackIdx, trackIdx);
+    // the decoder config is what the container puts into the esds of the sound description
+    const uint32_t fourCC = ' aac';
+    const uint32_t cookieType = 'esds';
+    const uint32_t bitRate = static_cast<uint32_t>(m_pCodecContext->bit_rate);
+    if ((p_pBuff->SetProperty(pIOPropFourCC, propTypeUInt32, &fourCC, 1) != errNone) ||
+        (p_pBuff->SetProperty(pIOPropMagicCookie, propTypeUInt8, m_pCodecContext->extradata, m_pCodecContext->extradata_size) != errNone) ||
+        (p_pBuff->SetProperty(pIOPropMagicCookieType, propTypeUInt32, &cookieType, 1) != errNone) ||
+        (p_pBuff->SetProperty(pIOPropBitRate, propTypeUInt32, &bitRate, 1) != errNone))
+    {
+        return errFail;
+    }
 
-    g_Log(logLevelWarn, "Dummy Audio Plugin :: Open Bit Depth: %d, isFloat: %d, Sampling Rate: %d, Num Channels: %d, Track Index: %d, Bit Rate: %d", bitDepth, isFloat, samplingRate, numChannels, trackIdx, m_pSettings->GetBitRate());
+    m_NextPts = 0;
+    // the worker's spans belong to the render of the movie the audio goes into
+    const uint64_t traceOwnerId = PipelineTrace::s_GetInstance().GetOwnerId(m_CommonProps.GetPath());
+    m_Worker = std::thread([this, traceOwnerId] {
+        PipelineTrace::s_SetThreadOwner(traceOwnerId);
+        EncodeLoop();
+    });
 
-    // fill magic cookie here if needed
+    g_Log(logLevelInfo, "Audio Plugin :: Encoding %u channels at %u Hz to AAC at %d kbps", m_NumChannels, m_SamplingRate, m_pSettings->GetBitRate());
     return errNone;
 }
 
-StatusCode AudioEncoder::DoProcess(HostBufferRef* p_pBuff)
+StatusCode AudioEncoder::ProcessAac(const char* p_pBuf, size_t p_NumFrames)
 {
-    if (p_pBuff != NULL)
+    if ((m_pCodecContext == NULL) || !m_Worker.joinable())
     {
-        int64_t pts = -1;
-        p_pBuff->GetINT64(pIOPropPTS, pts);
+        PLUGIN_LOG(logLevelError, "Audio Plugin :: AAC encoder is not running");
+        return errFail;
+    }
 
-        int64_t duration = 0; // in sampling rate units
-        p_pBuff->GetINT64(pIOPropDuration, duration);
+    const size_t srcFrameSize = m_NumChannels * g_PCMBytesPerSample(m_SrcFormat);
+    const size_t frameSize = m_pCodecContext->frame_size;
 
-        char* pBuf = NULL;
-        size_t bufSize = 0;
-        if (p_pBuff->LockBuffer(&pBuf, &bufSize))
+    // converted straight into the FIFO, the host only waits when the encoder fell a whole FIFO behind
+    while ((p_NumFrames > 0) && !m_HasError)
+    {
+        size_t numContiguous = 0;
+        float* pDst = m_Fifo.GetWritePtr(&numContiguous);
+        if (numContiguous == 0)
         {
-            // put the encoding code here
-            g_Log(logLevelWarn, "Dummy Audio Plugin :: Process buffer PTS: %lld, Duration: %lld, size: %ld", pts, duration, bufSize);
-            p_pBuff->UnlockBuffer();
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_ProgressCond.wait(lock, [this] { return (m_Fifo.GetWritableFrames() > 0) || m_HasError || m_IsDrained; });
+            if (m_IsDrained)
+            {
+                break;
+            }
+            continue;
+        }
+
+        const size_t numFrames = std::min(numContiguous, p_NumFrames);
+        g_ConvertPCM(p_pBuf, m_SrcFormat, pDst, pcmFormatF32, false, numFrames * m_NumChannels);
+        m_Fifo.CommitWrite(numFrames);
+
+        p_pBuf += numFrames * srcFrameSize;
+        p_NumFrames -= numFrames;
+
+        if (m_Fifo.GetReadableFrames() >= frameSize)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+            }
+            m_WorkCond.notify_one();
         }
     }
-    else
+
+    if (m_HasError || (p_NumFrames > 0))
+    {
+        return errFail;
+    }
+
+    return SendEncodedPackets();
+}
+
+void AudioEncoder::DrainAac()
+{
+    if (!m_Worker.joinable())
+    {
+        return;
+    }
+
     {
-        g_Log(logLevelWarn, "Dummy Audio Plugin :: Process flush buffer");
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_IsFlushing = true;
+        m_WorkCond.notify_all();
+        m_ProgressCond.wait(lock, [this] { return m_IsDrained; });
+    }
+
+    m_Worker.join();
+    SendEncodedPackets();
+}
+
+StatusCode AudioEncoder::SendEncodedPackets()
+{
+    std::deque<AVPacket*> packets;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        packets.swap(m_Packets);
+    }
+
+    StatusCode err = m_pCallback ? errNone : errInvalidOperation;
+    for (size_t i = 0; i < packets.size(); ++i)
+    {
+        AVPacket* pPacket = packets[i];
+        if (err == errNone)
+        {
+            HostBufferRef outBuf(false);
+            char* pOutBuf = NULL;
+            size_t outBufSize = 0;
+            if (!outBuf.IsValid() || !outBuf.Resize(pPacket->size) || !outBuf.LockBuffer(&pOutBuf, &outBufSize))
+            {
+                err = errAlloc;
+            }
+            else
+            {
+                memcpy(pOutBuf, pPacket->data, pPacket->size);
+
+                int64_t pts = pPacket->pts;
+                int64_t dts = pPacket->dts;
+                int64_t duration = pPacket->duration;
+                outBuf.SetProperty(pIOPropPTS, propTypeInt64, &pts, 1);
+                outBuf.SetProperty(pIOPropDTS, propTypeInt64, &dts, 1);
+                outBuf.SetProperty(pIOPropDuration, propTypeInt64, &duration, 1);
+                err = m_pCallback->SendOutput(&outBuf);
+                outBuf.UnlockBuffer();
+            }
+        }
+
+        av_packet_free(&pPacket);
     }
 
-    // Passthrough the buffer to the writer to be processed there
-    return IPluginCodecRef::DoProcess(p_pBuff);
+    return err;
+}
+
+void AudioEncoder::EncodeLoop()
+{
+    PipelineTrace::s_SetThreadName("aac_encoder");
+
+    const size_t frameSize = m_pCodecContext->frame_size;
+
+    while (true)
+    {
+        bool isFlushing = false;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WorkCond.wait(lock, [this, frameSize] { return m_IsStopping || m_IsFlushing || (m_Fifo.GetReadableFrames() >= frameSize); });
+            if (m_IsStopping)
+            {
+                break;
+            }
+
+            isFlushing = m_IsFlushing;
+        }
+
+        // once flushing is seen the host wrote its last samples, the short tail becomes the last frame
+        bool isOk = true;
+        while (isOk && (m_Fifo.GetReadableFrames() >= frameSize))
+        {
+            isOk = EncodeFrame(frameSize);
+        }
+
+        if (isOk && isFlushing)
+        {
+            const size_t numLeft = m_Fifo.GetReadableFrames();
+            isOk = ((numLeft == 0) || EncodeFrame(numLeft)) && EncodeFrame(0);
+        }
+
+        if (!isOk)
+        {
+            m_HasError = true;
+        }
+
+        if (!isOk || isFlushing)
+        {
+            break;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_IsDrained = true;
+    }
+    m_ProgressCond.notify_all();
+}
+
+bool AudioEncoder::EncodeFrame(size_t p_NumFrames)
+{
+    TraceSpan span("aac_frame", "audio");
+
+    // no frames drains the encoder
+    const AVFrame* pFrame = NULL;
+    if (p_NumFrames > 0)
+    {
+        if (av_frame_make_writable(m_pFrame) < 0)
+        {
+            return false;
+        }
+
+        m_pFrame->nb_samples = static_cast<int>(p_NumFrames);
+        m_Fifo.Read(reinterpret_cast<float* const*>(m_pFrame->extended_data), p_NumFrames);
+        m_pFrame->pts = m_NextPts;
+        m_NextPts += p_NumFrames;
+        pFrame = m_pFrame;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+        }
+        m_ProgressCond.notify_all();
+    }
+
+    int ret = avcodec_send_frame(m_pCodecContext, pFrame);
+    if (ret < 0)
+    {
+        PLUGIN_LOG(logLevelError, "Audio Plugin :: AAC encoding failed, error %d", ret);
+        return false;
+    }
+
+    while (true)
+    {
+        AVPacket* pPacket = av_packet_alloc();
+        if (pPacket == NULL)
+        {
+            return false;
+        }
+
+        ret = avcodec_receive_packet(m_pCodecContext, pPacket);
+        if ((ret == AVERROR(EAGAIN)) || (ret == AVERROR_EOF))
+        {
+            av_packet_free(&pPacket);
+            return true;
+        }
+        else if (ret < 0)
+        {
+            PLUGIN_LOG(logLevelError, "Audio Plugin :: AAC encoding failed, error %d", ret);
+            av_packet_free(&pPacket);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Packets.push_back(pPacket);
+    }
 }
@@ -1,21 +1,36 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "wrapper/plugin_api.h"
+#include "audio_fifo.h"
+#include "pcm_convert.h"
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
 
 using namespace IOPlugin;
 class UIAudioSettingsController;
 
+// Linear PCM, or AAC through libavcodec, chosen by the UUID the host creates the codec with
 class AudioEncoder : public IPluginCodecRef
 {
 public:
     static const uint8_t s_UUID[];
+    static const uint8_t s_AacUUID[];
 
 public:
-    AudioEncoder();
+    explicit AudioEncoder(bool p_IsAac = false);
     ~AudioEncoder();
 
     static StatusCode s_RegisterCodecs(HostListRef* p_pList);
-    static StatusCode s_GetEncoderSettings(HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList);
+    static StatusCode s_GetEncoderSettings(bool p_IsAac, HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList);
 
 protected:
     virtual void DoFlush() override;
@@ -23,7 +38,58 @@ protected:
     virtual StatusCode DoOpen(HostBufferRef* p_pBuff) override;
     virtual StatusCode DoProcess(HostBufferRef* p_pBuff) override;
 
+private:
+    // disable assignment and copy constructor
+    AudioEncoder(const AudioEncoder& p_Other);
+    AudioEncoder& operator=(const AudioEncoder& p_Other);
+
+    // sends the first p_NumFrames converted frames as one packet
+    StatusCode SendPending(size_t p_NumFrames);
+
+    StatusCode OpenAac(HostBufferRef* p_pBuff);
+    StatusCode ProcessAac(const char* p_pBuf, size_t p_NumFrames);
+
+    // tells the worker the input ended and waits until it encoded everything
+    void DrainAac();
+
+    // sends what the worker encoded so far, on the host thread
+    StatusCode SendEncodedPackets();
+
+    // worker thread, encodes whole frames from m_Fifo
+    void EncodeLoop();
+    bool EncodeFrame(size_t p_NumFrames);
+
 private:
     std::unique_ptr<UIAudioSettingsController> m_pSettings;
     HostCodecConfigCommon m_CommonProps;
-};
\ No newline at end of file
+
+    bool m_IsAac;
+    PCMSampleFormat m_SrcFormat; // as the host delivers it
+    PCMSampleFormat m_DstFormat; // as it goes into the movie
+    bool m_IsBigEndian;
+    bool m_IsDiscreteMono; // planar, one plane per channel
+    uint32_t m_SamplingRate;
+    uint32_t m_NumChannels;
+
+    // host buffers are often a few ms long, converted samples collect here until a packet is full.
+    // Discrete mono keeps one plane of m_FramesPerPacket samples per channel
+    std::vector<uint8_t> m_Pending;
+    size_t m_NumPendingFrames;
+    size_t m_FramesPerPacket;
+    int64_t m_NextPts; // in samples
+
+    // AAC, the host thread fills m_Fifo and the worker owns the codec
+    AVCodecContext* m_pCodecContext;
+    AVFrame* m_pFrame;
+    AudioSampleFifo m_Fifo;
+    std::thread m_Worker;
+
+    std::mutex m_Mutex; // guards the flags and m_Packets, never the samples
+    std::condition_variable m_WorkCond;     // more input, flushing or stopping
+    std::condition_variable m_ProgressCond; // space freed, packets ready or drained
+    bool m_IsFlushing;
+    bool m_IsDrained;
+    bool m_IsStopping;
+    std::atomic<bool> m_HasError;
+    std::deque<AVPacket*> m_Packets; // encoded, waiting for the host thread
+};
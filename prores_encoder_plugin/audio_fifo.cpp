@@ -0,0 +1,77 @@
+#include "audio_fifo.h"
+
+AudioSampleFifo::AudioSampleFifo()
+    : m_NumFrames(0)
+    , m_NumChannels(0)
+    , m_WritePos(0)
+    , m_ReadPos(0)
+{
+}
+
+AudioSampleFifo::~AudioSampleFifo()
+{
+}
+
+bool AudioSampleFifo::Init(size_t p_NumFrames, int p_NumChannels)
+{
+    if ((p_NumFrames == 0) || (p_NumChannels <= 0))
+    {
+        return false;
+    }
+
+    m_Samples.assign(p_NumFrames * p_NumChannels, 0.0f);
+    m_NumFrames = p_NumFrames;
+    m_NumChannels = p_NumChannels;
+    m_WritePos.store(0, std::memory_order_relaxed);
+    m_ReadPos.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+size_t AudioSampleFifo::GetWritableFrames() const
+{
+    const uint64_t readPos = m_ReadPos.load(std::memory_order_acquire);
+    const uint64_t writePos = m_WritePos.load(std::memory_order_relaxed);
+    return m_NumFrames - static_cast<size_t>(writePos - readPos);
+}
+
+float* AudioSampleFifo::GetWritePtr(size_t* p_pNumContiguous)
+{
+    const size_t writeIdx = static_cast<size_t>(m_WritePos.load(std::memory_order_relaxed) % m_NumFrames);
+    const size_t writable = GetWritableFrames();
+    *p_pNumContiguous = (writable < m_NumFrames - writeIdx) ? writable : (m_NumFrames - writeIdx);
+    return m_Samples.data() + writeIdx * m_NumChannels;
+}
+
+void AudioSampleFifo::CommitWrite(size_t p_NumFrames)
+{
+    m_WritePos.fetch_add(p_NumFrames, std::memory_order_release);
+}
+
+size_t AudioSampleFifo::GetReadableFrames() const
+{
+    const uint64_t writePos = m_WritePos.load(std::memory_order_acquire);
+    const uint64_t readPos = m_ReadPos.load(std::memory_order_relaxed);
+    return static_cast<size_t>(writePos - readPos);
+}
+
+void AudioSampleFifo::Read(float* const* p_ppPlanes, size_t p_NumFrames)
+{
+    const uint64_t readPos = m_ReadPos.load(std::memory_order_relaxed);
+    size_t readIdx = static_cast<size_t>(readPos % m_NumFrames);
+
+    for (size_t i = 0; i < p_NumFrames; ++i)
+    {
+        const float* pFrame = m_Samples.data() + readIdx * m_NumChannels;
+        for (int c = 0; c < m_NumChannels; ++c)
+        {
+            p_ppPlanes[c][i] = pFrame[c];
+        }
+
+        if (++readIdx == m_NumFrames)
+        {
+            readIdx = 0;
+        }
+    }
+
+    m_ReadPos.store(readPos + p_NumFrames, std::memory_order_release);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+// Single producer, single consumer ring of interleaved float frames. The storage is allocated once in Init,
+// the two sides only share the read and write positions, so neither ever waits for the other inside the FIFO.
+class AudioSampleFifo
+{
+public:
+    AudioSampleFifo();
+    ~AudioSampleFifo();
+
+    // not thread safe, call before either side starts
+    bool Init(size_t p_NumFrames, int p_NumChannels);
+
+    // producer: room for this many frames at most
+    size_t GetWritableFrames() const;
+
+    // producer: where the next frames go and how many fit before the ring wraps
+    float* GetWritePtr(size_t* p_pNumContiguous);
+
+    // producer: makes p_NumFrames frames written at GetWritePtr visible to the consumer
+    void CommitWrite(size_t p_NumFrames);
+
+    // consumer: frames ready to be read
+    size_t GetReadableFrames() const;
+
+    // consumer: deinterleaves p_NumFrames frames into one plane per channel and frees their space
+    void Read(float* const* p_ppPlanes, size_t p_NumFrames);
+
+private:
+    // disable assignment and copy constructor
+    AudioSampleFifo(const AudioSampleFifo& p_Other);
+    AudioSampleFifo& operator=(const AudioSampleFifo& p_Other);
+
+private:
+    std::vector<float> m_Samples;
+    size_t m_NumFrames; // capacity
+    int m_NumChannels;
+
+    // frames ever written and read, on separate cache lines so the two threads do not contend
+    alignas(64) std::atomic<uint64_t> m_WritePos;
+    alignas(64) std::atomic<uint64_t> m_ReadPos;
+};
@@ -0,0 +1,21 @@
+#include "json_util.h"
+
+std::string g_JsonString(const std::string& p_Str)
+{
+    std::string out = "\"";
+    for (size_t i = 0; i < p_Str.size(); ++i)
+    {
+        const char c = p_Str[i];
+        if ((c == '"') || (c == '\\'))
+        {
+            out += '\\';
+        }
+
+        if (static_cast<unsigned char>(c) >= 0x20)
+        {
+            out += c;
+        }
+    }
+
+    return out + "\"";
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <string>
+
+// p_Str as a quoted JSON string, quotes and backslashes escaped and control characters dropped
+std::string g_JsonString(const std::string& p_Str);
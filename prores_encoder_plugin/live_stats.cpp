@@ -0,0 +1,256 @@
+#include "live_stats.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <thread>
+
+#include "wrapper/host_api.h"
+
+// frames of a shorter interval are folded into the next one, per frame rates would be mostly timer noise
+static const double s_FpsSampleSeconds = 0.5;
+
+static int64_t s_UnixTimeMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static LiveStatsRecord* s_GetRecord(void* p_pMapping, uint32_t p_Idx)
+{
+    return reinterpret_cast<LiveStatsRecord*>(static_cast<uint8_t*>(p_pMapping) + sizeof(LiveStatsHeader) + p_Idx * sizeof(LiveStatsRecord));
+}
+
+// begins a seqlock update, false when another thread is inside one
+static bool s_BeginUpdate(LiveStatsRecord* p_pRecord, uint32_t* p_pSequence)
+{
+    uint32_t sequence = p_pRecord->sequence.load(std::memory_order_relaxed);
+    if (((sequence & 1) != 0) || !p_pRecord->sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    // keeps the field stores below from moving ahead of the odd sequence
+    std::atomic_thread_fence(std::memory_order_release);
+    *p_pSequence = sequence + 2;
+    return true;
+}
+
+static void s_EndUpdate(LiveStatsRecord* p_pRecord, uint32_t p_Sequence)
+{
+    p_pRecord->sequence.store(p_Sequence, std::memory_order_release);
+}
+
+LiveStatsSegment& LiveStatsSegment::s_GetInstance()
+{
+    static LiveStatsSegment s_Segment;
+    return s_Segment;
+}
+
+LiveStatsSegment::LiveStatsSegment()
+    : m_pMapping(NULL)
+    , m_MappingSize(0)
+    , m_NumAcquired(0)
+    , m_IsFailed(false)
+{
+}
+
+LiveStatsSegment::~LiveStatsSegment()
+{
+    Close();
+}
+
+bool LiveStatsSegment::Create()
+{
+    char name[64];
+    snprintf(name, sizeof(name), LIVE_STATS_NAME_PREFIX "%d", static_cast<int>(getpid()));
+
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        g_Log(logLevelWarn, "LiveStats :: Could not create %s: %s", name, strerror(errno));
+        return false;
+    }
+
+    const size_t mappingSize = sizeof(LiveStatsHeader) + s_LiveStatsNumRecords * sizeof(LiveStatsRecord);
+    void* pMapping = MAP_FAILED;
+    if (ftruncate(fd, mappingSize) == 0)
+    {
+        pMapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (pMapping == MAP_FAILED)
+    {
+        g_Log(logLevelWarn, "LiveStats :: Could not map %s: %s", name, strerror(errno));
+        shm_unlink(name);
+        return false;
+    }
+
+    // the new segment is zero filled, records start out free with an even sequence
+    LiveStatsHeader* pHeader = static_cast<LiveStatsHeader*>(pMapping);
+    pHeader->version = s_LiveStatsVersion;
+    pHeader->headerSize = sizeof(LiveStatsHeader);
+    pHeader->recordSize = sizeof(LiveStatsRecord);
+    pHeader->numRecords = s_LiveStatsNumRecords;
+    pHeader->pid = getpid();
+    std::atomic_thread_fence(std::memory_order_release);
+    pHeader->magic = s_LiveStatsMagic;
+
+    m_Name = name;
+    m_pMapping = pMapping;
+    m_MappingSize = mappingSize;
+    g_Log(logLevelInfo, "LiveStats :: Publishing to %s", name);
+    return true;
+}
+
+LiveStatsRecord* LiveStatsSegment::Acquire(LiveStatsKind p_Kind, const std::string& p_Path)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if ((m_pMapping == NULL) && (m_IsFailed || !Create()))
+    {
+        m_IsFailed = true;
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < s_LiveStatsNumRecords; ++i)
+    {
+        LiveStatsRecord* pRecord = s_GetRecord(m_pMapping, i);
+        if (pRecord->kind != liveStatsFree)
+        {
+            continue;
+        }
+
+        // records are claimed under m_Mutex, the seqlock only keeps readers from seeing a half written record
+        uint32_t sequence = 0;
+        if (!s_BeginUpdate(pRecord, &sequence))
+        {
+            continue;
+        }
+
+        const int64_t nowMs = s_UnixTimeMs();
+        pRecord->kind = p_Kind;
+        pRecord->startedAtMs = nowMs;
+        pRecord->updatedAtMs = nowMs;
+        pRecord->numFrames = 0;
+        pRecord->fps = 0.0;
+        pRecord->bytesWritten = 0;
+        pRecord->queueDepth = 0;
+        pRecord->numReused = 0;
+        pRecord->memoryInUse = 0;
+        snprintf(pRecord->path, sizeof(pRecord->path), "%s", p_Path.c_str());
+        s_EndUpdate(pRecord, sequence);
+
+        ++m_NumAcquired;
+        return pRecord;
+    }
+
+    g_Log(logLevelWarn, "LiveStats :: All %u records of %s are taken", s_LiveStatsNumRecords, m_Name.c_str());
+    return NULL;
+}
+
+void LiveStatsSegment::Release(LiveStatsRecord* p_pRecord)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_pMapping == NULL)
+    {
+        return;
+    }
+
+    // the owner has stopped publishing, a busy record can only be an update about to end
+    uint32_t sequence = 0;
+    while (!s_BeginUpdate(p_pRecord, &sequence))
+    {
+        std::this_thread::yield();
+    }
+
+    p_pRecord->kind = liveStatsFree;
+    p_pRecord->updatedAtMs = s_UnixTimeMs();
+    s_EndUpdate(p_pRecord, sequence);
+
+    --m_NumAcquired;
+}
+
+void LiveStatsSegment::Close()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_pMapping == NULL)
+    {
+        return;
+    }
+
+    shm_unlink(m_Name.c_str());
+
+    // an instance the host never closed keeps writing into the mapping, which then stays until the process exits
+    if (m_NumAcquired == 0)
+    {
+        munmap(m_pMapping, m_MappingSize);
+        m_pMapping = NULL;
+        m_MappingSize = 0;
+    }
+}
+
+LiveStatsPublisher::LiveStatsPublisher()
+    : m_pRecord(NULL)
+    , m_SampledFrames(0)
+    , m_Fps(0.0)
+{
+}
+
+LiveStatsPublisher::~LiveStatsPublisher()
+{
+    Close();
+}
+
+void LiveStatsPublisher::Open(LiveStatsKind p_Kind, const std::string& p_Path)
+{
+    Close();
+
+    m_pRecord = LiveStatsSegment::s_GetInstance().Acquire(p_Kind, p_Path);
+    m_SampledAt = std::chrono::steady_clock::now();
+    m_SampledFrames = 0;
+    m_Fps = 0.0;
+}
+
+void LiveStatsPublisher::Close()
+{
+    if (m_pRecord != NULL)
+    {
+        LiveStatsSegment::s_GetInstance().Release(m_pRecord);
+        m_pRecord = NULL;
+    }
+}
+
+void LiveStatsPublisher::Publish(const LiveStatsValues& p_Values)
+{
+    uint32_t sequence = 0;
+    if ((m_pRecord == NULL) || !s_BeginUpdate(m_pRecord, &sequence))
+    {
+        return;
+    }
+
+    // the average since the start would hide a render slowing down, the rate of the last seconds shows it
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(now - m_SampledAt).count();
+    if ((seconds >= s_FpsSampleSeconds) && (p_Values.numFrames >= m_SampledFrames))
+    {
+        const double fps = (p_Values.numFrames - m_SampledFrames) / seconds;
+        const bool isFirst = (m_SampledFrames == 0) && (m_Fps == 0.0);
+        m_Fps = isFirst ? fps : m_Fps + (1.0 - exp(-seconds / s_LiveStatsFpsSeconds)) * (fps - m_Fps);
+        m_SampledAt = now;
+        m_SampledFrames = p_Values.numFrames;
+    }
+
+    m_pRecord->updatedAtMs = s_UnixTimeMs();
+    m_pRecord->numFrames = p_Values.numFrames;
+    m_pRecord->fps = m_Fps;
+    m_pRecord->bytesWritten = p_Values.bytesWritten;
+    m_pRecord->queueDepth = p_Values.queueDepth;
+    m_pRecord->numReused = p_Values.numReused;
+    m_pRecord->memoryInUse = p_Values.memoryInUse;
+    s_EndUpdate(m_pRecord, sequence);
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+// Live counters of the encoder and container instances of a process, published for farm monitoring in the
+// POSIX shared memory segment "/prores_stats.<pid>" (/dev/shm/prores_stats.<pid> on Linux). tools/livestats.cpp
+// is a reader.
+//
+// Layout, version 1, native byte order and alignment:
+//   LiveStatsHeader
+//   LiveStatsRecord[numRecords], recordSize bytes apart
+// Every record is guarded by a seqlock. Its sequence is odd while the owner updates it, a reader copies the record
+// and starts over when the sequence was odd or changed meanwhile. Writers never wait, an update that finds the
+// record busy is dropped and the next one carries its counters. Readers must check magic and version first,
+// fields are only ever appended and recordSize tells how far apart the records are.
+
+#define LIVE_STATS_NAME_PREFIX "/prores_stats."
+
+static const uint32_t s_LiveStatsMagic = 0x534c5250; // "PRLS"
+static const uint32_t s_LiveStatsVersion = 1;
+static const uint32_t s_LiveStatsNumRecords = 64;
+static const double s_LiveStatsFpsSeconds = 5.0;
+
+enum LiveStatsKind
+{
+    liveStatsFree = 0, // unused record
+    liveStatsEncoder,
+    liveStatsContainer,
+};
+
+struct LiveStatsHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordSize;
+    uint32_t numRecords;
+    uint32_t reserved;
+    int64_t pid;
+};
+
+struct LiveStatsRecord
+{
+    std::atomic<uint32_t> sequence;
+    uint32_t kind; // LiveStatsKind
+    int64_t startedAtMs; // unix time the instance opened
+    int64_t updatedAtMs;
+    uint64_t numFrames; // encoder: frames encoded, container: video frames written
+    double fps; // current rate, exponentially weighted with a time constant of s_LiveStatsFpsSeconds
+    uint64_t bytesWritten; // encoder: compressed bytes sent to the host, container: bytes given to the muxer
+    uint64_t queueDepth; // encoder: frames inside libavcodec, container: packets waiting in the interleave queue
+    uint64_t numReused; // encoder: frames taken over from an interrupted render instead of encoding them again
+    uint64_t memoryInUse; // encoder: bytes of the frames inside libavcodec, container: bytes in the interleave queue
+    char path[256]; // the movie, NUL terminated
+};
+
+// the counters a publisher fills in, numFrames also gives the fps
+struct LiveStatsValues
+{
+    uint64_t numFrames = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t queueDepth = 0;
+    uint64_t numReused = 0;
+    uint64_t memoryInUse = 0;
+};
+
+// the process wide segment, created with the first record and removed by Close
+class LiveStatsSegment
+{
+public:
+    static LiveStatsSegment& s_GetInstance();
+
+    // NULL when the segment can not be created or all records are taken
+    LiveStatsRecord* Acquire(LiveStatsKind p_Kind, const std::string& p_Path);
+    void Release(LiveStatsRecord* p_pRecord);
+
+    // unmaps and unlinks the segment, records still held stop being published
+    void Close();
+
+private:
+    LiveStatsSegment();
+    ~LiveStatsSegment();
+
+    // disable assignment and copy constructor
+    LiveStatsSegment(const LiveStatsSegment& p_Other);
+    LiveStatsSegment& operator=(const LiveStatsSegment& p_Other);
+
+    bool Create();
+
+private:
+    std::mutex m_Mutex;
+    std::string m_Name;
+    void* m_pMapping;
+    size_t m_MappingSize;
+    int m_NumAcquired;
+    bool m_IsFailed; // creating the segment is not retried
+};
+
+// one instance's record
+class LiveStatsPublisher
+{
+public:
+    LiveStatsPublisher();
+    ~LiveStatsPublisher();
+
+    void Open(LiveStatsKind p_Kind, const std::string& p_Path);
+    void Close();
+
+    // wait-free, called by the owner from its write path
+    void Publish(const LiveStatsValues& p_Values);
+
+private:
+    // disable assignment and copy constructor
+    LiveStatsPublisher(const LiveStatsPublisher& p_Other);
+    LiveStatsPublisher& operator=(const LiveStatsPublisher& p_Other);
+
+private:
+    LiveStatsRecord* m_pRecord;
+
+    // rate state, only touched inside the record's update
+    std::chrono::steady_clock::time_point m_SampledAt;
+    uint64_t m_SampledFrames;
+    double m_Fps;
+};
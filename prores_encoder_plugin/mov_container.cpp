@@ -1,9 +1,17 @@
 #include "mov_container.h"
 
 #include <assert.h>
+#include <stdio.h>
+
+#include <algorithm>
 
 #include "prores_encoder.h"
 #include "prores_props.h"
+#include "mov_journal.h"
+#include "mov_writer.h"
+#include "prores_handoff.h"
+#include "prores_resume.h"
+#include "plugin_log.h"
 
 using namespace IOPlugin;
 
@@ -11,6 +19,17 @@ using namespace IOPlugin;
 const uint8_t MovContainer::s_UUID[] = { 0x87, 0x7b, 0x52, 0x48, 0x7a, 0x34, 0x11, 0xee, 0x86, 0x52, 0x83, 0x47, 0xc2, 0x64, 0x80, 0x3a };
 const char * MovContainer::s_UUIDStr = "877b52487a3411ee86528347c264803a";
 
+enum ContainerStage
+{
+    containerStageWriteVideo = 0, // all of WriteVideo including the mux
+    containerStageWriteAudio, // all of WriteAudio including the mux
+    containerStageMux, // the muxer queue and, as packets leave it, av_write_frame or MovWriter
+    containerStageClose, // trailer or moov and closing the files
+    containerStageCount
+};
+
+static const char* const s_ContainerStageNames[containerStageCount] = { "write_video", "write_audio", "mux", "close" };
+
 
 
 class MovTrackWriter : public IPluginTrackBase, public IPluginTrackWriter
@@ -39,6 +58,118 @@ private:
     bool m_IsVideo;
 };
 
+// Apple's target data rates in Mbps at 1920x1080 and 29.97 fps, indexed by the libavcodec ProRes profile
+static const double s_ProResMbps[] = { 45.0, 102.0, 147.0, 220.0, 330.0, 500.0 };
+
+static int64_t s_EstimateMovieSize(const AVCodecContext* p_pCodecContext, double p_DurationSec, double p_Fps)
+{
+    const int numProfiles = sizeof(s_ProResMbps) / sizeof(s_ProResMbps[0]);
+    if ((p_DurationSec <= 0.0) || (p_Fps <= 0.0) || (p_pCodecContext->profile < 0) || (p_pCodecContext->profile >= numProfiles))
+    {
+        return 0;
+    }
+
+    // rates scale with the pixel rate, 10% on top for busy material and the sample tables
+    const double scale = (static_cast<double>(p_pCodecContext->width) * p_pCodecContext->height * p_Fps) / (1920.0 * 1080.0 * 29.97);
+    const double bytes = s_ProResMbps[p_pCodecContext->profile] * 1000000.0 / 8.0 * scale * p_DurationSec * 1.1;
+    return static_cast<int64_t>(bytes) + (1 << 20);
+}
+
+// splits a ';' separated directory list, trimming blanks and trailing separators
+static std::vector<std::string> s_SplitDirs(const std::string& p_Dirs)
+{
+    std::vector<std::string> dirs;
+    size_t start = 0;
+    while (start <= p_Dirs.size())
+    {
+        size_t end = p_Dirs.find(';', start);
+        if (end == std::string::npos)
+        {
+            end = p_Dirs.size();
+        }
+
+        std::string dir = p_Dirs.substr(start, end - start);
+        while (!dir.empty() && ((dir.back() == ' ') || (dir.back() == '/') || (dir.back() == '\\')))
+        {
+            dir.pop_back();
+        }
+
+        const size_t dirStart = dir.find_first_not_of(' ');
+        if (dirStart != std::string::npos)
+        {
+            dirs.push_back(dir.substr(dirStart));
+        }
+
+        start = end + 1;
+    }
+
+    return dirs;
+}
+
+static std::string s_FileName(const std::string& p_Path)
+{
+    const size_t slashPos = p_Path.find_last_of("/\\");
+    return (slashPos == std::string::npos) ? p_Path : p_Path.substr(slashPos + 1);
+}
+
+static std::vector<std::string> s_MirrorPaths(const std::string& p_Path, const std::string& p_MirrorDirs)
+{
+    const std::string fileName = s_FileName(p_Path);
+    const std::vector<std::string> dirs = s_SplitDirs(p_MirrorDirs);
+
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < dirs.size(); ++i)
+    {
+        const std::string mirrorPath = dirs[i] + "/" + fileName;
+        if (mirrorPath != p_Path)
+        {
+            paths.push_back(mirrorPath);
+        }
+    }
+
+    return paths;
+}
+
+// one data file per directory, numbered so two stripes in the same directory do not collide
+static std::vector<std::string> s_StripePaths(const std::string& p_Path, const std::string& p_StripeDirs)
+{
+    const std::string fileName = s_FileName(p_Path);
+    const std::vector<std::string> dirs = s_SplitDirs(p_StripeDirs);
+
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < dirs.size(); ++i)
+    {
+        paths.push_back(dirs[i] + "/" + fileName + ".stripe" + std::to_string(i));
+    }
+
+    return paths;
+}
+
+// the speaker of channel p_Channel in the host layout, host 5.1 and 7.1 are L R C LFE Ls Rs (Lrs Rrs)
+static uint64_t s_ChannelLabel(uint32_t p_HostLayout, uint32_t p_NumChannels, uint32_t p_Channel)
+{
+    static const uint64_t s_Stereo[] = { AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT };
+    static const uint64_t s_Surround51[] = { AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, AV_CH_FRONT_CENTER, AV_CH_LOW_FREQUENCY, AV_CH_BACK_LEFT, AV_CH_BACK_RIGHT };
+    static const uint64_t s_Surround71[] = { AV_CH_FRONT_LEFT, AV_CH_FRONT_RIGHT, AV_CH_FRONT_CENTER, AV_CH_LOW_FREQUENCY,
+                                             AV_CH_SIDE_LEFT, AV_CH_SIDE_RIGHT, AV_CH_BACK_LEFT, AV_CH_BACK_RIGHT };
+
+    if ((p_HostLayout == audLayoutStereo) && (p_NumChannels == 2))
+    {
+        return s_Stereo[p_Channel];
+    }
+    else if ((p_HostLayout == audLayoutGeneric5_1) && (p_NumChannels == 6))
+    {
+        return s_Surround51[p_Channel];
+    }
+    else if ((p_HostLayout == audLayoutGeneric7_1) && (p_NumChannels == 8))
+    {
+        return s_Surround71[p_Channel];
+    }
+
+    // unknown layouts are plain mono
+    return AV_CH_LAYOUT_MONO;
+}
+
 StatusCode MovContainer::s_Register(HostListRef* p_pList)
 {
     HostPropertyCollectionRef containerInfo;
@@ -66,7 +197,14 @@ StatusCode MovContainer::s_Register(HostListRef* p_pList)
     return errNone;
 }
 
-MovContainer::MovContainer() : m_outFormatContext(0), m_outStream(0)
+MovContainer::MovContainer()
+    : m_FastStartFrames(0)
+    , m_NumStripes(0)
+    , m_NumResumeFrames(0)
+    , m_IsResumeBroken(false)
+    , m_StageStats("container", s_ContainerStageNames, containerStageCount)
+    , m_IsStageStatsJson(false)
+    , m_TraceOwnerId(0)
 {
 }
 
@@ -87,7 +225,11 @@ StatusCode MovContainer::DoOpen(HostPropertyCollectionRef* p_pProps)
 
     g_Log(logLevelWarn, "Dummy Container Plugin :: open container with path: %s", path.c_str());
 
- 
+    // the file itself is opened with the first video track, which carries the output settings
+    if (!m_Muxer.Create(path))
+    {
+        return errFail;
+    }
 
     return errNone;
 }
@@ -104,6 +246,12 @@ StatusCode MovContainer::DoAddTrack(HostPropertyCollectionRef* p_pProps, HostPro
     }
     const bool isVideo = (mediaType == mediaVideo);
 
+    if (!m_Muxer.IsOpen() || m_Muxer.IsHeaderWritten())
+    {
+        g_Log(logLevelError, "Tracks can only be added between opening the container and the first write");
+        return errFail;
+    }
+
     // extract some params for demo purposes
     PropertyType propType;
     const void* pVal = NULL;
@@ -170,39 +318,26 @@ StatusCode MovContainer::DoAddTrack(HostPropertyCollectionRef* p_pProps, HostPro
 
 
         // extract extra options from p_pCodecProps if needed such as magic cookie etc, whichever the codec has set
-              // Create a new AVStream for the video
-
-      // Create a new AVFormatContext to represent the output format
-        std::string path;
-        p_pProps->GetString(pIOPropPath, path);
-
-        if (avformat_alloc_output_context2(&m_outFormatContext, nullptr, "mov", path.c_str() )  < 0) {
-            g_Log(logLevelError,"Failed to create output stream");
-            return errFail;
-        }              
 
-        m_outStream = avformat_new_stream(m_outFormatContext, codec);
-        if (!m_outStream) {
-            g_Log(logLevelError,"Failed to create new stream");
-            return errFail;
-        }    
-
-        m_outStream->codecpar->codec_tag = 0;
-        avcodec_parameters_from_context(m_outStream->codecpar, codecContext);
-
-
-            // Open the output file
-        if (avio_open(&m_outFormatContext->pb,  path.c_str() , AVIO_FLAG_WRITE) < 0) {
-            g_Log(logLevelError, "Could not open output file" );
-            return errFail;;
+        // the first video track decides how the file is written, further ones (e.g. stereo eyes or fill and key) just add streams
+        if (!m_Muxer.IsOutputOpen())
+        {
+            const StatusCode err = OpenOutput(p_pCodecProps, codecContext, duration, fpsNum, fpsDen);
+            if (err != errNone)
+            {
+                return err;
+            }
         }
 
-        // Write the file header
-        if (avformat_write_header(m_outFormatContext, nullptr) < 0) {
-            g_Log(logLevelError,  "Error writing file header" );
+        const int streamIdx = m_Muxer.AddStream(codec, codecContext);
+        if (streamIdx < 0)
+        {
             return errFail;
         }
 
+        m_VideoStreamIdxVec.push_back(streamIdx);
+        PlanResumeTrack(streamIdx, 1, NULL);
+
         // try to find the sample x264 plugin config entry if it was set
         std::string markerColor;
         p_pCodecProps->GetString("x264_enc_markers", markerColor);
@@ -220,14 +355,12 @@ StatusCode MovContainer::DoAddTrack(HostPropertyCollectionRef* p_pProps, HostPro
                 HostMarkersMap markers;
                 if (markers.FromBuffer(static_cast<const uint8_t*>(pVal), numVals))
                 {
-                    const std::map<double, HostMarkerInfo>& markersMap = markers.GetMarkersMap();
-                    for (auto it = markersMap.begin(); it != markersMap.end(); ++it)
+                    size_t numFound = 0;
+                    const uint32_t* pFound = markers.FindByColor(markerColor, &numFound);
+                    for (size_t i = 0; i < numFound; ++i)
                     {
-                        const HostMarkerInfo& marker = it->second;
-                        if (marker.GetColor() == markerColor)
-                        {
-                            g_Log(logLevelWarn, "Dummy Container Plugin :: Matchind marker at %f seconds with name: %s", marker.GetPositionSeconds(), marker.GetName().c_str());
-                        }
+                        const HostMarker& marker = markers.GetMarker(pFound[i]);
+                        PLUGIN_LOG(logLevelWarn, "Dummy Container Plugin :: Matchind marker at %f seconds with name: %.*s", marker.positionSeconds, static_cast<int>(marker.name.size()), marker.name.data());
                     }
                 }
             }
@@ -251,8 +384,119 @@ StatusCode MovContainer::DoAddTrack(HostPropertyCollectionRef* p_pProps, HostPro
         uint8_t isFloat = 0; // 0 - integer data, 1 - floating point data
         p_pProps->GetUINT8(pIOPropIsFloat, isFloat);
 
+        uint8_t isBigEndian = 0;
+        p_pProps->GetUINT8(pIOPropByteOrder, isBigEndian);
+
         uint32_t channelLayout = 0; // AudioChannelLayout enum value
         p_pProps->GetUINT32(pIOPropAudioChannelLayout, channelLayout);
+
+        // the LPCM encoder converts the host samples and says which format it sends
+        p_pCodecProps->GetUINT32(pIOPropBitDepth, bitDepth);
+        p_pCodecProps->GetUINT8(pIOPropIsFloat, isFloat);
+        p_pCodecProps->GetUINT8(pIOPropByteOrder, isBigEndian);
+
+        uint32_t fourCC = 0;
+        p_pCodecProps->GetUINT32(pIOPropFourCC, fourCC);
+        const bool isAac = (fourCC == ' aac');
+
+        uint8_t isDiscreteMono = 0;
+        p_pCodecProps->GetUINT8(pIOPropDiscreteMono, isDiscreteMono);
+        const int numStreams = ((isDiscreteMono != 0) && !isAac) ? static_cast<int>(numChannels) : 1;
+
+        AVCodecID codecId = AV_CODEC_ID_NONE;
+        if (isAac)
+        {
+            codecId = AV_CODEC_ID_AAC;
+        }
+        else if ((isFloat != 0) && (bitDepth == 32))
+        {
+            codecId = (isBigEndian != 0) ? AV_CODEC_ID_PCM_F32BE : AV_CODEC_ID_PCM_F32LE;
+        }
+        else if ((isFloat == 0) && (isBigEndian != 0))
+        {
+            codecId = (bitDepth == 16) ? AV_CODEC_ID_PCM_S16BE : ((bitDepth == 24) ? AV_CODEC_ID_PCM_S24BE : ((bitDepth == 32) ? AV_CODEC_ID_PCM_S32BE : AV_CODEC_ID_NONE));
+        }
+        else if (isFloat == 0)
+        {
+            codecId = (bitDepth == 16) ? AV_CODEC_ID_PCM_S16LE : ((bitDepth == 24) ? AV_CODEC_ID_PCM_S24LE : ((bitDepth == 32) ? AV_CODEC_ID_PCM_S32LE : AV_CODEC_ID_NONE));
+        }
+
+        if ((codecId == AV_CODEC_ID_NONE) || (samplingRate == 0) || (numChannels == 0))
+        {
+            g_Log(logLevelError, "Unsupported audio format: %u bits%s%s, %u Hz, %u channels", bitDepth, (isFloat != 0) ? " float" : "", (isBigEndian != 0) ? " big endian" : "", samplingRate, numChannels);
+            return errFail;
+        }
+
+        AVCodecParameters* pPar = avcodec_parameters_alloc();
+        if (pPar == NULL)
+        {
+            return errAlloc;
+        }
+
+        pPar->codec_type = AVMEDIA_TYPE_AUDIO;
+        pPar->codec_id = codecId;
+        pPar->sample_rate = samplingRate;
+        pPar->channels = numChannels / numStreams;
+        pPar->channel_layout = av_get_default_channel_layout(pPar->channels);
+        if (isAac)
+        {
+            // the decoder config comes as the magic cookie
+            PropertyType cookieType = propTypeNull;
+            const void* pCookie = NULL;
+            int cookieSize = 0;
+            if ((p_pCodecProps->GetProperty(pIOPropMagicCookie, &cookieType, &pCookie, &cookieSize) == errNone) && (cookieType == propTypeUInt8) && (cookieSize > 0))
+            {
+                pPar->extradata = static_cast<uint8_t*>(av_mallocz(cookieSize + AV_INPUT_BUFFER_PADDING_SIZE));
+                if (pPar->extradata != NULL)
+                {
+                    memcpy(pPar->extradata, pCookie, cookieSize);
+                    pPar->extradata_size = cookieSize;
+                }
+            }
+
+            uint32_t bitRate = 0;
+            p_pCodecProps->GetUINT32(pIOPropBitRate, bitRate);
+            pPar->bit_rate = bitRate;
+            pPar->frame_size = 1024;
+        }
+        else
+        {
+            pPar->bits_per_coded_sample = bitDepth;
+            pPar->block_align = pPar->channels * bitDepth / 8;
+        }
+
+        // discrete mono tracks are added back to back and labeled with the speaker of their channel
+        AudioStream audioStream;
+        audioStream.streamIdx = -1;
+        audioStream.numStreams = numStreams;
+        audioStream.bytesPerFrame = pPar->block_align * numStreams;
+        audioStream.isCompressed = isAac;
+        audioStream.numSamples = 0;
+        audioStream.resumeEnd = 0;
+        bool isOk = true;
+        for (int i = 0; (i < numStreams) && isOk; ++i)
+        {
+            if (numStreams > 1)
+            {
+                pPar->channel_layout = s_ChannelLabel(channelLayout, numChannels, i);
+            }
+
+            const int streamIdx = m_Muxer.AddStream(pPar, AVRational{ 1, static_cast<int>(samplingRate) });
+            if (i == 0)
+            {
+                audioStream.streamIdx = streamIdx;
+            }
+            isOk = (streamIdx >= 0) && (streamIdx == audioStream.streamIdx + i);
+        }
+        avcodec_parameters_free(&pPar);
+
+        if (!isOk)
+        {
+            return errFail;
+        }
+
+        m_AudioStreams.push_back(audioStream);
+        PlanResumeTrack(audioStream.streamIdx, numStreams, &m_AudioStreams.back());
     }
 
     MovTrackWriter* pTrack = new MovTrackWriter(this, isVideo ? m_VideoTrackVec.size() : m_AudioTrackVec.size(), isVideo);
@@ -270,6 +514,376 @@ StatusCode MovContainer::DoAddTrack(HostPropertyCollectionRef* p_pProps, HostPro
     return errNone;
 }
 
+StatusCode MovContainer::OpenOutput(HostPropertyCollectionRef* p_pCodecProps, const AVCodecContext* p_pCodecContext, double p_Duration, uint32_t p_FpsNum, uint32_t p_FpsDen)
+{
+    const std::string& path = m_Muxer.GetPath();
+
+    // a fragmented movie is readable up to its last fragment while rendering, the fragment length is given in seconds
+    int32_t fragmentSeconds = 0;
+    p_pCodecProps->GetINT32(pIOPropFragmentSeconds, fragmentSeconds);
+
+    // in resumable mode the output of an interrupted render is moved aside and its journaled samples carried over
+    uint8_t isResumable = 0;
+    p_pCodecProps->GetUINT8(pIOPropResumable, isResumable);
+    if ((isResumable != 0) && (fragmentSeconds > 0))
+    {
+        g_Log(logLevelWarn, "Fragmented output can not be resumed, ignoring the resumable option");
+        isResumable = 0;
+    }
+
+    std::string partialPath;
+    if (isResumable != 0)
+    {
+        const std::string journalPath = g_MovJournalPath(path);
+        FILE* pJournal = fopen(journalPath.c_str(), "rb");
+        if (pJournal != NULL)
+        {
+            fclose(pJournal);
+            partialPath = path + ".partial";
+            if ((rename(path.c_str(), partialPath.c_str()) != 0) || (rename(journalPath.c_str(), g_MovJournalPath(partialPath).c_str()) != 0))
+            {
+                g_Log(logLevelError, "Failed to move aside the interrupted render %s", path.c_str());
+                return errFail;
+            }
+        }
+
+        m_Muxer.EnableJournal(journalPath);
+    }
+
+    uint8_t isDirectIO = 0;
+    p_pCodecProps->GetUINT8(pIOPropDirectIO, isDirectIO);
+    if (isDirectIO != 0)
+    {
+        m_Muxer.SetOutputHints(s_EstimateMovieSize(p_pCodecContext, p_Duration, (p_FpsDen > 0) ? (static_cast<double>(p_FpsNum) / p_FpsDen) : 0.0), true);
+    }
+
+    // mirrors get the same file name in each of the configured directories
+    std::string mirrorDirs;
+    p_pCodecProps->GetString(pIOPropMirrorDirs, mirrorDirs);
+
+    if (!m_Muxer.Open(path, s_MirrorPaths(path, mirrorDirs)))
+    {
+        return errFail;
+    }
+
+    if (fragmentSeconds > 0)
+    {
+        const double fps = (p_FpsDen > 0) ? (static_cast<double>(p_FpsNum) / p_FpsDen) : 25.0;
+        m_Muxer.EnableFragments(std::max(1, static_cast<int>(fragmentSeconds * fps + 0.5)));
+    }
+
+    // fast start needs MovWriter, the moov goes into space sized from the expected frame count and, once the header
+    // is due, the tracks
+    uint8_t isNativeMuxer = 0;
+    p_pCodecProps->GetUINT8(pIOPropNativeMuxer, isNativeMuxer);
+
+    uint8_t isFastStart = 0;
+    p_pCodecProps->GetUINT8(pIOPropFastStart, isFastStart);
+
+    if (isFastStart != 0)
+    {
+        const int64_t numFrames = (p_FpsDen > 0) ? static_cast<int64_t>(p_Duration * p_FpsNum / p_FpsDen + 1.0) : 0;
+        if (numFrames <= 1)
+        {
+            g_Log(logLevelWarn, "No duration given, the moov of %s will be written at the end", path.c_str());
+        }
+
+        m_FastStartFrames = (numFrames > 1) ? numFrames : 0;
+        m_Muxer.EnableNativeWriter();
+    }
+    else if (isNativeMuxer != 0)
+    {
+        m_Muxer.EnableNativeWriter();
+    }
+
+    // striping writes a reference movie, only MovWriter knows how
+    std::string stripeDirs;
+    p_pCodecProps->GetString(pIOPropStripeDirs, stripeDirs);
+
+    const std::vector<std::string> stripePaths = s_StripePaths(path, stripeDirs);
+    if (!stripePaths.empty())
+    {
+        if ((isFastStart == 0) && (isNativeMuxer == 0))
+        {
+            m_Muxer.EnableNativeWriter();
+        }
+
+        m_Muxer.EnableStriping(stripePaths);
+    }
+    m_NumStripes = static_cast<int>(stripePaths.size());
+
+    uint8_t isStageStats = 0;
+    p_pCodecProps->GetUINT8(pIOPropStageStats, isStageStats);
+    m_IsStageStatsJson = (isStageStats != 0);
+
+    m_LiveValues = LiveStatsValues();
+    m_LiveStats.Open(liveStatsContainer, path);
+    m_TraceOwnerId = PipelineTrace::s_GetInstance().GetOwnerId(path);
+
+    // the header waits for the first write so tracks added after this one make it into the movie
+    m_PartialPath = partialPath;
+    m_pResumeJournal.reset();
+    m_NumResumeRecords.clear();
+    m_NumResumeFrames = 0;
+    m_IsResumeBroken = false;
+    if (!partialPath.empty())
+    {
+        PlanResume(partialPath);
+    }
+    return errNone;
+}
+
+bool MovContainer::WriteHeaderIfNeeded()
+{
+    if (m_Muxer.IsHeaderWritten())
+    {
+        return true;
+    }
+
+    if (m_FastStartFrames > 0)
+    {
+        // the host may hand over audio with every frame, more often than the half second packets of the LPCM encoder
+        int numAudioStreams = 0;
+        for (size_t i = 0; i < m_AudioStreams.size(); ++i)
+        {
+            numAudioStreams += m_AudioStreams[i].isCompressed ? 0 : m_AudioStreams[i].numStreams;
+        }
+
+        m_Muxer.EnableNativeWriter(MovWriter::s_EstimateMoovSize(m_FastStartFrames, static_cast<int>(m_VideoStreamIdxVec.size()), numAudioStreams, m_FastStartFrames, m_NumStripes));
+    }
+
+    // without a video track nobody opened the file yet
+    if (!m_Muxer.IsOpen() || (!m_Muxer.IsOutputOpen() && !m_Muxer.Open(m_Muxer.GetPath())) || !m_Muxer.WriteHeader())
+    {
+        return false;
+    }
+
+    return (m_PartialPath.empty() || ResumeFromPartial(m_PartialPath));
+}
+
+void MovContainer::PlanResume(const std::string& p_PartialPath)
+{
+    std::unique_ptr<MovJournalReader> pJournal(new MovJournalReader());
+    if (!pJournal->Load(g_MovJournalPath(p_PartialPath)))
+    {
+        g_Log(logLevelWarn, "No usable journal for %s, rendering from the start", p_PartialPath.c_str());
+        return;
+    }
+
+    // the records before the first sample missing from the file can be copied, for each stream a run of its leading samples
+    const size_t numAvailable = pJournal->GetNumAvailableRecords(p_PartialPath);
+    const std::vector<MovJournalRecord>& records = pJournal->GetRecords();
+    m_NumResumeRecords.assign(pJournal->GetNumStreams(), 0);
+    for (size_t i = 0; i < numAvailable; ++i)
+    {
+        ++m_NumResumeRecords[records[i].streamIdx];
+    }
+
+    if (numAvailable == 0)
+    {
+        g_Log(logLevelWarn, "Nothing to carry over from %s, rendering from the start", p_PartialPath.c_str());
+        m_NumResumeRecords.clear();
+        return;
+    }
+
+    // the tracks are matched against the journal as they are added
+    m_pResumeJournal = std::move(pJournal);
+}
+
+// why a stream of the interrupted render can not be carried over into p_pPar, NULL when it can
+static const char* s_ResumeMismatch(const AVCodecParameters* p_pJournalPar, const AVCodecParameters* p_pPar)
+{
+    if ((p_pJournalPar->codec_type != p_pPar->codec_type) || (p_pJournalPar->codec_id != p_pPar->codec_id))
+    {
+        return "has a different track layout";
+    }
+
+    if ((p_pPar->codec_type == AVMEDIA_TYPE_VIDEO) &&
+        ((p_pJournalPar->profile != p_pPar->profile) || (p_pJournalPar->width != p_pPar->width) || (p_pJournalPar->height != p_pPar->height)))
+    {
+        return "has a different profile or frame size";
+    }
+
+    if ((p_pPar->codec_type == AVMEDIA_TYPE_AUDIO) &&
+        ((p_pJournalPar->sample_rate != p_pPar->sample_rate) || (p_pJournalPar->channels != p_pPar->channels) || (p_pJournalPar->block_align != p_pPar->block_align)))
+    {
+        return "has a different audio format";
+    }
+
+    return NULL;
+}
+
+void MovContainer::PlanResumeTrack(int p_FirstStreamIdx, int p_NumStreams, AudioStream* p_pAudioStream)
+{
+    if (!m_pResumeJournal)
+    {
+        return;
+    }
+
+    // a stream the interrupted render did not have can not be carried over, one it had and this one lacks is left out
+    for (int i = p_FirstStreamIdx; i < p_FirstStreamIdx + p_NumStreams; ++i)
+    {
+        const char* pMismatch = "has fewer tracks";
+        if (static_cast<size_t>(i) < m_pResumeJournal->GetNumStreams())
+        {
+            pMismatch = s_ResumeMismatch(m_pResumeJournal->GetStreamParams(i), m_Muxer.GetStream(i)->codecpar);
+        }
+
+        if (pMismatch != NULL)
+        {
+            AbandonResume(pMismatch);
+            return;
+        }
+    }
+
+    const std::vector<MovJournalRecord>& records = m_pResumeJournal->GetRecords();
+    if (p_pAudioStream == NULL)
+    {
+        // the encoder skips frames by pts, so every video stream carries over as many as the shortest one has
+        size_t numFrames = m_NumResumeRecords[p_FirstStreamIdx];
+        if (m_VideoStreamIdxVec.size() > 1)
+        {
+            numFrames = std::min(numFrames, m_NumResumeFrames);
+        }
+
+        if (numFrames == 0)
+        {
+            AbandonResume("has no frames to carry over");
+            return;
+        }
+
+        if (numFrames == m_NumResumeFrames)
+        {
+            return;
+        }
+
+        // the journal pts are in the muxer's video time base, which the encoder scales its pts to as well
+        const int firstVideoIdx = m_VideoStreamIdxVec[0];
+        std::vector<int64_t> pts;
+        pts.reserve(numFrames);
+        for (size_t i = 0; (i < records.size()) && (pts.size() < numFrames); ++i)
+        {
+            if (records[i].streamIdx == static_cast<uint32_t>(firstVideoIdx))
+            {
+                pts.push_back(records[i].pts);
+            }
+        }
+        std::sort(pts.begin(), pts.end());
+
+        if (!ProResResumeRegistry::s_GetInstance().Publish(m_Muxer.GetPath(), pts))
+        {
+            AbandonResume("lost frames after the encoder started");
+            return;
+        }
+
+        m_NumResumeFrames = numFrames;
+        return;
+    }
+
+    // the mono tracks of one mix carry over the same number of packets, each packet covering the same samples
+    size_t numPackets = SIZE_MAX;
+    for (int i = p_FirstStreamIdx; i < p_FirstStreamIdx + p_NumStreams; ++i)
+    {
+        numPackets = std::min(numPackets, m_NumResumeRecords[i]);
+    }
+
+    for (int i = p_FirstStreamIdx; i < p_FirstStreamIdx + p_NumStreams; ++i)
+    {
+        m_NumResumeRecords[i] = numPackets;
+    }
+
+    // the host sends the audio from the start again, WriteAudio drops what is already in the movie. LPCM
+    // counts samples by size, compressed packets end at their pts plus duration
+    const AVCodecParameters* pJournalPar = m_pResumeJournal->GetStreamParams(p_FirstStreamIdx);
+    const AVRational timeBase = m_Muxer.GetStream(p_FirstStreamIdx)->time_base;
+    int64_t resumeEnd = 0;
+    size_t numSeen = 0;
+    for (size_t i = 0; (i < records.size()) && (numSeen < numPackets); ++i)
+    {
+        const MovJournalRecord& record = records[i];
+        if (record.streamIdx != static_cast<uint32_t>(p_FirstStreamIdx))
+        {
+            continue;
+        }
+
+        ++numSeen;
+        if (p_pAudioStream->isCompressed)
+        {
+            resumeEnd = av_rescale_q(record.pts + record.duration, m_pResumeJournal->GetStreamTimeBase(p_FirstStreamIdx), timeBase);
+        }
+        else if (pJournalPar->block_align > 0)
+        {
+            resumeEnd += record.size / pJournalPar->block_align;
+        }
+    }
+
+    p_pAudioStream->resumeEnd = resumeEnd;
+}
+
+void MovContainer::AbandonResume(const char* p_pReason)
+{
+    // with the encoder yet to claim the frames it still renders all of them, otherwise the header fails the render
+    if (ProResResumeRegistry::s_GetInstance().Revoke(m_Muxer.GetPath()))
+    {
+        g_Log(logLevelWarn, "Interrupted render %s %s, rendering from the start", m_PartialPath.c_str(), p_pReason);
+        m_pResumeJournal.reset();
+        m_NumResumeRecords.clear();
+        m_NumResumeFrames = 0;
+        for (size_t i = 0; i < m_AudioStreams.size(); ++i)
+        {
+            m_AudioStreams[i].resumeEnd = 0;
+        }
+        return;
+    }
+
+    g_Log(logLevelError, "Interrupted render %s %s, but its frames were already skipped", m_PartialPath.c_str(), p_pReason);
+    m_IsResumeBroken = true;
+}
+
+bool MovContainer::ResumeFromPartial(const std::string& p_PartialPath)
+{
+    const std::string journalPath = g_MovJournalPath(p_PartialPath);
+    if (!m_pResumeJournal)
+    {
+        // the resume was rejected or abandoned and the new header is out, the interrupted render is of no use anymore
+        g_Log(logLevelInfo, "Removing the interrupted render %s", p_PartialPath.c_str());
+        remove(p_PartialPath.c_str());
+        remove(journalPath.c_str());
+        return true;
+    }
+
+    // the encoder skips the published frames, from here on they have to come from the partial file. Video streams
+    // carry over the published frames, streams the interrupted render had beyond this one's are left out
+    size_t numStreams = m_VideoStreamIdxVec.size();
+    for (size_t i = 0; i < m_AudioStreams.size(); ++i)
+    {
+        numStreams += m_AudioStreams[i].numStreams;
+    }
+
+    std::vector<size_t> maxRecords(m_NumResumeRecords.size(), 0);
+    size_t numExpected = 0;
+    for (size_t i = 0; (i < maxRecords.size()) && (i < numStreams); ++i)
+    {
+        const bool isVideo = (m_Muxer.GetStream(static_cast<int>(i))->codecpar->codec_type == AVMEDIA_TYPE_VIDEO);
+        maxRecords[i] = isVideo ? m_NumResumeFrames : m_NumResumeRecords[i];
+        numExpected += maxRecords[i];
+    }
+
+    int64_t numCopied = 0;
+    if (m_IsResumeBroken || !m_pResumeJournal->CopySamples(p_PartialPath, &m_Muxer, &numCopied, maxRecords) || (numCopied != static_cast<int64_t>(numExpected)))
+    {
+        g_Log(logLevelError, "Failed to carry over %d samples of %s, the render has to start over", static_cast<int>(numExpected), p_PartialPath.c_str());
+        return false;
+    }
+
+    g_Log(logLevelInfo, "Resumed render with %lld samples of %d tracks from %s", static_cast<long long>(numCopied), static_cast<int>(numStreams), p_PartialPath.c_str());
+    m_pResumeJournal.reset();
+
+    remove(p_PartialPath.c_str());
+    remove(journalPath.c_str());
+    return true;
+}
+
 StatusCode MovContainer::DoClose()
 {
     // release all tracks and dereferencing the container
@@ -286,15 +900,65 @@ StatusCode MovContainer::DoClose()
     }
     m_VideoTrackVec.clear();
 
-    // Clean up and close the output file
-    av_write_trailer(m_outFormatContext);
-
-    avio_close(m_outFormatContext->pb);
+    // Clean up and close the output file, a render without any writes still gets a valid empty movie
+    if (m_Muxer.IsOpen())
+    {
+        TraceOwnerScope traceOwner(m_TraceOwnerId);
+        const bool hasTracks = (!m_VideoStreamIdxVec.empty() || !m_AudioStreams.empty());
+        const bool isOk = !hasTracks || WriteHeaderIfNeeded();
+        bool isClosed = false;
+        {
+            StageTimer timer(&m_StageStats, containerStageClose);
+            isClosed = m_Muxer.Close();
+        }
 
+        CloseStageStats();
+        m_LiveStats.Close();
+        ProResResumeRegistry::s_GetInstance().Remove(m_Muxer.GetPath());
+        PipelineTrace::s_GetInstance().Write(m_Muxer.GetPath() + ".trace.json", m_TraceOwnerId);
+        if (!isClosed || !isOk)
+        {
+            return errFail;
+        }
+    }
 
     return errNone;
 }
 
+bool MovContainer::QueuePacket(AVPacket* p_pPacket, bool p_IsVideoFrame)
+{
+    bool isOk = false;
+    {
+        StageTimer timer(&m_StageStats, containerStageMux, p_pPacket->size);
+        isOk = m_Muxer.QueuePacket(p_pPacket);
+    }
+
+    if (isOk)
+    {
+        m_LiveValues.numFrames += p_IsVideoFrame ? 1 : 0;
+        m_LiveValues.bytesWritten += p_pPacket->size;
+    }
+    m_LiveValues.queueDepth = m_Muxer.GetNumQueuedPackets();
+    m_LiveValues.memoryInUse = m_Muxer.GetQueuedBytes();
+    m_LiveStats.Publish(m_LiveValues);
+    return isOk;
+}
+
+void MovContainer::CloseStageStats()
+{
+    if (m_StageStats.IsEmpty())
+    {
+        return;
+    }
+
+    m_StageStats.LogSummary();
+    if (m_IsStageStatsJson)
+    {
+        m_StageStats.WriteJson(m_Muxer.GetPath());
+    }
+    m_StageStats.Reset();
+}
+
 StatusCode MovContainer::WriteVideo(uint32_t p_TrackIdx, HostBufferRef* p_pBuf)
 {
     if (p_pBuf == NULL)
@@ -303,41 +967,62 @@ StatusCode MovContainer::WriteVideo(uint32_t p_TrackIdx, HostBufferRef* p_pBuf)
         return errNone;
     }
 
-    int64_t pts = -1LL;
-    int64_t dts = -1LL;
-    double duration = 0.0; // optional, may be invalid and default to 1 frame in track fps
-    p_pBuf->GetINT64(pIOPropPTS, pts);
-    if (!p_pBuf->GetINT64(pIOPropDTS, dts))
-    {
-        dts = pts;
-    }
-    if (!p_pBuf->GetDouble(pIOPropDuration, duration))
+    if (p_TrackIdx >= m_VideoStreamIdxVec.size())
     {
-        // duration may be double or int64, if double - in seconds, if int64_t then in time base units (or fps)
-        int64_t intDuration = 0;
-        p_pBuf->GetINT64(pIOPropDuration, intDuration);
+        return errInvalidParam;
     }
 
+    // duration is optional, may be invalid and default to 1 frame in track fps
+    HostBufferTiming timing;
+    p_pBuf->GetTiming(timing);
+    const int64_t pts = timing.pts;
+    const int64_t dts = timing.dts;
+
+    TraceOwnerScope traceOwner(m_TraceOwnerId);
+    StageTimer timer(&m_StageStats, containerStageWriteVideo);
+
     char* pBuf = NULL;
     size_t bufSize = 0;
     if (p_pBuf->LockBuffer(&pBuf, &bufSize))
     {
+        timer.SetBytes(bufSize);
+
         // put the writing code here
         //g_Log(logLevelWarn, "Dummy Container Plugin :: Write Video of %ld for track %d: pts: %lld, dts: %lld, duration: %f", bufSize, p_TrackIdx, pts, dts, duration);
         // Write the encoded data to the output file
+        // a handoff token brings the encoder's own refcounted packet which the queue only references,
+        // otherwise the queue copies the data and the host buffer is only borrowed
+        AVPacket* pHandedOff = NULL;
+        if (ProResPacketRegistry::s_IsToken(pBuf, bufSize))
+        {
+            pHandedOff = ProResPacketRegistry::s_GetInstance().Take(pBuf, bufSize);
+            if (pHandedOff == NULL)
+            {
+                p_pBuf->UnlockBuffer();
+                return errFail;
+            }
+        }
+
         AVPacket packet;
         av_init_packet(&packet);
-        av_packet_from_data(&packet, reinterpret_cast<uint8_t*>(pBuf), bufSize);
-
-        packet.pts = pts;
-        packet.dts = dts;
-        packet.flags = AV_PKT_FLAG_KEY;
+        packet.data = reinterpret_cast<uint8_t*>(pBuf);
+        packet.size = static_cast<int>(bufSize);
 
-        if (av_write_frame(m_outFormatContext, &packet) < 0) {
-          g_Log(logLevelError, "error writing");
-        }
+        AVPacket* pPacket = (pHandedOff != NULL) ? pHandedOff : &packet;
+        pPacket->pts = pts;
+        pPacket->dts = dts;
+        pPacket->flags = AV_PKT_FLAG_KEY;
+        pPacket->stream_index = m_VideoStreamIdxVec[p_TrackIdx];
 
+        const bool isOk = WriteHeaderIfNeeded() && QueuePacket(pPacket, true);
         p_pBuf->UnlockBuffer();
+        av_packet_free(&pHandedOff);
+
+        if (!isOk)
+        {
+            PLUGIN_LOG(logLevelError, "Dummy Container Plugin :: Failed to write video to %s", m_Muxer.GetPath().c_str());
+            return errFail;
+        }
     }
 
     return errNone;
@@ -351,27 +1036,109 @@ StatusCode MovContainer::WriteAudio(uint32_t p_TrackIdx, HostBufferRef* p_pBuf)
         return errNone;
     }
 
-    int64_t pts = -1LL;
-    int64_t dts = -1LL;
-    int64_t duration = 0;
-    p_pBuf->GetINT64(pIOPropPTS, pts);
-    if (!p_pBuf->GetINT64(pIOPropDTS, dts))
+    if (p_TrackIdx >= m_AudioStreams.size())
     {
-        dts = pts;
+        return errInvalidParam;
     }
 
-    p_pBuf->GetINT64(pIOPropDuration, duration); // may be double in seconds or int64 in samples
-
-    // if pIOPropTimeBase is set then pts/dts/duration in seconds will be the corresponding value multiplied by time base
+    // LPCM timing follows from the sample count alone, only compressed packets need theirs from the host.
+    // If pIOPropTimeBase is set then pts/dts/duration in seconds will be the corresponding value multiplied by time base
     // otherwise it's the value divided by frame rate of the track
+    HostBufferTiming timing;
+    if (m_AudioStreams[p_TrackIdx].isCompressed)
+    {
+        p_pBuf->GetTiming(timing);
+    }
+    const int64_t pts = timing.pts;
+    const int64_t dts = timing.dts;
+    const int64_t duration = timing.duration;
+
+    TraceOwnerScope traceOwner(m_TraceOwnerId);
+    StageTimer timer(&m_StageStats, containerStageWriteAudio);
 
     char* pBuf = NULL;
     size_t bufSize = 0;
     if (p_pBuf->LockBuffer(&pBuf, &bufSize))
     {
-        // put the writing code here
-        g_Log(logLevelWarn, "Dummy Container Plugin :: Write Audio of %ld for track %d: pts: %lld, dts: %lld, duration: %d", bufSize, p_TrackIdx, pts, dts, duration);
+        timer.SetBytes(bufSize);
+
+        // LPCM is contiguous, timestamps follow from the samples written so far. Compressed packets carry
+        // their own, in samples, the first ones are negative for the encoder delay
+        AudioStream& audioStream = m_AudioStreams[p_TrackIdx];
+
+        AVPacket packet;
+        av_init_packet(&packet);
+        packet.data = reinterpret_cast<uint8_t*>(pBuf);
+        packet.size = static_cast<int>(bufSize);
+
+        const int64_t numSamples = audioStream.isCompressed ? duration : static_cast<int64_t>(bufSize / audioStream.bytesPerFrame);
+        packet.pts = audioStream.isCompressed ? pts : audioStream.numSamples;
+        packet.dts = audioStream.isCompressed ? dts : audioStream.numSamples;
+        packet.duration = numSamples;
+        packet.flags = AV_PKT_FLAG_KEY;
+        packet.stream_index = audioStream.streamIdx;
+
+        // a resumed render already has the start of the audio, LPCM is cut at the sample where it ends and compressed
+        // packets before it are dropped whole
+        int64_t numSkipped = 0;
+        bool isCarriedOver = false;
+        if (audioStream.isCompressed)
+        {
+            isCarriedOver = (audioStream.resumeEnd > 0) && (pts + duration <= audioStream.resumeEnd);
+        }
+        else if (audioStream.numSamples < audioStream.resumeEnd)
+        {
+            numSkipped = std::min(numSamples, audioStream.resumeEnd - audioStream.numSamples);
+            isCarriedOver = (numSkipped == numSamples);
+        }
+        audioStream.numSamples += numSamples;
+
+        // per track bytes of the skipped samples, LPCM frames are interleaved or planar with one plane per mono track
+        const int skipBytes = static_cast<int>(numSkipped * (audioStream.bytesPerFrame / audioStream.numStreams));
+        packet.pts += numSkipped;
+        packet.dts += numSkipped;
+        packet.duration -= numSkipped;
+
+        bool isOk = WriteHeaderIfNeeded();
+        if (isOk && isCarriedOver)
+        {
+            // all of it is in the movie already
+        }
+        else if (isOk && (audioStream.numStreams > 1))
+        {
+            // the buffer holds one plane per mono track. It is copied once, the packets of the tracks all reference that copy
+            const int planeSize = static_cast<int>(bufSize) / audioStream.numStreams;
+            AVBufferRef* pPlanes = av_buffer_alloc(static_cast<int>(bufSize) + AV_INPUT_BUFFER_PADDING_SIZE);
+            isOk = (pPlanes != NULL);
+            if (isOk)
+            {
+                memcpy(pPlanes->data, pBuf, bufSize);
+                packet.buf = pPlanes;
+                packet.size = planeSize - skipBytes;
+            }
+
+            for (int i = 0; (i < audioStream.numStreams) && isOk; ++i)
+            {
+                packet.data = pPlanes->data + i * planeSize + skipBytes;
+                packet.stream_index = audioStream.streamIdx + i;
+                isOk = QueuePacket(&packet);
+            }
+
+            av_buffer_unref(&pPlanes);
+        }
+        else if (isOk)
+        {
+            packet.data += skipBytes;
+            packet.size -= skipBytes;
+            isOk = QueuePacket(&packet);
+        }
         p_pBuf->UnlockBuffer();
+
+        if (!isOk)
+        {
+            PLUGIN_LOG(logLevelError, "Dummy Container Plugin :: Failed to write audio to %s", m_Muxer.GetPath().c_str());
+            return errFail;
+        }
     }
 
     return errNone;
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "wrapper/plugin_api.h"
+#include "mov_muxer.h"
+#include "stage_stats.h"
+#include "live_stats.h"
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
@@ -10,6 +13,7 @@ extern "C" {
 using namespace IOPlugin;
 
 
+class MovJournalReader;
 class MovTrackWriter;
 class MovContainer : public IPluginContainerRef
 {
@@ -35,10 +39,64 @@ protected:
 
 protected:
     virtual ~MovContainer();
+
+    // applies the output settings of the first video track and opens the file
+    StatusCode OpenOutput(HostPropertyCollectionRef* p_pCodecProps, const AVCodecContext* p_pCodecContext, double p_Duration, uint32_t p_FpsNum, uint32_t p_FpsDen);
+
+    struct AudioStream;
+
+    // loads the journal of the interrupted render and counts the samples of each stream it can carry over
+    void PlanResume(const std::string& p_PartialPath);
+
+    // matches the streams of a track just added against the journal. Video publishes the frames every video stream
+    // can carry over, see ProResResumeRegistry, audio learns where its carried over samples end
+    void PlanResumeTrack(int p_FirstStreamIdx, int p_NumStreams, AudioStream* p_pAudioStream);
+
+    // drops the plan unless the encoder already claimed the published frames, then the header fails the render
+    void AbandonResume(const char* p_pReason);
+
+    bool ResumeFromPartial(const std::string& p_PartialPath);
+
+    // the header goes out with the first packet, once all tracks are known
+    bool WriteHeaderIfNeeded();
+
+    // m_Muxer.QueuePacket under the mux stage timer, a queued video frame counts into the live stats
+    bool QueuePacket(AVPacket* p_pPacket, bool p_IsVideoFrame = false);
+
+    // logs the stage timings and writes them next to the movie when asked to
+    void CloseStageStats();
+
     std::vector<MovTrackWriter*> m_VideoTrackVec;
     std::vector<MovTrackWriter*> m_AudioTrackVec;
 
-    AVStream* m_outStream;
-    AVFormatContext* m_outFormatContext;
+    MovMuxer m_Muxer;
+    std::vector<int> m_VideoStreamIdxVec; // by video track index
+
+    struct AudioStream
+    {
+        int streamIdx; // the first one for discrete mono
+        int numStreams; // one per channel for discrete mono, otherwise 1
+        int bytesPerFrame; // of all streams together, 0 for compressed audio
+        bool isCompressed;
+        int64_t numSamples; // written so far, the pts of the next buffer
+        int64_t resumeEnd; // end of the samples carried over from the interrupted render, the host resends them and they are dropped
+    };
+    std::vector<AudioStream> m_AudioStreams; // by audio track index
+
+    int64_t m_FastStartFrames; // expected frames the moov space is reserved for, 0 without fast start
+    int m_NumStripes; // data files the samples are spread over, 0 without striping
+
+    std::string m_PartialPath; // interrupted render to carry over once the header is written
+    std::unique_ptr<MovJournalReader> m_pResumeJournal; // its journal, NULL to render from the start
+    std::vector<size_t> m_NumResumeRecords; // leading records carried over per journal stream
+    size_t m_NumResumeFrames; // video frames published to the encoder, the same for every video stream
+    bool m_IsResumeBroken; // a track did not match after the encoder claimed the frames
+
+    StageStats m_StageStats;
+    bool m_IsStageStatsJson;
+    uint64_t m_TraceOwnerId; // this render's spans in PipelineTrace
+
+    LiveStatsPublisher m_LiveStats;
+    LiveStatsValues m_LiveValues;
 
 };
\ No newline at end of file
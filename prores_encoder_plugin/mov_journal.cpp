@@ -0,0 +1,359 @@
+#include "mov_journal.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "mov_muxer.h"
+
+static const char s_JournalMagic[4] = { 'P', 'R', 'J', 'L' };
+static const uint32_t s_JournalVersion = 1;
+static const uint32_t s_RecordTag = 0x4C504D53; // "SMPL"
+// codec headers are a few hundred bytes, anything near this comes from a damaged journal
+static const uint32_t s_MaxExtradataSize = 1024 * 1024;
+
+static uint32_t s_RecordCheck(const MovJournalRecord& p_Record)
+{
+    // FNV-1a over everything but the check itself, catches records torn by a crash mid-write
+    const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(&p_Record);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(MovJournalRecord, check); ++i)
+    {
+        hash = (hash ^ pBytes[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+std::string g_MovJournalPath(const std::string& p_MediaPath)
+{
+    return p_MediaPath + ".journal";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// MovJournalWriter
+///
+////////////////////////////////////////////////////////////////////////////////
+MovJournalWriter::MovJournalWriter()
+    : m_pFile(NULL)
+{
+}
+
+MovJournalWriter::~MovJournalWriter()
+{
+    Close(false);
+}
+
+bool MovJournalWriter::Open(const std::string& p_Path, const AVFormatContext* p_pFormatContext)
+{
+    Close(false);
+
+    m_pFile = fopen(p_Path.c_str(), "wb");
+    if (m_pFile == NULL)
+    {
+        g_Log(logLevelError, "MovJournal :: Could not create journal %s", p_Path.c_str());
+        return false;
+    }
+
+    m_Path = p_Path;
+
+    const uint32_t numStreams = p_pFormatContext->nb_streams;
+    bool isOk = (fwrite(s_JournalMagic, sizeof(s_JournalMagic), 1, m_pFile) == 1);
+    isOk = isOk && (fwrite(&s_JournalVersion, sizeof(s_JournalVersion), 1, m_pFile) == 1);
+    isOk = isOk && (fwrite(&numStreams, sizeof(numStreams), 1, m_pFile) == 1);
+
+    for (uint32_t i = 0; isOk && (i < numStreams); ++i)
+    {
+        const AVStream* pStream = p_pFormatContext->streams[i];
+        const AVCodecParameters* pPar = pStream->codecpar;
+
+        MovJournalStreamInfo info;
+        memset(&info, 0, sizeof(info));
+        info.codecType = static_cast<uint32_t>(pPar->codec_type);
+        info.codecId = static_cast<uint32_t>(pPar->codec_id);
+        info.codecTag = pPar->codec_tag;
+        info.format = pPar->format;
+        info.width = pPar->width;
+        info.height = pPar->height;
+        info.profile = pPar->profile;
+        info.sampleRate = pPar->sample_rate;
+        info.channels = pPar->channels;
+        info.bitsPerCodedSample = pPar->bits_per_coded_sample;
+        info.bitsPerRawSample = pPar->bits_per_raw_sample;
+        info.blockAlign = pPar->block_align;
+        info.timeBaseNum = pStream->time_base.num;
+        info.timeBaseDen = pStream->time_base.den;
+        info.extradataSize = (pPar->extradata != NULL) ? pPar->extradata_size : 0;
+
+        isOk = (fwrite(&info, sizeof(info), 1, m_pFile) == 1);
+        if (isOk && (info.extradataSize > 0))
+        {
+            isOk = (fwrite(pPar->extradata, info.extradataSize, 1, m_pFile) == 1);
+        }
+    }
+
+    if (!isOk || (fflush(m_pFile) != 0))
+    {
+        g_Log(logLevelError, "MovJournal :: Failed to write journal header to %s", p_Path.c_str());
+        Close(false);
+        return false;
+    }
+
+    return true;
+}
+
+bool MovJournalWriter::Append(uint32_t p_StreamIdx, int64_t p_Offset, int64_t p_Size, int64_t p_PTS, int64_t p_DTS, int64_t p_Duration, uint32_t p_Flags)
+{
+    if (m_pFile == NULL)
+    {
+        return false;
+    }
+
+    MovJournalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.tag = s_RecordTag;
+    record.streamIdx = p_StreamIdx;
+    record.offset = p_Offset;
+    record.size = p_Size;
+    record.pts = p_PTS;
+    record.dts = p_DTS;
+    record.duration = p_Duration;
+    record.flags = p_Flags;
+    record.check = s_RecordCheck(record);
+
+    // flushed per record so the journal never lags the sample data already handed to the OS
+    return ((fwrite(&record, sizeof(record), 1, m_pFile) == 1) && (fflush(m_pFile) == 0));
+}
+
+void MovJournalWriter::Close(bool p_IsComplete)
+{
+    if (m_pFile == NULL)
+    {
+        return;
+    }
+
+    fclose(m_pFile);
+    m_pFile = NULL;
+
+    if (p_IsComplete)
+    {
+        remove(m_Path.c_str());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// MovJournalReader
+///
+////////////////////////////////////////////////////////////////////////////////
+MovJournalReader::MovJournalReader()
+{
+}
+
+MovJournalReader::~MovJournalReader()
+{
+    Clear();
+}
+
+void MovJournalReader::Clear()
+{
+    for (size_t i = 0; i < m_StreamParams.size(); ++i)
+    {
+        avcodec_parameters_free(&m_StreamParams[i]);
+    }
+
+    m_StreamParams.clear();
+    m_StreamTimeBases.clear();
+    m_Records.clear();
+}
+
+bool MovJournalReader::Load(const std::string& p_Path)
+{
+    Clear();
+
+    FILE* pFile = fopen(p_Path.c_str(), "rb");
+    if (pFile == NULL)
+    {
+        return false;
+    }
+
+    const int64_t fileSize = (fseeko(pFile, 0, SEEK_END) == 0) ? static_cast<int64_t>(ftello(pFile)) : 0;
+    rewind(pFile);
+
+    char magic[4] = { 0 };
+    uint32_t version = 0;
+    uint32_t numStreams = 0;
+    bool isOk = (fread(magic, sizeof(magic), 1, pFile) == 1) && (memcmp(magic, s_JournalMagic, sizeof(magic)) == 0);
+    isOk = isOk && (fread(&version, sizeof(version), 1, pFile) == 1) && (version == s_JournalVersion);
+    isOk = isOk && (fread(&numStreams, sizeof(numStreams), 1, pFile) == 1) && (numStreams > 0);
+
+    for (uint32_t i = 0; isOk && (i < numStreams); ++i)
+    {
+        MovJournalStreamInfo info;
+        isOk = (fread(&info, sizeof(info), 1, pFile) == 1);
+        if (!isOk)
+        {
+            break;
+        }
+
+        AVCodecParameters* pPar = avcodec_parameters_alloc();
+        if (pPar == NULL)
+        {
+            isOk = false;
+            break;
+        }
+
+        m_StreamParams.push_back(pPar);
+        m_StreamTimeBases.push_back(av_make_q(info.timeBaseNum, info.timeBaseDen));
+
+        pPar->codec_type = static_cast<AVMediaType>(info.codecType);
+        pPar->codec_id = static_cast<AVCodecID>(info.codecId);
+        pPar->codec_tag = info.codecTag;
+        pPar->format = info.format;
+        pPar->width = info.width;
+        pPar->height = info.height;
+        pPar->profile = info.profile;
+        pPar->sample_rate = info.sampleRate;
+        pPar->channels = info.channels;
+        pPar->bits_per_coded_sample = info.bitsPerCodedSample;
+        pPar->bits_per_raw_sample = info.bitsPerRawSample;
+        pPar->block_align = info.blockAlign;
+
+        if ((info.extradataSize > s_MaxExtradataSize) || (info.extradataSize > fileSize - static_cast<int64_t>(ftello(pFile))))
+        {
+            g_Log(logLevelError, "MovJournal :: Stream %u of %s claims %u bytes of codec header, the journal is damaged", i, p_Path.c_str(), info.extradataSize);
+            isOk = false;
+        }
+        else if (info.extradataSize > 0)
+        {
+            pPar->extradata = static_cast<uint8_t*>(av_mallocz(info.extradataSize + AV_INPUT_BUFFER_PADDING_SIZE));
+            isOk = (pPar->extradata != NULL) && (fread(pPar->extradata, info.extradataSize, 1, pFile) == 1);
+            pPar->extradata_size = isOk ? info.extradataSize : 0;
+        }
+    }
+
+    MovJournalRecord record;
+    while (isOk && (fread(&record, sizeof(record), 1, pFile) == 1))
+    {
+        if ((record.tag != s_RecordTag) || (record.check != s_RecordCheck(record)) || (record.streamIdx >= numStreams))
+        {
+            // torn tail of a crashed render
+            break;
+        }
+
+        m_Records.push_back(record);
+    }
+
+    fclose(pFile);
+
+    if (!isOk)
+    {
+        g_Log(logLevelError, "MovJournal :: Journal %s is not valid", p_Path.c_str());
+        Clear();
+    }
+
+    return isOk;
+}
+
+bool MovJournalReader::AddStreams(MovMuxer* p_pMuxer) const
+{
+    for (size_t i = 0; i < m_StreamParams.size(); ++i)
+    {
+        if (p_pMuxer->AddStream(m_StreamParams[i], m_StreamTimeBases[i]) != static_cast<int>(i))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t MovJournalReader::GetNumAvailableRecords(const std::string& p_MediaPath) const
+{
+    FILE* pFile = fopen(p_MediaPath.c_str(), "rb");
+    if (pFile == NULL)
+    {
+        return 0;
+    }
+
+    const int64_t fileSize = (fseeko(pFile, 0, SEEK_END) == 0) ? static_cast<int64_t>(ftello(pFile)) : 0;
+    fclose(pFile);
+
+    size_t numAvailable = 0;
+    while (numAvailable < m_Records.size())
+    {
+        const MovJournalRecord& record = m_Records[numAvailable];
+        if ((record.size <= 0) || (record.offset < 0) || (record.offset > fileSize - record.size))
+        {
+            break;
+        }
+
+        ++numAvailable;
+    }
+
+    return numAvailable;
+}
+
+bool MovJournalReader::CopySamples(const std::string& p_MediaPath, MovMuxer* p_pMuxer, int64_t* p_pNumCopied, const std::vector<size_t>& p_MaxRecords) const
+{
+    *p_pNumCopied = 0;
+
+    FILE* pFile = fopen(p_MediaPath.c_str(), "rb");
+    if (pFile == NULL)
+    {
+        g_Log(logLevelError, "MovJournal :: Could not open %s", p_MediaPath.c_str());
+        return false;
+    }
+
+    bool isOk = true;
+    std::vector<size_t> numCopied(m_StreamParams.size(), 0);
+    for (size_t i = 0; i < m_Records.size(); ++i)
+    {
+        const MovJournalRecord& record = m_Records[i];
+        if (!p_MaxRecords.empty() && ((record.streamIdx >= p_MaxRecords.size()) || (numCopied[record.streamIdx] >= p_MaxRecords[record.streamIdx])))
+        {
+            continue;
+        }
+
+        AVPacket packet;
+        av_init_packet(&packet);
+        if ((record.size <= 0) || (av_new_packet(&packet, static_cast<int>(record.size)) < 0))
+        {
+            isOk = false;
+            break;
+        }
+
+        if ((fseeko(pFile, record.offset, SEEK_SET) != 0) || (fread(packet.data, record.size, 1, pFile) != 1))
+        {
+            // the sample never reached the disk, everything after it is dropped to keep the timeline contiguous
+            g_Log(logLevelWarn, "MovJournal :: Sample %lld is missing from %s, stopping there", static_cast<long long>(i), p_MediaPath.c_str());
+            av_packet_unref(&packet);
+            break;
+        }
+
+        packet.stream_index = record.streamIdx;
+        packet.pts = record.pts;
+        packet.dts = record.dts;
+        packet.duration = record.duration;
+        packet.flags = record.flags;
+
+        const AVStream* pStream = p_pMuxer->GetStream(record.streamIdx);
+        if (pStream != NULL)
+        {
+            av_packet_rescale_ts(&packet, m_StreamTimeBases[record.streamIdx], pStream->time_base);
+        }
+
+        isOk = p_pMuxer->WritePacket(&packet);
+        av_packet_unref(&packet);
+        if (!isOk)
+        {
+            break;
+        }
+
+        ++numCopied[record.streamIdx];
+        ++(*p_pNumCopied);
+    }
+
+    fclose(pFile);
+    return isOk;
+}
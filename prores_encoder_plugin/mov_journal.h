@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "wrapper/host_api.h"
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+class MovMuxer;
+
+// Write journal kept next to a movie being rendered, it lists every sample that made it to the file
+// so a movie left without moov by a crash can be rebuilt and a restarted render can skip finished frames.
+//
+// Layout, host byte order:
+//   "PRJL", uint32 version, uint32 stream count
+//   per stream: MovJournalStreamInfo followed by its extradata bytes
+//   MovJournalRecord per written sample, a torn trailing record is ignored on load
+
+std::string g_MovJournalPath(const std::string& p_MediaPath);
+
+#pragma pack(push, 1)
+struct MovJournalStreamInfo
+{
+    uint32_t codecType;
+    uint32_t codecId;
+    uint32_t codecTag;
+    int32_t format;
+    int32_t width;
+    int32_t height;
+    int32_t profile;
+    int32_t sampleRate;
+    int32_t channels;
+    int32_t bitsPerCodedSample;
+    int32_t bitsPerRawSample;
+    int32_t blockAlign;
+    int32_t timeBaseNum;
+    int32_t timeBaseDen;
+    uint32_t extradataSize;
+};
+
+struct MovJournalRecord
+{
+    uint32_t tag;
+    uint32_t streamIdx;
+    int64_t offset;
+    int64_t size;
+    int64_t pts;
+    int64_t dts;
+    int64_t duration;
+    uint32_t flags;
+    uint32_t check;
+};
+#pragma pack(pop)
+
+class MovJournalWriter
+{
+public:
+    MovJournalWriter();
+    ~MovJournalWriter();
+
+    bool Open(const std::string& p_Path, const AVFormatContext* p_pFormatContext);
+    bool Append(uint32_t p_StreamIdx, int64_t p_Offset, int64_t p_Size, int64_t p_PTS, int64_t p_DTS, int64_t p_Duration, uint32_t p_Flags);
+
+    // the journal is only removed when the movie was finalized, otherwise it stays for recovery
+    void Close(bool p_IsComplete);
+
+private:
+    FILE* m_pFile;
+    std::string m_Path;
+};
+
+class MovJournalReader
+{
+public:
+    MovJournalReader();
+    ~MovJournalReader();
+
+    bool Load(const std::string& p_Path);
+
+    size_t GetNumStreams() const
+    {
+        return m_StreamParams.size();
+    }
+
+    const AVCodecParameters* GetStreamParams(size_t p_Idx) const
+    {
+        return m_StreamParams[p_Idx];
+    }
+
+    AVRational GetStreamTimeBase(size_t p_Idx) const
+    {
+        return m_StreamTimeBases[p_Idx];
+    }
+
+    const std::vector<MovJournalRecord>& GetRecords() const
+    {
+        return m_Records;
+    }
+
+    // adds the journal streams to a muxer which has not written its header yet
+    bool AddStreams(MovMuxer* p_pMuxer) const;
+
+    // how many leading records CopySamples finds in p_MediaPath, the ones before the first sample missing from the file
+    size_t GetNumAvailableRecords(const std::string& p_MediaPath) const;
+
+    // copies the journaled samples found in p_MediaPath to the muxer, stops at the first sample missing from the file.
+    // A non-empty p_MaxRecords limits each stream to its leading records, streams past its end are left out
+    bool CopySamples(const std::string& p_MediaPath, MovMuxer* p_pMuxer, int64_t* p_pNumCopied, const std::vector<size_t>& p_MaxRecords = std::vector<size_t>()) const;
+
+private:
+    // disable assignment and copy constructor
+    MovJournalReader(const MovJournalReader& p_Other);
+    MovJournalReader& operator=(const MovJournalReader& p_Other);
+
+    void Clear();
+
+private:
+    std::vector<AVCodecParameters*> m_StreamParams;
+    std::vector<AVRational> m_StreamTimeBases;
+    std::vector<MovJournalRecord> m_Records;
+};
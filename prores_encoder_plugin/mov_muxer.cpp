@@ -0,0 +1,560 @@
+#include "mov_muxer.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "mov_journal.h"
+#include "mov_output.h"
+#include "mov_writer.h"
+
+// bounds of the interleave queue, past them the earliest packet is written even if a stream has nothing queued
+static const int64_t s_MaxQueuedBytes = 64 * 1024 * 1024;
+static const double s_MaxInterleaveSeconds = 1.0;
+
+static const char* s_ErrorString(int p_Err, char* p_pBuf, size_t p_BufSize)
+{
+    if (av_strerror(p_Err, p_pBuf, p_BufSize) < 0)
+    {
+        snprintf(p_pBuf, p_BufSize, "error %d", p_Err);
+    }
+
+    return p_pBuf;
+}
+
+MovMuxer::MovMuxer()
+    : m_pFormatContext(NULL)
+    , m_HeaderWritten(false)
+    , m_ExpectedSize(0)
+    , m_IsDirectIO(false)
+    , m_IsNativeWriter(false)
+    , m_MoovReserve(0)
+    , m_FramesPerFragment(0)
+    , m_NumFragmentFrames(0)
+    , m_FragmentStreamIdx(-1)
+    , m_QueuedBytes(0)
+    , m_NewestQueuedSeconds(0.0)
+{
+}
+
+MovMuxer::~MovMuxer()
+{
+    Release();
+}
+
+void MovMuxer::SetOutputHints(int64_t p_ExpectedSize, bool p_IsDirectIO)
+{
+    m_ExpectedSize = p_ExpectedSize;
+    m_IsDirectIO = p_IsDirectIO;
+}
+
+void MovMuxer::EnableNativeWriter(int64_t p_MoovReserve)
+{
+    m_IsNativeWriter = true;
+    m_MoovReserve = p_MoovReserve;
+}
+
+void MovMuxer::EnableFragments(int p_FramesPerFragment)
+{
+    m_FramesPerFragment = p_FramesPerFragment;
+}
+
+void MovMuxer::EnableStriping(const std::vector<std::string>& p_DataPaths)
+{
+    m_StripePaths = p_DataPaths;
+}
+
+void MovMuxer::EnableJournal(const std::string& p_JournalPath)
+{
+    m_JournalPath = p_JournalPath;
+}
+
+bool MovMuxer::Open(const std::string& p_Path)
+{
+    return Open(p_Path, std::vector<std::string>());
+}
+
+bool MovMuxer::Create(const std::string& p_Path)
+{
+    Release();
+
+    if (avformat_alloc_output_context2(&m_pFormatContext, NULL, "mov", p_Path.c_str()) < 0)
+    {
+        g_Log(logLevelError, "MovMuxer :: Failed to create output context for %s", p_Path.c_str());
+        m_pFormatContext = NULL;
+        return false;
+    }
+
+    m_Path = p_Path;
+    return true;
+}
+
+bool MovMuxer::Open(const std::string& p_Path, const std::vector<std::string>& p_MirrorPaths)
+{
+    if (((m_pFormatContext == NULL) || (p_Path != m_Path)) && !Create(p_Path))
+    {
+        return false;
+    }
+
+    if (m_pOutput)
+    {
+        g_Log(logLevelError, "MovMuxer :: %s is already open", p_Path.c_str());
+        return false;
+    }
+
+    std::vector<std::string> paths(1, p_Path);
+    paths.insert(paths.end(), p_MirrorPaths.begin(), p_MirrorPaths.end());
+
+    m_pOutput.reset(new MovOutput());
+    if (!m_pOutput->Open(paths, m_ExpectedSize, m_IsDirectIO))
+    {
+        g_Log(logLevelError, "MovMuxer :: Could not open output file %s", p_Path.c_str());
+        m_pOutput.reset();
+        return false;
+    }
+
+    m_pFormatContext->pb = m_pOutput->GetIOContext();
+    m_pFormatContext->flags |= AVFMT_FLAG_CUSTOM_IO;
+    return true;
+}
+
+int MovMuxer::AddStream(const AVCodecParameters* p_pCodecPar, AVRational p_TimeBase)
+{
+    if ((m_pFormatContext == NULL) || m_HeaderWritten)
+    {
+        return -1;
+    }
+
+    AVStream* pStream = avformat_new_stream(m_pFormatContext, NULL);
+    if (pStream == NULL)
+    {
+        g_Log(logLevelError, "MovMuxer :: Failed to create new stream");
+        return -1;
+    }
+
+    if (avcodec_parameters_copy(pStream->codecpar, p_pCodecPar) < 0)
+    {
+        g_Log(logLevelError, "MovMuxer :: Failed to copy codec parameters");
+        return -1;
+    }
+
+    // let the muxer pick the tag matching the codec id
+    pStream->codecpar->codec_tag = 0;
+    pStream->time_base = p_TimeBase;
+
+    return pStream->index;
+}
+
+int MovMuxer::AddStream(const AVCodec* p_pCodec, const AVCodecContext* p_pCodecContext)
+{
+    if ((m_pFormatContext == NULL) || m_HeaderWritten)
+    {
+        return -1;
+    }
+
+    AVStream* pStream = avformat_new_stream(m_pFormatContext, p_pCodec);
+    if (pStream == NULL)
+    {
+        g_Log(logLevelError, "MovMuxer :: Failed to create new stream");
+        return -1;
+    }
+
+    // stream time base is left to the muxer default (1/90000 for video) which the encoder pts are scaled to
+    avcodec_parameters_from_context(pStream->codecpar, p_pCodecContext);
+    pStream->codecpar->codec_tag = 0;
+    pStream->avg_frame_rate = p_pCodecContext->framerate;
+
+    return pStream->index;
+}
+
+AVStream* MovMuxer::GetStream(int p_Idx) const
+{
+    if ((m_pFormatContext == NULL) || (p_Idx < 0) || (static_cast<unsigned>(p_Idx) >= m_pFormatContext->nb_streams))
+    {
+        return NULL;
+    }
+
+    return m_pFormatContext->streams[p_Idx];
+}
+
+int MovMuxer::GetNumQueuedPackets() const
+{
+    size_t numPackets = 0;
+    for (size_t i = 0; i < m_Queues.size(); ++i)
+    {
+        numPackets += m_Queues[i].size();
+    }
+
+    return static_cast<int>(numPackets);
+}
+
+bool MovMuxer::WriteHeader()
+{
+    if ((m_pFormatContext == NULL) || !m_pOutput || m_HeaderWritten)
+    {
+        return false;
+    }
+
+    if (m_IsNativeWriter && (m_FramesPerFragment > 0))
+    {
+        g_Log(logLevelWarn, "MovMuxer :: Fragmented output is written with libavformat");
+    }
+    else if (m_IsNativeWriter && !MovWriter::s_CanWrite(m_pFormatContext))
+    {
+        g_Log(logLevelWarn, "MovMuxer :: Compressed audio is written with libavformat");
+    }
+    else if (m_IsNativeWriter)
+    {
+        m_pWriter.reset(new MovWriter());
+        m_pWriter->ReserveMoov(m_MoovReserve);
+        if (!m_StripePaths.empty() && !OpenStripes())
+        {
+            m_pWriter.reset();
+            return false;
+        }
+
+        if (!m_pWriter->Begin(m_pFormatContext->pb, m_pFormatContext))
+        {
+            g_Log(logLevelError, "MovMuxer :: Error writing file header for %s", m_Path.c_str());
+            m_pWriter.reset();
+            return false;
+        }
+    }
+
+    // fragments are cut by hand so their length follows the frame count rather than the keyframes
+    AVDictionary* pOptions = NULL;
+    if (m_FramesPerFragment > 0)
+    {
+        av_dict_set(&pOptions, "movflags", "empty_moov+frag_custom", 0);
+    }
+
+    const int ret = m_pWriter ? 0 : avformat_write_header(m_pFormatContext, &pOptions);
+    av_dict_free(&pOptions);
+    if (ret < 0)
+    {
+        char errBuf[AV_ERROR_MAX_STRING_SIZE];
+        g_Log(logLevelError, "MovMuxer :: Error writing file header: %s", s_ErrorString(ret, errBuf, sizeof(errBuf)));
+        return false;
+    }
+
+    m_HeaderWritten = true;
+    m_NumFragmentFrames = 0;
+
+    // with several video streams the first one sets the fragment length
+    m_FragmentStreamIdx = -1;
+    for (unsigned i = 0; (i < m_pFormatContext->nb_streams) && (m_FragmentStreamIdx < 0); ++i)
+    {
+        if (m_pFormatContext->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            m_FragmentStreamIdx = i;
+        }
+    }
+
+    // readers of a fragmented movie need the moov on disk before the first fragment
+    if ((m_FramesPerFragment > 0) && !m_pOutput->Flush())
+    {
+        g_Log(logLevelError, "MovMuxer :: Error writing file header to %s", m_Path.c_str());
+        return false;
+    }
+
+    if (!m_StripePaths.empty() && m_StripeOutputs.empty())
+    {
+        g_Log(logLevelWarn, "MovMuxer :: Striping needs MovWriter, writing %s as a single file", m_Path.c_str());
+    }
+
+    if (!m_JournalPath.empty() && (m_FramesPerFragment > 0))
+    {
+        // fragment data is held back by the muxer, offsets taken after each packet would be wrong
+        g_Log(logLevelWarn, "MovMuxer :: No write journal for fragmented output %s", m_Path.c_str());
+    }
+    else if (!m_JournalPath.empty() && !m_StripeOutputs.empty())
+    {
+        // the journal only follows the movie file, the samples are elsewhere
+        g_Log(logLevelWarn, "MovMuxer :: No write journal for striped output %s", m_Path.c_str());
+    }
+    else if (!m_JournalPath.empty())
+    {
+        m_pJournal.reset(new MovJournalWriter());
+        if (!m_pJournal->Open(m_JournalPath, m_pFormatContext))
+        {
+            m_pJournal.reset();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MovMuxer::WritePacket(AVPacket* p_pPacket)
+{
+    if (!m_HeaderWritten)
+    {
+        return false;
+    }
+
+    // the muxer may adjust the packet, keep what the journal needs
+    const int streamIdx = p_pPacket->stream_index;
+    const int64_t size = p_pPacket->size;
+    const int64_t pts = p_pPacket->pts;
+    const int64_t dts = p_pPacket->dts;
+    const int64_t duration = p_pPacket->duration;
+    const int flags = p_pPacket->flags;
+
+    if (m_pWriter && !m_pWriter->WritePacket(p_pPacket))
+    {
+        g_Log(logLevelError, "MovMuxer :: Error writing packet to %s", m_Path.c_str());
+        return false;
+    }
+
+    const int ret = m_pWriter ? 0 : av_write_frame(m_pFormatContext, p_pPacket);
+    if (ret < 0)
+    {
+        char errBuf[AV_ERROR_MAX_STRING_SIZE];
+        g_Log(logLevelError, "MovMuxer :: Error writing packet: %s", s_ErrorString(ret, errBuf, sizeof(errBuf)));
+        return false;
+    }
+
+    if ((m_FramesPerFragment > 0) && (streamIdx == m_FragmentStreamIdx) && (++m_NumFragmentFrames >= m_FramesPerFragment))
+    {
+        // a NULL packet makes the muxer write out the fragment collected so far
+        m_NumFragmentFrames = 0;
+        if ((av_write_frame(m_pFormatContext, NULL) < 0) || !m_pOutput->Flush())
+        {
+            g_Log(logLevelError, "MovMuxer :: Error writing fragment to %s", m_Path.c_str());
+            return false;
+        }
+    }
+
+    if (m_pJournal)
+    {
+        // sample data is the last thing the muxer wrote, push it out before journaling it
+        avio_flush(m_pFormatContext->pb);
+        const int64_t offset = avio_tell(m_pFormatContext->pb) - size;
+
+        const PendingRecord record = { streamIdx, offset, size, pts, dts, duration, flags };
+        m_PendingRecords.push_back(record);
+
+        if (!FlushJournal(m_pOutput->GetCommittedEnd()))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MovMuxer::QueuePacket(const AVPacket* p_pPacket)
+{
+    if (!m_HeaderWritten || (p_pPacket->stream_index < 0) || (static_cast<unsigned>(p_pPacket->stream_index) >= m_pFormatContext->nb_streams))
+    {
+        return false;
+    }
+
+    AVPacket* pPacket = av_packet_alloc();
+    if ((pPacket == NULL) || (av_packet_ref(pPacket, p_pPacket) < 0))
+    {
+        g_Log(logLevelError, "MovMuxer :: Failed to queue packet");
+        av_packet_free(&pPacket);
+        return false;
+    }
+
+    m_Queues.resize(m_pFormatContext->nb_streams);
+    m_Queues[pPacket->stream_index].push_back(pPacket);
+    m_QueuedBytes += pPacket->size;
+
+    const AVRational timeBase = m_pFormatContext->streams[pPacket->stream_index]->time_base;
+    m_NewestQueuedSeconds = std::max(m_NewestQueuedSeconds, pPacket->dts * av_q2d(timeBase));
+
+    return WriteQueued(false);
+}
+
+bool MovMuxer::FlushQueue()
+{
+    return WriteQueued(true);
+}
+
+bool MovMuxer::WriteQueued(bool p_IsFlushing)
+{
+    while (true)
+    {
+        // earliest head of all streams
+        int nextIdx = -1;
+        bool hasEmptyQueue = false;
+        for (size_t i = 0; i < m_Queues.size(); ++i)
+        {
+            if (m_Queues[i].empty())
+            {
+                hasEmptyQueue = true;
+                continue;
+            }
+
+            const AVPacket* pHead = m_Queues[i].front();
+            if ((nextIdx < 0) || (av_compare_ts(pHead->dts, m_pFormatContext->streams[i]->time_base,
+                                                m_Queues[nextIdx].front()->dts, m_pFormatContext->streams[nextIdx]->time_base) < 0))
+            {
+                nextIdx = static_cast<int>(i);
+            }
+        }
+
+        if (nextIdx < 0)
+        {
+            return true;
+        }
+
+        AVPacket* pPacket = m_Queues[nextIdx].front();
+        const double headSeconds = pPacket->dts * av_q2d(m_pFormatContext->streams[nextIdx]->time_base);
+
+        // with a stream still to deliver, the head is only safe to write when the queue has to shrink
+        if (!p_IsFlushing && hasEmptyQueue && (m_QueuedBytes <= s_MaxQueuedBytes) && ((m_NewestQueuedSeconds - headSeconds) <= s_MaxInterleaveSeconds))
+        {
+            return true;
+        }
+
+        m_Queues[nextIdx].pop_front();
+        m_QueuedBytes -= pPacket->size;
+
+        const bool isOk = WritePacket(pPacket);
+        av_packet_free(&pPacket);
+        if (!isOk)
+        {
+            return false;
+        }
+    }
+}
+
+bool MovMuxer::FlushJournal(int64_t p_CommittedEnd)
+{
+    // a record must never point at sample data which is not in the file yet
+    while (!m_PendingRecords.empty() && ((m_PendingRecords.front().offset + m_PendingRecords.front().size) <= p_CommittedEnd))
+    {
+        const PendingRecord& record = m_PendingRecords.front();
+        if (!m_pJournal->Append(record.streamIdx, record.offset, record.size, record.pts, record.dts, record.duration, record.flags))
+        {
+            g_Log(logLevelError, "MovMuxer :: Failed to journal packet at %lld", static_cast<long long>(record.offset));
+            return false;
+        }
+
+        m_PendingRecords.pop_front();
+    }
+
+    return true;
+}
+
+bool MovMuxer::Close()
+{
+    if (m_pFormatContext == NULL)
+    {
+        return false;
+    }
+
+    bool isOk = !m_HeaderWritten || FlushQueue();
+    if (m_HeaderWritten && (m_pWriter ? !m_pWriter->Finish() : (av_write_trailer(m_pFormatContext) < 0)))
+    {
+        g_Log(logLevelError, "MovMuxer :: Error writing trailer for %s", m_Path.c_str());
+        isOk = false;
+    }
+
+    if (!CloseStripes())
+    {
+        isOk = false;
+    }
+
+    // the context belongs to MovOutput, closing waits for every destination to catch up
+    m_pFormatContext->pb = NULL;
+    if (m_pOutput && !m_pOutput->Close())
+    {
+        g_Log(logLevelError, "MovMuxer :: Error closing %s", m_Path.c_str());
+        isOk = false;
+    }
+    else if (m_pJournal)
+    {
+        // everything is on disk now, even if the trailer failed the samples stay recoverable
+        FlushJournal(INT64_MAX);
+    }
+
+    m_pOutput.reset();
+
+    if (m_pJournal)
+    {
+        // only a finalized movie drops its journal
+        m_pJournal->Close(isOk);
+        m_pJournal.reset();
+    }
+
+    Release();
+    return isOk;
+}
+
+bool MovMuxer::OpenStripes()
+{
+    // every data file gets its own writer threads, spreading the bandwidth over the volumes they live on
+    const int64_t expectedSize = m_ExpectedSize / static_cast<int64_t>(m_StripePaths.size());
+
+    std::vector<AVIOContext*> ioContexts;
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < m_StripePaths.size(); ++i)
+    {
+        std::unique_ptr<MovOutput> pOutput(new MovOutput());
+        if (!pOutput->Open(std::vector<std::string>(1, m_StripePaths[i]), expectedSize, m_IsDirectIO))
+        {
+            g_Log(logLevelError, "MovMuxer :: Could not open stripe %s", m_StripePaths[i].c_str());
+            CloseStripes();
+            return false;
+        }
+
+        ioContexts.push_back(pOutput->GetIOContext());
+        urls.push_back("file://" + m_StripePaths[i]);
+        m_StripeOutputs.push_back(std::move(pOutput));
+    }
+
+    m_pWriter->SetDataFiles(ioContexts, urls);
+    return true;
+}
+
+bool MovMuxer::CloseStripes()
+{
+    bool isOk = true;
+    for (size_t i = 0; i < m_StripeOutputs.size(); ++i)
+    {
+        if (!m_StripeOutputs[i]->Close())
+        {
+            g_Log(logLevelError, "MovMuxer :: Error closing stripe %s", m_StripePaths[i].c_str());
+            isOk = false;
+        }
+    }
+
+    m_StripeOutputs.clear();
+    return isOk;
+}
+
+void MovMuxer::Release()
+{
+    if (m_pFormatContext != NULL)
+    {
+        // owned by m_pOutput
+        m_pFormatContext->pb = NULL;
+
+        avformat_free_context(m_pFormatContext);
+        m_pFormatContext = NULL;
+    }
+
+    m_pJournal.reset();
+    m_pWriter.reset();
+    m_StripeOutputs.clear();
+    m_pOutput.reset();
+    m_PendingRecords.clear();
+
+    for (size_t i = 0; i < m_Queues.size(); ++i)
+    {
+        for (size_t j = 0; j < m_Queues[i].size(); ++j)
+        {
+            av_packet_free(&m_Queues[i][j]);
+        }
+    }
+    m_Queues.clear();
+    m_QueuedBytes = 0;
+    m_NewestQueuedSeconds = 0.0;
+
+    m_HeaderWritten = false;
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "wrapper/host_api.h"
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+class MovJournalWriter;
+class MovOutput;
+class MovWriter;
+
+// Thin wrapper around the libavformat QuickTime muxer, shared by MovContainer and the command line tools.
+// Optionally writes through MovWriter instead, which keeps the sample tables out of memory.
+class MovMuxer
+{
+public:
+    MovMuxer();
+    ~MovMuxer();
+
+    // allocates the muxer for p_Path, streams can be added from here on while the file is opened later
+    bool Create(const std::string& p_Path);
+
+    // opens the output, creating the muxer first unless Create was called with the same path
+    bool Open(const std::string& p_Path);
+
+    // same as above, every byte written to p_Path is also written to each of the mirror paths
+    bool Open(const std::string& p_Path, const std::vector<std::string>& p_MirrorPaths);
+
+    // returns the stream index or -1 on failure, must be called after Create or Open and before WriteHeader
+    int AddStream(const AVCodecParameters* p_pCodecPar, AVRational p_TimeBase);
+    int AddStream(const AVCodec* p_pCodec, const AVCodecContext* p_pCodecContext);
+
+    // preallocate p_ExpectedSize bytes (0 for none) and write with direct I/O, must be called before Open
+    void SetOutputHints(int64_t p_ExpectedSize, bool p_IsDirectIO);
+
+    // write the movie with MovWriter (ProRes and LPCM only), must be called before WriteHeader.
+    // p_MoovReserve > 0 reserves that much space in front of the mdat so the moov can go first
+    void EnableNativeWriter(int64_t p_MoovReserve = 0);
+
+    // write a fragmented movie, a moov up front and a moof/mdat pair every p_FramesPerFragment video frames,
+    // so the file can be read while it grows. Not combined with the journal or MovWriter, must be called before WriteHeader
+    void EnableFragments(int p_FramesPerFragment);
+
+    // with the native writer, spread the sample data over p_DataPaths, each sample going to the stripe with the fewest
+    // bytes so far and each stripe written by its own thread, and keep only a reference movie at the output path.
+    // Must be called before WriteHeader
+    void EnableStriping(const std::vector<std::string>& p_DataPaths);
+
+    // keep a write journal next to the output so a crashed render can be recovered, must be called before WriteHeader
+    void EnableJournal(const std::string& p_JournalPath);
+
+    bool WriteHeader();
+    bool WritePacket(AVPacket* p_pPacket);
+
+    // copies the packet into the interleave queue and writes queued packets in dts order across the streams.
+    // A packet waits until every stream has one queued or the queue is over its size or time bound
+    bool QueuePacket(const AVPacket* p_pPacket);
+
+    // writes everything still queued, Close does this too
+    bool FlushQueue();
+
+    bool Close();
+
+    bool IsOpen() const
+    {
+        return (m_pFormatContext != NULL);
+    }
+
+    bool IsOutputOpen() const
+    {
+        return (m_pOutput != nullptr);
+    }
+
+    bool IsHeaderWritten() const
+    {
+        return m_HeaderWritten;
+    }
+
+    // packets and bytes waiting in the interleave queue
+    int GetNumQueuedPackets() const;
+
+    int64_t GetQueuedBytes() const
+    {
+        return m_QueuedBytes;
+    }
+
+    AVStream* GetStream(int p_Idx) const;
+
+    const std::string& GetPath() const
+    {
+        return m_Path;
+    }
+
+private:
+    // disable assignment and copy constructor
+    MovMuxer(const MovMuxer& p_Other);
+    MovMuxer& operator=(const MovMuxer& p_Other);
+
+    void Release();
+    bool FlushJournal(int64_t p_CommittedEnd);
+    bool WriteQueued(bool p_IsFlushing);
+    bool OpenStripes();
+    bool CloseStripes();
+
+private:
+    AVFormatContext* m_pFormatContext;
+    std::string m_Path;
+    bool m_HeaderWritten;
+
+    int64_t m_ExpectedSize;
+    bool m_IsDirectIO;
+
+    std::string m_JournalPath;
+    std::unique_ptr<MovJournalWriter> m_pJournal;
+
+    // writes land asynchronously on the writer threads, so journal records wait for them
+    std::unique_ptr<MovOutput> m_pOutput;
+
+    bool m_IsNativeWriter;
+    int64_t m_MoovReserve;
+    std::unique_ptr<MovWriter> m_pWriter;
+
+    std::vector<std::string> m_StripePaths;
+    std::vector<std::unique_ptr<MovOutput> > m_StripeOutputs;
+
+    int m_FramesPerFragment; // 0 for a regular movie
+    int m_NumFragmentFrames;
+    int m_FragmentStreamIdx; // the video stream whose frames are counted
+
+    struct PendingRecord
+    {
+        int streamIdx;
+        int64_t offset;
+        int64_t size;
+        int64_t pts;
+        int64_t dts;
+        int64_t duration;
+        int flags;
+    };
+    std::deque<PendingRecord> m_PendingRecords;
+
+    std::vector<std::deque<AVPacket*> > m_Queues; // per stream, owned
+    int64_t m_QueuedBytes;
+    double m_NewestQueuedSeconds;
+};
@@ -0,0 +1,702 @@
+#include "mov_output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "pipeline_trace.h"
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+static const int s_IOBufferSize = 256 * 1024;
+static const size_t s_ChunkSize = 8 * 1024 * 1024;
+static const size_t s_ChunkAlignment = 4096;
+static const size_t s_MaxQueuedBytes = 256 * 1024 * 1024;
+#ifdef HAVE_LIBURING
+static const unsigned s_UringDepth = 8;
+#endif
+
+static double s_Seconds(std::chrono::steady_clock::duration p_Duration)
+{
+    return std::chrono::duration<double>(p_Duration).count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// MovOutputBufferPool
+///
+////////////////////////////////////////////////////////////////////////////////
+MovOutputBufferPool::MovOutputBufferPool(size_t p_BufferSize, size_t p_Alignment)
+    : m_BufferSize(p_BufferSize)
+    , m_Alignment(p_Alignment)
+{
+}
+
+MovOutputBufferPool::~MovOutputBufferPool()
+{
+    for (size_t i = 0; i < m_Buffers.size(); ++i)
+    {
+        free(m_Buffers[i]);
+    }
+}
+
+uint8_t* MovOutputBufferPool::Acquire(int* p_pIdx)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (!m_FreeBuffers.empty())
+    {
+        *p_pIdx = m_FreeBuffers.back();
+        m_FreeBuffers.pop_back();
+        return m_Buffers[*p_pIdx];
+    }
+
+    void* pBuf = NULL;
+    if (posix_memalign(&pBuf, m_Alignment, m_BufferSize) != 0)
+    {
+        return NULL;
+    }
+
+    *p_pIdx = static_cast<int>(m_Buffers.size());
+    m_Buffers.push_back(static_cast<uint8_t*>(pBuf));
+    return static_cast<uint8_t*>(pBuf);
+}
+
+void MovOutputBufferPool::Release(int p_Idx)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_FreeBuffers.push_back(p_Idx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// MovOutputDestination
+///
+////////////////////////////////////////////////////////////////////////////////
+MovOutputDestination::MovOutputDestination(const std::string& p_Path, size_t p_MaxQueuedBytes)
+    : m_Path(p_Path)
+    , m_Fd(-1)
+    , m_MaxQueuedBytes(p_MaxQueuedBytes)
+    , m_IsDirectIO(false)
+    , m_IsResizable(false)
+    , m_QueuedBytes(0)
+    , m_IsStopping(false)
+    , m_IsFailed(false)
+    , m_CommittedEnd(0)
+{
+}
+
+MovOutputDestination::~MovOutputDestination()
+{
+    Finish();
+}
+
+bool MovOutputDestination::Open(int64_t p_ExpectedSize, bool p_IsDirectIO)
+{
+    // read access for the read-modify-write of partial blocks
+    int flags = O_RDWR | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+    if (p_IsDirectIO)
+    {
+        m_Fd = open(m_Path.c_str(), flags | O_DIRECT, 0644);
+        if (m_Fd >= 0)
+        {
+            m_IsDirectIO = true;
+            m_IsResizable = true;
+        }
+        else
+        {
+            g_Log(logLevelWarn, "MovOutput :: No direct I/O for %s (%s), writing through the page cache", m_Path.c_str(), strerror(errno));
+        }
+    }
+#endif
+
+    if (m_Fd < 0)
+    {
+        m_Fd = open(m_Path.c_str(), flags, 0644);
+    }
+
+    if (m_Fd < 0)
+    {
+        g_Log(logLevelError, "MovOutput :: Could not open %s: %s", m_Path.c_str(), strerror(errno));
+        return false;
+    }
+
+#ifdef __linux__
+    // one contiguous allocation up front instead of growing the file extent by extent
+    if (p_ExpectedSize > 0)
+    {
+        if (fallocate(m_Fd, 0, 0, p_ExpectedSize) == 0)
+        {
+            m_IsResizable = true;
+            g_Log(logLevelInfo, "MovOutput :: Preallocated %.1f MB for %s", p_ExpectedSize / (1024.0 * 1024.0), m_Path.c_str());
+        }
+        else
+        {
+            g_Log(logLevelWarn, "MovOutput :: Could not preallocate %s: %s", m_Path.c_str(), strerror(errno));
+        }
+    }
+#endif
+
+#ifdef HAVE_LIBURING
+    // several large writes in flight, plain pwrite when the kernel has no io_uring
+    m_pUring.reset(new MovUringWriter());
+    if (!m_pUring->Init(m_Fd, s_UringDepth, s_MaxQueuedBytes / s_ChunkSize + s_UringDepth, s_ChunkSize))
+    {
+        m_pUring.reset();
+    }
+#endif
+
+    const uint64_t traceOwnerId = PipelineTrace::s_GetThreadOwner();
+    m_Thread = std::thread([this, traceOwnerId] {
+        PipelineTrace::s_SetThreadOwner(traceOwnerId);
+        ThreadProc();
+    });
+    return true;
+}
+
+bool MovOutputDestination::Push(const std::shared_ptr<MovOutputChunk>& p_pChunk)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    // a slow volume is allowed to fall behind by the queue bound before the muxer has to wait for it
+    m_SpaceCond.wait(lock, [this] { return m_IsFailed.load() || m_Queue.empty() || (m_QueuedBytes < m_MaxQueuedBytes); });
+    if (m_IsFailed.load())
+    {
+        return false;
+    }
+
+    m_Queue.push_back(p_pChunk);
+    m_QueuedBytes += p_pChunk->size;
+    m_Stats.maxQueuedBytes = std::max<int64_t>(m_Stats.maxQueuedBytes, m_QueuedBytes);
+    m_Stats.maxQueuedChunks = std::max<int64_t>(m_Stats.maxQueuedChunks, m_Queue.size());
+
+    m_QueueCond.notify_one();
+    return true;
+}
+
+bool MovOutputDestination::Finish(int64_t p_FinalSize)
+{
+    if (m_Thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_IsStopping = true;
+        }
+
+        m_QueueCond.notify_one();
+        m_Thread.join();
+    }
+
+    if (m_Fd >= 0)
+    {
+        if (m_IsResizable && (p_FinalSize >= 0) && (ftruncate(m_Fd, p_FinalSize) != 0))
+        {
+            g_Log(logLevelError, "MovOutput :: Failed to truncate %s: %s", m_Path.c_str(), strerror(errno));
+            m_IsFailed = true;
+        }
+
+        if (close(m_Fd) != 0)
+        {
+            g_Log(logLevelError, "MovOutput :: Failed to close %s: %s", m_Path.c_str(), strerror(errno));
+            m_IsFailed = true;
+        }
+
+        m_Fd = -1;
+    }
+
+    return !m_IsFailed.load();
+}
+
+MovOutputStats MovOutputDestination::GetStats()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Stats;
+}
+
+bool MovOutputDestination::IsAligned(const MovOutputChunk& p_Chunk) const
+{
+    return (((p_Chunk.offset % s_ChunkAlignment) == 0) && ((p_Chunk.size % s_ChunkAlignment) == 0) &&
+            ((reinterpret_cast<uintptr_t>(p_Chunk.pData) % s_ChunkAlignment) == 0));
+}
+
+bool MovOutputDestination::WriteUnaligned(const MovOutputChunk& p_Chunk)
+{
+    // direct I/O only takes whole blocks, so the chunk is widened to block boundaries in a bounce buffer
+    // and the partial blocks at both ends are filled with what the file already holds there
+    const int64_t start = p_Chunk.offset - (p_Chunk.offset % s_ChunkAlignment);
+    const int64_t end = ((p_Chunk.offset + p_Chunk.size + s_ChunkAlignment - 1) / s_ChunkAlignment) * s_ChunkAlignment;
+    const size_t size = end - start;
+
+    void* pBounce = NULL;
+    if (posix_memalign(&pBounce, s_ChunkAlignment, size) != 0)
+    {
+        g_Log(logLevelError, "MovOutput :: Out of memory writing %s", m_Path.c_str());
+        return false;
+    }
+
+    uint8_t* pBuf = static_cast<uint8_t*>(pBounce);
+    memset(pBuf, 0, size);
+
+    bool isOk = true;
+    const int64_t blockOffsets[2] = { start, end - static_cast<int64_t>(s_ChunkAlignment) };
+    for (int i = 0; (i < 2) && isOk; ++i)
+    {
+        if ((i == 1) && (blockOffsets[1] == blockOffsets[0]))
+        {
+            break;
+        }
+
+        // reads past the end of the file come back short, the rest stays zero
+        if (pread(m_Fd, pBuf + (blockOffsets[i] - start), s_ChunkAlignment, blockOffsets[i]) < 0)
+        {
+            g_Log(logLevelError, "MovOutput :: Read back of %s failed: %s", m_Path.c_str(), strerror(errno));
+            isOk = false;
+        }
+    }
+
+    if (isOk)
+    {
+        memcpy(pBuf + (p_Chunk.offset - start), p_Chunk.pData, p_Chunk.size);
+
+        MovOutputChunk bounce = p_Chunk;
+        bounce.offset = start;
+        bounce.pData = pBuf;
+        bounce.size = size;
+        isOk = WriteChunk(bounce);
+    }
+
+    free(pBounce);
+    return isOk;
+}
+
+bool MovOutputDestination::WriteChunk(const MovOutputChunk& p_Chunk)
+{
+    if (m_IsDirectIO && !IsAligned(p_Chunk))
+    {
+        return WriteUnaligned(p_Chunk);
+    }
+
+    const uint8_t* pData = p_Chunk.pData;
+    size_t bytesLeft = p_Chunk.size;
+    int64_t offset = p_Chunk.offset;
+
+    while (bytesLeft > 0)
+    {
+        const ssize_t written = pwrite(m_Fd, pData, bytesLeft, offset);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            g_Log(logLevelError, "MovOutput :: Write to %s failed: %s", m_Path.c_str(), strerror(errno));
+            return false;
+        }
+
+        pData += written;
+        offset += written;
+        bytesLeft -= written;
+    }
+
+    return true;
+}
+
+void MovOutputDestination::Retire(const MovOutputChunk& p_Chunk, std::chrono::steady_clock::time_point p_StartedAt, bool p_IsOk)
+{
+    const std::chrono::steady_clock::time_point endedAt = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_QueuedBytes -= p_Chunk.size;
+
+        if (p_IsOk)
+        {
+            const double writeSeconds = s_Seconds(endedAt - p_StartedAt);
+            m_Stats.bytesWritten += p_Chunk.size;
+            ++m_Stats.numWrites;
+            m_Stats.writeSeconds += writeSeconds;
+            m_Stats.maxWriteSeconds = std::max(m_Stats.maxWriteSeconds, writeSeconds);
+            m_Stats.maxLagSeconds = std::max(m_Stats.maxLagSeconds, s_Seconds(p_StartedAt - p_Chunk.queuedAt));
+
+            const int64_t chunkEnd = p_Chunk.offset + p_Chunk.size;
+            if (chunkEnd > m_CommittedEnd.load())
+            {
+                m_CommittedEnd = chunkEnd;
+            }
+        }
+        else
+        {
+            m_IsFailed = true;
+        }
+    }
+
+    m_SpaceCond.notify_all();
+}
+
+void MovOutputDestination::ThreadProc()
+{
+    PipelineTrace::s_SetThreadName("mov_output");
+
+#ifdef HAVE_LIBURING
+    if (m_pUring)
+    {
+        UringThreadProc();
+        return;
+    }
+#endif
+
+    while (true)
+    {
+        std::shared_ptr<MovOutputChunk> pChunk;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_QueueCond.wait(lock, [this] { return m_IsStopping || !m_Queue.empty(); });
+            if (m_Queue.empty())
+            {
+                break;
+            }
+
+            pChunk = m_Queue.front();
+            m_Queue.pop_front();
+        }
+
+        TraceSpan span("write", "output");
+        const std::chrono::steady_clock::time_point startedAt = std::chrono::steady_clock::now();
+        Retire(*pChunk, startedAt, !m_IsFailed.load() && WriteChunk(*pChunk));
+    }
+}
+
+#ifdef HAVE_LIBURING
+void MovOutputDestination::UringThreadProc()
+{
+    struct InFlightWrite
+    {
+        std::shared_ptr<MovOutputChunk> pChunk;
+        std::chrono::steady_clock::time_point startedAt;
+        bool isDone;
+        bool isOk;
+    };
+
+    // in submission order, retired from the front so the committed end only ever covers completed writes
+    std::deque<InFlightWrite> inFlight;
+    int64_t nextOffset = 0;
+
+    while (true)
+    {
+        std::shared_ptr<MovOutputChunk> pChunk;
+        bool isDrained = false;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            if (inFlight.empty())
+            {
+                m_QueueCond.wait(lock, [this] { return m_IsStopping || !m_Queue.empty(); });
+                isDrained = m_Queue.empty();
+            }
+
+            // a seek back may overlap data still in flight, it waits until everything before it completed, so does
+            // a direct I/O chunk which needs the read-modify-write of a partial block
+            if (!m_Queue.empty() && (inFlight.size() < m_pUring->GetDepth()) &&
+                (inFlight.empty() || ((m_Queue.front()->offset == nextOffset) && (!m_IsDirectIO || IsAligned(*m_Queue.front())))))
+            {
+                pChunk = m_Queue.front();
+                m_Queue.pop_front();
+            }
+        }
+
+        if (isDrained)
+        {
+            break;
+        }
+
+        if (pChunk)
+        {
+            InFlightWrite write = { pChunk, std::chrono::steady_clock::now(), false, false };
+            inFlight.push_back(write);
+            nextOffset = pChunk->offset + pChunk->size;
+
+            if (m_IsDirectIO && !IsAligned(*pChunk))
+            {
+                // nothing else is in flight at this point
+                inFlight.back().isDone = true;
+                inFlight.back().isOk = !m_IsFailed.load() && WriteChunk(*pChunk);
+            }
+            else if (m_IsFailed.load() || !m_pUring->Submit(pChunk->pData, pChunk->size, pChunk->offset, pChunk->bufferIdx, &inFlight.back()))
+            {
+                inFlight.back().isDone = true;
+            }
+        }
+
+        // block for a completion only when nothing else can be submitted
+        bool isWaiting = !pChunk && (m_pUring->GetNumInFlight() > 0);
+        void* pUserData = NULL;
+        int result = 0;
+        while (m_pUring->Reap(isWaiting, &pUserData, &result))
+        {
+            isWaiting = false;
+
+            InFlightWrite* pWrite = static_cast<InFlightWrite*>(pUserData);
+            pWrite->isDone = true;
+            if (result < 0)
+            {
+                g_Log(logLevelError, "MovOutput :: Write to %s failed: %s", m_Path.c_str(), strerror(-result));
+            }
+            else if (static_cast<size_t>(result) < pWrite->pChunk->size)
+            {
+                // short write, the rest goes out synchronously
+                MovOutputChunk rest = *pWrite->pChunk;
+                rest.pData += result;
+                rest.offset += result;
+                rest.size -= result;
+                pWrite->isOk = WriteChunk(rest);
+            }
+            else
+            {
+                pWrite->isOk = true;
+            }
+        }
+
+        while (!inFlight.empty() && inFlight.front().isDone)
+        {
+            Retire(*inFlight.front().pChunk, inFlight.front().startedAt, inFlight.front().isOk);
+            inFlight.pop_front();
+        }
+    }
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// MovOutput
+///
+////////////////////////////////////////////////////////////////////////////////
+MovOutput::MovOutput()
+    : m_Pool(s_ChunkSize, s_ChunkAlignment)
+    , m_pIOContext(NULL)
+    , m_Pos(0)
+    , m_Size(0)
+{
+}
+
+MovOutput::~MovOutput()
+{
+    Close();
+}
+
+bool MovOutput::Open(const std::vector<std::string>& p_Paths, int64_t p_ExpectedSize, bool p_IsDirectIO)
+{
+    Close();
+
+    for (size_t i = 0; i < p_Paths.size(); ++i)
+    {
+        std::unique_ptr<MovOutputDestination> pDest(new MovOutputDestination(p_Paths[i], s_MaxQueuedBytes));
+        if (!pDest->Open(p_ExpectedSize, p_IsDirectIO))
+        {
+            // only the primary output is mandatory
+            if (i == 0)
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        m_Destinations.push_back(std::move(pDest));
+    }
+
+    uint8_t* pBuf = static_cast<uint8_t*>(av_malloc(s_IOBufferSize));
+    if (pBuf == NULL)
+    {
+        return false;
+    }
+
+    m_pIOContext = avio_alloc_context(pBuf, s_IOBufferSize, 1, this, NULL, s_WritePacket, s_Seek);
+    if (m_pIOContext == NULL)
+    {
+        av_free(pBuf);
+        return false;
+    }
+
+    m_Pos = 0;
+    m_Size = 0;
+    m_OpenedAt = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool MovOutput::Close()
+{
+    bool isOk = true;
+    if (m_pIOContext != NULL)
+    {
+        avio_flush(m_pIOContext);
+        isOk = Submit();
+
+        av_freep(&m_pIOContext->buffer);
+        avio_context_free(&m_pIOContext);
+    }
+
+    if (m_Destinations.empty())
+    {
+        return isOk;
+    }
+
+    for (size_t i = 0; i < m_Destinations.size(); ++i)
+    {
+        if (!m_Destinations[i]->Finish(m_Size) && (i == 0))
+        {
+            isOk = false;
+        }
+    }
+
+    LogStats();
+    m_Destinations.clear();
+    return isOk;
+}
+
+int64_t MovOutput::GetCommittedEnd() const
+{
+    return m_Destinations.empty() ? 0 : m_Destinations[0]->GetCommittedEnd();
+}
+
+int MovOutput::s_WritePacket(void* p_pOpaque, uint8_t* p_pBuf, int p_BufSize)
+{
+    return static_cast<MovOutput*>(p_pOpaque)->Write(p_pBuf, p_BufSize);
+}
+
+int64_t MovOutput::s_Seek(void* p_pOpaque, int64_t p_Offset, int p_Whence)
+{
+    MovOutput* pOutput = static_cast<MovOutput*>(p_pOpaque);
+    switch (p_Whence & ~AVSEEK_FORCE)
+    {
+        case AVSEEK_SIZE:
+            return pOutput->m_Size;
+        case SEEK_SET:
+            pOutput->m_Pos = p_Offset;
+            break;
+        case SEEK_CUR:
+            pOutput->m_Pos += p_Offset;
+            break;
+        case SEEK_END:
+            pOutput->m_Pos = pOutput->m_Size + p_Offset;
+            break;
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    return pOutput->m_Pos;
+}
+
+int MovOutput::Write(const uint8_t* p_pBuf, int p_BufSize)
+{
+    int bytesLeft = p_BufSize;
+    while (bytesLeft > 0)
+    {
+        // only sequential data is combined, a seek back (size patches) starts a new chunk
+        if (m_pChunk && ((m_pChunk->offset + static_cast<int64_t>(m_pChunk->size) != m_Pos) || (m_pChunk->size == m_Pool.GetBufferSize())))
+        {
+            if (!Submit())
+            {
+                return AVERROR(EIO);
+            }
+        }
+
+        if (!m_pChunk)
+        {
+            int bufferIdx = -1;
+            uint8_t* pData = m_Pool.Acquire(&bufferIdx);
+            if (pData == NULL)
+            {
+                return AVERROR(ENOMEM);
+            }
+
+            MovOutputBufferPool* pPool = &m_Pool;
+            m_pChunk.reset(new MovOutputChunk(), [pPool](MovOutputChunk* p_pChunk)
+            {
+                pPool->Release(p_pChunk->bufferIdx);
+                delete p_pChunk;
+            });
+
+            m_pChunk->offset = m_Pos;
+            m_pChunk->pData = pData;
+            m_pChunk->bufferIdx = bufferIdx;
+            m_pChunk->size = 0;
+        }
+
+        const size_t bytesToCopy = std::min(m_Pool.GetBufferSize() - m_pChunk->size, static_cast<size_t>(bytesLeft));
+        memcpy(m_pChunk->pData + m_pChunk->size, p_pBuf, bytesToCopy);
+        m_pChunk->size += bytesToCopy;
+
+        p_pBuf += bytesToCopy;
+        bytesLeft -= bytesToCopy;
+        m_Pos += bytesToCopy;
+    }
+
+    if (m_Pos > m_Size)
+    {
+        m_Size = m_Pos;
+    }
+
+    return p_BufSize;
+}
+
+bool MovOutput::Flush()
+{
+    avio_flush(m_pIOContext);
+    return (m_pIOContext->error == 0) && Submit();
+}
+
+bool MovOutput::Submit()
+{
+    if (!m_pChunk)
+    {
+        return true;
+    }
+
+    std::shared_ptr<MovOutputChunk> pChunk;
+    pChunk.swap(m_pChunk);
+    pChunk->queuedAt = std::chrono::steady_clock::now();
+
+    // the same chunk is shared by all destinations
+    for (size_t i = 0; i < m_Destinations.size(); ++i)
+    {
+        if (!m_Destinations[i]->Push(pChunk))
+        {
+            if (i == 0)
+            {
+                return false;
+            }
+
+            g_Log(logLevelError, "MovOutput :: Mirror %s failed, dropping it", m_Destinations[i]->GetPath().c_str());
+            m_Destinations[i]->Finish();
+            m_Destinations.erase(m_Destinations.begin() + i);
+            --i;
+        }
+    }
+
+    return true;
+}
+
+void MovOutput::LogStats()
+{
+    const double wallSeconds = s_Seconds(std::chrono::steady_clock::now() - m_OpenedAt);
+    for (size_t i = 0; i < m_Destinations.size(); ++i)
+    {
+        const MovOutputStats stats = m_Destinations[i]->GetStats();
+        const double mbytes = stats.bytesWritten / (1024.0 * 1024.0);
+        const double avgWriteMs = (stats.numWrites > 0) ? (1000.0 * stats.writeSeconds / stats.numWrites) : 0.0;
+        g_Log(logLevelInfo, "MovOutput :: %s: %.1f MB in %lld writes, %.1f MB/s writing, %.1f MB/s overall, write latency avg %.2f ms max %.2f ms, "
+              "max queue depth %lld (%.1f MB), max lag %.3f s",
+              m_Destinations[i]->GetPath().c_str(), mbytes, static_cast<long long>(stats.numWrites),
+              (stats.writeSeconds > 0.0) ? (mbytes / stats.writeSeconds) : 0.0, (wallSeconds > 0.0) ? (mbytes / wallSeconds) : 0.0,
+              avgWriteMs, 1000.0 * stats.maxWriteSeconds, static_cast<long long>(stats.maxQueuedChunks), stats.maxQueuedBytes / (1024.0 * 1024.0),
+              stats.maxLagSeconds);
+    }
+
+    g_Log(logLevelInfo, "MovOutput :: %d chunk buffers of %d MB allocated", static_cast<int>(m_Pool.GetNumAllocated()),
+          static_cast<int>(m_Pool.GetBufferSize() / (1024 * 1024)));
+}
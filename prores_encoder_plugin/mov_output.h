@@ -0,0 +1,193 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wrapper/host_api.h"
+#include "mov_output_uring.h"
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// Muxer output routed through a custom AVIOContext. Sequential writes of the muxer are combined into large
+// aligned chunks which are written by one thread per destination, so the muxer never waits on the disk
+// directly and a movie can be mirrored to several volumes at once.
+
+struct MovOutputChunk
+{
+    int64_t offset;
+    uint8_t* pData; // aligned, MovOutputBufferPool::GetBufferSize() bytes
+    int bufferIdx;  // index in the pool, stable for the lifetime of the pool
+    size_t size;
+    std::chrono::steady_clock::time_point queuedAt;
+};
+
+// recycles the aligned chunk buffers, in steady state a single destination only needs two of them
+class MovOutputBufferPool
+{
+public:
+    MovOutputBufferPool(size_t p_BufferSize, size_t p_Alignment);
+    ~MovOutputBufferPool();
+
+    // returns NULL when out of memory
+    uint8_t* Acquire(int* p_pIdx);
+    void Release(int p_Idx);
+
+    size_t GetBufferSize() const
+    {
+        return m_BufferSize;
+    }
+
+    size_t GetNumAllocated()
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        return m_Buffers.size();
+    }
+
+private:
+    // disable assignment and copy constructor
+    MovOutputBufferPool(const MovOutputBufferPool& p_Other);
+    MovOutputBufferPool& operator=(const MovOutputBufferPool& p_Other);
+
+private:
+    size_t m_BufferSize;
+    size_t m_Alignment;
+    std::mutex m_Mutex;
+    std::vector<uint8_t*> m_Buffers;
+    std::vector<int> m_FreeBuffers;
+};
+
+struct MovOutputStats
+{
+    int64_t bytesWritten = 0;
+    int64_t numWrites = 0;
+    double writeSeconds = 0.0; // time spent inside write calls
+    double maxWriteSeconds = 0.0;
+    int64_t maxQueuedBytes = 0;
+    int64_t maxQueuedChunks = 0;
+    double maxLagSeconds = 0.0; // longest a chunk waited in the queue before being written
+};
+
+class MovOutputDestination
+{
+public:
+    MovOutputDestination(const std::string& p_Path, size_t p_MaxQueuedBytes);
+    ~MovOutputDestination();
+
+    // p_ExpectedSize > 0 preallocates the file, p_IsDirectIO bypasses the page cache where the file system allows it
+    bool Open(int64_t p_ExpectedSize, bool p_IsDirectIO);
+
+    // blocks while the queue is over its bound, returns false once the destination failed
+    bool Push(const std::shared_ptr<MovOutputChunk>& p_pChunk);
+
+    // writes whatever is queued, stops the thread and closes the file, which is cut to p_FinalSize when given
+    bool Finish(int64_t p_FinalSize = -1);
+
+    // end of the last chunk written to the file, the muxer writes sequentially apart from header patches
+    int64_t GetCommittedEnd() const
+    {
+        return m_CommittedEnd.load();
+    }
+
+    bool IsFailed() const
+    {
+        return m_IsFailed.load();
+    }
+
+    const std::string& GetPath() const
+    {
+        return m_Path;
+    }
+
+    MovOutputStats GetStats();
+
+private:
+    void ThreadProc();
+    bool WriteChunk(const MovOutputChunk& p_Chunk);
+    bool WriteUnaligned(const MovOutputChunk& p_Chunk);
+    bool IsAligned(const MovOutputChunk& p_Chunk) const;
+
+    // accounts a chunk which left the queue, successfully written or not
+    void Retire(const MovOutputChunk& p_Chunk, std::chrono::steady_clock::time_point p_StartedAt, bool p_IsOk);
+
+#ifdef HAVE_LIBURING
+    void UringThreadProc();
+#endif
+
+private:
+    std::string m_Path;
+    int m_Fd;
+    size_t m_MaxQueuedBytes;
+    bool m_IsDirectIO;   // O_DIRECT, every write has to be block aligned
+    bool m_IsResizable;  // preallocated or padded by direct writes, cut to size when finished
+
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_QueueCond;
+    std::condition_variable m_SpaceCond;
+    std::deque<std::shared_ptr<MovOutputChunk> > m_Queue;
+    size_t m_QueuedBytes;
+    bool m_IsStopping;
+
+    std::atomic<bool> m_IsFailed;
+    std::atomic<int64_t> m_CommittedEnd;
+    MovOutputStats m_Stats;
+
+#ifdef HAVE_LIBURING
+    std::unique_ptr<MovUringWriter> m_pUring; // NULL when io_uring is not available
+#endif
+};
+
+class MovOutput
+{
+public:
+    MovOutput();
+    ~MovOutput();
+
+    // the first path is the primary output, the others are mirrors, see MovOutputDestination::Open for the rest
+    bool Open(const std::vector<std::string>& p_Paths, int64_t p_ExpectedSize = 0, bool p_IsDirectIO = false);
+    bool Close();
+
+    // hands everything written so far to the destinations without waiting for the chunk to fill up
+    bool Flush();
+
+    AVIOContext* GetIOContext() const
+    {
+        return m_pIOContext;
+    }
+
+    // bytes of the primary output known to be handed to the OS, data still being combined is not included
+    int64_t GetCommittedEnd() const;
+
+private:
+    // disable assignment and copy constructor
+    MovOutput(const MovOutput& p_Other);
+    MovOutput& operator=(const MovOutput& p_Other);
+
+    static int s_WritePacket(void* p_pOpaque, uint8_t* p_pBuf, int p_BufSize);
+    static int64_t s_Seek(void* p_pOpaque, int64_t p_Offset, int p_Whence);
+
+    int Write(const uint8_t* p_pBuf, int p_BufSize);
+
+    // hands the chunk being combined to the destinations
+    bool Submit();
+    void LogStats();
+
+private:
+    MovOutputBufferPool m_Pool;
+    AVIOContext* m_pIOContext;
+    std::vector<std::unique_ptr<MovOutputDestination> > m_Destinations;
+    std::shared_ptr<MovOutputChunk> m_pChunk; // being combined, not queued yet
+    int64_t m_Pos;
+    int64_t m_Size;
+    std::chrono::steady_clock::time_point m_OpenedAt;
+};
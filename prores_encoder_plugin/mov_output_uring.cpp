@@ -0,0 +1,140 @@
+#include "mov_output_uring.h"
+
+#ifdef HAVE_LIBURING
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "wrapper/host_api.h"
+
+MovUringWriter::MovUringWriter()
+    : m_IsInitialized(false)
+    , m_Fd(-1)
+    , m_Depth(0)
+    , m_NumInFlight(0)
+    , m_BufferSize(0)
+{
+    memset(&m_Ring, 0, sizeof(m_Ring));
+}
+
+MovUringWriter::~MovUringWriter()
+{
+    if (!m_IsInitialized)
+    {
+        return;
+    }
+
+    // the kernel may still access the buffers, wait for them before tearing the ring down
+    void* pUserData = NULL;
+    int result = 0;
+    while ((m_NumInFlight > 0) && Reap(true, &pUserData, &result))
+    {
+    }
+
+    io_uring_queue_exit(&m_Ring);
+}
+
+bool MovUringWriter::Init(int p_Fd, unsigned p_Depth, unsigned p_NumBufferSlots, size_t p_BufferSize)
+{
+    const int ret = io_uring_queue_init(p_Depth, &m_Ring, 0);
+    if (ret < 0)
+    {
+        g_Log(logLevelWarn, "MovOutput :: io_uring not available (%s), using pwrite", strerror(-ret));
+        return false;
+    }
+
+    m_IsInitialized = true;
+    m_Fd = p_Fd;
+    m_Depth = p_Depth;
+    m_BufferSize = p_BufferSize;
+
+    if (io_uring_register_buffers_sparse(&m_Ring, p_NumBufferSlots) == 0)
+    {
+        m_BufferStates.assign(p_NumBufferSlots, bufferUnknown);
+    }
+
+    return true;
+}
+
+bool MovUringWriter::RegisterBuffer(const uint8_t* p_pData, int p_BufferIdx)
+{
+    if ((p_BufferIdx < 0) || (static_cast<size_t>(p_BufferIdx) >= m_BufferStates.size()))
+    {
+        return false;
+    }
+
+    uint8_t& state = m_BufferStates[p_BufferIdx];
+    if (state == bufferUnknown)
+    {
+        // pool buffers are never freed while the ring exists, so registering the whole allocation once is enough
+        struct iovec iov;
+        iov.iov_base = const_cast<uint8_t*>(p_pData);
+        iov.iov_len = m_BufferSize;
+        state = (io_uring_register_buffers_update_tag(&m_Ring, p_BufferIdx, &iov, NULL, 1) >= 0) ? bufferRegistered : bufferUnregistrable;
+    }
+
+    return (state == bufferRegistered);
+}
+
+bool MovUringWriter::Submit(const uint8_t* p_pData, size_t p_Size, int64_t p_Offset, int p_BufferIdx, void* p_pUserData)
+{
+    struct io_uring_sqe* pSqe = io_uring_get_sqe(&m_Ring);
+    if (pSqe == NULL)
+    {
+        g_Log(logLevelError, "MovOutput :: io_uring submission queue full");
+        return false;
+    }
+
+    // a chunk always starts at the beginning of its pool buffer, which is the registered range
+    if (RegisterBuffer(p_pData, p_BufferIdx))
+    {
+        io_uring_prep_write_fixed(pSqe, m_Fd, p_pData, p_Size, p_Offset, p_BufferIdx);
+    }
+    else
+    {
+        io_uring_prep_write(pSqe, m_Fd, p_pData, p_Size, p_Offset);
+    }
+
+    io_uring_sqe_set_data(pSqe, p_pUserData);
+
+    const int ret = io_uring_submit(&m_Ring);
+    if (ret < 0)
+    {
+        g_Log(logLevelError, "MovOutput :: io_uring submit failed: %s", strerror(-ret));
+        return false;
+    }
+
+    ++m_NumInFlight;
+    return true;
+}
+
+bool MovUringWriter::Reap(bool p_IsWaiting, void** p_ppUserData, int* p_pResult)
+{
+    if (m_NumInFlight == 0)
+    {
+        return false;
+    }
+
+    struct io_uring_cqe* pCqe = NULL;
+    int ret = 0;
+    do
+    {
+        ret = p_IsWaiting ? io_uring_wait_cqe(&m_Ring, &pCqe) : io_uring_peek_cqe(&m_Ring, &pCqe);
+    }
+    while (ret == -EINTR);
+
+    if ((ret < 0) || (pCqe == NULL))
+    {
+        return false;
+    }
+
+    *p_ppUserData = io_uring_cqe_get_data(pCqe);
+    *p_pResult = pCqe->res;
+    io_uring_cqe_seen(&m_Ring, pCqe);
+
+    --m_NumInFlight;
+    return true;
+}
+
+#endif
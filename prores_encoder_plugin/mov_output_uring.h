@@ -0,0 +1,65 @@
+#pragma once
+
+// optional io_uring backend of MovOutputDestination, built with URING=1
+#ifdef HAVE_LIBURING
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include <liburing.h>
+
+// Keeps several writes of one file in flight. Pool buffers are registered with the ring the first time they
+// are written so later writes of the same buffer skip the page pinning, plain writes are used when the
+// kernel refuses the registration (e.g. over RLIMIT_MEMLOCK).
+class MovUringWriter
+{
+public:
+    MovUringWriter();
+    ~MovUringWriter();
+
+    // p_BufferSize is the size of every pool buffer
+    bool Init(int p_Fd, unsigned p_Depth, unsigned p_NumBufferSlots, size_t p_BufferSize);
+
+    // the buffer must stay valid until the write is reaped, p_BufferIdx is the pool index or -1
+    bool Submit(const uint8_t* p_pData, size_t p_Size, int64_t p_Offset, int p_BufferIdx, void* p_pUserData);
+
+    // returns false when no completion is available, p_IsWaiting blocks until one is
+    bool Reap(bool p_IsWaiting, void** p_ppUserData, int* p_pResult);
+
+    unsigned GetDepth() const
+    {
+        return m_Depth;
+    }
+
+    unsigned GetNumInFlight() const
+    {
+        return m_NumInFlight;
+    }
+
+private:
+    // disable assignment and copy constructor
+    MovUringWriter(const MovUringWriter& p_Other);
+    MovUringWriter& operator=(const MovUringWriter& p_Other);
+
+    bool RegisterBuffer(const uint8_t* p_pData, int p_BufferIdx);
+
+private:
+    struct io_uring m_Ring;
+    bool m_IsInitialized;
+    int m_Fd;
+    unsigned m_Depth;
+    unsigned m_NumInFlight;
+    size_t m_BufferSize;
+
+    enum BufferState
+    {
+        bufferUnknown = 0,
+        bufferRegistered,
+        bufferUnregistrable
+    };
+    std::vector<uint8_t> m_BufferStates; // per pool slot, empty without a sparse buffer table
+};
+
+#endif
@@ -0,0 +1,931 @@
+#include "mov_writer.h"
+
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+extern "C" {
+#include <libavutil/intfloat.h>
+}
+
+static const uint32_t s_MovieTimescale = 1000;
+static const uint32_t s_MacEpochOffset = 2082844800; // 1904 to 1970
+static const int s_SpoolBatch = 4096;
+
+// moov space reserved per sample. A video frame has its stsz and co64 entry and an stts entry when rounding makes
+// the durations alternate, an stsc entry when striping switches its data file. An audio packet is a chunk with its
+// co64 entry and an stsc entry when its frame count differs from the one before
+static const int64_t s_MoovBytesPerVideoFrame = 4 + 8 + 8;
+static const int64_t s_MoovBytesPerAudioPacket = 8 + 12;
+static const int64_t s_MoovBytesPerStripedSample = 12;
+// mvhd and what else is not per track, the atoms of a track, and the url and sample description it adds per data file
+static const int64_t s_MoovFixedSize = 64 * 1024;
+static const int64_t s_MoovBytesPerTrack = 4 * 1024;
+static const int64_t s_MoovBytesPerTrackStripe = 4096 + 256;
+
+static const char* s_VideoHandlerName = "VideoHandler";
+static const char* s_SoundHandlerName = "SoundHandler";
+static const char* s_DataHandlerName = "DataHandler";
+
+// fixed atom sizes including their headers
+static const int64_t s_MvhdSize = 108;
+static const int64_t s_TkhdSize = 92;
+static const int64_t s_EdtsSize = 36;
+static const int64_t s_VmhdSize = 20;
+static const int64_t s_SmhdSize = 16;
+static const int64_t s_VideoEntrySize = 86;
+static const int64_t s_SoundEntryV2Size = 72;
+static const int64_t s_FielSize = 10;
+static const int64_t s_ColrSize = 18;
+static const int64_t s_ChanSize = 24;
+
+static const struct
+{
+    uint32_t fourCC;
+    const char* pName;
+} s_ProResTypes[] = {
+    { MKTAG('a', 'p', 'c', 'o'), "Apple ProRes 422 Proxy" },
+    { MKTAG('a', 'p', 'c', 's'), "Apple ProRes 422 LT" },
+    { MKTAG('a', 'p', 'c', 'n'), "Apple ProRes 422" },
+    { MKTAG('a', 'p', 'c', 'h'), "Apple ProRes 422 HQ" },
+    { MKTAG('a', 'p', '4', 'h'), "Apple ProRes 4444" },
+    { MKTAG('a', 'p', '4', 'x'), "Apple ProRes 4444 XQ" },
+};
+static const int s_NumProResTypes = sizeof(s_ProResTypes) / sizeof(s_ProResTypes[0]);
+
+static const struct
+{
+    AVCodecID codecId;
+    bool isFloat;
+    bool isBigEndian;
+} s_PCMTypes[] = {
+    { AV_CODEC_ID_PCM_S16LE, false, false },
+    { AV_CODEC_ID_PCM_S16BE, false, true },
+    { AV_CODEC_ID_PCM_S24LE, false, false },
+    { AV_CODEC_ID_PCM_S24BE, false, true },
+    { AV_CODEC_ID_PCM_S32LE, false, false },
+    { AV_CODEC_ID_PCM_S32BE, false, true },
+    { AV_CODEC_ID_PCM_F32LE, true, false },
+    { AV_CODEC_ID_PCM_F32BE, true, true },
+};
+static const int s_NumPCMTypes = sizeof(s_PCMTypes) / sizeof(s_PCMTypes[0]);
+
+static int s_FindPCMType(AVCodecID p_CodecId)
+{
+    for (int i = 0; i < s_NumPCMTypes; ++i)
+    {
+        if (s_PCMTypes[i].codecId == p_CodecId)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int64_t s_HdlrSize(const char* p_pName)
+{
+    return 8 + 24 + 1 + strlen(p_pName);
+}
+
+static bool s_HasColr(const AVCodecParameters* p_pPar)
+{
+    return ((p_pPar->color_primaries != AVCOL_PRI_UNSPECIFIED) || (p_pPar->color_trc != AVCOL_TRC_UNSPECIFIED) ||
+            (p_pPar->color_space != AVCOL_SPC_UNSPECIFIED));
+}
+
+// mono tracks split off a multichannel mix carry the speaker they feed
+static bool s_HasChan(const AVCodecParameters* p_pPar)
+{
+    return ((p_pPar->channels == 1) && (p_pPar->channel_layout != 0) && (p_pPar->channel_layout != AV_CH_LAYOUT_MONO));
+}
+
+MovWriter::MovWriter()
+    : m_pIOContext(NULL)
+    , m_IsSpoolFailed(false)
+    , m_ReservedPos(0)
+    , m_ReservedSize(0)
+    , m_WidePos(0)
+    , m_MdatPos(0)
+    , m_CreationTime(0)
+{
+}
+
+MovWriter::~MovWriter()
+{
+    for (size_t i = 0; i < m_Tracks.size(); ++i)
+    {
+        if (m_Tracks[i].pSpool != NULL)
+        {
+            fclose(m_Tracks[i].pSpool);
+        }
+    }
+}
+
+void MovWriter::ReserveMoov(int64_t p_Size)
+{
+    m_ReservedSize = std::min<int64_t>(p_Size, UINT32_MAX);
+}
+
+void MovWriter::SetDataFiles(const std::vector<AVIOContext*>& p_IOContexts, const std::vector<std::string>& p_Urls)
+{
+    m_DataIOContexts = p_IOContexts;
+    m_DataUrls = p_Urls;
+}
+
+int64_t MovWriter::s_EstimateMoovSize(int64_t p_NumVideoFrames, int p_NumVideoStreams, int p_NumAudioStreams, int64_t p_NumAudioPackets, int p_NumStripes)
+{
+    const int64_t stripedBytes = (p_NumStripes > 1) ? s_MoovBytesPerStripedSample : 0;
+    const int64_t videoBytes = p_NumVideoStreams * p_NumVideoFrames * (s_MoovBytesPerVideoFrame + stripedBytes);
+    const int64_t audioBytes = p_NumAudioStreams * p_NumAudioPackets * s_MoovBytesPerAudioPacket;
+    const int64_t trackBytes = (p_NumVideoStreams + p_NumAudioStreams) * (s_MoovBytesPerTrack + p_NumStripes * s_MoovBytesPerTrackStripe);
+    return s_MoovFixedSize + trackBytes + ((videoBytes + audioBytes) * 11) / 10;
+}
+
+bool MovWriter::s_CanWrite(const AVFormatContext* p_pFormatContext)
+{
+    for (unsigned i = 0; i < p_pFormatContext->nb_streams; ++i)
+    {
+        const AVCodecParameters* pPar = p_pFormatContext->streams[i]->codecpar;
+        if ((pPar->codec_id != AV_CODEC_ID_PRORES) && (s_FindPCMType(pPar->codec_id) < 0))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool MovWriter::Begin(AVIOContext* p_pIOContext, const AVFormatContext* p_pFormatContext)
+{
+    m_pIOContext = p_pIOContext;
+    m_Tracks.clear();
+
+    for (unsigned i = 0; i < p_pFormatContext->nb_streams; ++i)
+    {
+        const AVStream* pStream = p_pFormatContext->streams[i];
+        const AVCodecParameters* pPar = pStream->codecpar;
+
+        Track track;
+        memset(&track, 0, sizeof(track));
+        track.pPar = pPar;
+        track.isVideo = (pPar->codec_type == AVMEDIA_TYPE_VIDEO);
+        track.trackId = i + 1;
+
+        if (track.isVideo)
+        {
+            if ((pPar->codec_id != AV_CODEC_ID_PRORES) || (pPar->profile < 0) || (pPar->profile >= s_NumProResTypes))
+            {
+                g_Log(logLevelError, "MovWriter :: Stream %u is not ProRes", i);
+                return false;
+            }
+
+            track.fourCC = (pPar->codec_tag != 0) ? pPar->codec_tag : s_ProResTypes[pPar->profile].fourCC;
+            track.timescale = (pStream->time_base.den > 0) ? pStream->time_base.den : 90000;
+            track.timeBaseNum = (pStream->time_base.den > 0) ? pStream->time_base.num : 1;
+            if ((pStream->avg_frame_rate.num > 0) && (pStream->avg_frame_rate.den > 0))
+            {
+                track.defaultDelta = static_cast<uint32_t>((static_cast<int64_t>(track.timescale) * pStream->avg_frame_rate.den) / pStream->avg_frame_rate.num);
+            }
+        }
+        else if (pPar->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+            const int bitsPerSample = av_get_bits_per_sample(pPar->codec_id);
+            if ((s_FindPCMType(pPar->codec_id) < 0) || (bitsPerSample <= 0) || (pPar->channels <= 0) || (pPar->sample_rate <= 0))
+            {
+                g_Log(logLevelError, "MovWriter :: Stream %u is not LPCM", i);
+                return false;
+            }
+
+            track.fourCC = MKTAG('l', 'p', 'c', 'm');
+            track.timescale = pPar->sample_rate;
+            track.timeBaseNum = 1;
+            track.bytesPerFrame = pPar->channels * bitsPerSample / 8;
+            track.defaultDelta = 1;
+        }
+        else
+        {
+            g_Log(logLevelError, "MovWriter :: Unsupported stream type for stream %u", i);
+            return false;
+        }
+
+        m_Tracks.push_back(track);
+    }
+
+    // a spool per track, so the tables of one track are read back without going over the samples of the others
+    for (size_t i = 0; i < m_Tracks.size(); ++i)
+    {
+        m_Tracks[i].pSpool = tmpfile();
+        if (m_Tracks[i].pSpool == NULL)
+        {
+            g_Log(logLevelError, "MovWriter :: Could not create the sample table spool of track %u", m_Tracks[i].trackId);
+            return false;
+        }
+    }
+
+    m_CreationTime = static_cast<uint32_t>(time(NULL) + s_MacEpochOffset);
+
+    // ftyp, a wide atom to grow the mdat header into and the mdat header with its size filled in at the end
+    WriteAtomHeader(20, "ftyp");
+    avio_wl32(m_pIOContext, MKTAG('q', 't', ' ', ' '));
+    avio_wb32(m_pIOContext, 0x20050300);
+    avio_wl32(m_pIOContext, MKTAG('q', 't', ' ', ' '));
+
+    if (m_ReservedSize >= 8)
+    {
+        m_ReservedPos = avio_tell(m_pIOContext);
+        WriteAtomHeader(m_ReservedSize, "free");
+
+        const std::vector<uint8_t> zeros(64 * 1024, 0);
+        for (int64_t bytesLeft = m_ReservedSize - 8; bytesLeft > 0; bytesLeft -= zeros.size())
+        {
+            avio_write(m_pIOContext, zeros.data(), static_cast<int>(std::min<int64_t>(bytesLeft, zeros.size())));
+        }
+    }
+
+    if (m_DataIOContexts.empty())
+    {
+        m_WidePos = avio_tell(m_pIOContext);
+        WriteAtomHeader(8, "wide");
+
+        m_MdatPos = avio_tell(m_pIOContext);
+        WriteAtomHeader(0, "mdat");
+    }
+
+    return (m_pIOContext->error == 0);
+}
+
+bool MovWriter::WritePacket(const AVPacket* p_pPacket)
+{
+    if (m_IsSpoolFailed || (p_pPacket->stream_index < 0) || (static_cast<size_t>(p_pPacket->stream_index) >= m_Tracks.size()))
+    {
+        return false;
+    }
+
+    Track& track = m_Tracks[p_pPacket->stream_index];
+
+    // with striping every sample goes to the data file holding the fewest bytes. Strict alternation would
+    // put every video frame on the same file when one audio packet follows each of them
+    AVIOContext* pIOContext = m_pIOContext;
+    SpoolRecord record;
+    record.dataIdx = 0;
+    if (!m_DataIOContexts.empty())
+    {
+        for (size_t i = 1; i < m_DataIOContexts.size(); ++i)
+        {
+            if (avio_tell(m_DataIOContexts[i]) < avio_tell(m_DataIOContexts[record.dataIdx]))
+            {
+                record.dataIdx = static_cast<uint16_t>(i);
+            }
+        }
+
+        pIOContext = m_DataIOContexts[record.dataIdx];
+    }
+
+    record.size = p_pPacket->size;
+    record.offset = avio_tell(pIOContext);
+    record.delta = 0;
+    record.numFrames = 1;
+
+    const int64_t dts = (p_pPacket->dts != AV_NOPTS_VALUE) ? p_pPacket->dts : p_pPacket->pts;
+    if ((track.numRecords == 0) && !track.hasPending)
+    {
+        track.firstDts = (dts != AV_NOPTS_VALUE) ? dts : 0;
+    }
+
+    if (track.isVideo)
+    {
+        if (track.hasPending)
+        {
+            const int64_t delta = (dts - track.pendingDts) * track.timeBaseNum;
+            track.pending.delta = static_cast<uint32_t>((delta > 0) ? delta : ((track.lastDelta > 0) ? track.lastDelta : std::max(track.defaultDelta, 1u)));
+            if (!AddRecord(track, track.pending))
+            {
+                return false;
+            }
+        }
+
+        track.hasPending = true;
+        track.pending = record;
+        track.pendingDts = dts;
+        track.pendingDuration = p_pPacket->duration * track.timeBaseNum;
+    }
+    else
+    {
+        if ((p_pPacket->size % track.bytesPerFrame) != 0)
+        {
+            g_Log(logLevelWarn, "MovWriter :: Audio packet of %d bytes is not a whole number of frames", p_pPacket->size);
+        }
+
+        record.numFrames = p_pPacket->size / track.bytesPerFrame;
+        record.size = record.numFrames * track.bytesPerFrame;
+        record.delta = 1;
+        if (record.numFrames == 0)
+        {
+            return true;
+        }
+
+        if (!AddRecord(track, record))
+        {
+            return false;
+        }
+    }
+
+    avio_write(pIOContext, p_pPacket->data, record.size);
+    return (pIOContext->error == 0);
+}
+
+bool MovWriter::AddRecord(Track& p_Track, const SpoolRecord& p_Record)
+{
+    if (m_IsSpoolFailed)
+    {
+        return false;
+    }
+
+    if (fwrite(&p_Record, sizeof(p_Record), 1, p_Track.pSpool) != 1)
+    {
+        g_Log(logLevelError, "MovWriter :: Could not spool the sample table entry of track %u", p_Track.trackId);
+        m_IsSpoolFailed = true;
+        return false;
+    }
+
+    if ((p_Track.numRecords == 0) || (p_Record.delta != p_Track.lastDelta))
+    {
+        ++p_Track.numSttsEntries;
+    }
+
+    if ((p_Track.numRecords == 0) || (p_Record.numFrames != p_Track.lastFramesPerChunk) || (p_Record.dataIdx != p_Track.lastDataIdx))
+    {
+        ++p_Track.numStscEntries;
+    }
+
+    p_Track.lastDelta = p_Record.delta;
+    p_Track.lastFramesPerChunk = p_Record.numFrames;
+    p_Track.lastDataIdx = p_Record.dataIdx;
+    p_Track.maxOffset = std::max(p_Track.maxOffset, p_Record.offset);
+    p_Track.mediaDuration += static_cast<int64_t>(p_Record.delta) * p_Record.numFrames;
+    p_Track.numFrames += p_Record.numFrames;
+    ++p_Track.numRecords;
+    return true;
+}
+
+bool MovWriter::FlushPending(Track& p_Track)
+{
+    if (!p_Track.hasPending)
+    {
+        return true;
+    }
+
+    // the last frame lasts as long as its packet says, or as long as the one before it
+    uint32_t delta = std::max(p_Track.defaultDelta, 1u);
+    if (p_Track.pendingDuration > 0)
+    {
+        delta = static_cast<uint32_t>(p_Track.pendingDuration);
+    }
+    else if (p_Track.lastDelta > 0)
+    {
+        delta = p_Track.lastDelta;
+    }
+
+    p_Track.pending.delta = delta;
+    p_Track.hasPending = false;
+    return AddRecord(p_Track, p_Track.pending);
+}
+
+template <typename TFunc> bool MovWriter::ForEachRecord(const Track& p_Track, TFunc p_Func)
+{
+    if ((fflush(p_Track.pSpool) != 0) || (fseek(p_Track.pSpool, 0, SEEK_SET) != 0))
+    {
+        return false;
+    }
+
+    std::vector<SpoolRecord> records(s_SpoolBatch);
+    size_t numRead = 0;
+    int64_t numRecords = 0;
+    while ((numRead = fread(records.data(), sizeof(SpoolRecord), records.size(), p_Track.pSpool)) > 0)
+    {
+        for (size_t i = 0; i < numRead; ++i)
+        {
+            p_Func(records[i]);
+        }
+        numRecords += numRead;
+    }
+
+    const bool isOk = (ferror(p_Track.pSpool) == 0) && (numRecords == p_Track.numRecords);
+    fseek(p_Track.pSpool, 0, SEEK_END);
+    return isOk;
+}
+
+bool MovWriter::IsCo64(const Track& p_Track) const
+{
+    return (p_Track.maxOffset > static_cast<int64_t>(UINT32_MAX));
+}
+
+bool MovWriter::IsMdhdV1(const Track& p_Track) const
+{
+    return (p_Track.mediaDuration > static_cast<int64_t>(UINT32_MAX));
+}
+
+int64_t MovWriter::GetMovieDuration(const Track& p_Track) const
+{
+    return (p_Track.mediaDuration * s_MovieTimescale + p_Track.timescale / 2) / p_Track.timescale;
+}
+
+int64_t MovWriter::GetSampleEntrySize(const Track& p_Track) const
+{
+    if (!p_Track.isVideo)
+    {
+        return s_SoundEntryV2Size + (s_HasChan(p_Track.pPar) ? s_ChanSize : 0);
+    }
+
+    return s_VideoEntrySize + s_FielSize + (s_HasColr(p_Track.pPar) ? s_ColrSize : 0);
+}
+
+uint32_t MovWriter::GetNumDataRefs() const
+{
+    return m_DataIOContexts.empty() ? 1 : static_cast<uint32_t>(m_DataIOContexts.size());
+}
+
+int64_t MovWriter::GetDinfSize() const
+{
+    // a self reference, or one url entry per data file
+    int64_t drefSize = 16 + 12;
+    if (!m_DataUrls.empty())
+    {
+        drefSize = 16;
+        for (size_t i = 0; i < m_DataUrls.size(); ++i)
+        {
+            drefSize += 12 + m_DataUrls[i].size() + 1;
+        }
+    }
+
+    return 8 + drefSize;
+}
+
+int64_t MovWriter::GetStblSize(const Track& p_Track) const
+{
+    // each data reference needs its own sample description
+    const int64_t stsd = 16 + GetNumDataRefs() * GetSampleEntrySize(p_Track);
+    const int64_t stts = 16 + 8 * p_Track.numSttsEntries;
+    const int64_t stsc = 16 + 12 * p_Track.numStscEntries;
+    const int64_t stsz = 20 + (p_Track.isVideo ? (4 * p_Track.numRecords) : 0);
+    const int64_t stco = 16 + (IsCo64(p_Track) ? 8 : 4) * p_Track.numRecords;
+    return 8 + stsd + stts + stsc + stsz + stco;
+}
+
+int64_t MovWriter::GetMinfSize(const Track& p_Track) const
+{
+    return 8 + (p_Track.isVideo ? s_VmhdSize : s_SmhdSize) + s_HdlrSize(s_DataHandlerName) + GetDinfSize() + GetStblSize(p_Track);
+}
+
+int64_t MovWriter::GetTrakSize(const Track& p_Track) const
+{
+    const int64_t mdhd = IsMdhdV1(p_Track) ? 44 : 32;
+    const int64_t mdia = 8 + mdhd + s_HdlrSize(p_Track.isVideo ? s_VideoHandlerName : s_SoundHandlerName) + GetMinfSize(p_Track);
+    return 8 + s_TkhdSize + s_EdtsSize + mdia;
+}
+
+int64_t MovWriter::GetMoovSize()
+{
+    int64_t size = 8 + s_MvhdSize;
+    for (size_t i = 0; i < m_Tracks.size(); ++i)
+    {
+        size += GetTrakSize(m_Tracks[i]);
+    }
+
+    return size;
+}
+
+void MovWriter::WriteAtomHeader(int64_t p_Size, const char* p_pType)
+{
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(p_Size));
+    avio_write(m_pIOContext, reinterpret_cast<const unsigned char*>(p_pType), 4);
+}
+
+void MovWriter::WriteMatrix()
+{
+    static const uint32_t s_Identity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    for (int i = 0; i < 9; ++i)
+    {
+        avio_wb32(m_pIOContext, s_Identity[i]);
+    }
+}
+
+void MovWriter::WritePascalString(const char* p_pStr, int p_FixedSize)
+{
+    const int len = static_cast<int>(strlen(p_pStr));
+    avio_w8(m_pIOContext, len);
+    avio_write(m_pIOContext, reinterpret_cast<const unsigned char*>(p_pStr), len);
+    for (int i = len + 1; i < p_FixedSize; ++i)
+    {
+        avio_w8(m_pIOContext, 0);
+    }
+}
+
+bool MovWriter::Finish()
+{
+    for (size_t i = 0; i < m_Tracks.size(); ++i)
+    {
+        if (!FlushPending(m_Tracks[i]))
+        {
+            return false;
+        }
+    }
+
+    if (m_IsSpoolFailed)
+    {
+        return false;
+    }
+
+    const int64_t mdatEnd = avio_tell(m_pIOContext);
+    const int64_t mdatSize = mdatEnd - m_MdatPos;
+    if (!m_DataIOContexts.empty())
+    {
+        // the samples are in the data files, the movie has no mdat
+    }
+    else if (mdatSize <= static_cast<int64_t>(UINT32_MAX))
+    {
+        avio_seek(m_pIOContext, m_MdatPos, SEEK_SET);
+        avio_wb32(m_pIOContext, static_cast<uint32_t>(mdatSize));
+    }
+    else
+    {
+        // the wide atom and the mdat header become one mdat header with a 64 bit size
+        avio_seek(m_pIOContext, m_WidePos, SEEK_SET);
+        WriteAtomHeader(1, "mdat");
+        avio_wb64(m_pIOContext, mdatEnd - m_WidePos);
+    }
+
+    // the moov either fills the reserved space exactly or leaves room for a free atom behind it
+    const int64_t moovSize = GetMoovSize();
+    if ((m_ReservedSize >= 8) && ((moovSize == m_ReservedSize) || ((moovSize + 8) <= m_ReservedSize)))
+    {
+        avio_seek(m_pIOContext, m_ReservedPos, SEEK_SET);
+        if (!WriteMoov())
+        {
+            return false;
+        }
+
+        if (moovSize < m_ReservedSize)
+        {
+            WriteAtomHeader(m_ReservedSize - moovSize, "free");
+        }
+
+        avio_seek(m_pIOContext, mdatEnd, SEEK_SET);
+        return (m_pIOContext->error == 0);
+    }
+
+    if (m_ReservedSize >= 8)
+    {
+        g_Log(logLevelWarn, "MovWriter :: moov of %lld bytes does not fit the %lld reserved, writing it at the end",
+              static_cast<long long>(moovSize), static_cast<long long>(m_ReservedSize));
+    }
+
+    avio_seek(m_pIOContext, mdatEnd, SEEK_SET);
+    return WriteMoov();
+}
+
+bool MovWriter::WriteMoov()
+{
+    const int64_t moovPos = avio_tell(m_pIOContext);
+    const int64_t moovSize = GetMoovSize();
+
+    int64_t duration = 0;
+    for (size_t i = 0; i < m_Tracks.size(); ++i)
+    {
+        duration = std::max(duration, GetMovieDuration(m_Tracks[i]));
+    }
+
+    WriteAtomHeader(moovSize, "moov");
+
+    WriteAtomHeader(s_MvhdSize, "mvhd");
+    avio_wb32(m_pIOContext, 0); // version and flags
+    avio_wb32(m_pIOContext, m_CreationTime);
+    avio_wb32(m_pIOContext, m_CreationTime);
+    avio_wb32(m_pIOContext, s_MovieTimescale);
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(duration));
+    avio_wb32(m_pIOContext, 0x00010000); // rate 1.0
+    avio_wb16(m_pIOContext, 0x0100);     // volume 1.0
+    for (int i = 0; i < 10; ++i)
+    {
+        avio_w8(m_pIOContext, 0);
+    }
+    WriteMatrix();
+    for (int i = 0; i < 6; ++i)
+    {
+        avio_wb32(m_pIOContext, 0); // preview, poster, selection and current time
+    }
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(m_Tracks.size() + 1));
+
+    for (size_t i = 0; i < m_Tracks.size(); ++i)
+    {
+        if (!WriteTrak(i))
+        {
+            return false;
+        }
+    }
+
+    const int64_t written = avio_tell(m_pIOContext) - moovPos;
+    if (written != moovSize)
+    {
+        g_Log(logLevelError, "MovWriter :: moov size mismatch, %lld bytes written for %lld", static_cast<long long>(written), static_cast<long long>(moovSize));
+        return false;
+    }
+
+    return (m_pIOContext->error == 0);
+}
+
+bool MovWriter::WriteTrak(uint32_t p_TrackIdx)
+{
+    const Track& track = m_Tracks[p_TrackIdx];
+    const int64_t duration = GetMovieDuration(track);
+
+    WriteAtomHeader(GetTrakSize(track), "trak");
+
+    WriteAtomHeader(s_TkhdSize, "tkhd");
+    avio_wb32(m_pIOContext, 0x00000003); // enabled, in movie
+    avio_wb32(m_pIOContext, m_CreationTime);
+    avio_wb32(m_pIOContext, m_CreationTime);
+    avio_wb32(m_pIOContext, track.trackId);
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(duration));
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, 0);
+    avio_wb16(m_pIOContext, 0); // layer
+    avio_wb16(m_pIOContext, 0); // alternate group
+    avio_wb16(m_pIOContext, track.isVideo ? 0 : 0x0100);
+    avio_wb16(m_pIOContext, 0);
+    WriteMatrix();
+    avio_wb32(m_pIOContext, track.isVideo ? (track.pPar->width << 16) : 0);
+    avio_wb32(m_pIOContext, track.isVideo ? (track.pPar->height << 16) : 0);
+
+    // the edit starts at the first sample, whatever its timestamp
+    WriteAtomHeader(s_EdtsSize, "edts");
+    WriteAtomHeader(s_EdtsSize - 8, "elst");
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, 1);
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(duration));
+    avio_wb32(m_pIOContext, track.isVideo ? static_cast<uint32_t>(std::max<int64_t>(track.firstDts * track.timeBaseNum, 0)) : 0);
+    avio_wb32(m_pIOContext, 0x00010000);
+
+    const char* pHandlerName = track.isVideo ? s_VideoHandlerName : s_SoundHandlerName;
+    WriteAtomHeader(GetTrakSize(track) - 8 - s_TkhdSize - s_EdtsSize, "mdia");
+
+    if (IsMdhdV1(track))
+    {
+        WriteAtomHeader(44, "mdhd");
+        avio_wb32(m_pIOContext, 0x01000000);
+        avio_wb64(m_pIOContext, m_CreationTime);
+        avio_wb64(m_pIOContext, m_CreationTime);
+        avio_wb32(m_pIOContext, track.timescale);
+        avio_wb64(m_pIOContext, track.mediaDuration);
+    }
+    else
+    {
+        WriteAtomHeader(32, "mdhd");
+        avio_wb32(m_pIOContext, 0);
+        avio_wb32(m_pIOContext, m_CreationTime);
+        avio_wb32(m_pIOContext, m_CreationTime);
+        avio_wb32(m_pIOContext, track.timescale);
+        avio_wb32(m_pIOContext, static_cast<uint32_t>(track.mediaDuration));
+    }
+    avio_wb16(m_pIOContext, 0); // language
+    avio_wb16(m_pIOContext, 0); // quality
+
+    WriteAtomHeader(s_HdlrSize(pHandlerName), "hdlr");
+    avio_wb32(m_pIOContext, 0);
+    avio_wl32(m_pIOContext, MKTAG('m', 'h', 'l', 'r'));
+    avio_wl32(m_pIOContext, track.isVideo ? MKTAG('v', 'i', 'd', 'e') : MKTAG('s', 'o', 'u', 'n'));
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, 0);
+    WritePascalString(pHandlerName, 0);
+
+    WriteAtomHeader(GetMinfSize(track), "minf");
+    if (track.isVideo)
+    {
+        WriteAtomHeader(s_VmhdSize, "vmhd");
+        avio_wb32(m_pIOContext, 0x00000001);
+        avio_wb16(m_pIOContext, 0x0040); // dither copy
+        avio_wb16(m_pIOContext, 0x8000);
+        avio_wb16(m_pIOContext, 0x8000);
+        avio_wb16(m_pIOContext, 0x8000);
+    }
+    else
+    {
+        WriteAtomHeader(s_SmhdSize, "smhd");
+        avio_wb32(m_pIOContext, 0);
+        avio_wb16(m_pIOContext, 0); // balance
+        avio_wb16(m_pIOContext, 0);
+    }
+
+    WriteAtomHeader(s_HdlrSize(s_DataHandlerName), "hdlr");
+    avio_wb32(m_pIOContext, 0);
+    avio_wl32(m_pIOContext, MKTAG('d', 'h', 'l', 'r'));
+    avio_wl32(m_pIOContext, m_DataUrls.empty() ? MKTAG('a', 'l', 'i', 's') : MKTAG('u', 'r', 'l', ' '));
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, 0);
+    WritePascalString(s_DataHandlerName, 0);
+
+    // the media data is in this file or in the data files
+    WriteAtomHeader(GetDinfSize(), "dinf");
+    WriteAtomHeader(GetDinfSize() - 8, "dref");
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, GetNumDataRefs());
+    if (m_DataUrls.empty())
+    {
+        WriteAtomHeader(12, "alis");
+        avio_wb32(m_pIOContext, 0x00000001);
+    }
+
+    for (size_t i = 0; i < m_DataUrls.size(); ++i)
+    {
+        WriteAtomHeader(12 + m_DataUrls[i].size() + 1, "url ");
+        avio_wb32(m_pIOContext, 0);
+        avio_write(m_pIOContext, reinterpret_cast<const unsigned char*>(m_DataUrls[i].c_str()), static_cast<int>(m_DataUrls[i].size() + 1));
+    }
+
+    WriteAtomHeader(GetStblSize(track), "stbl");
+
+    WriteAtomHeader(16 + GetNumDataRefs() * GetSampleEntrySize(track), "stsd");
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, GetNumDataRefs());
+    for (uint32_t i = 0; i < GetNumDataRefs(); ++i)
+    {
+        WriteSampleEntry(track, static_cast<uint16_t>(i + 1));
+    }
+
+    // time to sample, runs of equal frame durations
+    WriteAtomHeader(16 + 8 * track.numSttsEntries, "stts");
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(track.numSttsEntries));
+    {
+        int64_t numEntries = 0;
+        uint32_t runCount = 0;
+        uint32_t runDelta = 0;
+        bool isOk = ForEachRecord(track, [&](const SpoolRecord& p_Record)
+        {
+            if ((runCount > 0) && (p_Record.delta != runDelta))
+            {
+                avio_wb32(m_pIOContext, runCount);
+                avio_wb32(m_pIOContext, runDelta);
+                ++numEntries;
+                runCount = 0;
+            }
+
+            runCount += p_Record.numFrames;
+            runDelta = p_Record.delta;
+        });
+
+        if (runCount > 0)
+        {
+            avio_wb32(m_pIOContext, runCount);
+            avio_wb32(m_pIOContext, runDelta);
+            ++numEntries;
+        }
+
+        if (!isOk || (numEntries != track.numSttsEntries))
+        {
+            g_Log(logLevelError, "MovWriter :: Failed to write the time to sample table of track %u", track.trackId);
+            return false;
+        }
+    }
+
+    // sample to chunk, every packet is a chunk of its own, its sample description selects the data file
+    WriteAtomHeader(16 + 12 * track.numStscEntries, "stsc");
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(track.numStscEntries));
+    {
+        uint32_t chunkIdx = 0;
+        uint32_t lastFrames = 0;
+        uint32_t lastDataIdx = 0;
+        if (!ForEachRecord(track, [&](const SpoolRecord& p_Record)
+        {
+            ++chunkIdx;
+            if ((chunkIdx == 1) || (p_Record.numFrames != lastFrames) || (p_Record.dataIdx != lastDataIdx))
+            {
+                avio_wb32(m_pIOContext, chunkIdx);
+                avio_wb32(m_pIOContext, p_Record.numFrames);
+                avio_wb32(m_pIOContext, p_Record.dataIdx + 1); // sample description
+                lastFrames = p_Record.numFrames;
+                lastDataIdx = p_Record.dataIdx;
+            }
+        }))
+        {
+            return false;
+        }
+    }
+
+    // sample sizes, LPCM frames all have the same size
+    WriteAtomHeader(20 + (track.isVideo ? (4 * track.numRecords) : 0), "stsz");
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, track.isVideo ? 0 : track.bytesPerFrame);
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(track.isVideo ? track.numRecords : track.numFrames));
+    if (track.isVideo && !ForEachRecord(track, [&](const SpoolRecord& p_Record) { avio_wb32(m_pIOContext, p_Record.size); }))
+    {
+        return false;
+    }
+
+    const bool isCo64 = IsCo64(track);
+    WriteAtomHeader(16 + (isCo64 ? 8 : 4) * track.numRecords, isCo64 ? "co64" : "stco");
+    avio_wb32(m_pIOContext, 0);
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(track.numRecords));
+    return ForEachRecord(track, [&](const SpoolRecord& p_Record)
+    {
+        if (isCo64)
+        {
+            avio_wb64(m_pIOContext, p_Record.offset);
+        }
+        else
+        {
+            avio_wb32(m_pIOContext, static_cast<uint32_t>(p_Record.offset));
+        }
+    });
+}
+
+void MovWriter::WriteSampleEntry(const Track& p_Track, uint16_t p_DataRefIdx)
+{
+    const AVCodecParameters* pPar = p_Track.pPar;
+
+    avio_wb32(m_pIOContext, static_cast<uint32_t>(GetSampleEntrySize(p_Track)));
+    avio_wl32(m_pIOContext, p_Track.fourCC);
+    avio_wb32(m_pIOContext, 0); // reserved
+    avio_wb16(m_pIOContext, 0);
+    avio_wb16(m_pIOContext, p_DataRefIdx);
+
+    if (p_Track.isVideo)
+    {
+        avio_wb16(m_pIOContext, 0); // version
+        avio_wb16(m_pIOContext, 0); // revision
+        avio_wb32(m_pIOContext, 0); // vendor
+        avio_wb32(m_pIOContext, 0x200); // temporal quality normal
+        avio_wb32(m_pIOContext, 0x200); // spatial quality normal
+        avio_wb16(m_pIOContext, pPar->width);
+        avio_wb16(m_pIOContext, pPar->height);
+        avio_wb32(m_pIOContext, 0x00480000); // 72 dpi
+        avio_wb32(m_pIOContext, 0x00480000);
+        avio_wb32(m_pIOContext, 0); // data size
+        avio_wb16(m_pIOContext, 1); // frames per sample
+
+        const char* pName = "";
+        for (int i = 0; i < s_NumProResTypes; ++i)
+        {
+            if (s_ProResTypes[i].fourCC == p_Track.fourCC)
+            {
+                pName = s_ProResTypes[i].pName;
+            }
+        }
+        WritePascalString(pName, 32);
+
+        avio_wb16(m_pIOContext, 0x18);   // depth
+        avio_wb16(m_pIOContext, 0xffff); // no color table
+
+        WriteAtomHeader(s_FielSize, "fiel");
+        avio_w8(m_pIOContext, 1); // progressive
+        avio_w8(m_pIOContext, 0);
+
+        if (s_HasColr(pPar))
+        {
+            WriteAtomHeader(s_ColrSize, "colr");
+            avio_wl32(m_pIOContext, MKTAG('n', 'c', 'l', 'c'));
+            avio_wb16(m_pIOContext, pPar->color_primaries);
+            avio_wb16(m_pIOContext, pPar->color_trc);
+            avio_wb16(m_pIOContext, pPar->color_space);
+        }
+    }
+    else
+    {
+        // version 2 sound description, the only one carrying an arbitrary LPCM layout
+        const int pcmType = s_FindPCMType(pPar->codec_id);
+        const uint32_t flags = (s_PCMTypes[pcmType].isFloat ? 0x1 : 0x4) | (s_PCMTypes[pcmType].isBigEndian ? 0x2 : 0x0) | 0x8; // float or signed, endianness, packed
+
+        avio_wb16(m_pIOContext, 2); // version
+        avio_wb16(m_pIOContext, 0); // revision
+        avio_wb32(m_pIOContext, 0); // vendor
+        avio_wb16(m_pIOContext, 3);
+        avio_wb16(m_pIOContext, 16);
+        avio_wb16(m_pIOContext, 0xfffe);
+        avio_wb16(m_pIOContext, 0);
+        avio_wb32(m_pIOContext, 0x00010000);
+        avio_wb32(m_pIOContext, static_cast<uint32_t>(s_SoundEntryV2Size));
+        avio_wb64(m_pIOContext, av_double2int(pPar->sample_rate));
+        avio_wb32(m_pIOContext, pPar->channels);
+        avio_wb32(m_pIOContext, 0x7f000000);
+        avio_wb32(m_pIOContext, av_get_bits_per_sample(pPar->codec_id));
+        avio_wb32(m_pIOContext, flags);
+        avio_wb32(m_pIOContext, p_Track.bytesPerFrame);
+        avio_wb32(m_pIOContext, 1); // frames per packet
+
+        if (s_HasChan(pPar))
+        {
+            // the channel bitmap bits match the libav channel bits
+            WriteAtomHeader(s_ChanSize, "chan");
+            avio_wb32(m_pIOContext, 0);       // version and flags
+            avio_wb32(m_pIOContext, 0x10000); // kAudioChannelLayoutTag_UseChannelBitmap
+            avio_wb32(m_pIOContext, static_cast<uint32_t>(pPar->channel_layout));
+            avio_wb32(m_pIOContext, 0);       // no channel descriptions
+        }
+    }
+}
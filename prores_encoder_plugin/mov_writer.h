@@ -0,0 +1,134 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "wrapper/host_api.h"
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// Streaming QuickTime writer for ProRes video and LPCM audio, an alternative to the libavformat muxer.
+// Sample data goes straight to the output while the per sample table entries are appended to a spool file
+// per track, only a few counters per track stay in memory. The moov is assembled from the spools at the end,
+// its size is known up front so it is written in one sequential pass.
+class MovWriter
+{
+public:
+    MovWriter();
+    ~MovWriter();
+
+    // reserve p_Size bytes in front of the mdat for the moov (faststart), must be called before Begin. When the
+    // moov does not fit at the end it is appended as usual and the reserved space stays a free atom
+    void ReserveMoov(int64_t p_Size);
+
+    // spread the sample data evenly over separate data files instead of an mdat in the movie, one
+    // data reference per file pointing at its url. Must be called before Begin
+    void SetDataFiles(const std::vector<AVIOContext*>& p_IOContexts, const std::vector<std::string>& p_Urls);
+
+    // generous moov size for p_NumVideoStreams video streams of p_NumVideoFrames frames and p_NumAudioStreams LPCM
+    // streams of p_NumAudioPackets packets each, with the samples spread over p_NumStripes data files (0 for none).
+    // Allows for 64 bit offsets and a sample table entry whenever the frame duration, chunk size or data file changes
+    static int64_t s_EstimateMoovSize(int64_t p_NumVideoFrames, int p_NumVideoStreams, int p_NumAudioStreams, int64_t p_NumAudioPackets, int p_NumStripes);
+
+    // whether every stream is ProRes or LPCM, the only codecs written here
+    static bool s_CanWrite(const AVFormatContext* p_pFormatContext);
+
+    // takes the streams of p_pFormatContext as tracks and writes ftyp and the mdat header to p_pIOContext
+    bool Begin(AVIOContext* p_pIOContext, const AVFormatContext* p_pFormatContext);
+
+    // writes the sample data, pts and dts are in the time base of the stream
+    bool WritePacket(const AVPacket* p_pPacket);
+
+    // closes the mdat and appends the moov
+    bool Finish();
+
+    // size of the moov Finish would write for the samples written so far
+    int64_t GetMoovSize();
+
+private:
+    // disable assignment and copy constructor
+    MovWriter(const MovWriter& p_Other);
+    MovWriter& operator=(const MovWriter& p_Other);
+
+#pragma pack(push, 1)
+    struct SpoolRecord
+    {
+        uint16_t dataIdx; // data file holding the sample, 0 without striping
+        uint32_t size;
+        int64_t offset;
+        uint32_t delta;     // duration of each frame in the media time scale
+        uint32_t numFrames; // 1 for video, audio frames in the chunk for LPCM
+    };
+#pragma pack(pop)
+
+    struct Track
+    {
+        const AVCodecParameters* pPar;
+        bool isVideo;
+        uint32_t trackId;
+        uint32_t timescale;
+        uint32_t timeBaseNum; // stream time base is timeBaseNum / timescale
+        uint32_t fourCC;
+        uint32_t bytesPerFrame; // LPCM only, video samples have individual sizes
+        uint32_t defaultDelta;  // frame duration when the stream does not tell
+        FILE* pSpool;           // table entries of the samples in the order they were written
+
+        int64_t numRecords;
+        int64_t numFrames;
+        int64_t mediaDuration;
+        int64_t numSttsEntries;
+        uint32_t lastDelta;
+        int64_t numStscEntries;
+        uint32_t lastFramesPerChunk;
+        uint32_t lastDataIdx;
+        int64_t maxOffset;
+        int64_t firstDts;
+
+        // video durations come from the next dts, so the latest sample waits here
+        bool hasPending;
+        SpoolRecord pending;
+        int64_t pendingDts;
+        int64_t pendingDuration;
+    };
+
+    // false once a record could not be spooled, the moov would miss samples from then on
+    bool AddRecord(Track& p_Track, const SpoolRecord& p_Record);
+    bool FlushPending(Track& p_Track);
+
+    // reads the spool of the track back, calling p_Func for every record
+    template <typename TFunc> bool ForEachRecord(const Track& p_Track, TFunc p_Func);
+
+    int64_t GetTrakSize(const Track& p_Track) const;
+    int64_t GetMinfSize(const Track& p_Track) const;
+    int64_t GetStblSize(const Track& p_Track) const;
+    int64_t GetSampleEntrySize(const Track& p_Track) const;
+    int64_t GetDinfSize() const;
+    uint32_t GetNumDataRefs() const;
+    int64_t GetMovieDuration(const Track& p_Track) const;
+    bool IsCo64(const Track& p_Track) const;
+    bool IsMdhdV1(const Track& p_Track) const;
+
+    void WriteAtomHeader(int64_t p_Size, const char* p_pType);
+    void WriteMatrix();
+    void WritePascalString(const char* p_pStr, int p_FixedSize);
+    bool WriteMoov();
+    bool WriteTrak(uint32_t p_TrackIdx);
+    void WriteSampleEntry(const Track& p_Track, uint16_t p_DataRefIdx);
+
+private:
+    AVIOContext* m_pIOContext;
+    bool m_IsSpoolFailed;
+    std::vector<Track> m_Tracks;
+    int64_t m_ReservedPos; // 'free' atom holding the space for the moov
+    int64_t m_ReservedSize;
+    int64_t m_WidePos; // 'wide' atom in front of mdat, becomes the 64 bit mdat header when needed
+    int64_t m_MdatPos;
+
+    std::vector<AVIOContext*> m_DataIOContexts; // empty when the samples go into the movie's own mdat
+    std::vector<std::string> m_DataUrls;
+    uint32_t m_CreationTime;
+};
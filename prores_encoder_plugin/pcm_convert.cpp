@@ -0,0 +1,590 @@
+#include "pcm_convert.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PCM_CONVERT_SSE2 1
+#endif
+
+// samples per pass through the staging buffer, small enough to stay in L1
+static const size_t s_BlockSize = 512;
+
+static int s_BitsPerSample(PCMSampleFormat p_Format)
+{
+    return g_PCMBytesPerSample(p_Format) * 8;
+}
+
+int g_PCMBytesPerSample(PCMSampleFormat p_Format)
+{
+    return (p_Format == pcmFormatS16) ? 2 : ((p_Format == pcmFormatS24) ? 3 : 4);
+}
+
+bool g_PCMFormatFromBitDepth(uint32_t p_BitDepth, bool p_IsFloat, PCMSampleFormat* p_pFormat)
+{
+    if (p_IsFloat)
+    {
+        *p_pFormat = pcmFormatF32;
+        return (p_BitDepth == 32);
+    }
+
+    switch (p_BitDepth)
+    {
+        case 16:
+            *p_pFormat = pcmFormatS16;
+            return true;
+        case 24:
+            *p_pFormat = pcmFormatS24;
+            return true;
+        case 32:
+            *p_pFormat = pcmFormatS32;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static inline int32_t s_ReadS24(const uint8_t* p_pSrc)
+{
+    return static_cast<int32_t>((static_cast<uint32_t>(p_pSrc[0]) << 8) | (static_cast<uint32_t>(p_pSrc[1]) << 16) | (static_cast<uint32_t>(p_pSrc[2]) << 24)) >> 8;
+}
+
+static inline uint32_t s_Swap32(uint32_t p_Val)
+{
+    return (p_Val << 24) | ((p_Val << 8) & 0x00ff0000) | ((p_Val >> 8) & 0x0000ff00) | (p_Val >> 24);
+}
+
+#ifdef PCM_CONVERT_SSE2
+static inline __m128i s_Swap32x4(const __m128i& p_Val)
+{
+    const __m128i swapped16 = _mm_or_si128(_mm_slli_epi16(p_Val, 8), _mm_srli_epi16(p_Val, 8));
+    return _mm_or_si128(_mm_slli_epi32(swapped16, 16), _mm_srli_epi32(swapped16, 16));
+}
+#endif
+
+// integer samples scaled to p_DstBits, sign extended in 32 bit lanes
+static void s_LoadInt(const uint8_t* p_pSrc, PCMSampleFormat p_SrcFormat, int p_DstBits, int32_t* p_pDst, size_t p_NumSamples)
+{
+    size_t i = 0;
+    switch (p_SrcFormat)
+    {
+        case pcmFormatS16:
+        {
+            const int16_t* pSrc = reinterpret_cast<const int16_t*>(p_pSrc);
+            const int shift = p_DstBits - 16;
+#ifdef PCM_CONVERT_SSE2
+            // the sample lands in the upper half of the lane, the arithmetic shift brings it down sign extended
+            const __m128i count = _mm_cvtsi32_si128(16 - shift);
+            const __m128i zero = _mm_setzero_si128();
+            for (; i + 8 <= p_NumSamples; i += 8)
+            {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + i), _mm_sra_epi32(_mm_unpacklo_epi16(zero, v), count));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + i + 4), _mm_sra_epi32(_mm_unpackhi_epi16(zero, v), count));
+            }
+#endif
+            for (; i < p_NumSamples; ++i)
+            {
+                p_pDst[i] = static_cast<int32_t>(static_cast<uint32_t>(static_cast<int32_t>(pSrc[i])) << shift);
+            }
+            break;
+        }
+        case pcmFormatS24:
+        {
+            for (; i < p_NumSamples; ++i)
+            {
+                const int32_t v = s_ReadS24(p_pSrc + i * 3);
+                p_pDst[i] = (p_DstBits >= 24) ? static_cast<int32_t>(static_cast<uint32_t>(v) << (p_DstBits - 24)) : (v >> (24 - p_DstBits));
+            }
+            break;
+        }
+        case pcmFormatS32:
+        {
+            const int32_t* pSrc = reinterpret_cast<const int32_t*>(p_pSrc);
+            const int shift = 32 - p_DstBits;
+#ifdef PCM_CONVERT_SSE2
+            const __m128i count = _mm_cvtsi32_si128(shift);
+            for (; i + 4 <= p_NumSamples; i += 4)
+            {
+                const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + i), _mm_sra_epi32(v, count));
+            }
+#endif
+            for (; i < p_NumSamples; ++i)
+            {
+                p_pDst[i] = pSrc[i] >> shift;
+            }
+            break;
+        }
+        case pcmFormatF32:
+        {
+            // the largest float below 2^31 stands in for INT32_MAX, which float can not hold
+            const float* pSrc = reinterpret_cast<const float*>(p_pSrc);
+            const float scale = ldexpf(1.0f, p_DstBits - 1);
+            const float hi = (p_DstBits == 32) ? 2147483520.0f : (scale - 1.0f);
+            const float lo = -scale;
+#ifdef PCM_CONVERT_SSE2
+            // min returns its second operand for NaN, so NaN ends up at hi on both paths
+            const __m128 scaleV = _mm_set1_ps(scale);
+            const __m128 hiV = _mm_set1_ps(hi);
+            const __m128 loV = _mm_set1_ps(lo);
+            for (; i + 4 <= p_NumSamples; i += 4)
+            {
+                __m128 v = _mm_mul_ps(_mm_loadu_ps(pSrc + i), scaleV);
+                v = _mm_max_ps(_mm_min_ps(v, hiV), loV);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + i), _mm_cvtps_epi32(v));
+            }
+#endif
+            for (; i < p_NumSamples; ++i)
+            {
+                float v = pSrc[i] * scale;
+                v = (v < hi) ? v : hi;
+                v = (v > lo) ? v : lo;
+                p_pDst[i] = static_cast<int32_t>(lrintf(v));
+            }
+            break;
+        }
+    }
+}
+
+// float samples in [-1, 1), p_pInt is scratch space for integer sources
+static void s_LoadFloat(const uint8_t* p_pSrc, PCMSampleFormat p_SrcFormat, int32_t* p_pInt, float* p_pDst, size_t p_NumSamples)
+{
+    if (p_SrcFormat == pcmFormatF32)
+    {
+        memcpy(p_pDst, p_pSrc, p_NumSamples * sizeof(float));
+        return;
+    }
+
+    // full range integers first, then one multiply
+    const int srcBits = s_BitsPerSample(p_SrcFormat);
+    s_LoadInt(p_pSrc, p_SrcFormat, srcBits, p_pInt, p_NumSamples);
+
+    const float scale = ldexpf(1.0f, 1 - srcBits);
+    size_t i = 0;
+#ifdef PCM_CONVERT_SSE2
+    const __m128 scaleV = _mm_set1_ps(scale);
+    for (; i + 4 <= p_NumSamples; i += 4)
+    {
+        const __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pInt + i)));
+        _mm_storeu_ps(p_pDst + i, _mm_mul_ps(v, scaleV));
+    }
+#endif
+    for (; i < p_NumSamples; ++i)
+    {
+        p_pDst[i] = static_cast<float>(p_pInt[i]) * scale;
+    }
+}
+
+// 32 bit lanes, integer or float bits, in the requested byte order
+static void s_Store32(const void* p_pSrc, uint8_t* p_pDst, bool p_IsBigEndian, size_t p_NumSamples)
+{
+    if (!p_IsBigEndian)
+    {
+        memcpy(p_pDst, p_pSrc, p_NumSamples * 4);
+        return;
+    }
+
+    const uint8_t* pSrc = static_cast<const uint8_t*>(p_pSrc);
+    size_t i = 0;
+#ifdef PCM_CONVERT_SSE2
+    for (; i + 4 <= p_NumSamples; i += 4)
+    {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSrc + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + i * 4), s_Swap32x4(v));
+    }
+#endif
+    for (; i < p_NumSamples; ++i)
+    {
+        uint32_t v;
+        memcpy(&v, pSrc + i * 4, 4);
+        v = s_Swap32(v);
+        memcpy(p_pDst + i * 4, &v, 4);
+    }
+}
+
+static void s_StoreS16(const int32_t* p_pSrc, uint8_t* p_pDst, bool p_IsBigEndian, size_t p_NumSamples)
+{
+    size_t i = 0;
+#ifdef PCM_CONVERT_SSE2
+    // the lanes already hold 16 bit values, the saturating pack does not change them
+    for (; i + 8 <= p_NumSamples; i += 8)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + i + 4));
+        __m128i v = _mm_packs_epi32(a, b);
+        if (p_IsBigEndian)
+        {
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + i * 2), v);
+    }
+#endif
+    for (; i < p_NumSamples; ++i)
+    {
+        const uint32_t v = static_cast<uint32_t>(p_pSrc[i]);
+        p_pDst[i * 2] = static_cast<uint8_t>(p_IsBigEndian ? (v >> 8) : v);
+        p_pDst[i * 2 + 1] = static_cast<uint8_t>(p_IsBigEndian ? v : (v >> 8));
+    }
+}
+
+static void s_StoreS24(const int32_t* p_pSrc, uint8_t* p_pDst, bool p_IsBigEndian, size_t p_NumSamples)
+{
+    // three byte samples do not fit the vector lanes, this stays scalar
+    for (size_t i = 0; i < p_NumSamples; ++i)
+    {
+        const uint32_t v = static_cast<uint32_t>(p_pSrc[i]);
+        uint8_t* pOut = p_pDst + i * 3;
+        pOut[p_IsBigEndian ? 2 : 0] = static_cast<uint8_t>(v);
+        pOut[1] = static_cast<uint8_t>(v >> 8);
+        pOut[p_IsBigEndian ? 0 : 2] = static_cast<uint8_t>(v >> 16);
+    }
+}
+
+void g_ConvertPCM(const void* p_pSrc, PCMSampleFormat p_SrcFormat, void* p_pDst, PCMSampleFormat p_DstFormat, bool p_IsBigEndian, size_t p_NumSamples)
+{
+    const uint8_t* pSrc = static_cast<const uint8_t*>(p_pSrc);
+    uint8_t* pDst = static_cast<uint8_t*>(p_pDst);
+
+    if ((p_SrcFormat == p_DstFormat) && !p_IsBigEndian)
+    {
+        memcpy(pDst, pSrc, p_NumSamples * g_PCMBytesPerSample(p_SrcFormat));
+        return;
+    }
+
+    const int srcBytes = g_PCMBytesPerSample(p_SrcFormat);
+    const int dstBytes = g_PCMBytesPerSample(p_DstFormat);
+
+    int32_t staging[s_BlockSize];
+    float stagingFloat[s_BlockSize];
+    for (size_t pos = 0; pos < p_NumSamples; pos += s_BlockSize)
+    {
+        const size_t numSamples = (p_NumSamples - pos < s_BlockSize) ? (p_NumSamples - pos) : s_BlockSize;
+        const uint8_t* pBlockSrc = pSrc + pos * srcBytes;
+        uint8_t* pBlockDst = pDst + pos * dstBytes;
+
+        if (p_DstFormat == pcmFormatF32)
+        {
+            s_LoadFloat(pBlockSrc, p_SrcFormat, staging, stagingFloat, numSamples);
+            s_Store32(stagingFloat, pBlockDst, p_IsBigEndian, numSamples);
+            continue;
+        }
+
+        s_LoadInt(pBlockSrc, p_SrcFormat, s_BitsPerSample(p_DstFormat), staging, numSamples);
+        if (p_DstFormat == pcmFormatS16)
+        {
+            s_StoreS16(staging, pBlockDst, p_IsBigEndian, numSamples);
+        }
+        else if (p_DstFormat == pcmFormatS24)
+        {
+            s_StoreS24(staging, pBlockDst, p_IsBigEndian, numSamples);
+        }
+        else
+        {
+            s_Store32(staging, pBlockDst, p_IsBigEndian, numSamples);
+        }
+    }
+}
+
+// copies channel p_Channel of p_NumFrames interleaved frames, the fixed sample size turns the copies into plain moves
+template<int t_Bytes>
+static void s_ExtractChannel(const uint8_t* p_pSrc, int p_NumChannels, int p_Channel, uint8_t* p_pDst, size_t p_NumFrames)
+{
+    const size_t stride = static_cast<size_t>(p_NumChannels) * t_Bytes;
+    const uint8_t* pSrc = p_pSrc + p_Channel * t_Bytes;
+    for (size_t i = 0; i < p_NumFrames; ++i)
+    {
+        memcpy(p_pDst + i * t_Bytes, pSrc + i * stride, t_Bytes);
+    }
+}
+
+#ifdef PCM_CONVERT_SSE2
+// stereo pairs split with shuffles, 8 frames of 16 bit or 4 frames of 32 bit samples per step
+static size_t s_SplitStereo16(const uint8_t* p_pSrc, uint8_t* p_pLeft, uint8_t* p_pRight, size_t p_NumFrames)
+{
+    size_t i = 0;
+    for (; i + 8 <= p_NumFrames; i += 8)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + i * 4));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + i * 4 + 16));
+
+        // left is the low half of each 32 bit pair, sign extend both halves and pack them back
+        const __m128i left = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+        const __m128i right = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pLeft + i * 2), left);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pRight + i * 2), right);
+    }
+
+    return i;
+}
+
+static size_t s_SplitStereo32(const uint8_t* p_pSrc, uint8_t* p_pLeft, uint8_t* p_pRight, size_t p_NumFrames)
+{
+    size_t i = 0;
+    for (; i + 4 <= p_NumFrames; i += 4)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + i * 8));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + i * 8 + 16));
+
+        // L0 R0 L1 R1 | L2 R2 L3 R3 -> L0 L1 R0 R1 | L2 L3 R2 R3
+        const __m128i x = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        const __m128i y = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pLeft + i * 4), _mm_unpacklo_epi64(x, y));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pRight + i * 4), _mm_unpackhi_epi64(x, y));
+    }
+
+    return i;
+}
+
+// 5.1 and 7.1 transpose a block of frames in registers, each channel comes out as one whole vector.
+// 8x8 16 bit samples: row r holds frame r, afterwards row c holds channel c
+static void s_Transpose8x16(__m128i* p_pRows)
+{
+    const __m128i a0 = _mm_unpacklo_epi16(p_pRows[0], p_pRows[1]);
+    const __m128i a1 = _mm_unpackhi_epi16(p_pRows[0], p_pRows[1]);
+    const __m128i a2 = _mm_unpacklo_epi16(p_pRows[2], p_pRows[3]);
+    const __m128i a3 = _mm_unpackhi_epi16(p_pRows[2], p_pRows[3]);
+    const __m128i a4 = _mm_unpacklo_epi16(p_pRows[4], p_pRows[5]);
+    const __m128i a5 = _mm_unpackhi_epi16(p_pRows[4], p_pRows[5]);
+    const __m128i a6 = _mm_unpacklo_epi16(p_pRows[6], p_pRows[7]);
+    const __m128i a7 = _mm_unpackhi_epi16(p_pRows[6], p_pRows[7]);
+
+    const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+    const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+    const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+    const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+    const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+    const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+    const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+    const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+    p_pRows[0] = _mm_unpacklo_epi64(b0, b4);
+    p_pRows[1] = _mm_unpackhi_epi64(b0, b4);
+    p_pRows[2] = _mm_unpacklo_epi64(b1, b5);
+    p_pRows[3] = _mm_unpackhi_epi64(b1, b5);
+    p_pRows[4] = _mm_unpacklo_epi64(b2, b6);
+    p_pRows[5] = _mm_unpackhi_epi64(b2, b6);
+    p_pRows[6] = _mm_unpacklo_epi64(b3, b7);
+    p_pRows[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+// 4x4 32 bit samples
+static void s_Transpose4x32(__m128i* p_pRows)
+{
+    const __m128i t0 = _mm_unpacklo_epi32(p_pRows[0], p_pRows[1]);
+    const __m128i t1 = _mm_unpackhi_epi32(p_pRows[0], p_pRows[1]);
+    const __m128i t2 = _mm_unpacklo_epi32(p_pRows[2], p_pRows[3]);
+    const __m128i t3 = _mm_unpackhi_epi32(p_pRows[2], p_pRows[3]);
+
+    p_pRows[0] = _mm_unpacklo_epi64(t0, t2);
+    p_pRows[1] = _mm_unpackhi_epi64(t0, t2);
+    p_pRows[2] = _mm_unpacklo_epi64(t1, t3);
+    p_pRows[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+// 7.1, a 16 bit frame is exactly one vector, 8 frames per step
+static size_t s_Split8Ch16(const uint8_t* p_pSrc, uint8_t* const* p_ppDst, size_t p_NumFrames)
+{
+    size_t i = 0;
+    for (; i + 8 <= p_NumFrames; i += 8)
+    {
+        __m128i rows[8];
+        for (int r = 0; r < 8; ++r)
+        {
+            rows[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + (i + r) * 16));
+        }
+
+        s_Transpose8x16(rows);
+        for (int c = 0; c < 8; ++c)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p_ppDst[c] + i * 2), rows[c]);
+        }
+    }
+
+    return i;
+}
+
+// 5.1, 8 frames of 12 bytes are six vectors. Every frame is shifted into a row of its own, the two lanes past
+// its end hold the next frame's samples and drop out as the unused channels 6 and 7 of the transpose
+static size_t s_Split6Ch16(const uint8_t* p_pSrc, uint8_t* const* p_ppDst, size_t p_NumFrames)
+{
+    size_t i = 0;
+    for (; i + 8 <= p_NumFrames; i += 8)
+    {
+        const __m128i* pIn = reinterpret_cast<const __m128i*>(p_pSrc + i * 12);
+        const __m128i v0 = _mm_loadu_si128(pIn);
+        const __m128i v1 = _mm_loadu_si128(pIn + 1);
+        const __m128i v2 = _mm_loadu_si128(pIn + 2);
+        const __m128i v3 = _mm_loadu_si128(pIn + 3);
+        const __m128i v4 = _mm_loadu_si128(pIn + 4);
+        const __m128i v5 = _mm_loadu_si128(pIn + 5);
+
+        __m128i rows[8];
+        rows[0] = v0;
+        rows[1] = _mm_or_si128(_mm_srli_si128(v0, 12), _mm_slli_si128(v1, 4));
+        rows[2] = _mm_or_si128(_mm_srli_si128(v1, 8), _mm_slli_si128(v2, 8));
+        rows[3] = _mm_srli_si128(v2, 4);
+        rows[4] = v3;
+        rows[5] = _mm_or_si128(_mm_srli_si128(v3, 12), _mm_slli_si128(v4, 4));
+        rows[6] = _mm_or_si128(_mm_srli_si128(v4, 8), _mm_slli_si128(v5, 8));
+        rows[7] = _mm_srli_si128(v5, 4);
+
+        s_Transpose8x16(rows);
+        for (int c = 0; c < 6; ++c)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p_ppDst[c] + i * 2), rows[c]);
+        }
+    }
+
+    return i;
+}
+
+// 7.1 with 32 bit samples, two vectors per frame, 4 frames per step
+static size_t s_Split8Ch32(const uint8_t* p_pSrc, uint8_t* const* p_ppDst, size_t p_NumFrames)
+{
+    size_t i = 0;
+    for (; i + 4 <= p_NumFrames; i += 4)
+    {
+        const __m128i* pIn = reinterpret_cast<const __m128i*>(p_pSrc + i * 32);
+        __m128i front[4];
+        __m128i back[4];
+        for (int r = 0; r < 4; ++r)
+        {
+            front[r] = _mm_loadu_si128(pIn + r * 2);
+            back[r] = _mm_loadu_si128(pIn + r * 2 + 1);
+        }
+
+        s_Transpose4x32(front);
+        s_Transpose4x32(back);
+        for (int c = 0; c < 4; ++c)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p_ppDst[c] + i * 4), front[c]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p_ppDst[c + 4] + i * 4), back[c]);
+        }
+    }
+
+    return i;
+}
+
+// 5.1 with 32 bit samples, 4 frames of 24 bytes are six vectors. Channels 0-3 of a frame are one shifted vector,
+// channels 4 and 5 the low half of another
+static size_t s_Split6Ch32(const uint8_t* p_pSrc, uint8_t* const* p_ppDst, size_t p_NumFrames)
+{
+    size_t i = 0;
+    for (; i + 4 <= p_NumFrames; i += 4)
+    {
+        const __m128i* pIn = reinterpret_cast<const __m128i*>(p_pSrc + i * 24);
+        const __m128i v0 = _mm_loadu_si128(pIn);
+        const __m128i v1 = _mm_loadu_si128(pIn + 1);
+        const __m128i v2 = _mm_loadu_si128(pIn + 2);
+        const __m128i v3 = _mm_loadu_si128(pIn + 3);
+        const __m128i v4 = _mm_loadu_si128(pIn + 4);
+        const __m128i v5 = _mm_loadu_si128(pIn + 5);
+
+        __m128i front[4];
+        front[0] = v0;
+        front[1] = _mm_or_si128(_mm_srli_si128(v1, 8), _mm_slli_si128(v2, 8));
+        front[2] = v3;
+        front[3] = _mm_or_si128(_mm_srli_si128(v4, 8), _mm_slli_si128(v5, 8));
+        s_Transpose4x32(front);
+
+        // channels 4 and 5 of frames 0 and 1, then of frames 2 and 3
+        const __m128i back01 = _mm_unpacklo_epi32(v1, _mm_srli_si128(v2, 8));
+        const __m128i back23 = _mm_unpacklo_epi32(v4, _mm_srli_si128(v5, 8));
+
+        for (int c = 0; c < 4; ++c)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p_ppDst[c] + i * 4), front[c]);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_ppDst[4] + i * 4), _mm_unpacklo_epi64(back01, back23));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_ppDst[5] + i * 4), _mm_unpackhi_epi64(back01, back23));
+    }
+
+    return i;
+}
+#endif
+
+static void s_Deinterleave(const uint8_t* p_pSrc, int p_Bytes, int p_NumChannels, uint8_t* const* p_ppDst, size_t p_NumFrames)
+{
+    size_t numDone = 0;
+#ifdef PCM_CONVERT_SSE2
+    if ((p_NumChannels == 2) && (p_Bytes == 2))
+    {
+        numDone = s_SplitStereo16(p_pSrc, p_ppDst[0], p_ppDst[1], p_NumFrames);
+    }
+    else if ((p_NumChannels == 2) && (p_Bytes == 4))
+    {
+        numDone = s_SplitStereo32(p_pSrc, p_ppDst[0], p_ppDst[1], p_NumFrames);
+    }
+    else if ((p_NumChannels == 6) && (p_Bytes == 2))
+    {
+        numDone = s_Split6Ch16(p_pSrc, p_ppDst, p_NumFrames);
+    }
+    else if ((p_NumChannels == 6) && (p_Bytes == 4))
+    {
+        numDone = s_Split6Ch32(p_pSrc, p_ppDst, p_NumFrames);
+    }
+    else if ((p_NumChannels == 8) && (p_Bytes == 2))
+    {
+        numDone = s_Split8Ch16(p_pSrc, p_ppDst, p_NumFrames);
+    }
+    else if ((p_NumChannels == 8) && (p_Bytes == 4))
+    {
+        numDone = s_Split8Ch32(p_pSrc, p_ppDst, p_NumFrames);
+    }
+#endif
+
+    const uint8_t* pSrc = p_pSrc + numDone * p_NumChannels * p_Bytes;
+    const size_t numFrames = p_NumFrames - numDone;
+    for (int c = 0; c < p_NumChannels; ++c)
+    {
+        uint8_t* pDst = p_ppDst[c] + numDone * p_Bytes;
+        if (p_Bytes == 2)
+        {
+            s_ExtractChannel<2>(pSrc, p_NumChannels, c, pDst, numFrames);
+        }
+        else if (p_Bytes == 3)
+        {
+            s_ExtractChannel<3>(pSrc, p_NumChannels, c, pDst, numFrames);
+        }
+        else
+        {
+            s_ExtractChannel<4>(pSrc, p_NumChannels, c, pDst, numFrames);
+        }
+    }
+}
+
+void g_DeinterleavePCM(const void* p_pSrc, PCMSampleFormat p_SrcFormat, void* const* p_ppDst, PCMSampleFormat p_DstFormat, bool p_IsBigEndian,
+                       size_t p_NumFrames, int p_NumChannels)
+{
+    const uint8_t* pSrc = static_cast<const uint8_t*>(p_pSrc);
+    const int srcBytes = g_PCMBytesPerSample(p_SrcFormat);
+    const int dstBytes = g_PCMBytesPerSample(p_DstFormat);
+
+    // each block is converted interleaved into a buffer that stays in L1, then fanned out to the planes
+    const size_t blockFrames = (p_NumChannels < static_cast<int>(s_BlockSize)) ? (s_BlockSize / p_NumChannels) : 1;
+    uint8_t converted[s_BlockSize * 4];
+    uint8_t* ppDst[8];
+    std::vector<uint8_t*> dstVec;
+    uint8_t** pDstPlanes = ppDst;
+    if (p_NumChannels > 8)
+    {
+        dstVec.resize(p_NumChannels);
+        pDstPlanes = dstVec.data();
+    }
+
+    for (size_t pos = 0; pos < p_NumFrames; pos += blockFrames)
+    {
+        const size_t numFrames = (p_NumFrames - pos < blockFrames) ? (p_NumFrames - pos) : blockFrames;
+        g_ConvertPCM(pSrc + pos * p_NumChannels * srcBytes, p_SrcFormat, converted, p_DstFormat, p_IsBigEndian, numFrames * p_NumChannels);
+
+        for (int c = 0; c < p_NumChannels; ++c)
+        {
+            pDstPlanes[c] = static_cast<uint8_t*>(p_ppDst[c]) + pos * dstBytes;
+        }
+        s_Deinterleave(converted, dstBytes, p_NumChannels, pDstPlanes, numFrames);
+    }
+}
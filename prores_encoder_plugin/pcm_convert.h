@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sample kernels moving interleaved host audio into the LPCM layout of the movie.
+// SSE2 is used where available with a scalar tail, results are bit exact with the scalar path.
+
+enum PCMSampleFormat
+{
+    pcmFormatS16 = 0,
+    pcmFormatS24, // packed, 3 bytes per sample
+    pcmFormatS32,
+    pcmFormatF32,
+};
+
+// bytes per sample of p_Format
+int g_PCMBytesPerSample(PCMSampleFormat p_Format);
+
+// the format the host means by a bit depth and float flag, false if there is none
+bool g_PCMFormatFromBitDepth(uint32_t p_BitDepth, bool p_IsFloat, PCMSampleFormat* p_pFormat);
+
+// converts p_NumSamples samples (frames times channels) from little endian p_SrcFormat to p_DstFormat in the given
+// byte order. Integer depths are narrowed by truncation and widened by shifting, float is clipped and rounded
+void g_ConvertPCM(const void* p_pSrc, PCMSampleFormat p_SrcFormat, void* p_pDst, PCMSampleFormat p_DstFormat, bool p_IsBigEndian, size_t p_NumSamples);
+
+// as g_ConvertPCM, but splits p_NumFrames interleaved frames of p_NumChannels channels into one plane per channel
+void g_DeinterleavePCM(const void* p_pSrc, PCMSampleFormat p_SrcFormat, void* const* p_ppDst, PCMSampleFormat p_DstFormat, bool p_IsBigEndian,
+                       size_t p_NumFrames, int p_NumChannels);
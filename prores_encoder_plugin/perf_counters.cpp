@@ -0,0 +1,167 @@
+#include "perf_counters.h"
+
+#ifdef HAVE_PERF_EVENTS
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "wrapper/host_api.h"
+
+static const uint64_t s_EventConfigs[perfCounterCount] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, // last level cache
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static int s_OpenEvent(uint64_t p_Config, int p_GroupFd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = p_Config;
+    attr.disabled = (p_GroupFd < 0) ? 1 : 0; // the group starts once all members are in
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // this thread on any cpu
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, p_GroupFd, 0));
+}
+
+// one group per thread, the leader counts cycles and a read returns all members at once
+class ThreadPerfCounters
+{
+public:
+    ThreadPerfCounters()
+        : m_IsOpen(false)
+    {
+        for (int i = 0; i < perfCounterCount; ++i)
+        {
+            m_Fds[i] = -1;
+            m_Ids[i] = 0;
+        }
+
+        Open();
+    }
+
+    ~ThreadPerfCounters()
+    {
+        for (int i = perfCounterCount - 1; i >= 0; --i)
+        {
+            if (m_Fds[i] >= 0)
+            {
+                close(m_Fds[i]);
+            }
+        }
+    }
+
+    bool Read(PerfCounterValues* p_pValues) const
+    {
+        if (!m_IsOpen)
+        {
+            return false;
+        }
+
+        // nr, time enabled, time running, then value and id per member
+        uint64_t buf[3 + 2 * perfCounterCount];
+        const ssize_t size = read(m_Fds[perfCounterCycles], buf, sizeof(buf));
+        if (size < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+        {
+            return false;
+        }
+
+        // with more events than hardware counters the kernel multiplexes them, scale up to the enabled time
+        const uint64_t numMembers = buf[0];
+        const double scale = (buf[2] > 0) ? (static_cast<double>(buf[1]) / buf[2]) : 0.0;
+        memset(p_pValues, 0, sizeof(*p_pValues));
+        for (uint64_t i = 0; (i < numMembers) && (i < perfCounterCount); ++i)
+        {
+            const uint64_t value = buf[3 + 2 * i];
+            const uint64_t id = buf[4 + 2 * i];
+            for (int counter = 0; counter < perfCounterCount; ++counter)
+            {
+                if ((m_Fds[counter] >= 0) && (m_Ids[counter] == id))
+                {
+                    p_pValues->values[counter] = static_cast<uint64_t>(value * scale);
+                }
+            }
+        }
+
+        return true;
+    }
+
+private:
+    // disable assignment and copy constructor
+    ThreadPerfCounters(const ThreadPerfCounters& p_Other);
+    ThreadPerfCounters& operator=(const ThreadPerfCounters& p_Other);
+
+    void Open()
+    {
+        static std::atomic<bool> s_IsWarned(false);
+
+        m_Fds[perfCounterCycles] = s_OpenEvent(s_EventConfigs[perfCounterCycles], -1);
+        if (m_Fds[perfCounterCycles] < 0)
+        {
+            if (!s_IsWarned.exchange(true))
+            {
+                g_Log(logLevelWarn, "PerfCounters :: perf_event_open failed: %s, check /proc/sys/kernel/perf_event_paranoid", strerror(errno));
+            }
+            return;
+        }
+
+        for (int i = perfCounterCycles + 1; i < perfCounterCount; ++i)
+        {
+            m_Fds[i] = s_OpenEvent(s_EventConfigs[i], m_Fds[perfCounterCycles]);
+            if ((m_Fds[i] < 0) && !s_IsWarned.exchange(true))
+            {
+                g_Log(logLevelWarn, "PerfCounters :: No %s counter: %s", g_PerfCounterName(i), strerror(errno));
+            }
+        }
+
+        for (int i = 0; i < perfCounterCount; ++i)
+        {
+            if ((m_Fds[i] >= 0) && (ioctl(m_Fds[i], PERF_EVENT_IOC_ID, &m_Ids[i]) != 0))
+            {
+                close(m_Fds[i]);
+                m_Fds[i] = -1;
+            }
+        }
+
+        m_IsOpen = (m_Fds[perfCounterCycles] >= 0) &&
+                   (ioctl(m_Fds[perfCounterCycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == 0);
+    }
+
+private:
+    int m_Fds[perfCounterCount];
+    uint64_t m_Ids[perfCounterCount];
+    bool m_IsOpen;
+};
+
+bool g_ReadThreadPerfCounters(PerfCounterValues* p_pValues)
+{
+    static thread_local ThreadPerfCounters s_Counters;
+    return s_Counters.Read(p_pValues);
+}
+
+#else
+
+bool g_ReadThreadPerfCounters(PerfCounterValues*)
+{
+    return false;
+}
+
+#endif
+
+const char* g_PerfCounterName(int p_Counter)
+{
+    static const char* const s_Names[perfCounterCount] = { "cycles", "instructions", "llc_misses", "branch_misses" };
+    return ((p_Counter >= 0) && (p_Counter < perfCounterCount)) ? s_Names[p_Counter] : "";
+}
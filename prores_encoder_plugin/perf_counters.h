@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// Hardware counters of the calling thread through perf_event_open, for telling compute bound stages from memory
+// bound ones. Only built with make PERF=1 (HAVE_PERF_EVENTS) on Linux, StageTimer then reads them around every
+// stage. The counters cover user space only, so they work with the default perf_event_paranoid of 2.
+
+enum PerfCounter
+{
+    perfCounterCycles = 0,
+    perfCounterInstructions,
+    perfCounterLLCMisses,
+    perfCounterBranchMisses,
+    perfCounterCount
+};
+
+struct PerfCounterValues
+{
+    uint64_t values[perfCounterCount];
+};
+
+// the current counts of the calling thread, opening its counters on the first call. False when they could not be
+// opened, a counter the CPU or hypervisor does not offer stays 0
+bool g_ReadThreadPerfCounters(PerfCounterValues* p_pValues);
+
+// name of p_Counter for logs and reports
+const char* g_PerfCounterName(int p_Counter);
@@ -0,0 +1,216 @@
+#include "pipeline_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "wrapper/host_api.h"
+
+static bool s_IsTraceRequested()
+{
+    const char* pValue = getenv("PRORES_TRACE");
+    return (pValue != NULL) && (pValue[0] != '\0') && (strcmp(pValue, "0") != 0);
+}
+
+PipelineTrace& PipelineTrace::s_GetInstance()
+{
+    static PipelineTrace s_Instance;
+    return s_Instance;
+}
+
+PipelineTrace::PipelineTrace()
+    : m_IsEnabled(s_IsTraceRequested())
+    , m_Origin(std::chrono::steady_clock::now())
+    , m_NextOwnerId(1)
+{
+}
+
+int PipelineTrace::s_GetThreadId()
+{
+    // small sequential ids read better in the trace viewer than native thread ids
+    static std::atomic<int> s_NextId(1);
+    static thread_local int s_ThreadId = 0;
+    if (s_ThreadId == 0)
+    {
+        s_ThreadId = s_NextId++;
+    }
+
+    return s_ThreadId;
+}
+
+uint64_t& PipelineTrace::s_ThreadOwner()
+{
+    static thread_local uint64_t s_OwnerId = 0;
+    return s_OwnerId;
+}
+
+void PipelineTrace::s_SetThreadOwner(uint64_t p_OwnerId)
+{
+    s_ThreadOwner() = p_OwnerId;
+}
+
+uint64_t PipelineTrace::s_GetThreadOwner()
+{
+    return s_ThreadOwner();
+}
+
+uint64_t PipelineTrace::GetOwnerId(const std::string& p_MoviePath)
+{
+    if (!m_IsEnabled)
+    {
+        return 0;
+    }
+
+    // ids start at 1, 0 collects the spans of threads outside any render
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::map<std::string, uint64_t>::const_iterator it = m_OwnerIds.find(p_MoviePath);
+    if (it != m_OwnerIds.end())
+    {
+        return it->second;
+    }
+
+    const uint64_t ownerId = m_NextOwnerId++;
+    m_OwnerIds[p_MoviePath] = ownerId;
+    return ownerId;
+}
+
+void PipelineTrace::s_SetThreadName(const char* p_pName)
+{
+    PipelineTrace& trace = s_GetInstance();
+    if (!trace.m_IsEnabled)
+    {
+        return;
+    }
+
+    const int threadId = s_GetThreadId();
+    std::lock_guard<std::mutex> lock(trace.m_Mutex);
+    trace.m_ThreadNames[threadId] = p_pName;
+}
+
+void PipelineTrace::AddSpan(const char* p_pName, const char* p_pCategory, std::chrono::steady_clock::time_point p_Begin,
+                            std::chrono::steady_clock::time_point p_End, int64_t p_Pts)
+{
+    Span span;
+    span.pName = p_pName;
+    span.pCategory = p_pCategory;
+    span.beginNs = std::chrono::duration_cast<std::chrono::nanoseconds>(p_Begin - m_Origin).count();
+    span.durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(p_End - p_Begin).count();
+    span.pts = p_Pts;
+    span.ownerId = s_ThreadOwner();
+    span.threadId = s_GetThreadId();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_RetiredOwnerIds.count(span.ownerId) > 0)
+    {
+        return;
+    }
+
+    if (m_Spans.size() >= s_MaxSpans)
+    {
+        ++m_NumDropped[span.ownerId];
+        return;
+    }
+
+    m_Spans.push_back(span);
+}
+
+bool PipelineTrace::Write(const std::string& p_Path, uint64_t p_OwnerId)
+{
+    if (!m_IsEnabled)
+    {
+        return true;
+    }
+
+    // the owner's spans move out, the ones of other renders stay for their own Write
+    std::vector<Span> spans;
+    std::map<int, const char*> threadNames;
+    uint64_t numDropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        std::vector<Span>::iterator keptEnd = m_Spans.begin();
+        for (std::vector<Span>::iterator it = m_Spans.begin(); it != m_Spans.end(); ++it)
+        {
+            if (it->ownerId == p_OwnerId)
+            {
+                spans.push_back(*it);
+                std::map<int, const char*>::const_iterator nameIt = m_ThreadNames.find(it->threadId);
+                if (nameIt != m_ThreadNames.end())
+                {
+                    threadNames[nameIt->first] = nameIt->second;
+                }
+            }
+            else
+            {
+                *keptEnd++ = *it;
+            }
+        }
+        m_Spans.erase(keptEnd, m_Spans.end());
+
+        std::map<uint64_t, uint64_t>::iterator droppedIt = m_NumDropped.find(p_OwnerId);
+        if (droppedIt != m_NumDropped.end())
+        {
+            numDropped = droppedIt->second;
+            m_NumDropped.erase(droppedIt);
+        }
+
+        // spans an encoder adds after the container closed would otherwise stay until the process exits
+        for (std::map<std::string, uint64_t>::iterator it = m_OwnerIds.begin(); it != m_OwnerIds.end(); ++it)
+        {
+            if (it->second == p_OwnerId)
+            {
+                m_OwnerIds.erase(it);
+                break;
+            }
+        }
+        if (p_OwnerId != 0)
+        {
+            m_RetiredOwnerIds.insert(p_OwnerId);
+        }
+    }
+
+    FILE* pFile = fopen(p_Path.c_str(), "w");
+    if (pFile == NULL)
+    {
+        g_Log(logLevelError, "PipelineTrace :: Could not create %s", p_Path.c_str());
+        return false;
+    }
+
+    // names and categories are identifiers, they need no escaping
+    fprintf(pFile, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(pFile, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"ProRes plugin\"}}");
+    for (std::map<int, const char*>::const_iterator it = threadNames.begin(); it != threadNames.end(); ++it)
+    {
+        fprintf(pFile, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}}", it->first, it->second);
+    }
+
+    for (size_t i = 0; i < spans.size(); ++i)
+    {
+        const Span& span = spans[i];
+        fprintf(pFile, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                span.pName, span.pCategory, span.threadId, span.beginNs / 1000.0, span.durationNs / 1000.0);
+        if (span.pts >= 0)
+        {
+            fprintf(pFile, ", \"args\": {\"pts\": %lld}", static_cast<long long>(span.pts));
+        }
+        fprintf(pFile, "}");
+    }
+    fprintf(pFile, "\n]}\n");
+
+    const bool isOk = (ferror(pFile) == 0);
+    fclose(pFile);
+    if (!isOk)
+    {
+        g_Log(logLevelError, "PipelineTrace :: Failed to write %s", p_Path.c_str());
+        return false;
+    }
+
+    if (numDropped > 0)
+    {
+        g_Log(logLevelWarn, "PipelineTrace :: Buffer full, %llu spans were not recorded", static_cast<unsigned long long>(numDropped));
+    }
+
+    g_Log(logLevelInfo, "PipelineTrace :: %d spans written to %s", static_cast<int>(spans.size()), p_Path.c_str());
+    return true;
+}
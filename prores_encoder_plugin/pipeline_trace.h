@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Span recorder for the encode and mux pipeline, written as Chrome trace event JSON which Perfetto and
+// chrome://tracing open. It is off unless the PRORES_TRACE environment variable is set to something other
+// than 0 when the plugin loads. Spans of all threads go into one bounded buffer, once it is full further
+// spans are only counted. Every span belongs to the owner set on its thread, the encoders and the container of
+// a render share one owner through their output path, so concurrent renders each write only their own spans.
+
+class PipelineTrace
+{
+public:
+    static PipelineTrace& s_GetInstance();
+
+    static bool s_IsEnabled()
+    {
+        return s_GetInstance().m_IsEnabled;
+    }
+
+    // names the calling thread in the trace, p_pName must be a literal
+    static void s_SetThreadName(const char* p_pName);
+
+    // the owner of the render writing p_MoviePath, 0 when tracing is off
+    uint64_t GetOwnerId(const std::string& p_MoviePath);
+
+    // spans of the calling thread go to p_OwnerId, threads started by an owner take it over
+    static void s_SetThreadOwner(uint64_t p_OwnerId);
+    static uint64_t s_GetThreadOwner();
+
+    // p_pName and p_pCategory must be literals or otherwise outlive the next Write, p_Pts < 0 is left out
+    void AddSpan(const char* p_pName, const char* p_pCategory, std::chrono::steady_clock::time_point p_Begin,
+                 std::chrono::steady_clock::time_point p_End, int64_t p_Pts);
+
+    // writes the spans of p_OwnerId and retires it, its later spans are dropped and the movie path gets a new owner
+    bool Write(const std::string& p_Path, uint64_t p_OwnerId);
+
+private:
+    PipelineTrace();
+
+    // disable assignment and copy constructor
+    PipelineTrace(const PipelineTrace& p_Other);
+    PipelineTrace& operator=(const PipelineTrace& p_Other);
+
+    static int s_GetThreadId();
+    static uint64_t& s_ThreadOwner();
+
+private:
+    static const size_t s_MaxSpans = 1 << 18;
+
+    struct Span
+    {
+        const char* pName;
+        const char* pCategory;
+        int64_t beginNs; // since m_Origin
+        int64_t durationNs;
+        int64_t pts;
+        uint64_t ownerId;
+        int threadId;
+    };
+
+    const bool m_IsEnabled;
+    const std::chrono::steady_clock::time_point m_Origin;
+
+    std::mutex m_Mutex;
+    std::vector<Span> m_Spans;
+    std::map<uint64_t, uint64_t> m_NumDropped; // by owner
+    std::map<int, const char*> m_ThreadNames;
+    std::map<std::string, uint64_t> m_OwnerIds; // by movie path
+    std::set<uint64_t> m_RetiredOwnerIds;
+    uint64_t m_NextOwnerId;
+};
+
+// sets the owner of the calling thread's spans for its scope, the plugin entry points of a render open one
+class TraceOwnerScope
+{
+public:
+    explicit TraceOwnerScope(uint64_t p_OwnerId)
+        : m_PrevOwnerId(PipelineTrace::s_GetThreadOwner())
+    {
+        PipelineTrace::s_SetThreadOwner(p_OwnerId);
+    }
+
+    ~TraceOwnerScope()
+    {
+        PipelineTrace::s_SetThreadOwner(m_PrevOwnerId);
+    }
+
+private:
+    // disable assignment and copy constructor
+    TraceOwnerScope(const TraceOwnerScope& p_Other);
+    TraceOwnerScope& operator=(const TraceOwnerScope& p_Other);
+
+private:
+    const uint64_t m_PrevOwnerId;
+};
+
+// records its own scope as a span when tracing is on
+class TraceSpan
+{
+public:
+    TraceSpan(const char* p_pName, const char* p_pCategory, int64_t p_Pts = -1)
+        : m_pName(p_pName)
+        , m_pCategory(p_pCategory)
+        , m_Pts(p_Pts)
+        , m_IsEnabled(PipelineTrace::s_IsEnabled())
+    {
+        if (m_IsEnabled)
+        {
+            m_BeganAt = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (m_IsEnabled)
+        {
+            PipelineTrace::s_GetInstance().AddSpan(m_pName, m_pCategory, m_BeganAt, std::chrono::steady_clock::now(), m_Pts);
+        }
+    }
+
+    void SetPts(int64_t p_Pts)
+    {
+        m_Pts = p_Pts;
+    }
+
+private:
+    // disable assignment and copy constructor
+    TraceSpan(const TraceSpan& p_Other);
+    TraceSpan& operator=(const TraceSpan& p_Other);
+
+private:
+    const char* m_pName;
+    const char* m_pCategory;
+    int64_t m_Pts;
+    bool m_IsEnabled;
+    std::chrono::steady_clock::time_point m_BeganAt;
+};
@@ -0,0 +1,151 @@
+#include "pixel_convert.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PIXEL_CONVERT_SSE2 1
+#endif
+
+#ifdef PIXEL_CONVERT_SSE2
+// splits 8 AYUV pixels into 8 Y, 8 U and 8 V lanes already scaled to 10 bits
+static inline void s_LoadAYUV8(const uint16_t* p_pSrc, __m128i& p_Y, __m128i& p_U, __m128i& p_V)
+{
+    const __m128i a = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc)), 6);
+    const __m128i b = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 8)), 6);
+    const __m128i c = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 16)), 6);
+    const __m128i d = _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + 24)), 6);
+
+    const __m128i t0 = _mm_unpacklo_epi16(a, b); // A0 A2 Y0 Y2 U0 U2 V0 V2
+    const __m128i t1 = _mm_unpackhi_epi16(a, b); // A1 A3 Y1 Y3 U1 U3 V1 V3
+    const __m128i t2 = _mm_unpacklo_epi16(c, d);
+    const __m128i t3 = _mm_unpackhi_epi16(c, d);
+
+    const __m128i u0 = _mm_unpacklo_epi16(t0, t1); // A0 A1 A2 A3 Y0 Y1 Y2 Y3
+    const __m128i u1 = _mm_unpackhi_epi16(t0, t1); // U0 U1 U2 U3 V0 V1 V2 V3
+    const __m128i u2 = _mm_unpacklo_epi16(t2, t3);
+    const __m128i u3 = _mm_unpackhi_epi16(t2, t3);
+
+    p_Y = _mm_unpackhi_epi64(u0, u2);
+    p_U = _mm_unpacklo_epi64(u1, u3);
+    p_V = _mm_unpackhi_epi64(u1, u3);
+}
+
+// odd lanes of two 8 sample vectors, packed as 4 + 4 samples
+static inline __m128i s_OddLanes(const __m128i& p_A, const __m128i& p_B)
+{
+    return _mm_packs_epi32(_mm_srli_epi32(p_A, 16), _mm_srli_epi32(p_B, 16));
+}
+#endif
+
+void g_ConvertAYUVToYUV444P10(const uint16_t* p_pSrc, int p_Width, uint16_t* p_pY, uint16_t* p_pU, uint16_t* p_pV)
+{
+    int x = 0;
+#ifdef PIXEL_CONVERT_SSE2
+    for (; x + 8 <= p_Width; x += 8)
+    {
+        __m128i y, u, v;
+        s_LoadAYUV8(p_pSrc, y, u, v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pY + x), y);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pU + x), u);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pV + x), v);
+        p_pSrc += 32;
+    }
+#endif
+    for (; x < p_Width; ++x)
+    {
+        p_pY[x] = p_pSrc[1] >> 6;
+        p_pU[x] = p_pSrc[2] >> 6;
+        p_pV[x] = p_pSrc[3] >> 6;
+        p_pSrc += 4;
+    }
+}
+
+void g_ConvertAYUVToYUV422P10(const uint16_t* p_pSrc, int p_Width, uint16_t* p_pY, uint16_t* p_pU, uint16_t* p_pV)
+{
+    int x = 0;
+#ifdef PIXEL_CONVERT_SSE2
+    for (; x + 8 <= p_Width; x += 8)
+    {
+        __m128i y, u, v;
+        s_LoadAYUV8(p_pSrc, y, u, v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pY + x), y);
+
+        const __m128i uv = s_OddLanes(u, v);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p_pU + x / 2), uv);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(p_pV + x / 2), _mm_unpackhi_epi64(uv, uv));
+        p_pSrc += 32;
+    }
+#endif
+    for (; x < p_Width; ++x)
+    {
+        p_pY[x] = p_pSrc[1] >> 6;
+        p_pU[x / 2] = p_pSrc[2] >> 6;
+        p_pV[x / 2] = p_pSrc[3] >> 6;
+        p_pSrc += 4;
+    }
+}
+
+void g_DecimateChromaRow(const uint16_t* p_pSrc, int p_SrcWidth, uint16_t* p_pDst)
+{
+    int x = 0;
+#ifdef PIXEL_CONVERT_SSE2
+    for (; x + 16 <= p_SrcWidth; x += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + x));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + x + 8));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + x / 2), s_OddLanes(a, b));
+    }
+#endif
+    for (; x < p_SrcWidth; ++x)
+    {
+        p_pDst[x / 2] = p_pSrc[x];
+    }
+}
+
+void g_UpsampleChromaRow(const uint16_t* p_pSrc, int p_DstWidth, uint16_t* p_pDst)
+{
+    int x = 0;
+#ifdef PIXEL_CONVERT_SSE2
+    for (; x + 16 <= p_DstWidth; x += 16)
+    {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_pSrc + x / 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + x), _mm_unpacklo_epi16(a, a));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p_pDst + x + 8), _mm_unpackhi_epi16(a, a));
+    }
+#endif
+    for (; x < p_DstWidth; ++x)
+    {
+        p_pDst[x] = p_pSrc[x / 2];
+    }
+}
+
+void g_DownscalePlane2x(const uint16_t* p_pSrc, int p_SrcStride, uint16_t* p_pDst, int p_DstStride, int p_DstWidth, int p_DstHeight)
+{
+    for (int y = 0; y < p_DstHeight; ++y)
+    {
+        const uint16_t* pRow0 = reinterpret_cast<const uint16_t*>(reinterpret_cast<const uint8_t*>(p_pSrc) + (2 * y) * p_SrcStride);
+        const uint16_t* pRow1 = reinterpret_cast<const uint16_t*>(reinterpret_cast<const uint8_t*>(p_pSrc) + (2 * y + 1) * p_SrcStride);
+        uint16_t* pDst = reinterpret_cast<uint16_t*>(reinterpret_cast<uint8_t*>(p_pDst) + y * p_DstStride);
+
+        int x = 0;
+#ifdef PIXEL_CONVERT_SSE2
+        const __m128i ones = _mm_set1_epi16(1);
+        const __m128i round = _mm_set1_epi32(2);
+        for (; x + 8 <= p_DstWidth; x += 8)
+        {
+            // 10 bit samples, the sum of four fits a 16 bit lane
+            const __m128i s0 = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + 2 * x)),
+                                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + 2 * x)));
+            const __m128i s1 = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow0 + 2 * x + 8)),
+                                             _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRow1 + 2 * x + 8)));
+
+            const __m128i p0 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(s0, ones), round), 2);
+            const __m128i p1 = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(s1, ones), round), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + x), _mm_packs_epi32(p0, p1));
+        }
+#endif
+        for (; x < p_DstWidth; ++x)
+        {
+            pDst[x] = static_cast<uint16_t>((pRow0[2 * x] + pRow0[2 * x + 1] + pRow1[2 * x] + pRow1[2 * x + 1] + 2) >> 2);
+        }
+    }
+}
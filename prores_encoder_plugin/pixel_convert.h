@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// Row kernels moving host pixels into the planar 10 bit layouts the ProRes encoder takes.
+// SSE2 is used where available with a scalar tail, results are bit exact with the scalar path.
+
+// host AYUV 16 bit (A, Y, U, V per pixel) to planar 4:4:4 10 bit
+void g_ConvertAYUVToYUV444P10(const uint16_t* p_pSrc, int p_Width, uint16_t* p_pY, uint16_t* p_pU, uint16_t* p_pV);
+
+// host AYUV 16 bit to planar 4:2:2 10 bit, chroma is taken from the odd pixel of each pair
+void g_ConvertAYUVToYUV422P10(const uint16_t* p_pSrc, int p_Width, uint16_t* p_pY, uint16_t* p_pU, uint16_t* p_pV);
+
+// 4:4:4 chroma row to 4:2:2, same odd pixel siting as g_ConvertAYUVToYUV422P10
+void g_DecimateChromaRow(const uint16_t* p_pSrc, int p_SrcWidth, uint16_t* p_pDst);
+
+// 4:2:2 chroma row to 4:4:4 by repeating samples
+void g_UpsampleChromaRow(const uint16_t* p_pSrc, int p_DstWidth, uint16_t* p_pDst);
+
+// 2:1 box filter of one plane, strides in bytes, p_DstWidth/p_DstHeight must not exceed half the source
+void g_DownscalePlane2x(const uint16_t* p_pSrc, int p_SrcStride, uint16_t* p_pDst, int p_DstStride, int p_DstWidth, int p_DstHeight);
@@ -7,6 +7,8 @@
 #include "prores_encoder.h"
 #include "audio_encoder.h"
 #include "mov_container.h"
+#include "plugin_log.h"
+#include "live_stats.h"
 
 // NOTE: When creating a plugin for release, please generate a new Plugin UUID in order to prevent conflicts with other third-party plugins.
 static const uint8_t pMyUUID[] = { 0x5d, 0x43, 0xce, 0x60, 0x45, 0x11, 0x4f, 0x58, 0x87, 0xde, 0xf3, 0x02, 0x80, 0x1e, 0x7b, 0xbc };
@@ -41,6 +43,11 @@ StatusCode g_HandleCreateObj(unsigned char* p_pUUID, ObjectRef* p_ppObj)
         *p_ppObj = new AudioEncoder();
         return errNone;
     }
+    else if (memcmp(p_pUUID, AudioEncoder::s_AacUUID, 16) == 0)
+    {
+        *p_ppObj = new AudioEncoder(true);
+        return errNone;
+    }
 
     return errUnsupported;
 }
@@ -50,11 +57,14 @@ StatusCode g_HandlePluginStart()
     av_register_all();
     avcodec_register_all();
 
+    AsyncLogger::s_GetInstance().Start();
     return errNone;
 }
 
 StatusCode g_HandlePluginTerminate()
 {
+    LiveStatsSegment::s_GetInstance().Close();
+    AsyncLogger::s_GetInstance().Stop();
     return errNone;
 }
 
@@ -88,7 +98,11 @@ StatusCode g_GetEncoderSettings(unsigned char* p_pUUID, HostPropertyCollectionRe
     }
     else if (memcmp(p_pUUID, AudioEncoder::s_UUID, 16) == 0)
     {
-        return AudioEncoder::s_GetEncoderSettings(p_pValues, p_pSettingsList);
+        return AudioEncoder::s_GetEncoderSettings(false, p_pValues, p_pSettingsList);
+    }
+    else if (memcmp(p_pUUID, AudioEncoder::s_AacUUID, 16) == 0)
+    {
+        return AudioEncoder::s_GetEncoderSettings(true, p_pValues, p_pSettingsList);
     }
 
     return errNoCodec;
@@ -0,0 +1,194 @@
+#include "plugin_log.h"
+
+#include <stdio.h>
+
+#include <chrono>
+
+static const uint32_t s_LogMaxPerWindow = 10;
+static const int64_t s_LogWindowMs = 1000;
+
+// the drain thread wakes up this often on its own, errors wake it right away
+static const int s_DrainIntervalMs = 50;
+
+bool g_LogRateCheck(LogRateLimit* p_pLimit, uint32_t* p_pNumSuppressed)
+{
+    const int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    // whoever moves the window on resets its count, the others see either window
+    int64_t windowStartMs = p_pLimit->windowStartMs.load(std::memory_order_relaxed);
+    if ((nowMs - windowStartMs >= s_LogWindowMs) && p_pLimit->windowStartMs.compare_exchange_strong(windowStartMs, nowMs, std::memory_order_relaxed))
+    {
+        p_pLimit->numInWindow.store(0, std::memory_order_relaxed);
+    }
+
+    if (p_pLimit->numInWindow.fetch_add(1, std::memory_order_relaxed) < s_LogMaxPerWindow)
+    {
+        *p_pNumSuppressed = p_pLimit->numSuppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    p_pLimit->numSuppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void g_LogAsync(uint32_t p_LogLevel, uint32_t p_NumSuppressed, const char* p_pFmt, ...)
+{
+    va_list args;
+    va_start(args, p_pFmt);
+    AsyncLogger::s_GetInstance().Log(p_LogLevel, p_NumSuppressed, p_pFmt, args);
+    va_end(args);
+}
+
+AsyncLogger& AsyncLogger::s_GetInstance()
+{
+    static AsyncLogger s_Logger;
+    return s_Logger;
+}
+
+AsyncLogger::AsyncLogger()
+    : m_WritePos(0)
+    , m_ReadPos(0)
+    , m_NumDropped(0)
+    , m_IsRunning(false)
+    , m_IsStopping(false)
+{
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    Stop();
+}
+
+void AsyncLogger::Start()
+{
+    if (m_Worker.joinable())
+    {
+        return;
+    }
+
+    // the slots stay allocated after Stop, a late producer may still be writing into one
+    if (!m_pSlots)
+    {
+        m_pSlots.reset(new Slot[s_NumSlots]);
+        for (size_t i = 0; i < s_NumSlots; ++i)
+        {
+            m_pSlots[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_WritePos.store(0, std::memory_order_relaxed);
+        m_ReadPos = 0;
+    }
+
+    m_IsStopping = false;
+    m_Worker = std::thread(&AsyncLogger::DrainLoop, this);
+    m_IsRunning.store(true, std::memory_order_release);
+}
+
+void AsyncLogger::Stop()
+{
+    if (!m_Worker.joinable())
+    {
+        return;
+    }
+
+    m_IsRunning.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_IsStopping = true;
+    }
+    m_WakeCond.notify_one();
+    m_Worker.join();
+}
+
+void AsyncLogger::Log(uint32_t p_LogLevel, uint32_t p_NumSuppressed, const char* p_pFmt, va_list p_Args)
+{
+    if (!IsRunning())
+    {
+        char msg[s_MsgSize];
+        vsnprintf(msg, sizeof(msg), p_pFmt, p_Args);
+        if (p_NumSuppressed > 0)
+        {
+            g_Log(p_LogLevel, "%s (%u more suppressed)", msg, p_NumSuppressed);
+        }
+        else
+        {
+            g_Log(p_LogLevel, "%s", msg);
+        }
+        return;
+    }
+
+    // claim the slot at the write position, a slot still holding an older message means the ring is full
+    uint64_t pos = m_WritePos.load(std::memory_order_relaxed);
+    Slot* pSlot = NULL;
+    while (true)
+    {
+        pSlot = &m_pSlots[pos & (s_NumSlots - 1)];
+        const int64_t diff = static_cast<int64_t>(pSlot->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0)
+        {
+            if (m_WritePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            m_NumDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = m_WritePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    pSlot->logLevel = p_LogLevel;
+    const int len = vsnprintf(pSlot->msg, s_MsgSize, p_pFmt, p_Args);
+    if ((p_NumSuppressed > 0) && (len >= 0) && (static_cast<size_t>(len) < s_MsgSize))
+    {
+        snprintf(pSlot->msg + len, s_MsgSize - len, " (%u more suppressed)", p_NumSuppressed);
+    }
+    pSlot->seq.store(pos + 1, std::memory_order_release);
+
+    if (p_LogLevel == logLevelError)
+    {
+        m_WakeCond.notify_one();
+    }
+}
+
+void AsyncLogger::DrainQueued()
+{
+    while (true)
+    {
+        Slot& slot = m_pSlots[m_ReadPos & (s_NumSlots - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != m_ReadPos + 1)
+        {
+            break;
+        }
+
+        g_Log(slot.logLevel, "%s", slot.msg);
+        slot.seq.store(m_ReadPos + s_NumSlots, std::memory_order_release);
+        ++m_ReadPos;
+    }
+
+    const uint64_t numDropped = m_NumDropped.exchange(0, std::memory_order_relaxed);
+    if (numDropped > 0)
+    {
+        g_Log(logLevelWarn, "Plugin :: %llu log messages dropped, the log queue was full", static_cast<unsigned long long>(numDropped));
+    }
+}
+
+void AsyncLogger::DrainLoop()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    while (!m_IsStopping)
+    {
+        lock.unlock();
+        DrainQueued();
+        lock.lock();
+
+        m_WakeCond.wait_for(lock, std::chrono::milliseconds(s_DrainIntervalMs));
+    }
+    lock.unlock();
+
+    DrainQueued();
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "wrapper/host_api.h"
+
+// Logging for the encode paths. PLUGIN_LOG formats into a lock-free ring and a background thread hands the
+// messages to g_Log, so the calling thread never waits on the host. Levels above PLUGIN_LOG_MAX_LEVEL are
+// compiled out, build with LOG_LEVEL=2 to keep the info messages. Errors always go through, for the other levels
+// each call site passes at most s_LogMaxPerWindow messages per second, the rest are counted and reported with the
+// next one let through.
+
+#ifndef PLUGIN_LOG_MAX_LEVEL
+#define PLUGIN_LOG_MAX_LEVEL 1 // logLevelWarn
+#endif
+
+#define PLUGIN_LOG(p_Level, ...)                                         \
+    do                                                                   \
+    {                                                                    \
+        if ((p_Level) <= PLUGIN_LOG_MAX_LEVEL)                           \
+        {                                                                \
+            static LogRateLimit s_RateLimit;                             \
+            uint32_t numSuppressed = 0;                                  \
+            if (((p_Level) == logLevelError) ||                          \
+                g_LogRateCheck(&s_RateLimit, &numSuppressed))            \
+            {                                                            \
+                g_LogAsync((p_Level), numSuppressed, __VA_ARGS__);       \
+            }                                                            \
+        }                                                                \
+    } while (0)
+
+// per call site state, zero initialized as a static
+struct LogRateLimit
+{
+    std::atomic<int64_t> windowStartMs;
+    std::atomic<uint32_t> numInWindow;
+    std::atomic<uint32_t> numSuppressed;
+};
+
+// whether the call site may log now, p_pNumSuppressed gets the messages dropped since it last could
+bool g_LogRateCheck(LogRateLimit* p_pLimit, uint32_t* p_pNumSuppressed);
+
+// queues the message, or logs it right away while AsyncLogger is not running
+void g_LogAsync(uint32_t p_LogLevel, uint32_t p_NumSuppressed, const char* p_pFmt, ...);
+
+// Bounded multi producer, single consumer ring of formatted messages. Producers claim a slot with one CAS and
+// format straight into it, a full ring drops the message rather than blocking the encoder.
+class AsyncLogger
+{
+public:
+    static AsyncLogger& s_GetInstance();
+
+    // from plugin start and terminate, Stop hands everything queued to the host before it returns
+    void Start();
+    void Stop();
+
+    bool IsRunning() const
+    {
+        return m_IsRunning.load(std::memory_order_acquire);
+    }
+
+    void Log(uint32_t p_LogLevel, uint32_t p_NumSuppressed, const char* p_pFmt, va_list p_Args);
+
+private:
+    AsyncLogger();
+    ~AsyncLogger();
+
+    // disable assignment and copy constructor
+    AsyncLogger(const AsyncLogger& p_Other);
+    AsyncLogger& operator=(const AsyncLogger& p_Other);
+
+    void DrainLoop();
+    void DrainQueued();
+
+private:
+    static const size_t s_NumSlots = 512; // power of two
+    static const size_t s_MsgSize = 500;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> seq; // == position when free, position + 1 when it holds the message
+        uint32_t logLevel;
+        char msg[s_MsgSize];
+    };
+
+    std::unique_ptr<Slot[]> m_pSlots;
+    alignas(64) std::atomic<uint64_t> m_WritePos;
+    alignas(64) uint64_t m_ReadPos; // drain thread only
+    std::atomic<uint64_t> m_NumDropped;
+    std::atomic<bool> m_IsRunning;
+
+    std::thread m_Worker;
+    std::mutex m_Mutex;
+    std::condition_variable m_WakeCond;
+    bool m_IsStopping;
+};
@@ -8,6 +8,12 @@
 #include <algorithm>
 #include <thread>
 #include "prores_props.h"
+#include "pixel_convert.h"
+#include "prores_rendition.h"
+#include "prores_verify.h"
+#include "prores_handoff.h"
+#include "prores_resume.h"
+#include "plugin_log.h"
 
 
 
@@ -15,6 +21,24 @@ const uint8_t ProResEncoder::s_UUID[] = { 0x71, 0x40, 0x3b, 0xa6, 0x7a, 0x34, 0x
 
 static const char * const prores_profile_names[] = { "422 Proxy", "422 LT", "422", "422 HQ", "4444", "4444 XQ", 0 };
 
+// additional outputs encoded from the same host frame, see ProResRendition
+static const int s_NumRenditions = 2;
+static const char * const s_RenditionDefaultSuffixes[s_NumRenditions] = { "_mezzanine", "_proxy" };
+
+enum EncoderStage
+{
+    encoderStageHost = 0, // from the return of DoProcess to the next call, the host rendering and delivering the frame
+    encoderStageConvert, // AYUV to planar YUV
+    encoderStageRenditions,
+    encoderStageSendFrame,
+    encoderStageReceivePacket,
+    encoderStageOutputCopy, // packet into the host buffer
+    encoderStageSendOutput, // the host passing the packet on, includes the container's write
+    encoderStageCount
+};
+
+static const char * const s_EncoderStageNames[encoderStageCount] = { "host", "convert", "renditions", "send_frame", "receive_packet", "output_copy", "send_output" };
+
 
 class UISettingsController
 {
@@ -45,6 +69,23 @@ public:
         }
 
         p_pValues->GetINT32("prores_profile", m_Profile);
+        p_pValues->GetUINT8(pIOPropResumable, m_IsResumable);
+        p_pValues->GetUINT8(pIOPropDirectIO, m_IsDirectIO);
+        p_pValues->GetUINT8(pIOPropNativeMuxer, m_IsNativeMuxer);
+        p_pValues->GetUINT8(pIOPropFastStart, m_IsFastStart);
+        p_pValues->GetINT32(pIOPropFragmentSeconds, m_FragmentSeconds);
+        p_pValues->GetString(pIOPropMirrorDirs, m_MirrorDirs);
+        p_pValues->GetString(pIOPropStripeDirs, m_StripeDirs);
+        p_pValues->GetUINT8("prores_verify", m_IsVerifying);
+        p_pValues->GetUINT8(pIOPropStageStats, m_IsStageStats);
+        p_pValues->GetUINT8(pIOPropPacketHandoff, m_IsPacketHandoff);
+
+        for (int i = 0; i < s_NumRenditions; ++i)
+        {
+            p_pValues->GetINT32(GetRenditionKey(i, "profile").c_str(), m_Renditions[i].profile);
+            p_pValues->GetINT32(GetRenditionKey(i, "size").c_str(), m_Renditions[i].isHalfSize);
+            p_pValues->GetString(GetRenditionKey(i, "suffix").c_str(), m_Renditions[i].suffix);
+        }
         //p_pValues->GetINT32("x264_bitrate", m_BitRate);
     }
 
@@ -72,6 +113,12 @@ public:
             return err;
         }
 
+        err = RenderRenditions(p_pSettingsList);
+        if (err != errNone)
+        {
+            return err;
+        }
+
         {
             HostUIConfigEntryRef item("x264_reset");
             item.MakeButton("Reset");
@@ -90,6 +137,23 @@ private:
     void InitDefaults()
     {
         m_Profile = 2;
+        m_IsResumable = 0;
+        m_IsDirectIO = 0;
+        m_IsNativeMuxer = 0;
+        m_IsFastStart = 0;
+        m_FragmentSeconds = 0;
+        m_MirrorDirs.clear();
+        m_StripeDirs.clear();
+        m_IsVerifying = 0;
+        m_IsStageStats = 0;
+        m_IsPacketHandoff = 0;
+
+        for (int i = 0; i < s_NumRenditions; ++i)
+        {
+            m_Renditions[i].profile = -1;
+            m_Renditions[i].isHalfSize = (i == (s_NumRenditions - 1)) ? 1 : 0;
+            m_Renditions[i].suffix = s_RenditionDefaultSuffixes[i];
+        }
         //m_BitRate = 0;
     }
 
@@ -130,6 +194,184 @@ private:
             }
         }
 
+        {
+            HostUIConfigEntryRef item(pIOPropResumable);
+            item.MakeCheckBox("Resumable", "Keep a write journal and resume interrupted renders", m_IsResumable != 0);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate resumable UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropDirectIO);
+            item.MakeCheckBox("Unbuffered Output", "Preallocate the movie and bypass the system file cache", m_IsDirectIO != 0);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate unbuffered output UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropNativeMuxer);
+            item.MakeCheckBox("Streaming Muxer", "Keep the sample tables on disk instead of in memory, for very long renders", m_IsNativeMuxer != 0);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate streaming muxer UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropFastStart);
+            item.MakeCheckBox("Fast Start", "Put the movie header in front of the media data, uses the streaming muxer", m_IsFastStart != 0);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate fast start UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropFragmentSeconds);
+
+            std::vector<std::string> textsVec;
+            std::vector<int> valuesVec;
+            static const int s_FragmentSeconds[] = { 0, 1, 2, 5, 10 };
+            for (size_t i = 0; i < sizeof(s_FragmentSeconds) / sizeof(s_FragmentSeconds[0]); ++i)
+            {
+                textsVec.push_back((s_FragmentSeconds[i] == 0) ? std::string("Off") : (std::to_string(s_FragmentSeconds[i]) + " s"));
+                valuesVec.push_back(s_FragmentSeconds[i]);
+            }
+
+            item.MakeComboBox("Fragments", textsVec, valuesVec, m_FragmentSeconds);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate fragments UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropMirrorDirs);
+            item.MakeTextBox("Mirror To", m_MirrorDirs, "folders, ; separated");
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate mirror UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropStripeDirs);
+            item.MakeTextBox("Stripe To", m_StripeDirs, "folders, ; separated");
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate stripe UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item("prores_verify");
+            item.MakeCheckBox("Verify", "Decode while rendering and write a QC report", m_IsVerifying != 0);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate verify UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropStageStats);
+            item.MakeCheckBox("Stage Statistics", "Write per stage timings of the encoder and muxer next to the movie", m_IsStageStats != 0);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate stage statistics UI entry");
+                return errFail;
+            }
+        }
+
+        {
+            HostUIConfigEntryRef item(pIOPropPacketHandoff);
+            item.MakeCheckBox("Zero Copy Handoff", "Pass encoded frames to the container in memory instead of through the host", m_IsPacketHandoff != 0);
+            if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+            {
+                g_Log(logLevelError, "X264 Plugin :: Failed to populate handoff UI entry");
+                return errFail;
+            }
+        }
+
+        return errNone;
+    }
+
+    static std::string GetRenditionKey(int p_Idx, const char* p_pName)
+    {
+        return std::string("prores_rend") + std::to_string(p_Idx + 1) + "_" + p_pName;
+    }
+
+    StatusCode RenderRenditions(HostListRef* p_pSettingsList)
+    {
+        for (int i = 0; i < s_NumRenditions; ++i)
+        {
+            const std::string label = "Rendition " + std::to_string(i + 1);
+            const bool isOff = (m_Renditions[i].profile < 0);
+
+            {
+                HostUIConfigEntryRef item(GetRenditionKey(i, "profile"));
+
+                std::vector<std::string> textsVec;
+                std::vector<int> valuesVec;
+                textsVec.push_back("Off");
+                valuesVec.push_back(-1);
+                for (int count = 0; prores_profile_names[count] != 0; ++count)
+                {
+                    textsVec.push_back(prores_profile_names[count]);
+                    valuesVec.push_back(count);
+                }
+
+                item.MakeComboBox(label, textsVec, valuesVec, m_Renditions[i].profile);
+                item.SetTriggersUpdate(true);
+                if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+                {
+                    g_Log(logLevelError, "X264 Plugin :: Failed to populate rendition profile UI entry");
+                    return errFail;
+                }
+            }
+
+            {
+                HostUIConfigEntryRef item(GetRenditionKey(i, "size"));
+
+                std::vector<std::string> textsVec;
+                std::vector<int> valuesVec;
+                textsVec.push_back("Full");
+                valuesVec.push_back(0);
+                textsVec.push_back("Half");
+                valuesVec.push_back(1);
+
+                item.MakeComboBox(label + " Size", textsVec, valuesVec, m_Renditions[i].isHalfSize);
+                item.SetDisabled(isOff);
+                if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+                {
+                    g_Log(logLevelError, "X264 Plugin :: Failed to populate rendition size UI entry");
+                    return errFail;
+                }
+            }
+
+            {
+                HostUIConfigEntryRef item(GetRenditionKey(i, "suffix"));
+                item.MakeTextBox(label + " Suffix", m_Renditions[i].suffix, "");
+                item.SetDisabled(isOff);
+                if (!item.IsSuccess() || !p_pSettingsList->Append(&item))
+                {
+                    g_Log(logLevelError, "X264 Plugin :: Failed to populate rendition suffix UI entry");
+                    return errFail;
+                }
+            }
+        }
+
         return errNone;
     }
 
@@ -169,6 +411,47 @@ public:
         return m_Profile;
     }
 
+    bool IsResumable() const
+    {
+        return (m_IsResumable != 0);
+    }
+
+    bool IsVerifying() const
+    {
+        return (m_IsVerifying != 0);
+    }
+
+    bool IsStageStats() const
+    {
+        return (m_IsStageStats != 0);
+    }
+
+    bool IsPacketHandoff() const
+    {
+        return (m_IsPacketHandoff != 0);
+    }
+
+    int GetNumRenditions() const
+    {
+        return s_NumRenditions;
+    }
+
+    // -1 when the rendition is off
+    int32_t GetRenditionProfile(int p_Idx) const
+    {
+        return m_Renditions[p_Idx].profile;
+    }
+
+    bool IsRenditionHalfSize(int p_Idx) const
+    {
+        return (m_Renditions[p_Idx].isHalfSize != 0);
+    }
+
+    const std::string& GetRenditionSuffix(int p_Idx) const
+    {
+        return m_Renditions[p_Idx].suffix;
+    }
+
     // int32_t GetBitRate() const
     // {
     //     return m_BitRate * 8;
@@ -179,7 +462,25 @@ public:
 private:
     HostCodecConfigCommon m_CommonProps;
     int32_t m_Profile;
+    uint8_t m_IsResumable;
+    uint8_t m_IsDirectIO;
+    uint8_t m_IsNativeMuxer;
+    uint8_t m_IsFastStart;
+    int32_t m_FragmentSeconds;
+    std::string m_MirrorDirs;
+    std::string m_StripeDirs;
+    uint8_t m_IsVerifying;
+    uint8_t m_IsStageStats;
+    uint8_t m_IsPacketHandoff;
     //int32_t m_BitRate;
+
+    struct RenditionSettings
+    {
+        int32_t profile;
+        int32_t isHalfSize;
+        std::string suffix;
+    };
+    RenditionSettings m_Renditions[s_NumRenditions];
 };
 
 StatusCode ProResEncoder::s_GetEncoderSettings(HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList)
@@ -281,6 +582,11 @@ ProResEncoder::ProResEncoder()
     , m_frame(0)
     , m_packet(0)
     , m_Error(errNone)
+    , m_IsResumePending(false)
+    , m_HandoffOwnerId(ProResPacketRegistry::s_GetInstance().NewOwnerId())
+    , m_TraceOwnerId(0)
+    , m_StageStats("encoder", s_EncoderStageNames, encoderStageCount)
+    , m_FrameBytes(0)
 {
 
 
@@ -288,15 +594,24 @@ ProResEncoder::ProResEncoder()
 
 ProResEncoder::~ProResEncoder()
 {
-    g_Log(logLevelError, "X264 Plugin :: Destructor");
+    PLUGIN_LOG(logLevelError, "X264 Plugin :: Destructor");
+    CloseRenditions();
+    CloseVerifier();
     CloseAV();
+    CloseStageStats();
+    m_LiveStats.Close();
+
+    ProResPacketRegistry::s_GetInstance().Drop(m_HandoffOwnerId);
 }
 
 void ProResEncoder::DoFlush()
     
 {
   g_Log(logLevelInfo, "X264 Plugin :: DoFlush");
+  TraceOwnerScope traceOwner(m_TraceOwnerId);
 
+  CloseRenditions();
+  CloseVerifier();
   CloseAV();
 
 
@@ -312,6 +627,9 @@ void ProResEncoder::DoFlush()
         sts = DoProcess(NULL);
     }
 
+    // after the drain so its send_frame and receive_packet calls count, on an error the destructor closes them
+    CloseStageStats();
+    m_LiveStats.Close();
 
     return;
 }
@@ -394,6 +712,91 @@ void ProResEncoder::OpenAV()
 
 }
 
+void ProResEncoder::OpenRenditions()
+{
+    CloseRenditions();
+
+    // a resumed render skips the frames the partial file already holds, the renditions would lose them
+    if (m_pSettings->IsResumable())
+    {
+        for (int i = 0; i < m_pSettings->GetNumRenditions(); ++i)
+        {
+            if (m_pSettings->GetRenditionProfile(i) >= 0)
+            {
+                g_Log(logLevelWarn, "X264 Plugin :: Renditions are not written in resumable renders");
+                break;
+            }
+        }
+        return;
+    }
+
+    // renditions go next to the main output, named after it
+    std::string basePath = m_CommonProps.GetPath();
+    const size_t extPos = basePath.rfind('.');
+    const size_t sepPos = basePath.find_last_of("/\\");
+    if ((extPos != std::string::npos) && ((sepPos == std::string::npos) || (extPos > sepPos)))
+    {
+        basePath.resize(extPos);
+    }
+
+    for (int i = 0; i < m_pSettings->GetNumRenditions(); ++i)
+    {
+        const int32_t profile = m_pSettings->GetRenditionProfile(i);
+        if ((profile < 0) || basePath.empty())
+        {
+            continue;
+        }
+
+        std::unique_ptr<ProResRendition> pRendition(new ProResRendition(profile, m_pSettings->IsRenditionHalfSize(i), basePath + m_pSettings->GetRenditionSuffix(i) + ".mov"));
+        if (!pRendition->Open(m_CommonProps.GetWidth(), m_CommonProps.GetHeight(), m_CommonProps.GetFrameRateNum(), m_CommonProps.GetFrameRateDen()))
+        {
+            g_Log(logLevelError, "X264 Plugin :: Failed to open rendition %s", pRendition->GetPath().c_str());
+            continue;
+        }
+
+        m_Renditions.push_back(std::move(pRendition));
+    }
+}
+
+void ProResEncoder::CloseRenditions()
+{
+    for (size_t i = 0; i < m_Renditions.size(); ++i)
+    {
+        if (!m_Renditions[i]->Close())
+        {
+            g_Log(logLevelError, "X264 Plugin :: Failed to finalize rendition %s", m_Renditions[i]->GetPath().c_str());
+        }
+    }
+
+    m_Renditions.clear();
+}
+
+void ProResEncoder::CloseVerifier()
+{
+    if (m_pVerifier)
+    {
+        m_pVerifier->Finish(m_CommonProps.GetPath() + ".qc.json", m_CommonProps.GetPath(), m_profile);
+        m_pVerifier.reset();
+    }
+}
+
+void ProResEncoder::CloseStageStats()
+{
+    // DoFlush and the destructor both close, the second one must not replace the file with an empty one
+    if (m_StageStats.IsEmpty())
+    {
+        return;
+    }
+
+    m_StageStats.LogSummary();
+    if (m_pSettings && m_pSettings->IsStageStats())
+    {
+        m_StageStats.WriteJson(m_CommonProps.GetPath());
+    }
+    m_StageStats.Reset();
+    m_ProcessedAt = std::chrono::steady_clock::time_point();
+}
+
 void ProResEncoder::CloseAV()
 {
     // Clean up and close the output file
@@ -410,6 +813,8 @@ StatusCode ProResEncoder::DoOpen(HostBufferRef* p_pBuff)
     g_Log(logLevelInfo, "X264 Plugin :: DoOpen");
     
     m_CommonProps.Load(p_pBuff);
+    m_TraceOwnerId = PipelineTrace::s_GetInstance().GetOwnerId(m_CommonProps.GetPath());
+    TraceOwnerScope traceOwner(m_TraceOwnerId);
 
     m_pSettings.reset(new UISettingsController(m_CommonProps));
     m_pSettings->Load(p_pBuff);
@@ -417,6 +822,27 @@ StatusCode ProResEncoder::DoOpen(HostBufferRef* p_pBuff)
 
     OpenAV();
 
+    m_CompletedPTS.clear();
+    m_IsResumePending = m_pSettings->IsResumable();
+
+    OpenRenditions();
+
+    // 10 bit planes, two bytes per sample, chroma at full or half width
+    const uint64_t numLumaSamples = static_cast<uint64_t>(m_CommonProps.GetWidth()) * m_CommonProps.GetHeight();
+    m_FrameBytes = numLumaSamples * 2 * ((m_profile >= FF_PROFILE_PRORES_4444) ? 3 : 2);
+    m_LiveValues = LiveStatsValues();
+    m_LiveStats.Open(liveStatsEncoder, m_CommonProps.GetPath());
+
+    if (m_pSettings->IsVerifying())
+    {
+        // decode on spare cores, the encoder already runs one thread per core
+        m_pVerifier.reset(new ProResVerifier());
+        if (!m_pVerifier->Open(std::max(1u, std::thread::hardware_concurrency() / 4)))
+        {
+            m_pVerifier.reset();
+        }
+    }
+
     uint64_t val = reinterpret_cast<uint64_t>(m_codec);
     StatusCode res = p_pBuff->SetProperty( pIOPropAVCodec, propTypeUInt64, reinterpret_cast<const void*>(&val), 1 );    
     if (res != errNone)
@@ -437,7 +863,54 @@ StatusCode ProResEncoder::DoOpen(HostBufferRef* p_pBuff)
     return errNone;
 }
 
+int64_t ProResEncoder::ToStreamPTS(int64_t p_PTS) const
+{
+    // the container keeps the muxer default 1/90000 video time base
+    float framerate = (float)m_codecContext->framerate.num / (float)m_codecContext->framerate.den;
+    return int64_t(p_PTS * (90000./ framerate) );
+}
+
+void ProResEncoder::LoadCompletedFrames()
+{
+    // the container published its list while the tracks were added, which is before the first frame
+    m_IsResumePending = false;
+    m_CompletedPTS = ProResResumeRegistry::s_GetInstance().Claim(m_CommonProps.GetPath());
+    if (!m_CompletedPTS.empty())
+    {
+        g_Log(logLevelInfo, "X264 Plugin :: Resuming, %d frames already rendered", static_cast<int>(m_CompletedPTS.size()));
+    }
+}
+
+bool ProResEncoder::IsFrameCompleted(int64_t p_PTS)
+{
+    if (m_IsResumePending)
+    {
+        LoadCompletedFrames();
+    }
+
+    return (!m_CompletedPTS.empty() && std::binary_search(m_CompletedPTS.begin(), m_CompletedPTS.end(), ToStreamPTS(p_PTS)));
+}
+
+bool ProResEncoder::IsAcceptingFrame(int64_t p_PTS)
+{
+    return !IsFrameCompleted(p_PTS);
+}
+
 StatusCode ProResEncoder::DoProcess(HostBufferRef* p_pBuff)
+{
+    TraceOwnerScope traceOwner(m_TraceOwnerId);
+    const std::chrono::steady_clock::time_point calledAt = std::chrono::steady_clock::now();
+    if (m_ProcessedAt != std::chrono::steady_clock::time_point())
+    {
+        m_StageStats.Add(encoderStageHost, std::chrono::duration_cast<std::chrono::nanoseconds>(calledAt - m_ProcessedAt).count(), 0);
+    }
+
+    const StatusCode sts = EncodeFrame(p_pBuff);
+    m_ProcessedAt = std::chrono::steady_clock::now();
+    return sts;
+}
+
+StatusCode ProResEncoder::EncodeFrame(HostBufferRef* p_pBuff)
 {
 
     if (m_Error != errNone)
@@ -455,39 +928,61 @@ StatusCode ProResEncoder::DoProcess(HostBufferRef* p_pBuff)
     if ((p_pBuff == NULL) || !p_pBuff->IsValid())
     {
         // flushing
-        g_Log(logLevelError, "X264 Plugin :: FLUSHING");
+        PLUGIN_LOG(logLevelError, "X264 Plugin :: FLUSHING");
         CloseAV();
     }
     else
     {
+        TraceSpan frameSpan("frame", "encoder");
+
         char* pBuf = NULL;
         size_t bufSize = 0;
-        if (!p_pBuff->LockBuffer(&pBuf, &bufSize))
+        bool isLocked = false;
+        {
+            TraceSpan lockSpan("lock", "encoder");
+            isLocked = p_pBuff->LockBuffer(&pBuf, &bufSize);
+        }
+        if (!isLocked)
         {
-            g_Log(logLevelError, "X264 Plugin :: Failed to lock the buffer");
+            PLUGIN_LOG(logLevelError, "X264 Plugin :: Failed to lock the buffer");
             return errFail;
         }
 
         if (pBuf == NULL || bufSize == 0)
         {
-            g_Log(logLevelError, "X264 Plugin :: No data to encode");
+            PLUGIN_LOG(logLevelError, "X264 Plugin :: No data to encode");
             p_pBuff->UnlockBuffer();
             return errUnsupported;
         }
 
-        uint32_t width = 0;
-        uint32_t height = 0;
-        if (!p_pBuff->GetUINT32(pIOPropWidth, width) || !p_pBuff->GetUINT32(pIOPropHeight, height))
+        // the frame size is fixed for the stream and known since DoOpen, only the timing is read per frame
+        const int width = static_cast<int>(m_CommonProps.GetWidth());
+        const int height = static_cast<int>(m_CommonProps.GetHeight());
+        if (bufSize < static_cast<size_t>(width) * height * 4 * sizeof(uint16_t))
         {
-            g_Log(logLevelError, "X264 Plugin :: Width/Height not set when encoding the frame");
-            return errNoParam;
+            PLUGIN_LOG(logLevelError, "X264 Plugin :: Frame of %zu bytes is too small for %dx%d", bufSize, width, height);
+            p_pBuff->UnlockBuffer();
+            return errInvalidParam;
         }
 
-        if (!p_pBuff->GetINT64(pIOPropPTS, pts))
+        HostBufferTiming timing;
+        if (!p_pBuff->GetTiming(timing))
         {
-            g_Log(logLevelError, "X264 Plugin :: PTS not set when encoding the frame");
+            PLUGIN_LOG(logLevelError, "X264 Plugin :: PTS not set when encoding the frame");
+            p_pBuff->UnlockBuffer();
             return errNoParam;
         }
+        pts = timing.pts;
+        frameSpan.SetPts(pts);
+
+        if (IsFrameCompleted(pts))
+        {
+            // already in the resumed output
+            p_pBuff->UnlockBuffer();
+            ++m_LiveValues.numReused;
+            m_LiveStats.Publish(m_LiveValues);
+            return errNone;
+        }
 
         //g_Log(logLevelInfo, "X264 Plugin :: PTS %ld", pts );
 
@@ -502,80 +997,88 @@ StatusCode ProResEncoder::DoProcess(HostBufferRef* p_pBuff)
         AVFrame* frame = av_frame_alloc();
         if (!frame) 
         {
-          g_Log(logLevelError, "Could not allocate frame" );
+          PLUGIN_LOG(logLevelError, "X264 Plugin :: Could not allocate frame" );
           return errFail;
         }
 
           // Initialize the frame parameters
-        float framerate = (float)m_codecContext->framerate.num / (float)m_codecContext->framerate.den;
         int hSampling = m_profile >= FF_PROFILE_PRORES_4444 /* 4444 4444 hq */ ? 1 : 2;
         frame->format = hSampling == 1 ? AV_PIX_FMT_YUV444P10 : AV_PIX_FMT_YUV422P10;
         frame->width =  m_codecContext->width;
         frame->height =  m_codecContext->height;            
-        frame->pts = int64_t(pts * (90000./ framerate) );
+        frame->pts = ToStreamPTS(pts);
 
         //g_Log(logLevelError, "PTS %ld", frame->pts );
 
 
           // Allocate memory for the frame data
         if (av_frame_get_buffer(frame, 0) < 0) {
-          g_Log(logLevelError, "Could not allocate frame data" );
+          PLUGIN_LOG(logLevelError, "X264 Plugin :: Could not allocate frame data" );
+          av_frame_free(&frame);
           return errFail;
         }
 
-        uint16_t* pSrc = reinterpret_cast<uint16_t*>(const_cast<char*>(pBuf));
-        for (int y = 0; y < height; ++y)
         {
-            g_Log(logLevelInfo, "X264 Plugin :: pcount %d", pSrc-reinterpret_cast<uint16_t*>(const_cast<char*>(pBuf) ));
-            uint16_t* row = (uint16_t*)(frame->data[0] + y * frame->linesize[0]);
-            uint16_t* rowU = (uint16_t*)(frame->data[1] + y * frame->linesize[1]);
-            uint16_t* rowV = (uint16_t*)(frame->data[2] + y * frame->linesize[2]);
+            StageTimer timer(&m_StageStats, encoderStageConvert, static_cast<uint64_t>(width) * height * 4 * sizeof(uint16_t));
+            uint16_t* pSrc = reinterpret_cast<uint16_t*>(const_cast<char*>(pBuf));
+            for (int y = 0; y < height; ++y)
+            {
+                uint16_t* row = (uint16_t*)(frame->data[0] + y * frame->linesize[0]);
+                uint16_t* rowU = (uint16_t*)(frame->data[1] + y * frame->linesize[1]);
+                uint16_t* rowV = (uint16_t*)(frame->data[2] + y * frame->linesize[2]);
+
+                if ( hSampling == 1 )
+                {
+                    g_ConvertAYUVToYUV444P10(pSrc, width, row, rowU, rowV);
+                }
+                else
+                {
+                    g_ConvertAYUVToYUV422P10(pSrc, width, row, rowU, rowV);
+                }
+                pSrc += 4 * width;
+            }
+        }
 
+        p_pBuff->UnlockBuffer();
 
-            if ( hSampling == 1 )
-            {
-              for (int x = 0; x < width; x++) 
-              {
-                row[x] = pSrc[1] >> 6;
-                rowU[x] = pSrc[2] >> 6;
-                rowV[x] = pSrc[3] >> 6;
-                pSrc += 4;
-              }
-            } else 
+        // extra renditions are derived from the converted master planes
+        if (!m_Renditions.empty())
+        {
+            StageTimer timer(&m_StageStats, encoderStageRenditions);
+            for (size_t i = 0; i < m_Renditions.size(); ++i)
             {
-              for (int x = 0; x < width; x++)
-              {
-                  
-                  row[x] = pSrc[1] >> 6;
-                  rowU[x/2] = pSrc[2] >> 6;
-                  rowV[x/2] = pSrc[3] >> 6;
-                  pSrc += 4;
-              }
-            //for (int x = 0; x < width; x += 2) // assuming source is 
-            // {
-                
-            //     row[x] = pSrc[1] >> 6;
-            //     row[x + 1] = pSrc[3] >> 6;
-            //     rowU[x/2] = pSrc[0] >> 6;
-            //     rowV[x/2] = pSrc[2] >> 6;
-            //     pSrc += 4;
-            // }
+                if (!m_Renditions[i]->Encode(frame))
+                {
+                    PLUGIN_LOG(logLevelError, "X264 Plugin :: Failed to encode rendition %s", m_Renditions[i]->GetPath().c_str());
+                }
             }
         }
 
-        p_pBuff->UnlockBuffer();
+        if (m_pVerifier)
+        {
+            m_pVerifier->AddSource(frame);
+        }
 
               // Encode the frame
-        int ret = avcodec_send_frame(m_codecContext, frame);
+        int ret = 0;
+        {
+            StageTimer timer(&m_StageStats, encoderStageSendFrame);
+            ret = avcodec_send_frame(m_codecContext, frame);
+        }
         if (ret < 0) {
-          g_Log(logLevelError, "error sending");
+          PLUGIN_LOG(logLevelError, "X264 Plugin :: error sending");
+        } else {
+          ++m_LiveValues.queueDepth;
         }
         while (ret >= 0) {
-            ret = avcodec_receive_packet(m_codecContext, &packet);
+            {
+                StageTimer timer(&m_StageStats, encoderStageReceivePacket);
+                ret = avcodec_receive_packet(m_codecContext, &packet);
+            }
             if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
               break;
             } else if (ret < 0) {
-              g_Log(logLevelError, "error encoding");
+              PLUGIN_LOG(logLevelError, "X264 Plugin :: error encoding");
             }
 
             // write packet to output buffer
@@ -584,37 +1087,74 @@ StatusCode ProResEncoder::DoProcess(HostBufferRef* p_pBuff)
 
             if (bytes < 0)
             {
+            av_packet_unref(&packet);
+            av_frame_free(&frame);
             return errFail;
             }
             else if (bytes == 0)
             {
+            av_packet_unref(&packet);
+            av_frame_free(&frame);
             return errMoreData;
             }
-            if (!outBuf.IsValid() || !outBuf.Resize(bytes))
+            // with the handoff the container picks the packet itself up from the registry
+            ProResPacketToken token;
+            const bool isHandoff = m_pSettings->IsPacketHandoff() && ProResPacketRegistry::s_GetInstance().Put(m_HandoffOwnerId, &packet, &token);
+            if (isHandoff)
             {
-                return errAlloc;
+                bytes = sizeof(token);
             }
 
             char* pOutBuf = NULL;
             size_t outBufSize = 0;
-            if (!outBuf.LockBuffer(&pOutBuf, &outBufSize))
+            if (!outBuf.IsValid() || !outBuf.Resize(bytes) || !outBuf.LockBuffer(&pOutBuf, &outBufSize))
             {
+                // the token never reaches the container, so the registry would hold the packet until the encoder closes
+                if (isHandoff)
+                {
+                    AVPacket* pHandedOff = ProResPacketRegistry::s_GetInstance().Take(&token, sizeof(token));
+                    av_packet_free(&pHandedOff);
+                }
+
+                av_packet_unref(&packet);
+                av_frame_free(&frame);
                 return errAlloc;
             }
 
 
-            memcpy(pOutBuf, packet.data, bytes );
+            {
+                StageTimer timer(&m_StageStats, encoderStageOutputCopy, bytes);
+                memcpy(pOutBuf, isHandoff ? reinterpret_cast<const uint8_t*>(&token) : packet.data, bytes );
+            }
 
             int64_t packet_pts = packet.pts;
             int64_t packet_dts = packet.dts;
 
             outBuf.SetProperty(pIOPropPTS, propTypeInt64, &packet_pts , 1);
             outBuf.SetProperty(pIOPropDTS, propTypeInt64, &packet_dts , 1);
-            m_pCallback->SendOutput(&outBuf);
+            {
+                StageTimer timer(&m_StageStats, encoderStageSendOutput, bytes);
+                m_pCallback->SendOutput(&outBuf);
+            }
             outBuf.UnlockBuffer();
 
+            if (m_pVerifier)
+            {
+                m_pVerifier->AddPacket(&packet);
+            }
+
+            ++m_LiveValues.numFrames;
+            m_LiveValues.bytesWritten += packet.size;
+            if (m_LiveValues.queueDepth > 0)
+            {
+                --m_LiveValues.queueDepth;
+            }
+
             av_packet_unref(&packet);
           }
+
+      m_LiveValues.memoryInUse = m_LiveValues.queueDepth * m_FrameBytes;
+      m_LiveStats.Publish(m_LiveValues);
       av_frame_free(&frame);
   }
 
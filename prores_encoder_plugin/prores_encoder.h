@@ -1,6 +1,8 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <vector>
 
 
 extern "C" {
@@ -10,6 +12,8 @@ extern "C" {
 }
 
 #include "wrapper/plugin_api.h"
+#include "stage_stats.h"
+#include "live_stats.h"
 
 
 
@@ -20,6 +24,8 @@ using namespace IOPlugin;
 struct x264_t;
 struct x264_param_t;
 class UISettingsController;
+class ProResRendition;
+class ProResVerifier;
 
 
 class ProResEncoder : public IPluginCodecRef
@@ -34,6 +40,8 @@ public:
     static StatusCode s_RegisterCodecs(HostListRef* p_pList);
     static StatusCode s_GetEncoderSettings(HostPropertyCollectionRef* p_pValues, HostListRef* p_pSettingsList);
 
+    virtual bool IsAcceptingFrame(int64_t p_PTS) override;
+
 protected:
     virtual void DoFlush() override;
     virtual StatusCode DoInit(HostPropertyCollectionRef* p_pProps) override;
@@ -44,6 +52,22 @@ private:
     void OpenAV();
     void CloseAV();
 
+    void OpenRenditions();
+    void CloseRenditions();
+
+    void CloseVerifier();
+
+    // encodes one host frame, DoProcess wraps it to time the host in between
+    StatusCode EncodeFrame(HostBufferRef* p_pBuff);
+
+    // logs the stage timings and writes them next to the movie when asked to
+    void CloseStageStats();
+
+    int64_t ToStreamPTS(int64_t p_PTS) const;
+    // claims the frames the container carries over from an interrupted render, see ProResResumeRegistry
+    void LoadCompletedFrames();
+    bool IsFrameCompleted(int64_t p_PTS);
+
 private:
 
     AVCodec* m_codec;
@@ -58,4 +82,21 @@ private:
     StatusCode m_Error;
 
     uint32_t m_profile;
+
+    // stream pts of the frames an interrupted render already wrote, sorted
+    std::vector<int64_t> m_CompletedPTS;
+    bool m_IsResumePending; // resumable and the container's list not claimed yet
+
+    std::vector<std::unique_ptr<ProResRendition> > m_Renditions;
+    std::unique_ptr<ProResVerifier> m_pVerifier;
+
+    uint64_t m_HandoffOwnerId; // this encoder's packets in ProResPacketRegistry
+    uint64_t m_TraceOwnerId; // this render's spans in PipelineTrace
+
+    StageStats m_StageStats;
+    std::chrono::steady_clock::time_point m_ProcessedAt; // return of the last DoProcess, the epoch before the first
+
+    LiveStatsPublisher m_LiveStats;
+    LiveStatsValues m_LiveValues;
+    uint64_t m_FrameBytes; // of one planar frame, for the memory held inside libavcodec
 };
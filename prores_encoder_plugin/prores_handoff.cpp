@@ -0,0 +1,107 @@
+#include "prores_handoff.h"
+
+#include <string.h>
+
+#include "wrapper/host_api.h"
+
+static const uint32_t s_TokenMagic = 0x4b545250; // "PRTK"
+
+ProResPacketRegistry& ProResPacketRegistry::s_GetInstance()
+{
+    static ProResPacketRegistry s_Registry;
+    return s_Registry;
+}
+
+ProResPacketRegistry::ProResPacketRegistry()
+    : m_NextOwnerId(1)
+{
+}
+
+ProResPacketRegistry::~ProResPacketRegistry()
+{
+    for (auto it = m_Packets.begin(); it != m_Packets.end(); ++it)
+    {
+        av_packet_free(&it->second);
+    }
+}
+
+uint64_t ProResPacketRegistry::NewOwnerId()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_NextOwnerId++;
+}
+
+bool ProResPacketRegistry::Put(uint64_t p_OwnerId, const AVPacket* p_pPacket, ProResPacketToken* p_pToken)
+{
+    // the encoder output is refcounted, so this is a reference rather than a copy
+    AVPacket* pPacket = av_packet_alloc();
+    if ((pPacket == NULL) || (av_packet_ref(pPacket, p_pPacket) < 0))
+    {
+        av_packet_free(&pPacket);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        AVPacket*& pEntry = m_Packets[std::make_pair(p_OwnerId, pPacket->pts)];
+        if (pEntry != NULL)
+        {
+            g_Log(logLevelWarn, "ProResPacketRegistry :: Replacing undelivered packet with pts %lld", static_cast<long long>(pPacket->pts));
+            av_packet_free(&pEntry);
+        }
+
+        pEntry = pPacket;
+    }
+
+    p_pToken->magic = s_TokenMagic;
+    p_pToken->size = sizeof(ProResPacketToken);
+    p_pToken->ownerId = p_OwnerId;
+    p_pToken->pts = pPacket->pts;
+    return true;
+}
+
+bool ProResPacketRegistry::s_IsToken(const void* p_pBuf, size_t p_BufSize)
+{
+    if (p_BufSize != sizeof(ProResPacketToken))
+    {
+        return false;
+    }
+
+    ProResPacketToken token;
+    memcpy(&token, p_pBuf, sizeof(token));
+    return ((token.magic == s_TokenMagic) && (token.size == sizeof(ProResPacketToken)));
+}
+
+AVPacket* ProResPacketRegistry::Take(const void* p_pBuf, size_t p_BufSize)
+{
+    if (!s_IsToken(p_pBuf, p_BufSize))
+    {
+        return NULL;
+    }
+
+    ProResPacketToken token;
+    memcpy(&token, p_pBuf, sizeof(token));
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Packets.find(std::make_pair(token.ownerId, token.pts));
+    if (it == m_Packets.end())
+    {
+        g_Log(logLevelError, "ProResPacketRegistry :: No packet for pts %lld", static_cast<long long>(token.pts));
+        return NULL;
+    }
+
+    AVPacket* pPacket = it->second;
+    m_Packets.erase(it);
+    return pPacket;
+}
+
+void ProResPacketRegistry::Drop(uint64_t p_OwnerId)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Packets.lower_bound(std::make_pair(p_OwnerId, INT64_MIN));
+    while ((it != m_Packets.end()) && (it->first.first == p_OwnerId))
+    {
+        av_packet_free(&it->second);
+        it = m_Packets.erase(it);
+    }
+}
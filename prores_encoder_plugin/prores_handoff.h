@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Encoder and container run in the same process, so with the handoff on the encoder keeps its packets here and
+// only sends a ProResPacketToken through the host. The container swaps the token for the packet and muxes it
+// without copying the compressed frame again.
+
+#pragma pack(push, 1)
+struct ProResPacketToken
+{
+    uint32_t magic;
+    uint32_t size; // sizeof(ProResPacketToken), guards against layout changes
+    uint64_t ownerId;
+    int64_t pts;
+};
+#pragma pack(pop)
+
+class ProResPacketRegistry
+{
+public:
+    static ProResPacketRegistry& s_GetInstance();
+
+    // unique per encoder instance, packets of different encoders may share a pts
+    uint64_t NewOwnerId();
+
+    // keeps a reference to p_pPacket and fills in the token to send instead
+    bool Put(uint64_t p_OwnerId, const AVPacket* p_pPacket, ProResPacketToken* p_pToken);
+
+    // whether the buffer holds a token rather than packet data
+    static bool s_IsToken(const void* p_pBuf, size_t p_BufSize);
+
+    // returns the packet the token stands for, to be freed with av_packet_free, NULL when it is unknown
+    AVPacket* Take(const void* p_pBuf, size_t p_BufSize);
+
+    // frees the packets the host never delivered
+    void Drop(uint64_t p_OwnerId);
+
+private:
+    ProResPacketRegistry();
+    ~ProResPacketRegistry();
+
+    // disable assignment and copy constructor
+    ProResPacketRegistry(const ProResPacketRegistry& p_Other);
+    ProResPacketRegistry& operator=(const ProResPacketRegistry& p_Other);
+
+private:
+    std::mutex m_Mutex;
+    uint64_t m_NextOwnerId;
+    std::map<std::pair<uint64_t, int64_t>, AVPacket*> m_Packets; // by owner and pts
+};
@@ -4,4 +4,17 @@
 namespace IOPlugin {
   static PropertyID pIOPropAVCodec = "av_codec";
   static PropertyID pIOPropAVCodecContext = "av_codec_context";
+
+  // encoder settings also read by the container
+  static PropertyID pIOPropResumable = "prores_resumable"; // uint8_t 1 - keep a write journal and resume from it
+  static PropertyID pIOPropDirectIO = "prores_direct_io"; // uint8_t 1 - preallocate the movie and write it bypassing the page cache
+  static PropertyID pIOPropNativeMuxer = "prores_native_muxer"; // uint8_t 1 - write the movie with MovWriter instead of libavformat
+  static PropertyID pIOPropFastStart = "prores_fast_start"; // uint8_t 1 - reserve space for the moov in front of the mdat, implies the native muxer
+  static PropertyID pIOPropFragmentSeconds = "prores_fragment_seconds"; // int32_t >0 - write a fragmented movie, one fragment per this many seconds
+  static PropertyID pIOPropPacketHandoff = "prores_packet_handoff"; // uint8_t 1 - send ProResPacketToken buffers, packets go through ProResPacketRegistry
+  static PropertyID pIOPropMirrorDirs = "prores_mirror_dirs"; // string ';' separated directories receiving a copy of the movie
+  static PropertyID pIOPropPCMFormat = "prores_pcm_format"; // int32_t 0 - keep the host sample format, otherwise PCMSampleFormat + 1
+  static PropertyID pIOPropDiscreteMono = "prores_discrete_mono"; // uint8_t 1 - each channel of the audio track goes into a mono track of its own
+  static PropertyID pIOPropStageStats = "prores_stage_stats"; // uint8_t 1 - write the per stage timings as <movie>.<component>.stats.json
+  static PropertyID pIOPropStripeDirs = "prores_stripe_dirs"; // string ';' separated directories the sample data is striped over, the movie references them
 }
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "prores_rendition.h"
+
+#include <string.h>
+
+#include <thread>
+
+#include "pixel_convert.h"
+
+static int s_ChromaWidth(int p_Format, int p_Width)
+{
+    return (p_Format == AV_PIX_FMT_YUV422P10) ? ((p_Width + 1) / 2) : p_Width;
+}
+
+static uint16_t* s_Row(const AVFrame* p_pFrame, int p_Plane, int p_Y)
+{
+    return reinterpret_cast<uint16_t*>(p_pFrame->data[p_Plane] + p_Y * p_pFrame->linesize[p_Plane]);
+}
+
+static AVFrame* s_AllocFrame(int p_Format, int p_Width, int p_Height)
+{
+    AVFrame* pFrame = av_frame_alloc();
+    if (pFrame == NULL)
+    {
+        return NULL;
+    }
+
+    pFrame->format = p_Format;
+    pFrame->width = p_Width;
+    pFrame->height = p_Height;
+    if (av_frame_get_buffer(pFrame, 0) < 0)
+    {
+        av_frame_free(&pFrame);
+        return NULL;
+    }
+
+    return pFrame;
+}
+
+ProResRendition::ProResRendition(int32_t p_Profile, bool p_IsHalfSize, const std::string& p_Path)
+    : m_Profile(p_Profile)
+    , m_IsHalfSize(p_IsHalfSize)
+    , m_Path(p_Path)
+    , m_pCodecContext(NULL)
+    , m_pFrame(NULL)
+    , m_pScaled(NULL)
+    , m_pPacket(NULL)
+    , m_StreamIdx(-1)
+{
+}
+
+ProResRendition::~ProResRendition()
+{
+    av_frame_free(&m_pFrame);
+    av_frame_free(&m_pScaled);
+    av_packet_free(&m_pPacket);
+    avcodec_free_context(&m_pCodecContext);
+}
+
+bool ProResRendition::Open(uint32_t p_MasterWidth, uint32_t p_MasterHeight, uint32_t p_FpsNum, uint32_t p_FpsDen)
+{
+    AVCodec* pCodec = avcodec_find_encoder(AV_CODEC_ID_PRORES);
+    if (pCodec == NULL)
+    {
+        g_Log(logLevelError, "ProRes codec not found");
+        return false;
+    }
+
+    m_pCodecContext = avcodec_alloc_context3(pCodec);
+    m_pPacket = av_packet_alloc();
+    if ((m_pCodecContext == NULL) || (m_pPacket == NULL))
+    {
+        g_Log(logLevelError, "Failed to allocate rendition codec context");
+        return false;
+    }
+
+    m_pCodecContext->width = m_IsHalfSize ? ((p_MasterWidth / 2) & ~1u) : p_MasterWidth;
+    m_pCodecContext->height = m_IsHalfSize ? (p_MasterHeight / 2) : p_MasterHeight;
+    m_pCodecContext->profile = m_Profile;
+    m_pCodecContext->codec_id = AV_CODEC_ID_PRORES;
+    m_pCodecContext->codec_type = AVMEDIA_TYPE_VIDEO;
+    m_pCodecContext->pix_fmt = (m_Profile >= FF_PROFILE_PRORES_4444) ? AV_PIX_FMT_YUV444P10 : AV_PIX_FMT_YUV422P10;
+    m_pCodecContext->thread_count = std::thread::hardware_concurrency();
+    m_pCodecContext->framerate.num = p_FpsNum;
+    m_pCodecContext->framerate.den = p_FpsDen;
+    m_pCodecContext->time_base.num = p_FpsDen;
+    m_pCodecContext->time_base.den = p_FpsNum;
+
+    if (avcodec_open2(m_pCodecContext, pCodec, NULL) < 0)
+    {
+        g_Log(logLevelError, "Could not open rendition codec for %s", m_Path.c_str());
+        return false;
+    }
+
+    m_pFrame = s_AllocFrame(m_pCodecContext->pix_fmt, m_pCodecContext->width, m_pCodecContext->height);
+    if (m_pFrame == NULL)
+    {
+        g_Log(logLevelError, "Could not allocate rendition frame");
+        return false;
+    }
+
+    if (!m_Muxer.Open(m_Path))
+    {
+        return false;
+    }
+
+    m_StreamIdx = m_Muxer.AddStream(pCodec, m_pCodecContext);
+    if ((m_StreamIdx < 0) || !m_Muxer.WriteHeader())
+    {
+        return false;
+    }
+
+    g_Log(logLevelInfo, "Rendition %s: profile %d, %dx%d", m_Path.c_str(), m_Profile, m_pCodecContext->width, m_pCodecContext->height);
+    return true;
+}
+
+bool ProResRendition::PrepareFrame(const AVFrame* p_pMaster)
+{
+    // the encoder may still reference the previous frame
+    if (av_frame_make_writable(m_pFrame) < 0)
+    {
+        return false;
+    }
+
+    const int width = m_pFrame->width;
+    const int height = m_pFrame->height;
+    const AVFrame* pSrc = p_pMaster;
+
+    if (m_IsHalfSize)
+    {
+        AVFrame* pDst = m_pFrame;
+        if (p_pMaster->format != m_pFrame->format)
+        {
+            if (m_pScaled == NULL)
+            {
+                m_pScaled = s_AllocFrame(p_pMaster->format, width, height);
+            }
+
+            if ((m_pScaled == NULL) || (av_frame_make_writable(m_pScaled) < 0))
+            {
+                return false;
+            }
+
+            pDst = m_pScaled;
+        }
+
+        for (int plane = 0; plane < 3; ++plane)
+        {
+            const int planeWidth = (plane == 0) ? width : s_ChromaWidth(pDst->format, width);
+            g_DownscalePlane2x(reinterpret_cast<const uint16_t*>(p_pMaster->data[plane]), p_pMaster->linesize[plane],
+                               reinterpret_cast<uint16_t*>(pDst->data[plane]), pDst->linesize[plane], planeWidth, height);
+        }
+
+        pSrc = pDst;
+    }
+
+    if (pSrc != m_pFrame)
+    {
+        // same dimensions from here on, only the chroma sampling may differ
+        const int chromaWidth = s_ChromaWidth(m_pFrame->format, width);
+        for (int y = 0; y < height; ++y)
+        {
+            memcpy(s_Row(m_pFrame, 0, y), s_Row(pSrc, 0, y), width * sizeof(uint16_t));
+            for (int plane = 1; plane < 3; ++plane)
+            {
+                if (pSrc->format == m_pFrame->format)
+                {
+                    memcpy(s_Row(m_pFrame, plane, y), s_Row(pSrc, plane, y), chromaWidth * sizeof(uint16_t));
+                }
+                else if (m_pFrame->format == AV_PIX_FMT_YUV422P10)
+                {
+                    g_DecimateChromaRow(s_Row(pSrc, plane, y), width, s_Row(m_pFrame, plane, y));
+                }
+                else
+                {
+                    g_UpsampleChromaRow(s_Row(pSrc, plane, y), width, s_Row(m_pFrame, plane, y));
+                }
+            }
+        }
+    }
+
+    m_pFrame->pts = p_pMaster->pts;
+    return true;
+}
+
+bool ProResRendition::Encode(const AVFrame* p_pMaster)
+{
+    if (m_pCodecContext == NULL)
+    {
+        return false;
+    }
+
+    // a full size rendition with the master sampling encodes the master planes as they are
+    if (!m_IsHalfSize && (p_pMaster->format == m_pFrame->format))
+    {
+        return SendFrame(p_pMaster);
+    }
+
+    if (!PrepareFrame(p_pMaster))
+    {
+        g_Log(logLevelError, "Failed to prepare rendition frame for %s", m_Path.c_str());
+        return false;
+    }
+
+    return SendFrame(m_pFrame);
+}
+
+bool ProResRendition::SendFrame(const AVFrame* p_pFrame)
+{
+    int ret = avcodec_send_frame(m_pCodecContext, p_pFrame);
+    if (ret < 0)
+    {
+        g_Log(logLevelError, "Rendition error sending frame");
+        return false;
+    }
+
+    while (ret >= 0)
+    {
+        ret = avcodec_receive_packet(m_pCodecContext, m_pPacket);
+        if ((ret == AVERROR(EAGAIN)) || (ret == AVERROR_EOF))
+        {
+            break;
+        }
+        else if (ret < 0)
+        {
+            g_Log(logLevelError, "Rendition error encoding");
+            return false;
+        }
+
+        m_pPacket->stream_index = m_StreamIdx;
+        m_pPacket->flags |= AV_PKT_FLAG_KEY;
+        const bool isWritten = m_Muxer.WritePacket(m_pPacket);
+        av_packet_unref(m_pPacket);
+        if (!isWritten)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ProResRendition::Close()
+{
+    if (m_pCodecContext == NULL)
+    {
+        return false;
+    }
+
+    const bool isFlushed = SendFrame(NULL);
+    const bool isClosed = m_Muxer.IsOpen() && m_Muxer.Close();
+
+    avcodec_free_context(&m_pCodecContext);
+    return (isFlushed && isClosed);
+}
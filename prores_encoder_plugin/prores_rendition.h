@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "mov_muxer.h"
+
+// Extra ProRes output encoded from the master frame of ProResEncoder, written to its own movie next to the main one.
+// The frame is derived from the already converted master planes, half size renditions use a 2:1 box filter.
+class ProResRendition
+{
+public:
+    ProResRendition(int32_t p_Profile, bool p_IsHalfSize, const std::string& p_Path);
+    ~ProResRendition();
+
+    bool Open(uint32_t p_MasterWidth, uint32_t p_MasterHeight, uint32_t p_FpsNum, uint32_t p_FpsDen);
+    bool Encode(const AVFrame* p_pMaster);
+
+    // drains the encoder and finalizes the movie
+    bool Close();
+
+    const std::string& GetPath() const
+    {
+        return m_Path;
+    }
+
+private:
+    // disable assignment and copy constructor
+    ProResRendition(const ProResRendition& p_Other);
+    ProResRendition& operator=(const ProResRendition& p_Other);
+
+    bool SendFrame(const AVFrame* p_pFrame);
+    bool PrepareFrame(const AVFrame* p_pMaster);
+
+private:
+    int32_t m_Profile;
+    bool m_IsHalfSize;
+    std::string m_Path;
+
+    AVCodecContext* m_pCodecContext;
+    AVFrame* m_pFrame;
+    AVFrame* m_pScaled; // half size planes in the master sampling when it differs from ours
+    AVPacket* m_pPacket;
+
+    MovMuxer m_Muxer;
+    int m_StreamIdx;
+};
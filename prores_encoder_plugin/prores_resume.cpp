@@ -0,0 +1,56 @@
+#include "prores_resume.h"
+
+ProResResumeRegistry& ProResResumeRegistry::s_GetInstance()
+{
+    static ProResResumeRegistry s_Registry;
+    return s_Registry;
+}
+
+ProResResumeRegistry::ProResResumeRegistry()
+{
+}
+
+bool ProResResumeRegistry::Publish(const std::string& p_MoviePath, const std::vector<int64_t>& p_SortedPTS)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Entry& entry = m_Entries[p_MoviePath];
+    if (entry.isClaimed)
+    {
+        return false;
+    }
+
+    entry.pts = p_SortedPTS;
+    return true;
+}
+
+bool ProResResumeRegistry::Revoke(const std::string& p_MoviePath)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Entries.find(p_MoviePath);
+    if (it == m_Entries.end())
+    {
+        return true;
+    }
+
+    if (it->second.isClaimed && !it->second.pts.empty())
+    {
+        return false;
+    }
+
+    it->second.pts.clear();
+    return true;
+}
+
+std::vector<int64_t> ProResResumeRegistry::Claim(const std::string& p_MoviePath)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Entry& entry = m_Entries[p_MoviePath];
+    entry.isClaimed = true;
+    return entry.pts;
+}
+
+void ProResResumeRegistry::Remove(const std::string& p_MoviePath)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Entries.erase(p_MoviePath);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Which frames a resumed render carries over from the interrupted one. The container validates the journal and
+// publishes the stream pts of the samples it will copy, the encoder claims that list before its first frame and
+// skips exactly those. Once claimed the list is binding, a container finding it can no longer copy them fails the
+// render rather than leaving the frames out.
+class ProResResumeRegistry
+{
+public:
+    static ProResResumeRegistry& s_GetInstance();
+
+    // false when the encoder of p_MoviePath already claimed without a list, it then encodes every frame itself
+    bool Publish(const std::string& p_MoviePath, const std::vector<int64_t>& p_SortedPTS);
+
+    // drops an unclaimed list, false when the encoder already claimed it
+    bool Revoke(const std::string& p_MoviePath);
+
+    // the list to skip, empty when the container published none. Later Publish calls for the movie fail
+    std::vector<int64_t> Claim(const std::string& p_MoviePath);
+
+    // forgets the movie once its container closed
+    void Remove(const std::string& p_MoviePath);
+
+private:
+    ProResResumeRegistry();
+
+    // disable assignment and copy constructor
+    ProResResumeRegistry(const ProResResumeRegistry& p_Other);
+    ProResResumeRegistry& operator=(const ProResResumeRegistry& p_Other);
+
+private:
+    struct Entry
+    {
+        bool isClaimed;
+        std::vector<int64_t> pts;
+    };
+
+    std::mutex m_Mutex;
+    std::map<std::string, Entry> m_Entries; // by movie path
+};
@@ -0,0 +1,308 @@
+#include "prores_verify.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "json_util.h"
+#include "pipeline_trace.h"
+
+static const double s_MaxPSNR = 100.0;
+static const double s_PeakValue = 1023.0; // 10 bit planes
+
+ProResVerifier::ProResVerifier()
+    : m_MaxJobs(0)
+    , m_IsStopping(false)
+{
+}
+
+ProResVerifier::~ProResVerifier()
+{
+    Stop();
+
+    for (auto it = m_Sources.begin(); it != m_Sources.end(); ++it)
+    {
+        av_frame_free(&it->second);
+    }
+}
+
+bool ProResVerifier::Open(int p_NumThreads)
+{
+    if (avcodec_find_decoder(AV_CODEC_ID_PRORES) == NULL)
+    {
+        g_Log(logLevelError, "ProResVerifier :: ProRes decoder not found");
+        return false;
+    }
+
+    m_IsStopping = false;
+    m_MaxJobs = 2 * std::max(p_NumThreads, 1);
+    const uint64_t traceOwnerId = PipelineTrace::s_GetThreadOwner();
+    for (int i = 0; i < std::max(p_NumThreads, 1); ++i)
+    {
+        m_Workers.push_back(std::thread([this, traceOwnerId] {
+            PipelineTrace::s_SetThreadOwner(traceOwnerId);
+            ThreadProc();
+        }));
+    }
+
+    return true;
+}
+
+void ProResVerifier::AddSource(const AVFrame* p_pFrame)
+{
+    // a reference keeps the planes alive without a copy, the encoder allocates a new frame every time
+    AVFrame* pSource = av_frame_clone(p_pFrame);
+    if (pSource == NULL)
+    {
+        return;
+    }
+
+    AVFrame*& pEntry = m_Sources[p_pFrame->pts];
+    av_frame_free(&pEntry);
+    pEntry = pSource;
+}
+
+void ProResVerifier::AddPacket(const AVPacket* p_pPacket)
+{
+    auto it = m_Sources.find(p_pPacket->pts);
+    if (it == m_Sources.end())
+    {
+        g_Log(logLevelWarn, "ProResVerifier :: No source frame for packet at %lld", static_cast<long long>(p_pPacket->pts));
+        return;
+    }
+
+    Job job;
+    job.pSource = it->second;
+    job.pPacket = av_packet_clone(p_pPacket);
+    m_Sources.erase(it);
+
+    if (job.pPacket == NULL)
+    {
+        av_frame_free(&job.pSource);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_SpaceCond.wait(lock, [this] { return m_Jobs.size() < m_MaxJobs; });
+    m_Jobs.push_back(job);
+    m_JobCond.notify_one();
+}
+
+void ProResVerifier::ThreadProc()
+{
+    PipelineTrace::s_SetThreadName("verifier");
+
+    AVCodecContext* pDecoder = NULL;
+    AVCodec* pCodec = avcodec_find_decoder(AV_CODEC_ID_PRORES);
+    if (pCodec != NULL)
+    {
+        pDecoder = avcodec_alloc_context3(pCodec);
+        if (pDecoder != NULL)
+        {
+            // every worker has its own single threaded decoder, ProRes frames decode independently
+            pDecoder->thread_count = 1;
+            if (avcodec_open2(pDecoder, pCodec, NULL) < 0)
+            {
+                avcodec_free_context(&pDecoder);
+            }
+        }
+    }
+
+    AVFrame* pDecoded = av_frame_alloc();
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_JobCond.wait(lock, [this] { return m_IsStopping || !m_Jobs.empty(); });
+            if (m_Jobs.empty())
+            {
+                break;
+            }
+
+            job = m_Jobs.front();
+            m_Jobs.pop_front();
+        }
+
+        m_SpaceCond.notify_one();
+
+        FrameResult result;
+        {
+            TraceSpan span("verify", "verifier", job.pPacket->pts);
+            Verify(pDecoder, pDecoded, job, result);
+        }
+
+        av_frame_free(&job.pSource);
+        av_packet_free(&job.pPacket);
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Results.push_back(result);
+    }
+
+    av_frame_free(&pDecoded);
+    avcodec_free_context(&pDecoder);
+}
+
+void ProResVerifier::Verify(AVCodecContext* p_pDecoder, AVFrame* p_pDecoded, const Job& p_Job, FrameResult& p_Result)
+{
+    p_Result.pts = p_Job.pPacket->pts;
+    p_Result.size = p_Job.pPacket->size;
+    p_Result.isDecoded = false;
+    p_Result.isMatching = false;
+    for (int plane = 0; plane < 3; ++plane)
+    {
+        p_Result.psnr[plane] = 0.0;
+        p_Result.minVal[plane] = 0;
+        p_Result.maxVal[plane] = 0;
+    }
+
+    if ((p_pDecoder == NULL) || (p_pDecoded == NULL) || (avcodec_send_packet(p_pDecoder, p_Job.pPacket) < 0) ||
+        (avcodec_receive_frame(p_pDecoder, p_pDecoded) < 0))
+    {
+        return;
+    }
+
+    p_Result.isDecoded = true;
+
+    const AVFrame* pSrc = p_Job.pSource;
+    p_Result.isMatching = ((p_pDecoded->format == pSrc->format) && (p_pDecoded->width == pSrc->width) && (p_pDecoded->height == pSrc->height));
+    if (p_Result.isMatching)
+    {
+        for (int plane = 0; plane < 3; ++plane)
+        {
+            const int width = ((plane > 0) && (pSrc->format == AV_PIX_FMT_YUV422P10)) ? ((pSrc->width + 1) / 2) : pSrc->width;
+
+            uint64_t sse = 0;
+            int minVal = 0xffff;
+            int maxVal = 0;
+            for (int y = 0; y < pSrc->height; ++y)
+            {
+                const uint16_t* pRef = reinterpret_cast<const uint16_t*>(pSrc->data[plane] + y * pSrc->linesize[plane]);
+                const uint16_t* pDec = reinterpret_cast<const uint16_t*>(p_pDecoded->data[plane] + y * p_pDecoded->linesize[plane]);
+                for (int x = 0; x < width; ++x)
+                {
+                    const int64_t diff = static_cast<int64_t>(pDec[x]) - pRef[x];
+                    sse += diff * diff;
+                    minVal = std::min<int>(minVal, pDec[x]);
+                    maxVal = std::max<int>(maxVal, pDec[x]);
+                }
+            }
+
+            const double mse = static_cast<double>(sse) / (static_cast<double>(width) * pSrc->height);
+            p_Result.psnr[plane] = (mse > 0.0) ? std::min(s_MaxPSNR, 10.0 * log10((s_PeakValue * s_PeakValue) / mse)) : s_MaxPSNR;
+            p_Result.minVal[plane] = minVal;
+            p_Result.maxVal[plane] = maxVal;
+        }
+    }
+
+    av_frame_unref(p_pDecoded);
+}
+
+void ProResVerifier::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_IsStopping = true;
+    }
+
+    m_JobCond.notify_all();
+    for (size_t i = 0; i < m_Workers.size(); ++i)
+    {
+        m_Workers[i].join();
+    }
+
+    m_Workers.clear();
+}
+
+bool ProResVerifier::Finish(const std::string& p_ReportPath, const std::string& p_MoviePath, int32_t p_Profile)
+{
+    if (!IsOpen())
+    {
+        return false;
+    }
+
+    Stop();
+
+    const bool isWritten = WriteReport(p_ReportPath, p_MoviePath, p_Profile);
+
+    for (auto it = m_Sources.begin(); it != m_Sources.end(); ++it)
+    {
+        av_frame_free(&it->second);
+    }
+
+    m_Sources.clear();
+    m_Results.clear();
+    return isWritten;
+}
+
+bool ProResVerifier::WriteReport(const std::string& p_ReportPath, const std::string& p_MoviePath, int32_t p_Profile)
+{
+    std::sort(m_Results.begin(), m_Results.end(), [](const FrameResult& p_A, const FrameResult& p_B) { return p_A.pts < p_B.pts; });
+
+    int numFailed = 0;
+    int numMismatched = 0;
+    int numCompared = 0;
+    double minPSNR[3] = { s_MaxPSNR, s_MaxPSNR, s_MaxPSNR };
+    double sumPSNR[3] = { 0.0, 0.0, 0.0 };
+    for (size_t i = 0; i < m_Results.size(); ++i)
+    {
+        const FrameResult& result = m_Results[i];
+        if (!result.isDecoded)
+        {
+            ++numFailed;
+            continue;
+        }
+        else if (!result.isMatching)
+        {
+            ++numMismatched;
+            continue;
+        }
+
+        ++numCompared;
+        for (int plane = 0; plane < 3; ++plane)
+        {
+            minPSNR[plane] = std::min(minPSNR[plane], result.psnr[plane]);
+            sumPSNR[plane] += result.psnr[plane];
+        }
+    }
+
+    FILE* pFile = fopen(p_ReportPath.c_str(), "w");
+    if (pFile == NULL)
+    {
+        g_Log(logLevelError, "ProResVerifier :: Could not create %s", p_ReportPath.c_str());
+        return false;
+    }
+
+    const double numAvg = std::max(numCompared, 1);
+    fprintf(pFile, "{\n");
+    fprintf(pFile, "  \"movie\": %s,\n", g_JsonString(p_MoviePath).c_str());
+    fprintf(pFile, "  \"profile\": %d,\n", p_Profile);
+    fprintf(pFile, "  \"frames\": %d,\n", static_cast<int>(m_Results.size()));
+    fprintf(pFile, "  \"decode_failures\": %d,\n", numFailed);
+    fprintf(pFile, "  \"format_mismatches\": %d,\n", numMismatched);
+    fprintf(pFile, "  \"unverified\": %d,\n", static_cast<int>(m_Sources.size()));
+    fprintf(pFile, "  \"psnr_min\": [%.3f, %.3f, %.3f],\n", minPSNR[0], minPSNR[1], minPSNR[2]);
+    fprintf(pFile, "  \"psnr_avg\": [%.3f, %.3f, %.3f],\n", sumPSNR[0] / numAvg, sumPSNR[1] / numAvg, sumPSNR[2] / numAvg);
+    fprintf(pFile, "  \"frame_results\": [");
+    for (size_t i = 0; i < m_Results.size(); ++i)
+    {
+        const FrameResult& result = m_Results[i];
+        fprintf(pFile, "%s\n    {\"pts\": %lld, \"size\": %lld, \"decoded\": %s", (i > 0) ? "," : "", static_cast<long long>(result.pts),
+                static_cast<long long>(result.size), result.isDecoded ? "true" : "false");
+        if (result.isDecoded && result.isMatching)
+        {
+            fprintf(pFile, ", \"psnr\": [%.3f, %.3f, %.3f], \"min\": [%d, %d, %d], \"max\": [%d, %d, %d]", result.psnr[0], result.psnr[1], result.psnr[2],
+                    result.minVal[0], result.minVal[1], result.minVal[2], result.maxVal[0], result.maxVal[1], result.maxVal[2]);
+        }
+
+        fprintf(pFile, "}");
+    }
+
+    fprintf(pFile, "\n  ]\n}\n");
+
+    const bool isOk = (fclose(pFile) == 0);
+    g_Log(logLevelInfo, "ProResVerifier :: %d frames verified, %d failed to decode, min luma PSNR %.2f dB, report %s", numCompared, numFailed,
+          minPSNR[0], p_ReportPath.c_str());
+    return isOk;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "wrapper/host_api.h"
+
+// Decodes every encoded packet on background threads while its source frame is still in memory and compares
+// the two, so a render gets a QC report without reading the movie back from disk.
+class ProResVerifier
+{
+public:
+    ProResVerifier();
+    ~ProResVerifier();
+
+    bool Open(int p_NumThreads);
+
+    // source frame is referenced until the packet with the same pts arrives
+    void AddSource(const AVFrame* p_pFrame);
+
+    // queues the packet for decoding, blocks while all workers are busy
+    void AddPacket(const AVPacket* p_pPacket);
+
+    // waits for the queued packets and writes the JSON report
+    bool Finish(const std::string& p_ReportPath, const std::string& p_MoviePath, int32_t p_Profile);
+
+    bool IsOpen() const
+    {
+        return !m_Workers.empty();
+    }
+
+private:
+    // disable assignment and copy constructor
+    ProResVerifier(const ProResVerifier& p_Other);
+    ProResVerifier& operator=(const ProResVerifier& p_Other);
+
+    struct Job
+    {
+        AVFrame* pSource;
+        AVPacket* pPacket;
+    };
+
+    struct FrameResult
+    {
+        int64_t pts;
+        int64_t size;
+        bool isDecoded;
+        bool isMatching; // decoded format and dimensions equal the source
+        double psnr[3];  // per plane, capped at s_MaxPSNR for identical planes
+        int minVal[3];
+        int maxVal[3];
+    };
+
+    void ThreadProc();
+    void Verify(AVCodecContext* p_pDecoder, AVFrame* p_pDecoded, const Job& p_Job, FrameResult& p_Result);
+    void Stop();
+    bool WriteReport(const std::string& p_ReportPath, const std::string& p_MoviePath, int32_t p_Profile);
+
+private:
+    std::vector<std::thread> m_Workers;
+    std::mutex m_Mutex;
+    std::condition_variable m_JobCond;
+    std::condition_variable m_SpaceCond;
+    std::deque<Job> m_Jobs;
+    size_t m_MaxJobs;
+    bool m_IsStopping;
+
+    std::map<int64_t, AVFrame*> m_Sources; // accessed from the encoder thread only
+    std::vector<FrameResult> m_Results;
+};
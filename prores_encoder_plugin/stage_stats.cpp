@@ -0,0 +1,238 @@
+#include "stage_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "json_util.h"
+#include "wrapper/host_api.h"
+
+LatencyHistogram::LatencyHistogram()
+    : m_Buckets(s_NumBuckets, 0)
+    , m_Count(0)
+    , m_Total(0)
+    , m_Max(0)
+{
+}
+
+int LatencyHistogram::s_BucketIdx(uint64_t p_Value)
+{
+    // values below s_NumSubBuckets are exact, above that the s_SubBucketBits bits after the leading one pick the bucket
+    if (p_Value < static_cast<uint64_t>(s_NumSubBuckets))
+    {
+        return static_cast<int>(p_Value);
+    }
+
+    int msb = 63;
+    while ((p_Value >> msb) == 0)
+    {
+        --msb;
+    }
+
+    const int shift = msb - s_SubBucketBits;
+    const int subBucket = static_cast<int>(p_Value >> shift) - s_NumSubBuckets;
+    return (shift + 1) * s_NumSubBuckets + subBucket;
+}
+
+uint64_t LatencyHistogram::s_BucketMax(int p_Idx)
+{
+    if (p_Idx < s_NumSubBuckets)
+    {
+        return static_cast<uint64_t>(p_Idx);
+    }
+
+    const int shift = p_Idx / s_NumSubBuckets - 1;
+    const uint64_t subBucket = static_cast<uint64_t>(p_Idx % s_NumSubBuckets);
+    return ((s_NumSubBuckets + subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Add(uint64_t p_Nanoseconds)
+{
+    ++m_Buckets[s_BucketIdx(p_Nanoseconds)];
+    ++m_Count;
+    m_Total += p_Nanoseconds;
+    if (p_Nanoseconds > m_Max)
+    {
+        m_Max = p_Nanoseconds;
+    }
+}
+
+uint64_t LatencyHistogram::GetPercentile(double p_Percentile) const
+{
+    if (m_Count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(p_Percentile / 100.0 * m_Count + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < s_NumBuckets; ++i)
+    {
+        seen += m_Buckets[i];
+        if (seen >= rank)
+        {
+            const uint64_t bucketMax = s_BucketMax(i);
+            return (bucketMax < m_Max) ? bucketMax : m_Max;
+        }
+    }
+
+    return m_Max;
+}
+
+static double s_Milliseconds(uint64_t p_Nanoseconds)
+{
+    return p_Nanoseconds / 1000000.0;
+}
+
+static double s_IPC(const PerfCounterValues& p_Perf)
+{
+    const uint64_t numCycles = p_Perf.values[perfCounterCycles];
+    return (numCycles > 0) ? (static_cast<double>(p_Perf.values[perfCounterInstructions]) / numCycles) : 0.0;
+}
+
+StageStats::StageStats(const char* p_pComponent, const char* const* p_ppStageNames, int p_NumStages)
+    : m_pComponent(p_pComponent)
+    , m_ppStageNames(p_ppStageNames)
+    , m_Stages(p_NumStages)
+{
+    Reset();
+}
+
+void StageStats::Add(int p_Stage, uint64_t p_Nanoseconds, uint64_t p_Bytes)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Stage& stage = m_Stages[p_Stage];
+    stage.latency.Add(p_Nanoseconds);
+    stage.bytes += p_Bytes;
+}
+
+void StageStats::AddPerf(int p_Stage, const PerfCounterValues& p_Delta)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Stage& stage = m_Stages[p_Stage];
+    for (int i = 0; i < perfCounterCount; ++i)
+    {
+        // scaling of multiplexed counters can make a delta come out slightly negative
+        if (static_cast<int64_t>(p_Delta.values[i]) > 0)
+        {
+            stage.perf.values[i] += p_Delta.values[i];
+        }
+    }
+    ++stage.numPerfCalls;
+}
+
+void StageStats::Reset()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (size_t i = 0; i < m_Stages.size(); ++i)
+    {
+        m_Stages[i].latency = LatencyHistogram();
+        m_Stages[i].bytes = 0;
+        memset(&m_Stages[i].perf, 0, sizeof(m_Stages[i].perf));
+        m_Stages[i].numPerfCalls = 0;
+    }
+}
+
+bool StageStats::IsEmpty()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (size_t i = 0; i < m_Stages.size(); ++i)
+    {
+        if (m_Stages[i].latency.GetCount() > 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void StageStats::LogSummary()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (size_t i = 0; i < m_Stages.size(); ++i)
+    {
+        const Stage& stage = m_Stages[i];
+        const uint64_t count = stage.latency.GetCount();
+        if (count == 0)
+        {
+            continue;
+        }
+
+        const uint64_t total = stage.latency.GetTotal();
+        const double mbPerSec = ((stage.bytes > 0) && (total > 0)) ? (stage.bytes / 1048576.0) / (total / 1e9) : 0.0;
+        g_Log(logLevelInfo, "StageStats :: %s %s: %llu calls, %.1f ms total, p50 %.3f ms, p99 %.3f ms, max %.3f ms, %.1f MB/s",
+              m_pComponent, m_ppStageNames[i], (unsigned long long)count, s_Milliseconds(total),
+              s_Milliseconds(stage.latency.GetPercentile(50)), s_Milliseconds(stage.latency.GetPercentile(99)),
+              s_Milliseconds(stage.latency.GetMax()), mbPerSec);
+
+        if (stage.numPerfCalls > 0)
+        {
+            const double numCalls = static_cast<double>(stage.numPerfCalls);
+            g_Log(logLevelInfo, "StageStats :: %s %s per call: %.0f cycles, %.0f instructions, IPC %.2f, %.0f LLC misses, %.0f branch misses",
+                  m_pComponent, m_ppStageNames[i], stage.perf.values[perfCounterCycles] / numCalls,
+                  stage.perf.values[perfCounterInstructions] / numCalls, s_IPC(stage.perf),
+                  stage.perf.values[perfCounterLLCMisses] / numCalls, stage.perf.values[perfCounterBranchMisses] / numCalls);
+        }
+    }
+}
+
+bool StageStats::WriteJson(const std::string& p_MoviePath)
+{
+    const std::string jsonPath = p_MoviePath + "." + m_pComponent + ".stats.json";
+    FILE* pFile = fopen(jsonPath.c_str(), "w");
+    if (pFile == NULL)
+    {
+        g_Log(logLevelError, "StageStats :: Failed to write stage statistics to %s", jsonPath.c_str());
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    fprintf(pFile, "{\n");
+    fprintf(pFile, "  \"component\": %s,\n", g_JsonString(m_pComponent).c_str());
+    fprintf(pFile, "  \"movie\": %s,\n", g_JsonString(p_MoviePath).c_str());
+    fprintf(pFile, "  \"stages\": [\n");
+    bool isFirst = true;
+    for (size_t i = 0; i < m_Stages.size(); ++i)
+    {
+        const Stage& stage = m_Stages[i];
+        if (stage.latency.GetCount() == 0)
+        {
+            continue;
+        }
+
+        fprintf(pFile, "%s    {\"name\": %s, \"calls\": %llu, \"bytes\": %llu, \"total_ms\": %.3f, "
+                       "\"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f, \"p999_ms\": %.4f, \"max_ms\": %.4f",
+                isFirst ? "" : ",\n", g_JsonString(m_ppStageNames[i]).c_str(),
+                (unsigned long long)stage.latency.GetCount(), (unsigned long long)stage.bytes,
+                s_Milliseconds(stage.latency.GetTotal()), s_Milliseconds(stage.latency.GetPercentile(50)),
+                s_Milliseconds(stage.latency.GetPercentile(90)), s_Milliseconds(stage.latency.GetPercentile(99)),
+                s_Milliseconds(stage.latency.GetPercentile(99.9)), s_Milliseconds(stage.latency.GetMax()));
+
+        // sums over the calls that had counters, each counter by its g_PerfCounterName
+        if (stage.numPerfCalls > 0)
+        {
+            fprintf(pFile, ", \"perf\": {\"calls\": %llu", (unsigned long long)stage.numPerfCalls);
+            for (int counter = 0; counter < perfCounterCount; ++counter)
+            {
+                fprintf(pFile, ", \"%s\": %llu", g_PerfCounterName(counter), (unsigned long long)stage.perf.values[counter]);
+            }
+            fprintf(pFile, ", \"ipc\": %.3f}", s_IPC(stage.perf));
+        }
+        fprintf(pFile, "}");
+        isFirst = false;
+    }
+    fprintf(pFile, "\n  ]\n}\n");
+
+    const bool isOk = (ferror(pFile) == 0);
+    fclose(pFile);
+    if (!isOk)
+    {
+        g_Log(logLevelError, "StageStats :: Failed to write stage statistics to %s", jsonPath.c_str());
+    }
+
+    return isOk;
+}
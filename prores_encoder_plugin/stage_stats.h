@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+#include "pipeline_trace.h"
+
+// Per stage timing of the encode and mux paths. Every stage keeps a latency histogram with log-linear buckets,
+// each power of two split into s_NumSubBuckets, so percentiles come out within about 3% at any scale without
+// storing the samples. Collection is always on, it costs two clock reads per stage. With PipelineTrace on
+// every timed stage also becomes a span of the trace. Built with HAVE_PERF_EVENTS the stages also count
+// cycles, instructions, LLC and branch misses of the thread running them.
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void Add(uint64_t p_Nanoseconds);
+
+    uint64_t GetCount() const
+    {
+        return m_Count;
+    }
+
+    uint64_t GetTotal() const
+    {
+        return m_Total;
+    }
+
+    uint64_t GetMax() const
+    {
+        return m_Max;
+    }
+
+    // upper bound of the bucket holding the p_Percentile (0..100) sample
+    uint64_t GetPercentile(double p_Percentile) const;
+
+private:
+    static const int s_SubBucketBits = 5;
+    static const int s_NumSubBuckets = 1 << s_SubBucketBits;
+    static const int s_NumBuckets = (64 - s_SubBucketBits + 1) * s_NumSubBuckets;
+
+    static int s_BucketIdx(uint64_t p_Value);
+    static uint64_t s_BucketMax(int p_Idx);
+
+private:
+    std::vector<uint32_t> m_Buckets;
+    uint64_t m_Count;
+    uint64_t m_Total;
+    uint64_t m_Max;
+};
+
+class StageStats
+{
+public:
+    // p_pComponent and p_ppStageNames must outlive the stats and a trace written after them, usually literals and
+    // a static table indexed by the owner's stage enum
+    StageStats(const char* p_pComponent, const char* const* p_ppStageNames, int p_NumStages);
+
+    void Add(int p_Stage, uint64_t p_Nanoseconds, uint64_t p_Bytes);
+
+    // hardware counter deltas of one call of p_Stage
+    void AddPerf(int p_Stage, const PerfCounterValues& p_Delta);
+
+    // one line per stage with calls, total, p50, p99, max and throughput, plus one with the counters per call
+    void LogSummary();
+
+    // "<p_MoviePath>.<component>.stats.json"
+    bool WriteJson(const std::string& p_MoviePath);
+
+    void Reset();
+
+    // true until a stage has a call since construction or the last Reset
+    bool IsEmpty();
+
+    const char* GetComponent() const
+    {
+        return m_pComponent;
+    }
+
+    const char* GetStageName(int p_Stage) const
+    {
+        return m_ppStageNames[p_Stage];
+    }
+
+private:
+    // disable assignment and copy constructor
+    StageStats(const StageStats& p_Other);
+    StageStats& operator=(const StageStats& p_Other);
+
+private:
+    struct Stage
+    {
+        LatencyHistogram latency;
+        uint64_t bytes;
+        PerfCounterValues perf; // sums
+        uint64_t numPerfCalls;
+    };
+
+    std::mutex m_Mutex; // the host may write audio and video from different threads
+    const char* m_pComponent;
+    const char* const* m_ppStageNames;
+    std::vector<Stage> m_Stages;
+};
+
+// times its own scope into one stage
+class StageTimer
+{
+public:
+    StageTimer(StageStats* p_pStats, int p_Stage, uint64_t p_Bytes = 0)
+        : m_pStats(p_pStats)
+        , m_Stage(p_Stage)
+        , m_Bytes(p_Bytes)
+    {
+#ifdef HAVE_PERF_EVENTS
+        // the counter reads are syscalls, they stay outside the timed span
+        m_HasPerf = g_ReadThreadPerfCounters(&m_PerfStart);
+#endif
+        m_StartedAt = std::chrono::steady_clock::now();
+    }
+
+    ~StageTimer()
+    {
+        const std::chrono::steady_clock::time_point endedAt = std::chrono::steady_clock::now();
+#ifdef HAVE_PERF_EVENTS
+        PerfCounterValues perfEnd;
+        if (m_HasPerf && g_ReadThreadPerfCounters(&perfEnd))
+        {
+            for (int i = 0; i < perfCounterCount; ++i)
+            {
+                perfEnd.values[i] -= m_PerfStart.values[i];
+            }
+            m_pStats->AddPerf(m_Stage, perfEnd);
+        }
+#endif
+        m_pStats->Add(m_Stage, std::chrono::duration_cast<std::chrono::nanoseconds>(endedAt - m_StartedAt).count(), m_Bytes);
+        if (PipelineTrace::s_IsEnabled())
+        {
+            PipelineTrace::s_GetInstance().AddSpan(m_pStats->GetStageName(m_Stage), m_pStats->GetComponent(), m_StartedAt, endedAt, -1);
+        }
+    }
+
+    void SetBytes(uint64_t p_Bytes)
+    {
+        m_Bytes = p_Bytes;
+    }
+
+private:
+    // disable assignment and copy constructor
+    StageTimer(const StageTimer& p_Other);
+    StageTimer& operator=(const StageTimer& p_Other);
+
+private:
+    StageStats* m_pStats;
+    int m_Stage;
+    uint64_t m_Bytes;
+    std::chrono::steady_clock::time_point m_StartedAt;
+#ifdef HAVE_PERF_EVENTS
+    PerfCounterValues m_PerfStart;
+    bool m_HasPerf;
+#endif
+};
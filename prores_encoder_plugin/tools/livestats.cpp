@@ -0,0 +1,181 @@
+// Prints the live render statistics the plugin publishes in shared memory, see live_stats.h for the layout.
+// Without pids it reads every /dev/shm/prores_stats.* segment, which only exists on Linux.
+
+#include "live_stats.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "wrapper/host_api.h"
+
+static const int s_MaxRetries = 1000;
+
+static void s_PrintUsage(const char* p_pName)
+{
+    fprintf(stderr, "usage: %s [-w seconds] [pid...]\n", p_pName);
+}
+
+// a consistent copy of p_pRecord, false when the writer kept it busy for all retries
+static bool s_ReadRecord(const LiveStatsRecord* p_pRecord, LiveStatsRecord* p_pCopy)
+{
+    for (int i = 0; i < s_MaxRetries; ++i)
+    {
+        const uint32_t sequence = p_pRecord->sequence.load(std::memory_order_acquire);
+        if ((sequence & 1) != 0)
+        {
+            continue;
+        }
+
+        // the sequence is an atomic, the rest of the record is plain data copied around it
+        memcpy(reinterpret_cast<char*>(p_pCopy) + sizeof(p_pCopy->sequence), reinterpret_cast<const char*>(p_pRecord) + sizeof(p_pRecord->sequence),
+               sizeof(LiveStatsRecord) - sizeof(p_pRecord->sequence));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (p_pRecord->sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static std::vector<std::string> s_FindSegments()
+{
+    std::vector<std::string> names;
+    DIR* pDir = opendir("/dev/shm");
+    if (pDir == NULL)
+    {
+        return names;
+    }
+
+    const std::string prefix = LIVE_STATS_NAME_PREFIX + 1;
+    for (struct dirent* pEntry = readdir(pDir); pEntry != NULL; pEntry = readdir(pDir))
+    {
+        if (strncmp(pEntry->d_name, prefix.c_str(), prefix.size()) == 0)
+        {
+            names.push_back(std::string("/") + pEntry->d_name);
+        }
+    }
+
+    closedir(pDir);
+    return names;
+}
+
+static void s_PrintSegment(const std::string& p_Name)
+{
+    const int fd = shm_open(p_Name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        g_Log(logLevelError, "livestats :: Could not open %s: %s", p_Name.c_str(), strerror(errno));
+        return;
+    }
+
+    struct stat st;
+    void* pMapping = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && (static_cast<size_t>(st.st_size) >= sizeof(LiveStatsHeader)))
+    {
+        pMapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (pMapping == MAP_FAILED)
+    {
+        g_Log(logLevelError, "livestats :: Could not map %s", p_Name.c_str());
+        return;
+    }
+
+    const LiveStatsHeader* pHeader = static_cast<const LiveStatsHeader*>(pMapping);
+    if ((pHeader->magic != s_LiveStatsMagic) || (pHeader->version != s_LiveStatsVersion) || (pHeader->recordSize < sizeof(LiveStatsRecord)) ||
+        (pHeader->headerSize + static_cast<uint64_t>(pHeader->numRecords) * pHeader->recordSize > static_cast<uint64_t>(st.st_size)))
+    {
+        g_Log(logLevelError, "livestats :: %s has an unknown layout", p_Name.c_str());
+        munmap(pMapping, st.st_size);
+        return;
+    }
+
+    // a crashed process leaves its segment behind
+    const bool isAlive = (kill(static_cast<pid_t>(pHeader->pid), 0) == 0) || (errno == EPERM);
+    printf("pid %lld%s\n", static_cast<long long>(pHeader->pid), isAlive ? "" : " (not running)");
+
+    for (uint32_t i = 0; i < pHeader->numRecords; ++i)
+    {
+        const LiveStatsRecord* pRecord = reinterpret_cast<const LiveStatsRecord*>(static_cast<const char*>(pMapping) + pHeader->headerSize + i * pHeader->recordSize);
+        LiveStatsRecord record;
+        if (!s_ReadRecord(pRecord, &record))
+        {
+            printf("  %2u  busy\n", i);
+            continue;
+        }
+
+        if (record.kind == liveStatsFree)
+        {
+            continue;
+        }
+
+        record.path[sizeof(record.path) - 1] = '\0';
+        printf("  %2u  %-9s  %8llu frames  %7.2f fps  %10.1f MB  queue %4llu  %8.1f MB held  %llu reused  %s\n", i,
+               (record.kind == liveStatsEncoder) ? "encoder" : "container", static_cast<unsigned long long>(record.numFrames), record.fps,
+               record.bytesWritten / 1048576.0, static_cast<unsigned long long>(record.queueDepth), record.memoryInUse / 1048576.0,
+               static_cast<unsigned long long>(record.numReused), record.path);
+    }
+
+    munmap(pMapping, st.st_size);
+}
+
+int main(int argc, char** argv)
+{
+    int intervalSeconds = 0;
+    std::vector<std::string> names;
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-w") == 0) && (i + 1 < argc))
+        {
+            intervalSeconds = atoi(argv[++i]);
+        }
+        else if (atoi(argv[i]) > 0)
+        {
+            names.push_back(LIVE_STATS_NAME_PREFIX + std::string(argv[i]));
+        }
+        else
+        {
+            s_PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    while (true)
+    {
+        const std::vector<std::string> segments = names.empty() ? s_FindSegments() : names;
+        if (segments.empty())
+        {
+            printf("no render statistics published\n");
+        }
+
+        for (size_t i = 0; i < segments.size(); ++i)
+        {
+            s_PrintSegment(segments[i]);
+        }
+
+        if (intervalSeconds <= 0)
+        {
+            break;
+        }
+
+        fflush(stdout);
+        sleep(intervalSeconds);
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+// Joins MOV segments rendered from consecutive frame ranges into a single file without re-encoding.
+// ProRes is intra-only, so every segment starts on a keyframe and the packets can be copied as they are,
+// only the timestamps are shifted so each segment continues where the previous one ended.
+
+#include "mov_muxer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static void s_PrintUsage(const char* p_pName)
+{
+    fprintf(stderr, "usage: %s -o <output.mov> <segment1.mov> <segment2.mov> ...\n", p_pName);
+}
+
+static bool s_IsCompatible(const AVStream* p_pFirst, const AVStream* p_pOther)
+{
+    const AVCodecParameters* pA = p_pFirst->codecpar;
+    const AVCodecParameters* pB = p_pOther->codecpar;
+
+    if ((pA->codec_type != pB->codec_type) || (pA->codec_id != pB->codec_id) || (pA->codec_tag != pB->codec_tag))
+    {
+        return false;
+    }
+
+    if (pA->codec_type == AVMEDIA_TYPE_VIDEO)
+    {
+        return ((pA->width == pB->width) && (pA->height == pB->height) && (pA->format == pB->format));
+    }
+
+    if (pA->codec_type == AVMEDIA_TYPE_AUDIO)
+    {
+        return ((pA->sample_rate == pB->sample_rate) && (pA->channels == pB->channels));
+    }
+
+    return true;
+}
+
+class SegmentReader
+{
+public:
+    SegmentReader()
+        : m_pFormatContext(NULL)
+    {
+    }
+
+    ~SegmentReader()
+    {
+        if (m_pFormatContext != NULL)
+        {
+            avformat_close_input(&m_pFormatContext);
+        }
+    }
+
+    bool Open(const std::string& p_Path)
+    {
+        if (avformat_open_input(&m_pFormatContext, p_Path.c_str(), NULL, NULL) < 0)
+        {
+            g_Log(logLevelError, "movcat :: Could not open segment %s", p_Path.c_str());
+            return false;
+        }
+
+        if (avformat_find_stream_info(m_pFormatContext, NULL) < 0)
+        {
+            g_Log(logLevelError, "movcat :: Could not read stream info of %s", p_Path.c_str());
+            return false;
+        }
+
+        m_Path = p_Path;
+        return true;
+    }
+
+    AVFormatContext* GetContext() const
+    {
+        return m_pFormatContext;
+    }
+
+    const std::string& GetPath() const
+    {
+        return m_Path;
+    }
+
+private:
+    AVFormatContext* m_pFormatContext;
+    std::string m_Path;
+};
+
+int main(int argc, char** argv)
+{
+    std::string outPath;
+    std::vector<std::string> segmentPaths;
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc))
+        {
+            outPath = argv[++i];
+        }
+        else
+        {
+            segmentPaths.push_back(argv[i]);
+        }
+    }
+
+    if (outPath.empty() || segmentPaths.empty())
+    {
+        s_PrintUsage(argv[0]);
+        return 1;
+    }
+
+    av_register_all();
+
+    std::vector<SegmentReader> segments(segmentPaths.size());
+    for (size_t i = 0; i < segmentPaths.size(); ++i)
+    {
+        if (!segments[i].Open(segmentPaths[i]))
+        {
+            return 1;
+        }
+    }
+
+    // all segments must carry the same track layout and coding parameters to share a sample description
+    const AVFormatContext* pFirst = segments[0].GetContext();
+    for (size_t i = 1; i < segments.size(); ++i)
+    {
+        const AVFormatContext* pOther = segments[i].GetContext();
+        if (pOther->nb_streams != pFirst->nb_streams)
+        {
+            g_Log(logLevelError, "movcat :: %s has %u tracks, expected %u", segments[i].GetPath().c_str(), pOther->nb_streams, pFirst->nb_streams);
+            return 1;
+        }
+
+        for (unsigned s = 0; s < pFirst->nb_streams; ++s)
+        {
+            if (!s_IsCompatible(pFirst->streams[s], pOther->streams[s]))
+            {
+                g_Log(logLevelError, "movcat :: Track %u of %s does not match the first segment", s, segments[i].GetPath().c_str());
+                return 1;
+            }
+        }
+    }
+
+    MovMuxer muxer;
+    if (!muxer.Open(outPath))
+    {
+        return 1;
+    }
+
+    for (unsigned s = 0; s < pFirst->nb_streams; ++s)
+    {
+        if (muxer.AddStream(pFirst->streams[s]->codecpar, pFirst->streams[s]->time_base) < 0)
+        {
+            return 1;
+        }
+    }
+
+    if (!muxer.WriteHeader())
+    {
+        return 1;
+    }
+
+    const AVRational usTimeBase = { 1, AV_TIME_BASE };
+
+    // start of the current segment on the output timeline, common to all tracks to keep them in sync
+    int64_t segmentStartUs = 0;
+    AVPacket packet;
+    av_init_packet(&packet);
+    packet.data = NULL;
+    packet.size = 0;
+
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        AVFormatContext* pInput = segments[i].GetContext();
+
+        std::vector<int64_t> firstDts(pInput->nb_streams, AV_NOPTS_VALUE);
+        int64_t segmentEndUs = segmentStartUs;
+        int64_t numPackets = 0;
+
+        int ret = 0;
+        while ((ret = av_read_frame(pInput, &packet)) >= 0)
+        {
+            const int streamIdx = packet.stream_index;
+            const AVStream* pInStream = pInput->streams[streamIdx];
+            const AVStream* pOutStream = muxer.GetStream(streamIdx);
+
+            const int64_t packetDts = (packet.dts != AV_NOPTS_VALUE) ? packet.dts : packet.pts;
+            if (firstDts[streamIdx] == AV_NOPTS_VALUE)
+            {
+                firstDts[streamIdx] = packetDts;
+            }
+
+            // rebase to the segment start, then move into the output time base
+            const int64_t offset = av_rescale_q(segmentStartUs, usTimeBase, pInStream->time_base) - firstDts[streamIdx];
+            if (packet.pts != AV_NOPTS_VALUE)
+            {
+                packet.pts += offset;
+            }
+            packet.dts = packetDts + offset;
+
+            const int64_t endUs = av_rescale_q(packet.dts + packet.duration, pInStream->time_base, usTimeBase);
+            if (endUs > segmentEndUs)
+            {
+                segmentEndUs = endUs;
+            }
+
+            av_packet_rescale_ts(&packet, pInStream->time_base, pOutStream->time_base);
+            packet.pos = -1;
+
+            if (!muxer.WritePacket(&packet))
+            {
+                av_packet_unref(&packet);
+                return 1;
+            }
+
+            av_packet_unref(&packet);
+            ++numPackets;
+        }
+
+        // anything but the end of the segment is a damaged input, the output would silently miss its tail
+        if (ret != AVERROR_EOF)
+        {
+            char errBuf[AV_ERROR_MAX_STRING_SIZE] = { 0 };
+            av_strerror(ret, errBuf, sizeof(errBuf));
+            g_Log(logLevelError, "movcat :: Failed to read %s after %lld packets: %s", segments[i].GetPath().c_str(), static_cast<long long>(numPackets), errBuf);
+            return 1;
+        }
+
+        g_Log(logLevelInfo, "movcat :: Appended %s, %lld packets, ends at %.3f seconds", segments[i].GetPath().c_str(), static_cast<long long>(numPackets), segmentEndUs / 1000000.0);
+        segmentStartUs = segmentEndUs;
+    }
+
+    return muxer.Close() ? 0 : 1;
+}
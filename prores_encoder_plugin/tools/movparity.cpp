@@ -0,0 +1,1169 @@
+// Checks that MovWriter and the libavformat muxer write the same movie. The same synthetic ProRes and LPCM packets
+// are muxed through both, in a plain, a multi-track and a striped layout, and each movie is parsed back:
+//   - the sample tables (stts, stsc, stsz) and the chunk offsets (stco/co64) must lead to exactly the bytes of every
+//     packet, through the data references for a striped movie
+//   - the sample description (codec, frame size and depth, or channels, sample size, rate, float and byte order),
+//     mdhd (duration) and tkhd (track id, flags, volume, size, duration) must agree between both movies, apart from the
+//     LPCM sample entry type and the enabled flag of the later sound tracks, where MovWriter differs on purpose
+// The fast start layouts reserve s_EstimateMoovSize for the expected frame count and check that the moov fits it.
+
+#include "mov_muxer.h"
+#include "mov_writer.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/intfloat.h>
+}
+
+static void s_PrintUsage(const char* p_pName)
+{
+    fprintf(stderr, "usage: %s [-k] [-d <work dir>]\n", p_pName);
+}
+
+static uint32_t s_ReadBE32(const uint8_t* p_pBuf)
+{
+    return (static_cast<uint32_t>(p_pBuf[0]) << 24) | (static_cast<uint32_t>(p_pBuf[1]) << 16) | (static_cast<uint32_t>(p_pBuf[2]) << 8) | p_pBuf[3];
+}
+
+static uint16_t s_ReadBE16(const uint8_t* p_pBuf)
+{
+    return static_cast<uint16_t>((p_pBuf[0] << 8) | p_pBuf[1]);
+}
+
+static uint64_t s_ReadBE64(const uint8_t* p_pBuf)
+{
+    return (static_cast<uint64_t>(s_ReadBE32(p_pBuf)) << 32) | s_ReadBE32(p_pBuf + 4);
+}
+
+static uint32_t s_ReadTag(const uint8_t* p_pBuf)
+{
+    return MKTAG(p_pBuf[0], p_pBuf[1], p_pBuf[2], p_pBuf[3]);
+}
+
+static std::string s_TagString(uint32_t p_Tag)
+{
+    char str[5] = { static_cast<char>(p_Tag), static_cast<char>(p_Tag >> 8), static_cast<char>(p_Tag >> 16), static_cast<char>(p_Tag >> 24), 0 };
+    return str;
+}
+
+// a view of one atom inside the moov, which is read into memory as a whole
+struct Atom
+{
+    uint32_t type;
+    const uint8_t* pData; // payload behind the header
+    size_t size;          // payload size
+};
+
+// the child atoms of p_pData, stops at the first one that does not fit
+static std::vector<Atom> s_ParseAtoms(const uint8_t* p_pData, size_t p_Size)
+{
+    std::vector<Atom> atoms;
+    size_t pos = 0;
+    while (pos + 8 <= p_Size)
+    {
+        uint64_t atomSize = s_ReadBE32(p_pData + pos);
+        size_t headerSize = 8;
+        if ((atomSize == 1) && (pos + 16 <= p_Size))
+        {
+            atomSize = s_ReadBE64(p_pData + pos + 8);
+            headerSize = 16;
+        }
+        else if (atomSize == 0)
+        {
+            atomSize = p_Size - pos;
+        }
+
+        if ((atomSize < headerSize) || (atomSize > p_Size - pos))
+        {
+            break;
+        }
+
+        Atom atom;
+        atom.type = s_ReadTag(p_pData + pos + 4);
+        atom.pData = p_pData + pos + headerSize;
+        atom.size = static_cast<size_t>(atomSize) - headerSize;
+        atoms.push_back(atom);
+        pos += static_cast<size_t>(atomSize);
+    }
+
+    return atoms;
+}
+
+static const Atom* s_FindAtom(const std::vector<Atom>& p_Atoms, uint32_t p_Type)
+{
+    for (size_t i = 0; i < p_Atoms.size(); ++i)
+    {
+        if (p_Atoms[i].type == p_Type)
+        {
+            return &p_Atoms[i];
+        }
+    }
+
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Synthetic source
+///
+////////////////////////////////////////////////////////////////////////////////
+
+struct AudioTrackDesc
+{
+    AVCodecID codecId;
+    int numChannels;
+    int bytesPerSample;
+};
+
+struct Layout
+{
+    const char* pName;
+    int64_t numFrames;
+    int fpsNum;
+    int fpsDen;
+    int sampleRate; // every audio track
+    std::vector<AudioTrackDesc> audioTracks;
+    int numStripes;   // MovWriter only, 0 for a self-contained movie
+    bool isFastStart; // MovWriter reserves s_MoovReserve() in front of the samples
+};
+
+// every audio track gets one packet per video frame, the moov space is sized for that
+static int64_t s_MoovReserve(const Layout& p_Layout)
+{
+    return MovWriter::s_EstimateMoovSize(p_Layout.numFrames, 1, static_cast<int>(p_Layout.audioTracks.size()), p_Layout.numFrames, p_Layout.numStripes);
+}
+
+// every byte of every packet is known from its position, so the samples are checked without keeping them
+static uint8_t s_SourceByte(int p_StreamIdx, uint64_t p_Pos)
+{
+    const uint64_t x = (p_Pos + 1) * 0x9E3779B97F4A7C15ull + (static_cast<uint64_t>(p_StreamIdx) + 1) * 0xBF58476D1CE4E5B9ull;
+    return static_cast<uint8_t>(x >> 56);
+}
+
+// video positions are the frame in the upper and the byte in the lower half
+static uint64_t s_VideoPos(int64_t p_FrameIdx, uint64_t p_ByteIdx)
+{
+    return (static_cast<uint64_t>(p_FrameIdx) << 32) | p_ByteIdx;
+}
+
+static int s_VideoPacketSize(int64_t p_FrameIdx)
+{
+    return 256 + static_cast<int>((p_FrameIdx * 7919) % 1024);
+}
+
+// audio frames per video frame, the layouts pick rates where this is a whole number
+static int64_t s_AudioFramesPerPacket(const Layout& p_Layout)
+{
+    return (static_cast<int64_t>(p_Layout.sampleRate) * p_Layout.fpsDen) / p_Layout.fpsNum;
+}
+
+static int s_AudioBytesPerFrame(const AudioTrackDesc& p_Track)
+{
+    return p_Track.numChannels * p_Track.bytesPerSample;
+}
+
+static bool s_Mux(const std::string& p_Path, const std::vector<std::string>& p_StripePaths, const Layout& p_Layout, bool p_IsNative)
+{
+    MovMuxer muxer;
+    if (p_IsNative)
+    {
+        muxer.EnableNativeWriter(p_Layout.isFastStart ? s_MoovReserve(p_Layout) : 0);
+        if (!p_StripePaths.empty())
+        {
+            muxer.EnableStriping(p_StripePaths);
+        }
+    }
+
+    if (!muxer.Open(p_Path))
+    {
+        return false;
+    }
+
+    AVCodecParameters* pVideoPar = avcodec_parameters_alloc();
+    pVideoPar->codec_type = AVMEDIA_TYPE_VIDEO;
+    pVideoPar->codec_id = AV_CODEC_ID_PRORES;
+    pVideoPar->profile = FF_PROFILE_PRORES_HQ;
+    pVideoPar->format = AV_PIX_FMT_YUV422P10;
+    pVideoPar->width = 1920;
+    pVideoPar->height = 1080;
+    const AVRational videoTimeBase = { p_Layout.fpsDen, p_Layout.fpsNum };
+    const AVRational audioTimeBase = { 1, p_Layout.sampleRate };
+    bool isOk = (muxer.AddStream(pVideoPar, videoTimeBase) == 0);
+    avcodec_parameters_free(&pVideoPar);
+
+    for (size_t i = 0; isOk && (i < p_Layout.audioTracks.size()); ++i)
+    {
+        const AudioTrackDesc& track = p_Layout.audioTracks[i];
+        AVCodecParameters* pAudioPar = avcodec_parameters_alloc();
+        pAudioPar->codec_type = AVMEDIA_TYPE_AUDIO;
+        pAudioPar->codec_id = track.codecId;
+        pAudioPar->channels = track.numChannels;
+        pAudioPar->channel_layout = av_get_default_channel_layout(track.numChannels);
+        pAudioPar->sample_rate = p_Layout.sampleRate;
+        pAudioPar->bits_per_coded_sample = track.bytesPerSample * 8;
+        pAudioPar->block_align = s_AudioBytesPerFrame(track);
+        isOk = (muxer.AddStream(pAudioPar, audioTimeBase) == static_cast<int>(i + 1));
+        avcodec_parameters_free(&pAudioPar);
+    }
+
+    if (!isOk || !muxer.WriteHeader())
+    {
+        g_Log(logLevelError, "movparity :: Could not start %s", p_Path.c_str());
+        return false;
+    }
+
+    const int64_t audioFramesPerPacket = s_AudioFramesPerPacket(p_Layout);
+    std::vector<uint8_t> data;
+    for (int64_t frameIdx = 0; isOk && (frameIdx < p_Layout.numFrames); ++frameIdx)
+    {
+        data.resize(s_VideoPacketSize(frameIdx));
+        for (size_t b = 0; b < data.size(); ++b)
+        {
+            data[b] = s_SourceByte(0, s_VideoPos(frameIdx, b));
+        }
+
+        AVPacket packet;
+        av_init_packet(&packet);
+        packet.data = data.data();
+        packet.size = static_cast<int>(data.size());
+        packet.stream_index = 0;
+        packet.pts = frameIdx;
+        packet.dts = frameIdx;
+        packet.duration = 1;
+        packet.flags = AV_PKT_FLAG_KEY;
+        // libavformat picks its own time base when the header is written, MovWriter keeps the one it was given
+        av_packet_rescale_ts(&packet, videoTimeBase, muxer.GetStream(0)->time_base);
+        isOk = muxer.QueuePacket(&packet);
+
+        for (size_t t = 0; isOk && (t < p_Layout.audioTracks.size()); ++t)
+        {
+            const int bytesPerFrame = s_AudioBytesPerFrame(p_Layout.audioTracks[t]);
+            const uint64_t firstByte = static_cast<uint64_t>(frameIdx * audioFramesPerPacket) * bytesPerFrame;
+            data.resize(audioFramesPerPacket * bytesPerFrame);
+            for (size_t b = 0; b < data.size(); ++b)
+            {
+                data[b] = s_SourceByte(static_cast<int>(t + 1), firstByte + b);
+            }
+
+            packet.data = data.data();
+            packet.size = static_cast<int>(data.size());
+            packet.stream_index = static_cast<int>(t + 1);
+            packet.pts = frameIdx * audioFramesPerPacket;
+            packet.dts = packet.pts;
+            packet.duration = audioFramesPerPacket;
+            av_packet_rescale_ts(&packet, audioTimeBase, muxer.GetStream(packet.stream_index)->time_base);
+            isOk = muxer.QueuePacket(&packet);
+        }
+    }
+
+    if (!isOk)
+    {
+        g_Log(logLevelError, "movparity :: Could not write the samples of %s", p_Path.c_str());
+        return false;
+    }
+
+    return muxer.Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Movie reader
+///
+////////////////////////////////////////////////////////////////////////////////
+
+// what a sample description says, normalized over the sound description versions
+struct SampleEntry
+{
+    uint32_t fourCC;
+    uint16_t dataRefIdx; // 1 based
+    uint16_t width;
+    uint16_t height;
+    uint16_t depth;
+    uint32_t numChannels;
+    uint32_t bitsPerSample;
+    uint32_t sampleRate;
+    bool isFloat;
+    bool isBigEndian;
+};
+
+// a run of bytes in one data file
+struct DataRange
+{
+    int dataIdx;
+    int64_t offset;
+    int64_t size;
+    uint32_t duration; // video: of the sample, in the media timescale
+};
+
+struct TrackInfo
+{
+    uint32_t handler;
+    uint32_t trackId;
+    uint32_t tkhdFlags;
+    uint16_t volume;
+    uint32_t width;  // 16.16
+    uint32_t height; // 16.16
+    double tkhdSeconds;
+
+    uint32_t timescale;
+    double mdhdSeconds;
+
+    std::vector<SampleEntry> entries;
+
+    // video: one range per sample, audio: one per chunk
+    std::vector<DataRange> ranges;
+    int64_t numSamples;
+    int64_t sttsTicks;
+};
+
+class ParsedMovie
+{
+public:
+    ParsedMovie()
+        : m_MovieTimescale(0)
+        , m_MoovPos(-1)
+        , m_MoovSize(0)
+    {
+    }
+
+    ~ParsedMovie()
+    {
+        for (size_t i = 0; i < m_DataFiles.size(); ++i)
+        {
+            if (m_DataFiles[i] != NULL)
+            {
+                fclose(m_DataFiles[i]);
+            }
+        }
+    }
+
+    bool Load(const std::string& p_Path)
+    {
+        m_Path = p_Path;
+        if (!ReadTopLevel())
+        {
+            return false;
+        }
+
+        const std::vector<Atom> moov = s_ParseAtoms(m_Moov.data(), m_Moov.size());
+        const Atom* pMvhd = s_FindAtom(moov, MKTAG('m', 'v', 'h', 'd'));
+        if ((pMvhd == NULL) || (pMvhd->size < 24))
+        {
+            return Fail("no movie header");
+        }
+
+        m_MovieTimescale = s_ReadBE32(pMvhd->pData + ((pMvhd->pData[0] == 1) ? 20 : 12));
+        for (size_t i = 0; i < moov.size(); ++i)
+        {
+            if ((moov[i].type == MKTAG('t', 'r', 'a', 'k')) && !ParseTrak(moov[i]))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool Read(int p_DataIdx, int64_t p_Offset, int64_t p_Size, std::vector<uint8_t>* p_pData)
+    {
+        FILE* pFile = m_DataFiles[p_DataIdx];
+        p_pData->resize(static_cast<size_t>(p_Size));
+        return (pFile != NULL) && (fseeko(pFile, p_Offset, SEEK_SET) == 0) && (p_pData->empty() || (fread(p_pData->data(), p_pData->size(), 1, pFile) == 1));
+    }
+
+    const std::string& GetPath() const
+    {
+        return m_Path;
+    }
+
+    const std::vector<TrackInfo>& GetTracks() const
+    {
+        return m_Tracks;
+    }
+
+    const std::vector<uint32_t>& GetTopLevel() const
+    {
+        return m_TopLevel;
+    }
+
+    int64_t GetMoovSize() const
+    {
+        return m_MoovSize;
+    }
+
+    double GetMovieSeconds(int64_t p_Ticks) const
+    {
+        return (m_MovieTimescale > 0) ? static_cast<double>(p_Ticks) / m_MovieTimescale : 0.0;
+    }
+
+    uint32_t GetMovieTimescale() const
+    {
+        return m_MovieTimescale;
+    }
+
+private:
+    // disable assignment and copy constructor
+    ParsedMovie(const ParsedMovie& p_Other);
+    ParsedMovie& operator=(const ParsedMovie& p_Other);
+
+    bool Fail(const char* p_pWhat) const
+    {
+        g_Log(logLevelError, "movparity :: %s: %s", m_Path.c_str(), p_pWhat);
+        return false;
+    }
+
+    bool ReadTopLevel()
+    {
+        FILE* pFile = fopen(m_Path.c_str(), "rb");
+        if (pFile == NULL)
+        {
+            return Fail("could not open");
+        }
+
+        // the data file of a self-contained movie is the movie itself
+        m_DataPaths.push_back(m_Path);
+        m_DataFiles.push_back(pFile);
+
+        int64_t pos = 0;
+        uint8_t header[16];
+        while ((fseeko(pFile, pos, SEEK_SET) == 0) && (fread(header, 8, 1, pFile) == 1))
+        {
+            int64_t atomSize = s_ReadBE32(header);
+            int64_t headerSize = 8;
+            if (atomSize == 1)
+            {
+                if (fread(header + 8, 8, 1, pFile) != 1)
+                {
+                    break;
+                }
+
+                atomSize = static_cast<int64_t>(s_ReadBE64(header + 8));
+                headerSize = 16;
+            }
+
+            if (atomSize < headerSize)
+            {
+                break;
+            }
+
+            const uint32_t type = s_ReadTag(header + 4);
+            m_TopLevel.push_back(type);
+            if ((type == MKTAG('m', 'o', 'o', 'v')) && (m_MoovPos < 0))
+            {
+                m_MoovPos = pos;
+                m_MoovSize = atomSize;
+                m_Moov.resize(static_cast<size_t>(atomSize - headerSize));
+                if (!m_Moov.empty() && (fread(m_Moov.data(), m_Moov.size(), 1, pFile) != 1))
+                {
+                    return Fail("truncated moov");
+                }
+            }
+
+            pos += atomSize;
+        }
+
+        return (m_MoovPos >= 0) || Fail("no moov");
+    }
+
+    // the data file a dref entry points at
+    int OpenDataRef(const Atom& p_Entry)
+    {
+        const bool isSelf = (p_Entry.size >= 4) && ((s_ReadBE32(p_Entry.pData) & 0x1) != 0);
+        if (isSelf)
+        {
+            return 0;
+        }
+
+        if ((p_Entry.type != MKTAG('u', 'r', 'l', ' ')) || (p_Entry.size <= 4))
+        {
+            Fail("unsupported data reference");
+            return -1;
+        }
+
+        std::string path(reinterpret_cast<const char*>(p_Entry.pData + 4), strnlen(reinterpret_cast<const char*>(p_Entry.pData + 4), p_Entry.size - 4));
+        if (path.compare(0, 7, "file://") == 0)
+        {
+            path.erase(0, 7);
+        }
+
+        for (size_t i = 0; i < m_DataPaths.size(); ++i)
+        {
+            if (m_DataPaths[i] == path)
+            {
+                return static_cast<int>(i);
+            }
+        }
+
+        FILE* pFile = fopen(path.c_str(), "rb");
+        if (pFile == NULL)
+        {
+            g_Log(logLevelError, "movparity :: %s: could not open data file %s", m_Path.c_str(), path.c_str());
+            return -1;
+        }
+
+        m_DataPaths.push_back(path);
+        m_DataFiles.push_back(pFile);
+        return static_cast<int>(m_DataFiles.size() - 1);
+    }
+
+    // 'sowt', 'twos', 'in24', 'in32', 'fl32' of sound description version 0 and 1 or 'lpcm' of version 2
+    bool ParseSoundEntry(const uint8_t* p_pEntry, size_t p_Size, SampleEntry* p_pDesc)
+    {
+        if (p_Size < 16 + 20)
+        {
+            return Fail("short sound description");
+        }
+
+        const uint16_t version = s_ReadBE16(p_pEntry + 16);
+        if (version == 2)
+        {
+            if (p_Size < 16 + 56)
+            {
+                return Fail("short sound description");
+            }
+
+            const uint8_t* pFields = p_pEntry + 16 + 20;
+            const uint32_t flags = s_ReadBE32(pFields + 24);
+            p_pDesc->sampleRate = static_cast<uint32_t>(av_int2double(s_ReadBE64(pFields + 4)));
+            p_pDesc->numChannels = s_ReadBE32(pFields + 12);
+            p_pDesc->bitsPerSample = s_ReadBE32(pFields + 20);
+            p_pDesc->isFloat = ((flags & 0x1) != 0);
+            p_pDesc->isBigEndian = ((flags & 0x2) != 0);
+            return true;
+        }
+
+        p_pDesc->numChannels = s_ReadBE16(p_pEntry + 16 + 8);
+        p_pDesc->bitsPerSample = s_ReadBE16(p_pEntry + 16 + 10);
+        p_pDesc->sampleRate = s_ReadBE32(p_pEntry + 16 + 16) >> 16;
+        p_pDesc->isFloat = false;
+        p_pDesc->isBigEndian = true;
+
+        const uint32_t fourCC = p_pDesc->fourCC;
+        if (fourCC == MKTAG('s', 'o', 'w', 't'))
+        {
+            p_pDesc->isBigEndian = false;
+        }
+        else if (fourCC == MKTAG('i', 'n', '2', '4'))
+        {
+            p_pDesc->bitsPerSample = 24;
+        }
+        else if (fourCC == MKTAG('i', 'n', '3', '2'))
+        {
+            p_pDesc->bitsPerSample = 32;
+        }
+        else if (fourCC == MKTAG('f', 'l', '3', '2'))
+        {
+            p_pDesc->bitsPerSample = 32;
+            p_pDesc->isFloat = true;
+        }
+        else if (fourCC != MKTAG('t', 'w', 'o', 's'))
+        {
+            return Fail("sound track is not LPCM");
+        }
+
+        // the byte order of the wider formats is an 'enda' atom, usually inside 'wave', behind the version 1 fields
+        const size_t extPos = 16 + 20 + ((version == 1) ? 16 : 0);
+        if (p_Size > extPos)
+        {
+            const std::vector<Atom> ext = s_ParseAtoms(p_pEntry + extPos, p_Size - extPos);
+            const Atom* pWave = s_FindAtom(ext, MKTAG('w', 'a', 'v', 'e'));
+            const std::vector<Atom> wave = (pWave != NULL) ? s_ParseAtoms(pWave->pData, pWave->size) : ext;
+            const Atom* pEnda = s_FindAtom(wave, MKTAG('e', 'n', 'd', 'a'));
+            if ((pEnda != NULL) && (pEnda->size >= 2))
+            {
+                p_pDesc->isBigEndian = (s_ReadBE16(pEnda->pData) == 0);
+            }
+        }
+
+        return true;
+    }
+
+    bool ParseStsd(const Atom& p_Stsd, bool p_IsVideo, TrackInfo* p_pTrack)
+    {
+        if (p_Stsd.size < 8)
+        {
+            return Fail("short stsd");
+        }
+
+        const uint32_t numEntries = s_ReadBE32(p_Stsd.pData + 4);
+        size_t pos = 8;
+        for (uint32_t i = 0; i < numEntries; ++i)
+        {
+            if (pos + 16 > p_Stsd.size)
+            {
+                return Fail("truncated stsd");
+            }
+
+            const uint8_t* pEntry = p_Stsd.pData + pos;
+            const size_t entrySize = s_ReadBE32(pEntry);
+            if ((entrySize < 16) || (pos + entrySize > p_Stsd.size))
+            {
+                return Fail("bad sample description size");
+            }
+
+            SampleEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.fourCC = s_ReadTag(pEntry + 4);
+            entry.dataRefIdx = s_ReadBE16(pEntry + 14);
+            if (p_IsVideo)
+            {
+                if (entrySize < 16 + 70)
+                {
+                    return Fail("short video sample description");
+                }
+
+                entry.width = s_ReadBE16(pEntry + 16 + 16);
+                entry.height = s_ReadBE16(pEntry + 16 + 18);
+                entry.depth = s_ReadBE16(pEntry + 16 + 66);
+            }
+            else if (!ParseSoundEntry(pEntry, entrySize, &entry))
+            {
+                return false;
+            }
+
+            p_pTrack->entries.push_back(entry);
+            pos += entrySize;
+        }
+
+        return !p_pTrack->entries.empty() || Fail("no sample description");
+    }
+
+    bool ParseTrak(const Atom& p_Trak)
+    {
+        const std::vector<Atom> trak = s_ParseAtoms(p_Trak.pData, p_Trak.size);
+        const Atom* pTkhd = s_FindAtom(trak, MKTAG('t', 'k', 'h', 'd'));
+        const Atom* pMdia = s_FindAtom(trak, MKTAG('m', 'd', 'i', 'a'));
+        if ((pTkhd == NULL) || (pMdia == NULL) || (pTkhd->size < 84) || ((pTkhd->pData[0] == 1) && (pTkhd->size < 96)))
+        {
+            return Fail("track without tkhd or mdia");
+        }
+
+        TrackInfo track;
+        track.numSamples = 0;
+        track.sttsTicks = 0;
+
+        // tkhd, version 1 has 64 bit times and duration
+        const uint8_t* pTkhdData = pTkhd->pData;
+        const bool isTkhdV1 = (pTkhdData[0] == 1);
+        const size_t tkhdShift = isTkhdV1 ? 12 : 0;
+        track.tkhdFlags = s_ReadBE32(pTkhdData) & 0xFFFFFF;
+        track.trackId = s_ReadBE32(pTkhdData + (isTkhdV1 ? 20 : 12));
+        track.tkhdSeconds = GetMovieSeconds(isTkhdV1 ? static_cast<int64_t>(s_ReadBE64(pTkhdData + 28)) : s_ReadBE32(pTkhdData + 20));
+        track.volume = s_ReadBE16(pTkhdData + 36 + tkhdShift);
+        track.width = s_ReadBE32(pTkhdData + 76 + tkhdShift);
+        track.height = s_ReadBE32(pTkhdData + 80 + tkhdShift);
+
+        const std::vector<Atom> mdia = s_ParseAtoms(pMdia->pData, pMdia->size);
+        const Atom* pMdhd = s_FindAtom(mdia, MKTAG('m', 'd', 'h', 'd'));
+        const Atom* pHdlr = s_FindAtom(mdia, MKTAG('h', 'd', 'l', 'r'));
+        const Atom* pMinf = s_FindAtom(mdia, MKTAG('m', 'i', 'n', 'f'));
+        if ((pMdhd == NULL) || (pHdlr == NULL) || (pMinf == NULL) || (pMdhd->size < 24) || ((pMdhd->pData[0] == 1) && (pMdhd->size < 32)) || (pHdlr->size < 12))
+        {
+            return Fail("track without mdhd, hdlr or minf");
+        }
+
+        const bool isMdhdV1 = (pMdhd->pData[0] == 1);
+        track.timescale = s_ReadBE32(pMdhd->pData + (isMdhdV1 ? 20 : 12));
+        const int64_t mdhdDuration = isMdhdV1 ? static_cast<int64_t>(s_ReadBE64(pMdhd->pData + 24)) : s_ReadBE32(pMdhd->pData + 16);
+        track.mdhdSeconds = (track.timescale > 0) ? static_cast<double>(mdhdDuration) / track.timescale : 0.0;
+        track.handler = s_ReadTag(pHdlr->pData + 8);
+
+        const bool isVideo = (track.handler == MKTAG('v', 'i', 'd', 'e'));
+        if (!isVideo && (track.handler != MKTAG('s', 'o', 'u', 'n')))
+        {
+            return Fail("track is neither video nor sound");
+        }
+
+        const std::vector<Atom> minf = s_ParseAtoms(pMinf->pData, pMinf->size);
+        const Atom* pDinf = s_FindAtom(minf, MKTAG('d', 'i', 'n', 'f'));
+        const Atom* pStbl = s_FindAtom(minf, MKTAG('s', 't', 'b', 'l'));
+        if ((pDinf == NULL) || (pStbl == NULL))
+        {
+            return Fail("track without dinf or stbl");
+        }
+
+        const std::vector<Atom> dinf = s_ParseAtoms(pDinf->pData, pDinf->size);
+        const Atom* pDref = s_FindAtom(dinf, MKTAG('d', 'r', 'e', 'f'));
+        if ((pDref == NULL) || (pDref->size < 8))
+        {
+            return Fail("track without dref");
+        }
+
+        std::vector<int> dataIdxByRef;
+        const std::vector<Atom> refs = s_ParseAtoms(pDref->pData + 8, pDref->size - 8);
+        for (size_t i = 0; i < refs.size(); ++i)
+        {
+            const int dataIdx = OpenDataRef(refs[i]);
+            if (dataIdx < 0)
+            {
+                return false;
+            }
+
+            dataIdxByRef.push_back(dataIdx);
+        }
+
+        const std::vector<Atom> stbl = s_ParseAtoms(pStbl->pData, pStbl->size);
+        const Atom* pStsd = s_FindAtom(stbl, MKTAG('s', 't', 's', 'd'));
+        const Atom* pStts = s_FindAtom(stbl, MKTAG('s', 't', 't', 's'));
+        const Atom* pStsc = s_FindAtom(stbl, MKTAG('s', 't', 's', 'c'));
+        const Atom* pStsz = s_FindAtom(stbl, MKTAG('s', 't', 's', 'z'));
+        const Atom* pStco = s_FindAtom(stbl, MKTAG('s', 't', 'c', 'o'));
+        const Atom* pCo64 = s_FindAtom(stbl, MKTAG('c', 'o', '6', '4'));
+        const Atom* pOffsets = (pCo64 != NULL) ? pCo64 : pStco;
+        if ((pStsd == NULL) || (pStts == NULL) || (pStsc == NULL) || (pStsz == NULL) || (pOffsets == NULL) ||
+            (pStts->size < 8) || (pStsc->size < 8) || (pStsz->size < 12) || (pOffsets->size < 8))
+        {
+            return Fail("incomplete sample table");
+        }
+
+        if (!ParseStsd(*pStsd, isVideo, &track))
+        {
+            return false;
+        }
+
+        // sample durations in decode order
+        std::vector<uint32_t> durations;
+        const uint32_t numSttsEntries = s_ReadBE32(pStts->pData + 4);
+        if (8 + static_cast<size_t>(numSttsEntries) * 8 > pStts->size)
+        {
+            return Fail("truncated stts");
+        }
+
+        for (uint32_t i = 0; i < numSttsEntries; ++i)
+        {
+            const uint32_t count = s_ReadBE32(pStts->pData + 8 + i * 8);
+            const uint32_t delta = s_ReadBE32(pStts->pData + 12 + i * 8);
+            track.sttsTicks += static_cast<int64_t>(count) * delta;
+            if (isVideo)
+            {
+                durations.insert(durations.end(), count, delta);
+            }
+        }
+
+        const uint32_t constSampleSize = s_ReadBE32(pStsz->pData + 4);
+        const uint32_t numSizes = s_ReadBE32(pStsz->pData + 8);
+        if ((constSampleSize == 0) && (12 + static_cast<size_t>(numSizes) * 4 > pStsz->size))
+        {
+            return Fail("truncated stsz");
+        }
+
+        const bool isCo64 = (pOffsets == pCo64);
+        const uint32_t numChunks = s_ReadBE32(pOffsets->pData + 4);
+        if (8 + static_cast<size_t>(numChunks) * (isCo64 ? 8 : 4) > pOffsets->size)
+        {
+            return Fail("truncated chunk offsets");
+        }
+
+        const uint32_t numStscEntries = s_ReadBE32(pStsc->pData + 4);
+        if ((numStscEntries == 0) || (8 + static_cast<size_t>(numStscEntries) * 12 > pStsc->size))
+        {
+            return Fail("bad stsc");
+        }
+
+        // walk the chunks, the stsc entry in force names the samples per chunk and their description
+        int64_t sampleIdx = 0;
+        uint32_t stscIdx = 0;
+        for (uint32_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            while ((stscIdx + 1 < numStscEntries) && (s_ReadBE32(pStsc->pData + 8 + (stscIdx + 1) * 12) <= chunk + 1))
+            {
+                ++stscIdx;
+            }
+
+            const uint32_t samplesPerChunk = s_ReadBE32(pStsc->pData + 8 + stscIdx * 12 + 4);
+            const uint32_t descIdx = s_ReadBE32(pStsc->pData + 8 + stscIdx * 12 + 8);
+            if ((descIdx == 0) || (descIdx > track.entries.size()))
+            {
+                return Fail("chunk with an unknown sample description");
+            }
+
+            const uint16_t refIdx = track.entries[descIdx - 1].dataRefIdx;
+            if ((refIdx == 0) || (refIdx > dataIdxByRef.size()))
+            {
+                return Fail("sample description with an unknown data reference");
+            }
+
+            DataRange range;
+            range.dataIdx = dataIdxByRef[refIdx - 1];
+            range.offset = isCo64 ? static_cast<int64_t>(s_ReadBE64(pOffsets->pData + 8 + chunk * 8)) : s_ReadBE32(pOffsets->pData + 8 + chunk * 4);
+            range.duration = 0;
+
+            if (!isVideo)
+            {
+                // LPCM samples are frames, stsz gives their size or just 1 in the old QuickTime convention
+                const SampleEntry& entry = track.entries[descIdx - 1];
+                const int64_t bytesPerFrame = (constSampleSize > 1) ? constSampleSize : (entry.numChannels * entry.bitsPerSample / 8);
+                range.size = samplesPerChunk * bytesPerFrame;
+                track.ranges.push_back(range);
+                track.numSamples += samplesPerChunk;
+                continue;
+            }
+
+            for (uint32_t s = 0; s < samplesPerChunk; ++s, ++sampleIdx)
+            {
+                if ((constSampleSize == 0) && (sampleIdx >= numSizes))
+                {
+                    return Fail("more samples in the chunks than in stsz");
+                }
+
+                range.size = (constSampleSize != 0) ? constSampleSize : s_ReadBE32(pStsz->pData + 12 + sampleIdx * 4);
+                range.duration = (static_cast<size_t>(sampleIdx) < durations.size()) ? durations[sampleIdx] : 0;
+                track.ranges.push_back(range);
+                range.offset += range.size;
+            }
+            track.numSamples = sampleIdx;
+        }
+
+        m_Tracks.push_back(track);
+        return true;
+    }
+
+private:
+    std::string m_Path;
+    std::vector<uint8_t> m_Moov;
+    std::vector<uint32_t> m_TopLevel;
+    uint32_t m_MovieTimescale;
+    int64_t m_MoovPos;
+    int64_t m_MoovSize;
+    std::vector<TrackInfo> m_Tracks;
+    std::vector<std::string> m_DataPaths;
+    std::vector<FILE*> m_DataFiles;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///
+/// Checks
+///
+////////////////////////////////////////////////////////////////////////////////
+
+// collects the mismatches of one layout
+class Report
+{
+public:
+    explicit Report(const char* p_pLayout)
+        : m_pLayout(p_pLayout)
+        , m_NumErrors(0)
+    {
+    }
+
+    void Error(const char* p_pFmt, ...)
+    {
+        char msg[1024];
+        va_list args;
+        va_start(args, p_pFmt);
+        vsnprintf(msg, sizeof(msg), p_pFmt, args);
+        va_end(args);
+
+        // one wrong table breaks every sample after it, the first few tell enough
+        if (++m_NumErrors <= 20)
+        {
+            g_Log(logLevelError, "movparity :: %s: %s", m_pLayout, msg);
+        }
+    }
+
+    int GetNumErrors() const
+    {
+        return m_NumErrors;
+    }
+
+private:
+    const char* m_pLayout;
+    int m_NumErrors;
+};
+
+static bool s_IsClose(double p_A, double p_B, double p_Tolerance)
+{
+    return (p_A - p_B <= p_Tolerance) && (p_B - p_A <= p_Tolerance);
+}
+
+// every sample of every track against the source
+static void s_CheckSamples(ParsedMovie* p_pMovie, const Layout& p_Layout, Report* p_pReport)
+{
+    const std::vector<TrackInfo>& tracks = p_pMovie->GetTracks();
+    const char* pPath = p_pMovie->GetPath().c_str();
+    if (tracks.size() != p_Layout.audioTracks.size() + 1)
+    {
+        p_pReport->Error("%s has %zu tracks, expected %zu", pPath, tracks.size(), p_Layout.audioTracks.size() + 1);
+        return;
+    }
+
+    std::vector<uint8_t> data;
+    const TrackInfo& video = tracks[0];
+    if (video.handler != MKTAG('v', 'i', 'd', 'e'))
+    {
+        p_pReport->Error("%s track 1 is not video", pPath);
+        return;
+    }
+
+    if (video.numSamples != p_Layout.numFrames)
+    {
+        p_pReport->Error("%s has %lld video samples, expected %lld", pPath, static_cast<long long>(video.numSamples), static_cast<long long>(p_Layout.numFrames));
+    }
+
+    const double frameSeconds = static_cast<double>(p_Layout.fpsDen) / p_Layout.fpsNum;
+    for (size_t i = 0; (i < video.ranges.size()) && (static_cast<int64_t>(i) < p_Layout.numFrames); ++i)
+    {
+        const DataRange& range = video.ranges[i];
+        if (range.size != s_VideoPacketSize(i))
+        {
+            p_pReport->Error("%s video sample %zu has %lld bytes, expected %d", pPath, i, static_cast<long long>(range.size), s_VideoPacketSize(i));
+            continue;
+        }
+
+        if ((video.timescale == 0) || !s_IsClose(static_cast<double>(range.duration) / video.timescale, frameSeconds, 0.5 / video.timescale))
+        {
+            p_pReport->Error("%s video sample %zu lasts %u of %u, expected %d/%d seconds", pPath, i, range.duration, video.timescale, p_Layout.fpsDen, p_Layout.fpsNum);
+        }
+
+        if (!p_pMovie->Read(range.dataIdx, range.offset, range.size, &data))
+        {
+            p_pReport->Error("%s video sample %zu at %lld is past the end of its data", pPath, i, static_cast<long long>(range.offset));
+            continue;
+        }
+
+        for (size_t b = 0; b < data.size(); ++b)
+        {
+            if (data[b] != s_SourceByte(0, s_VideoPos(i, b)))
+            {
+                p_pReport->Error("%s video sample %zu at %lld does not hold the packet's bytes", pPath, i, static_cast<long long>(range.offset));
+                break;
+            }
+        }
+    }
+
+    // audio is one byte stream, however the writer cut it into chunks
+    const int64_t audioFramesPerPacket = s_AudioFramesPerPacket(p_Layout);
+    for (size_t t = 0; t < p_Layout.audioTracks.size(); ++t)
+    {
+        const TrackInfo& audio = tracks[t + 1];
+        const int streamIdx = static_cast<int>(t + 1);
+        const int64_t numFrames = p_Layout.numFrames * audioFramesPerPacket;
+        const int64_t numBytes = numFrames * s_AudioBytesPerFrame(p_Layout.audioTracks[t]);
+        if (audio.handler != MKTAG('s', 'o', 'u', 'n'))
+        {
+            p_pReport->Error("%s track %zu is not sound", pPath, t + 2);
+            continue;
+        }
+
+        if ((audio.numSamples != numFrames) || (audio.sttsTicks != numFrames))
+        {
+            p_pReport->Error("%s track %zu has %lld frames and %lld ticks, expected %lld", pPath, t + 2, static_cast<long long>(audio.numSamples),
+                             static_cast<long long>(audio.sttsTicks), static_cast<long long>(numFrames));
+        }
+
+        int64_t pos = 0;
+        for (size_t c = 0; c < audio.ranges.size(); ++c)
+        {
+            const DataRange& range = audio.ranges[c];
+            if ((pos + range.size > numBytes) || !p_pMovie->Read(range.dataIdx, range.offset, range.size, &data))
+            {
+                p_pReport->Error("%s track %zu chunk %zu at %lld is past the end of the audio or its data", pPath, t + 2, c, static_cast<long long>(range.offset));
+                break;
+            }
+
+            for (size_t b = 0; b < data.size(); ++b)
+            {
+                if (data[b] != s_SourceByte(streamIdx, pos + b))
+                {
+                    p_pReport->Error("%s track %zu chunk %zu at %lld does not hold audio byte %lld", pPath, t + 2, c, static_cast<long long>(range.offset),
+                                     static_cast<long long>(pos + b));
+                    break;
+                }
+            }
+            pos += range.size;
+        }
+    }
+}
+
+// the descriptive fields of both movies, libavformat being the reference
+static void s_CompareTracks(const ParsedMovie& p_Ref, const ParsedMovie& p_Test, Report* p_pReport)
+{
+    const std::vector<TrackInfo>& refTracks = p_Ref.GetTracks();
+    const std::vector<TrackInfo>& testTracks = p_Test.GetTracks();
+    const double tolerance = 1.0 / std::max<uint32_t>(1, std::min(p_Ref.GetMovieTimescale(), p_Test.GetMovieTimescale()));
+    for (size_t i = 0; (i < refTracks.size()) && (i < testTracks.size()); ++i)
+    {
+        const TrackInfo& ref = refTracks[i];
+        const TrackInfo& test = testTracks[i];
+
+        // the striped movie repeats the description per data file, the first one stands for all
+        // MovWriter describes LPCM with a version 2 'lpcm' entry where libavformat picks 'sowt', 'in24' and the like,
+        // for sound the normalized fields below are what has to agree
+        const bool isSound = (ref.handler == MKTAG('s', 'o', 'u', 'n'));
+        const SampleEntry& refEntry = ref.entries[0];
+        const SampleEntry& testEntry = test.entries[0];
+        if (!isSound && (refEntry.fourCC != testEntry.fourCC))
+        {
+            p_pReport->Error("track %zu stsd: '%s' against '%s' from libavformat", i + 1, s_TagString(testEntry.fourCC).c_str(), s_TagString(refEntry.fourCC).c_str());
+        }
+
+        if ((refEntry.width != testEntry.width) || (refEntry.height != testEntry.height) || (refEntry.depth != testEntry.depth))
+        {
+            p_pReport->Error("track %zu stsd: %ux%u depth %u against %ux%u depth %u from libavformat", i + 1, testEntry.width, testEntry.height, testEntry.depth,
+                             refEntry.width, refEntry.height, refEntry.depth);
+        }
+
+        if ((refEntry.numChannels != testEntry.numChannels) || (refEntry.bitsPerSample != testEntry.bitsPerSample) || (refEntry.sampleRate != testEntry.sampleRate) ||
+            (refEntry.isFloat != testEntry.isFloat) || (refEntry.isBigEndian != testEntry.isBigEndian))
+        {
+            p_pReport->Error("track %zu stsd: %u ch %u bit%s %s %u Hz against %u ch %u bit%s %s %u Hz from libavformat", i + 1, testEntry.numChannels,
+                             testEntry.bitsPerSample, testEntry.isFloat ? " float" : "", testEntry.isBigEndian ? "BE" : "LE", testEntry.sampleRate, refEntry.numChannels,
+                             refEntry.bitsPerSample, refEntry.isFloat ? " float" : "", refEntry.isBigEndian ? "BE" : "LE", refEntry.sampleRate);
+        }
+
+        for (size_t e = 1; e < test.entries.size(); ++e)
+        {
+            if ((test.entries[e].fourCC != testEntry.fourCC) || (test.entries[e].width != testEntry.width) || (test.entries[e].numChannels != testEntry.numChannels))
+            {
+                p_pReport->Error("track %zu stsd: description %zu differs from the first", i + 1, e + 1);
+            }
+        }
+
+        const double mdhdTolerance = 1.0 / std::max<uint32_t>(1, std::min(ref.timescale, test.timescale));
+        if (!s_IsClose(ref.mdhdSeconds, test.mdhdSeconds, mdhdTolerance))
+        {
+            p_pReport->Error("track %zu mdhd: %.6f s against %.6f s from libavformat", i + 1, test.mdhdSeconds, ref.mdhdSeconds);
+        }
+
+        // libavformat only enables the first sound track, MovWriter enables all of them so a movie with a mono track per
+        // channel plays every channel
+        const uint32_t enabledMask = isSound ? ~0x1u : ~0u;
+        if ((ref.trackId != test.trackId) || ((ref.tkhdFlags & enabledMask) != (test.tkhdFlags & enabledMask)) || (ref.volume != test.volume) ||
+            (ref.width != test.width) || (ref.height != test.height))
+        {
+            p_pReport->Error("track %zu tkhd: id %u flags 0x%x volume 0x%x size %ux%u against id %u flags 0x%x volume 0x%x size %ux%u from libavformat", i + 1,
+                             test.trackId, test.tkhdFlags, test.volume, test.width >> 16, test.height >> 16, ref.trackId, ref.tkhdFlags, ref.volume, ref.width >> 16,
+                             ref.height >> 16);
+        }
+
+        if (!s_IsClose(ref.tkhdSeconds, test.tkhdSeconds, tolerance))
+        {
+            p_pReport->Error("track %zu tkhd: %.6f s against %.6f s from libavformat", i + 1, test.tkhdSeconds, ref.tkhdSeconds);
+        }
+    }
+}
+
+// with fast start the moov must sit in the reserved space, right behind ftyp
+static void s_CheckMoovReserve(const ParsedMovie& p_Movie, const Layout& p_Layout, Report* p_pReport)
+{
+    const int64_t reserved = s_MoovReserve(p_Layout);
+    const std::vector<uint32_t>& topLevel = p_Movie.GetTopLevel();
+    const bool isFirst = (topLevel.size() >= 2) && (topLevel[0] == MKTAG('f', 't', 'y', 'p')) && (topLevel[1] == MKTAG('m', 'o', 'o', 'v'));
+    g_Log(logLevelInfo, "movparity :: %s: moov of %lld bytes, %.1f per frame, %lld reserved", p_Layout.pName, static_cast<long long>(p_Movie.GetMoovSize()),
+          static_cast<double>(p_Movie.GetMoovSize()) / p_Layout.numFrames, static_cast<long long>(reserved));
+    if (!isFirst || (p_Movie.GetMoovSize() > reserved))
+    {
+        p_pReport->Error("moov of %lld bytes does not fit the %lld s_EstimateMoovSize reserves for %lld frames", static_cast<long long>(p_Movie.GetMoovSize()),
+                         static_cast<long long>(reserved), static_cast<long long>(p_Layout.numFrames));
+    }
+}
+
+static int s_RunLayout(const std::string& p_WorkDir, const Layout& p_Layout, bool p_IsKeep)
+{
+    Report report(p_Layout.pName);
+    const std::string base = p_WorkDir + "/movparity_" + p_Layout.pName;
+    const std::string refPath = base + "_lavf.mov";
+    const std::string testPath = base + "_native.mov";
+    std::vector<std::string> stripePaths;
+    for (int i = 0; i < p_Layout.numStripes; ++i)
+    {
+        stripePaths.push_back(testPath + ".stripe" + std::to_string(i));
+    }
+
+    if (!s_Mux(refPath, std::vector<std::string>(), p_Layout, false) || !s_Mux(testPath, stripePaths, p_Layout, true))
+    {
+        report.Error("muxing failed");
+    }
+    else
+    {
+        ParsedMovie ref;
+        ParsedMovie test;
+        if (!ref.Load(refPath) || !test.Load(testPath))
+        {
+            report.Error("could not read the movies back");
+        }
+        else
+        {
+            s_CheckSamples(&ref, p_Layout, &report);
+            s_CheckSamples(&test, p_Layout, &report);
+            s_CompareTracks(ref, test, &report);
+            if (p_Layout.isFastStart)
+            {
+                s_CheckMoovReserve(test, p_Layout, &report);
+            }
+        }
+    }
+
+    if (!p_IsKeep)
+    {
+        remove(refPath.c_str());
+        remove(testPath.c_str());
+        for (size_t i = 0; i < stripePaths.size(); ++i)
+        {
+            remove(stripePaths[i].c_str());
+        }
+    }
+
+    g_Log(logLevelInfo, "movparity :: %s: %lld frames, %zu audio tracks, %d stripes%s: %s", p_Layout.pName, static_cast<long long>(p_Layout.numFrames),
+          p_Layout.audioTracks.size(), p_Layout.numStripes, p_Layout.isFastStart ? ", fast start" : "", (report.GetNumErrors() == 0) ? "same" : "DIFFERENT");
+    return report.GetNumErrors();
+}
+
+int main(int argc, char** argv)
+{
+    std::string workDir = "/tmp";
+    bool isKeep = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-d") == 0) && (i + 1 < argc))
+        {
+            workDir = argv[++i];
+        }
+        else if (strcmp(argv[i], "-k") == 0)
+        {
+            isKeep = true;
+        }
+        else
+        {
+            s_PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    const AudioTrackDesc stereo16 = { AV_CODEC_ID_PCM_S16LE, 2, 2 };
+    const AudioTrackDesc mono24 = { AV_CODEC_ID_PCM_S24LE, 1, 3 };
+    const AudioTrackDesc surround24 = { AV_CODEC_ID_PCM_S24LE, 6, 3 };
+    const AudioTrackDesc mono16 = { AV_CODEC_ID_PCM_S16LE, 1, 2 };
+
+    // 23.976 with 2002 audio frames per video frame. The long fast start runs use 25 fps and 8 kHz so a few ten
+    // thousand frames stay small on disk, the moov only depends on the number of chunks
+    std::vector<Layout> layouts;
+    layouts.push_back({ "video", 240, 24000, 1001, 48000, {}, 0, false });
+    layouts.push_back({ "multitrack", 240, 24000, 1001, 48000, { stereo16, mono24, surround24 }, 0, false });
+    layouts.push_back({ "striped", 240, 24000, 1001, 48000, { stereo16 }, 2, false });
+    layouts.push_back({ "faststart", 30000, 25, 1, 8000, { mono16 }, 0, true });
+    layouts.push_back({ "faststart_multitrack", 30000, 25, 1, 8000, { mono16, mono16, mono16, mono16, mono16, mono16 }, 0, true });
+    layouts.push_back({ "faststart_striped", 30000, 25, 1, 8000, { mono16, mono16 }, 3, true });
+
+    int numFailed = 0;
+    for (size_t i = 0; i < layouts.size(); ++i)
+    {
+        numFailed += (s_RunLayout(workDir, layouts[i], isKeep) > 0) ? 1 : 0;
+    }
+
+    if (numFailed > 0)
+    {
+        g_Log(logLevelError, "movparity :: %d of %zu layouts differ", numFailed, layouts.size());
+        return 1;
+    }
+
+    return 0;
+}
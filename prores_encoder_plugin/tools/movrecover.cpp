@@ -0,0 +1,70 @@
+// Rebuilds a playable movie from the output of an interrupted render using the write journal kept next to it.
+// The journaled samples are copied into a fresh movie, the original file and journal are left untouched.
+
+#include "mov_journal.h"
+#include "mov_muxer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+static void s_PrintUsage(const char* p_pName)
+{
+    fprintf(stderr, "usage: %s [-o <recovered.mov>] <interrupted.mov>\n", p_pName);
+}
+
+int main(int argc, char** argv)
+{
+    std::string outPath;
+    std::string inPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc))
+        {
+            outPath = argv[++i];
+        }
+        else
+        {
+            inPath = argv[i];
+        }
+    }
+
+    if (inPath.empty())
+    {
+        s_PrintUsage(argv[0]);
+        return 1;
+    }
+
+    if (outPath.empty())
+    {
+        const size_t extPos = inPath.rfind('.');
+        outPath = ((extPos != std::string::npos) ? inPath.substr(0, extPos) : inPath) + "_recovered.mov";
+    }
+
+    av_register_all();
+
+    MovJournalReader journal;
+    if (!journal.Load(g_MovJournalPath(inPath)))
+    {
+        g_Log(logLevelError, "movrecover :: No usable journal found for %s", inPath.c_str());
+        return 1;
+    }
+
+    MovMuxer muxer;
+    if (!muxer.Open(outPath) || !journal.AddStreams(&muxer) || !muxer.WriteHeader())
+    {
+        return 1;
+    }
+
+    int64_t numCopied = 0;
+    const bool isCopied = journal.CopySamples(inPath, &muxer, &numCopied);
+    if (!muxer.Close() || !isCopied)
+    {
+        return 1;
+    }
+
+    g_Log(logLevelInfo, "movrecover :: Recovered %lld of %lld samples into %s", static_cast<long long>(numCopied),
+          static_cast<long long>(journal.GetRecords().size()), outPath.c_str());
+    return 0;
+}
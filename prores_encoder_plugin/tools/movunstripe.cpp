@@ -0,0 +1,694 @@
+// Consolidates a striped render, a reference movie whose samples are spread over data files on several volumes,
+// into a single self-contained movie. The sample tables of the reference movie say which data file and offset
+// every chunk lives at, the chunks are copied in time order and the data files are left untouched.
+
+#include "mov_muxer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavutil/channel_layout.h>
+#include <libavutil/intfloat.h>
+}
+
+static void s_PrintUsage(const char* p_pName)
+{
+    fprintf(stderr, "usage: %s -o <output.mov> <striped.mov>\n", p_pName);
+}
+
+static uint32_t s_ReadBE32(const uint8_t* p_pBuf)
+{
+    return (static_cast<uint32_t>(p_pBuf[0]) << 24) | (static_cast<uint32_t>(p_pBuf[1]) << 16) | (static_cast<uint32_t>(p_pBuf[2]) << 8) | p_pBuf[3];
+}
+
+static uint16_t s_ReadBE16(const uint8_t* p_pBuf)
+{
+    return static_cast<uint16_t>((p_pBuf[0] << 8) | p_pBuf[1]);
+}
+
+static uint64_t s_ReadBE64(const uint8_t* p_pBuf)
+{
+    return (static_cast<uint64_t>(s_ReadBE32(p_pBuf)) << 32) | s_ReadBE32(p_pBuf + 4);
+}
+
+static uint32_t s_ReadTag(const uint8_t* p_pBuf)
+{
+    return MKTAG(p_pBuf[0], p_pBuf[1], p_pBuf[2], p_pBuf[3]);
+}
+
+// a view of one atom inside the moov, which is read into memory as a whole
+struct Atom
+{
+    uint32_t type;
+    const uint8_t* pData; // payload behind the header
+    size_t size;          // payload size
+};
+
+// the child atoms of p_pData, stops at the first one that does not fit
+static std::vector<Atom> s_ParseAtoms(const uint8_t* p_pData, size_t p_Size)
+{
+    std::vector<Atom> atoms;
+    size_t pos = 0;
+    while (pos + 8 <= p_Size)
+    {
+        uint64_t atomSize = s_ReadBE32(p_pData + pos);
+        size_t headerSize = 8;
+        if ((atomSize == 1) && (pos + 16 <= p_Size))
+        {
+            atomSize = s_ReadBE64(p_pData + pos + 8);
+            headerSize = 16;
+        }
+        else if (atomSize == 0)
+        {
+            atomSize = p_Size - pos;
+        }
+
+        if ((atomSize < headerSize) || (atomSize > p_Size - pos))
+        {
+            break;
+        }
+
+        Atom atom;
+        atom.type = s_ReadTag(p_pData + pos + 4);
+        atom.pData = p_pData + pos + headerSize;
+        atom.size = static_cast<size_t>(atomSize) - headerSize;
+        atoms.push_back(atom);
+        pos += static_cast<size_t>(atomSize);
+    }
+
+    return atoms;
+}
+
+static const Atom* s_FindAtom(const std::vector<Atom>& p_Atoms, uint32_t p_Type)
+{
+    for (size_t i = 0; i < p_Atoms.size(); ++i)
+    {
+        if (p_Atoms[i].type == p_Type)
+        {
+            return &p_Atoms[i];
+        }
+    }
+
+    return NULL;
+}
+
+static const struct
+{
+    uint32_t fourCC;
+    int profile;
+} s_ProResProfiles[] = {
+    { MKTAG('a', 'p', 'c', 'o'), FF_PROFILE_PRORES_PROXY },
+    { MKTAG('a', 'p', 'c', 's'), FF_PROFILE_PRORES_LT },
+    { MKTAG('a', 'p', 'c', 'n'), FF_PROFILE_PRORES_STANDARD },
+    { MKTAG('a', 'p', 'c', 'h'), FF_PROFILE_PRORES_HQ },
+    { MKTAG('a', 'p', '4', 'h'), FF_PROFILE_PRORES_4444 },
+    { MKTAG('a', 'p', '4', 'x'), FF_PROFILE_PRORES_XQ },
+};
+static const int s_NumProResProfiles = sizeof(s_ProResProfiles) / sizeof(s_ProResProfiles[0]);
+
+// one chunk of one track as it sits in a data file
+struct ChunkDesc
+{
+    int trackIdx;
+    int dataIdx;
+    int64_t offset;
+    int64_t size;
+    int64_t dts;      // in the track timescale
+    int64_t duration;
+    double seconds;   // dts on the common timeline, used to interleave the tracks
+};
+
+class StripedMovie
+{
+public:
+    StripedMovie()
+    {
+    }
+
+    ~StripedMovie()
+    {
+        for (size_t i = 0; i < m_Tracks.size(); ++i)
+        {
+            avcodec_parameters_free(&m_Tracks[i].pPar);
+        }
+
+        for (size_t i = 0; i < m_DataFiles.size(); ++i)
+        {
+            if (m_DataFiles[i] != NULL)
+            {
+                fclose(m_DataFiles[i]);
+            }
+        }
+    }
+
+    bool Load(const std::string& p_Path)
+    {
+        m_Path = p_Path;
+        if (!ReadMoov())
+        {
+            return false;
+        }
+
+        const std::vector<Atom> moov = s_ParseAtoms(m_Moov.data(), m_Moov.size());
+        for (size_t i = 0; i < moov.size(); ++i)
+        {
+            if ((moov[i].type == MKTAG('t', 'r', 'a', 'k')) && !ParseTrak(moov[i]))
+            {
+                return false;
+            }
+        }
+
+        if (m_Tracks.empty())
+        {
+            g_Log(logLevelError, "movunstripe :: No tracks in %s", m_Path.c_str());
+            return false;
+        }
+
+        std::stable_sort(m_Chunks.begin(), m_Chunks.end(), [](const ChunkDesc& p_A, const ChunkDesc& p_B)
+        {
+            return p_A.seconds < p_B.seconds;
+        });
+        return true;
+    }
+
+    bool AddStreams(MovMuxer* p_pMuxer) const
+    {
+        for (size_t i = 0; i < m_Tracks.size(); ++i)
+        {
+            const AVRational timeBase = { 1, static_cast<int>(m_Tracks[i].timescale) };
+            if (p_pMuxer->AddStream(m_Tracks[i].pPar, timeBase) != static_cast<int>(i))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool CopyChunks(MovMuxer* p_pMuxer, int64_t* p_pNumCopied) const
+    {
+        *p_pNumCopied = 0;
+        for (size_t i = 0; i < m_Chunks.size(); ++i)
+        {
+            const ChunkDesc& chunk = m_Chunks[i];
+            FILE* pFile = m_DataFiles[chunk.dataIdx];
+
+            AVPacket packet;
+            av_init_packet(&packet);
+            if ((chunk.size <= 0) || (av_new_packet(&packet, static_cast<int>(chunk.size)) < 0))
+            {
+                return false;
+            }
+
+            if ((fseeko(pFile, chunk.offset, SEEK_SET) != 0) || (fread(packet.data, chunk.size, 1, pFile) != 1))
+            {
+                g_Log(logLevelError, "movunstripe :: Could not read %lld bytes at %lld from %s", static_cast<long long>(chunk.size),
+                      static_cast<long long>(chunk.offset), m_DataPaths[chunk.dataIdx].c_str());
+                av_packet_unref(&packet);
+                return false;
+            }
+
+            const Track& track = m_Tracks[chunk.trackIdx];
+            const AVRational timeBase = { 1, static_cast<int>(track.timescale) };
+
+            packet.stream_index = chunk.trackIdx;
+            packet.pts = chunk.dts;
+            packet.dts = chunk.dts;
+            packet.duration = chunk.duration;
+            packet.flags = AV_PKT_FLAG_KEY;
+
+            const AVStream* pStream = p_pMuxer->GetStream(chunk.trackIdx);
+            if (pStream != NULL)
+            {
+                av_packet_rescale_ts(&packet, timeBase, pStream->time_base);
+            }
+
+            const bool isOk = p_pMuxer->WritePacket(&packet);
+            av_packet_unref(&packet);
+            if (!isOk)
+            {
+                return false;
+            }
+
+            ++*p_pNumCopied;
+        }
+
+        return true;
+    }
+
+    size_t GetNumDataFiles() const
+    {
+        return m_DataPaths.size();
+    }
+
+private:
+    // disable assignment and copy constructor
+    StripedMovie(const StripedMovie& p_Other);
+    StripedMovie& operator=(const StripedMovie& p_Other);
+
+    struct Track
+    {
+        AVCodecParameters* pPar;
+        uint32_t timescale;
+        uint32_t bytesPerFrame; // audio only, a chunk holds whole frames
+        std::vector<int> dataIdxBySampleDesc;
+    };
+
+    bool ReadMoov()
+    {
+        FILE* pFile = fopen(m_Path.c_str(), "rb");
+        if (pFile == NULL)
+        {
+            g_Log(logLevelError, "movunstripe :: Could not open %s", m_Path.c_str());
+            return false;
+        }
+
+        // only the top level is walked on disk, the moov is small enough to parse in memory
+        bool isFound = false;
+        int64_t pos = 0;
+        uint8_t header[16];
+        while (!isFound && (fseeko(pFile, pos, SEEK_SET) == 0) && (fread(header, 8, 1, pFile) == 1))
+        {
+            int64_t atomSize = s_ReadBE32(header);
+            int64_t headerSize = 8;
+            if (atomSize == 1)
+            {
+                if (fread(header + 8, 8, 1, pFile) != 1)
+                {
+                    break;
+                }
+
+                atomSize = static_cast<int64_t>(s_ReadBE64(header + 8));
+                headerSize = 16;
+            }
+
+            if (atomSize < headerSize)
+            {
+                break;
+            }
+
+            if (s_ReadTag(header + 4) == MKTAG('m', 'o', 'o', 'v'))
+            {
+                m_Moov.resize(static_cast<size_t>(atomSize - headerSize));
+                isFound = m_Moov.empty() || (fread(m_Moov.data(), m_Moov.size(), 1, pFile) == 1);
+            }
+
+            pos += atomSize;
+        }
+
+        fclose(pFile);
+        if (!isFound)
+        {
+            g_Log(logLevelError, "movunstripe :: No movie header in %s", m_Path.c_str());
+        }
+
+        return isFound;
+    }
+
+    // the data file a dref entry points at, opened once even if several tracks share it
+    int OpenDataRef(const Atom& p_Entry)
+    {
+        std::string path = m_Path;
+        const bool isSelf = (p_Entry.size >= 4) && ((s_ReadBE32(p_Entry.pData) & 0x1) != 0);
+        if (!isSelf)
+        {
+            if ((p_Entry.type != MKTAG('u', 'r', 'l', ' ')) || (p_Entry.size <= 4))
+            {
+                g_Log(logLevelError, "movunstripe :: Unsupported data reference in %s", m_Path.c_str());
+                return -1;
+            }
+
+            path.assign(reinterpret_cast<const char*>(p_Entry.pData + 4), strnlen(reinterpret_cast<const char*>(p_Entry.pData + 4), p_Entry.size - 4));
+            if (path.compare(0, 7, "file://") == 0)
+            {
+                path.erase(0, 7);
+            }
+        }
+
+        for (size_t i = 0; i < m_DataPaths.size(); ++i)
+        {
+            if (m_DataPaths[i] == path)
+            {
+                return static_cast<int>(i);
+            }
+        }
+
+        FILE* pFile = fopen(path.c_str(), "rb");
+        if (pFile == NULL)
+        {
+            // the stripes may have been moved along with the movie, look next to it
+            const size_t slashPos = path.find_last_of('/');
+            const size_t movieSlashPos = m_Path.find_last_of('/');
+            const std::string movieDir = (movieSlashPos == std::string::npos) ? std::string() : m_Path.substr(0, movieSlashPos + 1);
+            const std::string localPath = movieDir + ((slashPos == std::string::npos) ? path : path.substr(slashPos + 1));
+            pFile = fopen(localPath.c_str(), "rb");
+        }
+
+        if (pFile == NULL)
+        {
+            g_Log(logLevelError, "movunstripe :: Could not open data file %s", path.c_str());
+            return -1;
+        }
+
+        m_DataPaths.push_back(path);
+        m_DataFiles.push_back(pFile);
+        return static_cast<int>(m_DataFiles.size() - 1);
+    }
+
+    bool ParseSampleEntry(const uint8_t* p_pEntry, size_t p_Size, bool p_IsVideo, Track* p_pTrack)
+    {
+        AVCodecParameters* pPar = p_pTrack->pPar;
+        const uint32_t fourCC = s_ReadTag(p_pEntry + 4);
+
+        if (p_IsVideo)
+        {
+            // 16 bytes of common header, then the video fields
+            if (p_Size < 16 + 70)
+            {
+                return false;
+            }
+
+            pPar->codec_type = AVMEDIA_TYPE_VIDEO;
+            pPar->codec_id = AV_CODEC_ID_PRORES;
+            pPar->codec_tag = fourCC;
+            pPar->width = s_ReadBE16(p_pEntry + 16 + 16);
+            pPar->height = s_ReadBE16(p_pEntry + 16 + 18);
+            pPar->profile = -1;
+            for (int i = 0; i < s_NumProResProfiles; ++i)
+            {
+                if (s_ProResProfiles[i].fourCC == fourCC)
+                {
+                    pPar->profile = s_ProResProfiles[i].profile;
+                }
+            }
+
+            if (pPar->profile < 0)
+            {
+                g_Log(logLevelError, "movunstripe :: Video track is not ProRes in %s", m_Path.c_str());
+                return false;
+            }
+
+            pPar->format = (pPar->profile >= FF_PROFILE_PRORES_4444) ? AV_PIX_FMT_YUV444P10 : AV_PIX_FMT_YUV422P10;
+            return true;
+        }
+
+        // version 2 sound description as MovWriter writes it
+        if ((fourCC != MKTAG('l', 'p', 'c', 'm')) || (p_Size < 16 + 48) || (s_ReadBE16(p_pEntry + 16) != 2))
+        {
+            g_Log(logLevelError, "movunstripe :: Sound track is not LPCM in %s", m_Path.c_str());
+            return false;
+        }
+
+        const uint8_t* pFields = p_pEntry + 16 + 20;
+        const double sampleRate = av_int2double(s_ReadBE64(pFields + 4));
+        const uint32_t numChannels = s_ReadBE32(pFields + 12);
+        const uint32_t bitsPerSample = s_ReadBE32(pFields + 20);
+        const uint32_t flags = s_ReadBE32(pFields + 24);
+        const bool isFloat = ((flags & 0x1) != 0);
+        const bool isBigEndian = ((flags & 0x2) != 0);
+
+        AVCodecID codecId = AV_CODEC_ID_NONE;
+        if (isFloat && (bitsPerSample == 32))
+        {
+            codecId = isBigEndian ? AV_CODEC_ID_PCM_F32BE : AV_CODEC_ID_PCM_F32LE;
+        }
+        else if (!isFloat && (bitsPerSample == 16))
+        {
+            codecId = isBigEndian ? AV_CODEC_ID_PCM_S16BE : AV_CODEC_ID_PCM_S16LE;
+        }
+        else if (!isFloat && (bitsPerSample == 24))
+        {
+            codecId = isBigEndian ? AV_CODEC_ID_PCM_S24BE : AV_CODEC_ID_PCM_S24LE;
+        }
+        else if (!isFloat && (bitsPerSample == 32))
+        {
+            codecId = isBigEndian ? AV_CODEC_ID_PCM_S32BE : AV_CODEC_ID_PCM_S32LE;
+        }
+
+        if ((codecId == AV_CODEC_ID_NONE) || (numChannels == 0))
+        {
+            g_Log(logLevelError, "movunstripe :: Unsupported LPCM layout in %s", m_Path.c_str());
+            return false;
+        }
+
+        pPar->codec_type = AVMEDIA_TYPE_AUDIO;
+        pPar->codec_id = codecId;
+        pPar->sample_rate = static_cast<int>(sampleRate + 0.5);
+        pPar->channels = static_cast<int>(numChannels);
+        pPar->channel_layout = av_get_default_channel_layout(pPar->channels);
+        pPar->bits_per_coded_sample = static_cast<int>(bitsPerSample);
+        p_pTrack->bytesPerFrame = numChannels * bitsPerSample / 8;
+        return true;
+    }
+
+    bool ParseTrak(const Atom& p_Trak)
+    {
+        const std::vector<Atom> trak = s_ParseAtoms(p_Trak.pData, p_Trak.size);
+        const Atom* pMdia = s_FindAtom(trak, MKTAG('m', 'd', 'i', 'a'));
+        if (pMdia == NULL)
+        {
+            return true;
+        }
+
+        const std::vector<Atom> mdia = s_ParseAtoms(pMdia->pData, pMdia->size);
+        const Atom* pMdhd = s_FindAtom(mdia, MKTAG('m', 'd', 'h', 'd'));
+        const Atom* pHdlr = s_FindAtom(mdia, MKTAG('h', 'd', 'l', 'r'));
+        const Atom* pMinf = s_FindAtom(mdia, MKTAG('m', 'i', 'n', 'f'));
+        if ((pMdhd == NULL) || (pHdlr == NULL) || (pMinf == NULL) || (pMdhd->size < 24) || (pHdlr->size < 12))
+        {
+            return true;
+        }
+
+        const uint32_t handler = s_ReadTag(pHdlr->pData + 8);
+        if ((handler != MKTAG('v', 'i', 'd', 'e')) && (handler != MKTAG('s', 'o', 'u', 'n')))
+        {
+            // timecode and other tracks are not carried over
+            return true;
+        }
+
+        const std::vector<Atom> minf = s_ParseAtoms(pMinf->pData, pMinf->size);
+        const Atom* pDinf = s_FindAtom(minf, MKTAG('d', 'i', 'n', 'f'));
+        const Atom* pStbl = s_FindAtom(minf, MKTAG('s', 't', 'b', 'l'));
+        if ((pDinf == NULL) || (pStbl == NULL))
+        {
+            g_Log(logLevelError, "movunstripe :: Incomplete track in %s", m_Path.c_str());
+            return false;
+        }
+
+        Track track;
+        track.pPar = avcodec_parameters_alloc();
+        track.timescale = (pMdhd->pData[0] == 1) ? s_ReadBE32(pMdhd->pData + 20) : s_ReadBE32(pMdhd->pData + 12);
+        track.bytesPerFrame = 0;
+        if ((track.pPar == NULL) || (track.timescale == 0))
+        {
+            avcodec_parameters_free(&track.pPar);
+            return false;
+        }
+
+        m_Tracks.push_back(track);
+        Track& newTrack = m_Tracks.back();
+        const int trackIdx = static_cast<int>(m_Tracks.size() - 1);
+
+        // data references, each sample description points at one of them
+        std::vector<int> dataIdxByRef;
+        const std::vector<Atom> dinf = s_ParseAtoms(pDinf->pData, pDinf->size);
+        const Atom* pDref = s_FindAtom(dinf, MKTAG('d', 'r', 'e', 'f'));
+        if ((pDref != NULL) && (pDref->size >= 8))
+        {
+            const std::vector<Atom> refs = s_ParseAtoms(pDref->pData + 8, pDref->size - 8);
+            for (size_t i = 0; i < refs.size(); ++i)
+            {
+                const int dataIdx = OpenDataRef(refs[i]);
+                if (dataIdx < 0)
+                {
+                    return false;
+                }
+
+                dataIdxByRef.push_back(dataIdx);
+            }
+        }
+
+        const std::vector<Atom> stbl = s_ParseAtoms(pStbl->pData, pStbl->size);
+        const Atom* pStsd = s_FindAtom(stbl, MKTAG('s', 't', 's', 'd'));
+        const Atom* pStts = s_FindAtom(stbl, MKTAG('s', 't', 't', 's'));
+        const Atom* pStsc = s_FindAtom(stbl, MKTAG('s', 't', 's', 'c'));
+        const Atom* pStsz = s_FindAtom(stbl, MKTAG('s', 't', 's', 'z'));
+        const Atom* pStco = s_FindAtom(stbl, MKTAG('s', 't', 'c', 'o'));
+        const Atom* pCo64 = s_FindAtom(stbl, MKTAG('c', 'o', '6', '4'));
+        if ((pStsd == NULL) || (pStts == NULL) || (pStsc == NULL) || (pStsz == NULL) || ((pStco == NULL) && (pCo64 == NULL)) ||
+            (pStsd->size < 8) || (pStts->size < 8) || (pStsc->size < 8) || (pStsz->size < 12))
+        {
+            g_Log(logLevelError, "movunstripe :: Incomplete sample tables in %s", m_Path.c_str());
+            return false;
+        }
+
+        // the sample descriptions only differ in their data reference, the first one describes the codec
+        const uint32_t numDescs = s_ReadBE32(pStsd->pData + 4);
+        size_t descPos = 8;
+        for (uint32_t i = 0; i < numDescs; ++i)
+        {
+            if (descPos + 16 > pStsd->size)
+            {
+                return false;
+            }
+
+            const uint32_t descSize = s_ReadBE32(pStsd->pData + descPos);
+            const uint16_t dataRefIdx = s_ReadBE16(pStsd->pData + descPos + 14);
+            if ((descSize < 16) || (descPos + descSize > pStsd->size) || (dataRefIdx == 0) || (dataRefIdx > dataIdxByRef.size()))
+            {
+                g_Log(logLevelError, "movunstripe :: Broken sample description in %s", m_Path.c_str());
+                return false;
+            }
+
+            if ((i == 0) && !ParseSampleEntry(pStsd->pData + descPos, descSize, (handler == MKTAG('v', 'i', 'd', 'e')), &newTrack))
+            {
+                return false;
+            }
+
+            newTrack.dataIdxBySampleDesc.push_back(dataIdxByRef[dataRefIdx - 1]);
+            descPos += descSize;
+        }
+
+        // chunk offsets
+        std::vector<int64_t> chunkOffsets;
+        const Atom* pOffsets = (pCo64 != NULL) ? pCo64 : pStco;
+        const size_t offsetSize = (pCo64 != NULL) ? 8 : 4;
+        if (pOffsets->size >= 8)
+        {
+            const uint32_t numChunks = s_ReadBE32(pOffsets->pData + 4);
+            for (uint32_t i = 0; (i < numChunks) && (8 + (i + 1) * offsetSize <= pOffsets->size); ++i)
+            {
+                const uint8_t* pEntry = pOffsets->pData + 8 + i * offsetSize;
+                chunkOffsets.push_back((offsetSize == 8) ? static_cast<int64_t>(s_ReadBE64(pEntry)) : s_ReadBE32(pEntry));
+            }
+        }
+
+        // sample sizes, a constant size is stored once
+        const uint32_t constSampleSize = s_ReadBE32(pStsz->pData + 4);
+        const uint32_t numSamples = s_ReadBE32(pStsz->pData + 8);
+        if ((constSampleSize == 0) && (12 + static_cast<size_t>(numSamples) * 4 > pStsz->size))
+        {
+            return false;
+        }
+
+        // sample durations, expanded lazily while walking the chunks
+        const uint32_t numSttsEntries = s_ReadBE32(pStts->pData + 4);
+        uint32_t sttsIdx = 0;
+        uint32_t sttsLeft = 0;
+        uint32_t sttsDelta = 0;
+
+        const uint32_t numStscEntries = s_ReadBE32(pStsc->pData + 4);
+        uint32_t sampleIdx = 0;
+        int64_t dts = 0;
+        for (uint32_t e = 0; (e < numStscEntries) && (8 + (e + 1) * 12 <= pStsc->size); ++e)
+        {
+            const uint8_t* pEntry = pStsc->pData + 8 + e * 12;
+            const uint32_t firstChunk = s_ReadBE32(pEntry);
+            const uint32_t samplesPerChunk = s_ReadBE32(pEntry + 4);
+            const uint32_t descIdx = s_ReadBE32(pEntry + 8);
+            const uint32_t lastChunk = ((e + 1 < numStscEntries) && (8 + (e + 2) * 12 <= pStsc->size)) ? s_ReadBE32(pEntry + 12) - 1 : static_cast<uint32_t>(chunkOffsets.size());
+            if ((firstChunk == 0) || (descIdx == 0) || (descIdx > newTrack.dataIdxBySampleDesc.size()))
+            {
+                g_Log(logLevelError, "movunstripe :: Broken sample to chunk table in %s", m_Path.c_str());
+                return false;
+            }
+
+            for (uint32_t c = firstChunk; (c <= lastChunk) && (c <= chunkOffsets.size()); ++c)
+            {
+                ChunkDesc chunk;
+                chunk.trackIdx = trackIdx;
+                chunk.dataIdx = newTrack.dataIdxBySampleDesc[descIdx - 1];
+                chunk.offset = chunkOffsets[c - 1];
+                chunk.size = 0;
+                chunk.dts = dts;
+                chunk.duration = 0;
+                chunk.seconds = static_cast<double>(dts) / newTrack.timescale;
+
+                for (uint32_t s = 0; (s < samplesPerChunk) && (sampleIdx < numSamples); ++s, ++sampleIdx)
+                {
+                    chunk.size += (constSampleSize != 0) ? constSampleSize : s_ReadBE32(pStsz->pData + 12 + sampleIdx * 4);
+
+                    while ((sttsLeft == 0) && (sttsIdx < numSttsEntries) && (8 + (sttsIdx + 1) * 8 <= pStts->size))
+                    {
+                        sttsLeft = s_ReadBE32(pStts->pData + 8 + sttsIdx * 8);
+                        sttsDelta = s_ReadBE32(pStts->pData + 8 + sttsIdx * 8 + 4);
+                        ++sttsIdx;
+                    }
+
+                    if (sttsLeft > 0)
+                    {
+                        --sttsLeft;
+                    }
+
+                    chunk.duration += sttsDelta;
+                }
+
+                dts += chunk.duration;
+                m_Chunks.push_back(chunk);
+            }
+        }
+
+        return true;
+    }
+
+private:
+    std::string m_Path;
+    std::vector<uint8_t> m_Moov;
+    std::vector<Track> m_Tracks;
+    std::vector<ChunkDesc> m_Chunks; // all tracks, in time order once loaded
+
+    std::vector<std::string> m_DataPaths;
+    std::vector<FILE*> m_DataFiles;
+};
+
+int main(int argc, char** argv)
+{
+    std::string outPath;
+    std::string inPath;
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc))
+        {
+            outPath = argv[++i];
+        }
+        else
+        {
+            inPath = argv[i];
+        }
+    }
+
+    if (inPath.empty() || outPath.empty())
+    {
+        s_PrintUsage(argv[0]);
+        return 1;
+    }
+
+    av_register_all();
+
+    StripedMovie movie;
+    if (!movie.Load(inPath))
+    {
+        return 1;
+    }
+
+    MovMuxer muxer;
+    if (!muxer.Open(outPath) || !movie.AddStreams(&muxer) || !muxer.WriteHeader())
+    {
+        return 1;
+    }
+
+    int64_t numCopied = 0;
+    const bool isCopied = movie.CopyChunks(&muxer, &numCopied);
+    if (!muxer.Close() || !isCopied)
+    {
+        return 1;
+    }
+
+    g_Log(logLevelInfo, "movunstripe :: Copied %lld chunks from %zu data files into %s", static_cast<long long>(numCopied), movie.GetNumDataFiles(), outPath.c_str());
+    return 0;
+}
@@ -0,0 +1,226 @@
+// Measures the host round trips the per frame property reads cost. A stub pHandleMessage stands in for the
+// host and counts every call. The old per frame reads, one typed getter per property plus the width and height
+// of every frame, run against the stream constants snapshot with GetTiming the plugin uses now.
+
+#include "wrapper/host_api.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+using namespace IOPlugin;
+
+namespace
+{
+    struct StubProperty
+    {
+        PropertyID id;
+        PropertyType type;
+        const void* pValue;
+    };
+
+    // the properties of the one buffer the stub host hands out
+    const uint32_t s_Width = 3840;
+    const uint32_t s_Height = 2160;
+    const int64_t s_Pts = 1001;
+    const int64_t s_Dts = 1000;
+    const int64_t s_IntDuration = 1;
+    const double s_DoubleDuration = 1.0 / 24;
+
+    StubProperty s_Properties[] = {
+        { pIOPropWidth, propTypeUInt32, &s_Width },
+        { pIOPropHeight, propTypeUInt32, &s_Height },
+        { pIOPropPTS, propTypeInt64, &s_Pts },
+        { pIOPropDTS, propTypeInt64, &s_Dts },
+        { pIOPropDuration, propTypeInt64, &s_IntDuration },
+    };
+    const int s_NumProperties = sizeof(s_Properties) / sizeof(s_Properties[0]);
+
+    uint64_t s_NumRoundTrips = 0;
+    int64_t s_CallCostNs = 0; // busy wait per call to model the host's dispatch
+
+    StatusCode s_HandleMessage(MessageID p_MsgID, ...)
+    {
+        ++s_NumRoundTrips;
+        if (s_CallCostNs > 0)
+        {
+            const std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(s_CallCostNs);
+            while (std::chrono::steady_clock::now() < until)
+            {
+            }
+        }
+
+        StatusCode sts = errUnsupported;
+        va_list args;
+        va_start(args, p_MsgID);
+        switch (p_MsgID)
+        {
+            case msgRetain:
+            case msgRelease:
+            {
+                va_arg(args, ObjectRef);
+                *va_arg(args, int*) = 1;
+                sts = errNone;
+                break;
+            }
+            case msgResolveLog:
+            {
+                va_arg(args, int);
+                fprintf(stderr, "%s\n", va_arg(args, const char*));
+                sts = errNone;
+                break;
+            }
+            case msgPropGet:
+            {
+                va_arg(args, ObjectRef);
+                const PropertyID id = va_arg(args, PropertyID);
+                PropertyType* pType = va_arg(args, PropertyType*);
+                const void** ppValue = va_arg(args, const void**);
+                int* pNumValues = va_arg(args, int*);
+                sts = errNoParam;
+                for (int i = 0; i < s_NumProperties; ++i)
+                {
+                    if (strcmp(id, s_Properties[i].id) == 0)
+                    {
+                        *pType = s_Properties[i].type;
+                        *ppValue = s_Properties[i].pValue;
+                        *pNumValues = 1;
+                        sts = errNone;
+                        break;
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        va_end(args);
+
+        return sts;
+    }
+
+    // what the encoder and the container read per video frame before the snapshot
+    int64_t s_ReadOld(HostBufferRef* p_pBuf)
+    {
+        // encoder
+        uint32_t width = 0;
+        uint32_t height = 0;
+        int64_t pts = -1;
+        p_pBuf->GetUINT32(pIOPropWidth, width);
+        p_pBuf->GetUINT32(pIOPropHeight, height);
+        p_pBuf->GetINT64(pIOPropPTS, pts);
+
+        // container
+        int64_t dts = -1;
+        double duration = 0.0;
+        p_pBuf->GetINT64(pIOPropPTS, pts);
+        if (!p_pBuf->GetINT64(pIOPropDTS, dts))
+        {
+            dts = pts;
+        }
+        if (!p_pBuf->GetDouble(pIOPropDuration, duration))
+        {
+            int64_t intDuration = 0;
+            p_pBuf->GetINT64(pIOPropDuration, intDuration);
+            duration = static_cast<double>(intDuration);
+        }
+
+        return pts + dts + width + height + static_cast<int64_t>(duration);
+    }
+
+    // the same with the frame size from the snapshot taken at open
+    int64_t s_ReadNew(HostBufferRef* p_pBuf, const HostCodecConfigCommon& p_CommonProps)
+    {
+        // encoder
+        HostBufferTiming timing;
+        p_pBuf->GetTiming(timing);
+        int64_t sum = timing.pts + p_CommonProps.GetWidth() + p_CommonProps.GetHeight();
+
+        // container
+        p_pBuf->GetTiming(timing);
+        return sum + timing.pts + timing.dts + timing.duration;
+    }
+
+    struct Result
+    {
+        double roundTripsPerFrame;
+        double nsPerFrame;
+    };
+
+    template<typename t_Read>
+    Result s_Run(int64_t p_NumFrames, t_Read p_Read)
+    {
+        volatile int64_t sink = 0;
+        const uint64_t numRoundTrips = s_NumRoundTrips;
+        const std::chrono::steady_clock::time_point startedAt = std::chrono::steady_clock::now();
+        for (int64_t i = 0; i < p_NumFrames; ++i)
+        {
+            sink = sink + p_Read();
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startedAt).count();
+
+        Result result;
+        result.roundTripsPerFrame = static_cast<double>(s_NumRoundTrips - numRoundTrips) / p_NumFrames;
+        result.nsPerFrame = ns / p_NumFrames;
+        return result;
+    }
+
+    void s_PrintUsage(const char* p_pName)
+    {
+        fprintf(stderr, "usage: %s [-n frames] [-c host ns per call]\n", p_pName);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int64_t numFrames = 1000000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc))
+        {
+            numFrames = atoll(argv[++i]);
+        }
+        else if ((strcmp(argv[i], "-c") == 0) && (i + 1 < argc))
+        {
+            s_CallCostNs = atoll(argv[++i]);
+        }
+        else
+        {
+            s_PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (numFrames <= 0)
+    {
+        s_PrintUsage(argv[0]);
+        return 1;
+    }
+
+    APIContext api = { 1, s_HandleMessage };
+    SetHostAPI(&api);
+
+    // any non NULL object, the stub only ever has the one buffer
+    static int s_Buffer = 0;
+    HostBufferRef buf(static_cast<ObjectRef>(&s_Buffer));
+    HostCodecConfigCommon commonProps;
+    commonProps.Load(&buf);
+
+    // the host gives the duration either as int64 in time base units or as double seconds
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const bool isDouble = (pass == 1);
+        s_Properties[s_NumProperties - 1].type = isDouble ? propTypeDouble : propTypeInt64;
+        s_Properties[s_NumProperties - 1].pValue = isDouble ? static_cast<const void*>(&s_DoubleDuration) : static_cast<const void*>(&s_IntDuration);
+
+        const Result oldResult = s_Run(numFrames, [&]() { return s_ReadOld(&buf); });
+        const Result newResult = s_Run(numFrames, [&]() { return s_ReadNew(&buf, commonProps); });
+        printf("duration as %-6s  getters: %4.1f round trips %7.1f ns per frame  snapshot + GetTiming: %4.1f round trips %7.1f ns per frame\n",
+               isDouble ? "double" : "int64", oldResult.roundTripsPerFrame, oldResult.nsPerFrame, newResult.roundTripsPerFrame, newResult.nsPerFrame);
+    }
+
+    return 0;
+}
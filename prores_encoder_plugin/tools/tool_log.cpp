@@ -0,0 +1,17 @@
+#include "wrapper/host_api.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+// the tools run without a host, route the plugin logging to stderr instead
+void g_Log(uint32_t p_LogLevel, const char* p_pFmt, ...)
+{
+    static const char* const s_LevelNames[] = { "error", "warn", "info" };
+
+    va_list args;
+    va_start(args, p_pFmt);
+    fprintf(stderr, "[%s] ", (p_LogLevel <= logLevelInfo) ? s_LevelNames[p_LogLevel] : "log");
+    vfprintf(stderr, p_pFmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
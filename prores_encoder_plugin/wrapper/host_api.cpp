@@ -4,6 +4,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -161,6 +162,42 @@ namespace IOPlugin
 
         return true;
     }
+
+    bool IPropertyProvider::GetTiming(HostBufferTiming& p_Timing)
+    {
+        p_Timing = HostBufferTiming();
+
+        PropertyType type = propTypeNull;
+        const void* pVal = NULL;
+        int numVals = 0;
+        if ((GetProperty(pIOPropPTS, &type, &pVal, &numVals) == errNone) && (type == propTypeInt64) && (numVals == 1))
+        {
+            p_Timing.pts = *static_cast<const int64_t*>(pVal);
+            p_Timing.hasPts = true;
+        }
+
+        p_Timing.dts = p_Timing.pts;
+        if ((GetProperty(pIOPropDTS, &type, &pVal, &numVals) == errNone) && (type == propTypeInt64) && (numVals == 1))
+        {
+            p_Timing.dts = *static_cast<const int64_t*>(pVal);
+        }
+
+        // duration may be double in seconds or int64 in time base units
+        if ((GetProperty(pIOPropDuration, &type, &pVal, &numVals) == errNone) && (numVals == 1))
+        {
+            if (type == propTypeInt64)
+            {
+                p_Timing.duration = *static_cast<const int64_t*>(pVal);
+            }
+            else if (type == propTypeDouble)
+            {
+                p_Timing.durationSec = *static_cast<const double*>(pVal);
+            }
+        }
+
+        return p_Timing.hasPts;
+    }
+
     ////////////////////////////////////////////////////////////////////////////////
     ///
     /// HostPropertyCollectionRef
@@ -301,6 +338,14 @@ namespace IOPlugin
         p_pOptions->GetUINT8(pIOPropHasAlpha, val8);
 
         m_HasAlpha = (val8 != 0);
+
+        p_pOptions->GetUINT32(pIOPropSamplingRate, m_SamplingRate);
+        p_pOptions->GetUINT32(pIOPropNumChannels, m_NumChannels);
+        p_pOptions->GetUINT32(pIOPropBitDepth, m_BitDepth);
+
+        val8 = 0;
+        p_pOptions->GetUINT8(pIOPropIsFloat, val8);
+        m_IsFloat = (val8 != 0);
     }
 
     ////////////////////////////////////////////////////////////////////////////////
@@ -558,19 +603,29 @@ namespace IOPlugin
     ////////////////////////////////////////////////////////////////////////////////
     bool HostMarkerInfo::FromBuffer(const uint8_t* p_pBuf, uint32_t p_BufSize)
     {
-        m_Name.clear();
-        m_Color.clear();
-        m_PositionSeconds = -1.0;
-        m_DurationSeconds = 0.0;
+        HostMarker marker;
+        const bool isOk = s_FromBuffer(p_pBuf, p_BufSize, &marker);
+
+        m_Name = marker.name.ToString();
+        m_Color = marker.color.ToString();
+        m_PositionSeconds = marker.positionSeconds;
+        m_DurationSeconds = marker.durationSeconds;
+        return isOk;
+    }
+
+    bool HostMarkerInfo::s_FromBuffer(const uint8_t* p_pBuf, uint32_t p_BufSize, HostMarker* p_pMarker)
+    {
+        p_pMarker->positionSeconds = -1.0;
+        p_pMarker->durationSeconds = 0.0;
+        p_pMarker->name = HostStringRef();
+        p_pMarker->color = HostStringRef();
 
         uint32_t bytesLeft = p_BufSize;
         const uint8_t* pBuf = p_pBuf;
-
         while (bytesLeft > 8)
         {
             uint32_t key = 0;
             uint32_t len = 0;
-
             memcpy(&key, pBuf, 4);
             memcpy(&len, pBuf + 4, 4);
             pBuf += 8;
@@ -586,18 +641,10 @@ namespace IOPlugin
                 continue;
             }
 
+            const char* pStr = reinterpret_cast<const char*>(pBuf);
             switch (key)
             {
                 case BLOB_KEY_POSITION:
-                {
-                    if (len != sizeof(double))
-                    {
-                        return false;
-                    }
-
-                    memcpy(&m_PositionSeconds, pBuf, len);
-                    break;
-                }
                 case BLOB_KEY_DURATION:
                 {
                     if (len != sizeof(double))
@@ -605,21 +652,19 @@ namespace IOPlugin
                         return false;
                     }
 
-                    memcpy(&m_DurationSeconds, pBuf, len);
+                    memcpy((key == BLOB_KEY_POSITION) ? &p_pMarker->positionSeconds : &p_pMarker->durationSeconds, pBuf, len);
                     break;
                 }
                 case BLOB_KEY_NAME:
                 {
-                    std::string str(len, '\0');
-                    memcpy(&str[0], pBuf, len);
-                    m_Name = str.c_str();
+                    const void* pEnd = memchr(pStr, '\0', len);
+                    p_pMarker->name = HostStringRef(pStr, (pEnd != NULL) ? (static_cast<const char*>(pEnd) - pStr) : len);
                     break;
                 }
                 case BLOB_KEY_COLOR:
                 {
-                    std::string str(len, '\0');
-                    memcpy(&str[0], pBuf, len);
-                    m_Color = str.c_str();
+                    const void* pEnd = memchr(pStr, '\0', len);
+                    p_pMarker->color = HostStringRef(pStr, (pEnd != NULL) ? (static_cast<const char*>(pEnd) - pStr) : len);
                     break;
                 }
                 default:
@@ -630,7 +675,7 @@ namespace IOPlugin
             bytesLeft -= len;
         }
 
-        return IsValid();
+        return ((p_pMarker->positionSeconds >= 0.0) && !p_pMarker->color.empty());
     }
 
     ////////////////////////////////////////////////////////////////////////////////
@@ -638,9 +683,23 @@ namespace IOPlugin
     /// HostMarkersMap
     ///
     ////////////////////////////////////////////////////////////////////////////////
+    int HostStringRef::Compare(const char* p_pData, size_t p_Size) const
+    {
+        const size_t size = (m_Size < p_Size) ? m_Size : p_Size;
+        const int diff = (size > 0) ? memcmp(m_pData, p_pData, size) : 0;
+        if (diff != 0)
+        {
+            return diff;
+        }
+
+        return (m_Size < p_Size) ? -1 : ((m_Size > p_Size) ? 1 : 0);
+    }
+
     bool HostMarkersMap::FromBuffer(const uint8_t* p_pBuf, uint32_t p_BufSize)
     {
-        m_MarkersMap.clear();
+        m_Markers.clear();
+        m_ColorIndex.clear();
+        m_Colors.clear();
         if (p_BufSize <= 8)
         {
             return true;
@@ -659,6 +718,9 @@ namespace IOPlugin
             return false;
         }
 
+        // a marker record takes at least its header and a position, enough to reserve everything in one go
+        m_Markers.reserve(bytesLeft / (8 + 8 + sizeof(double)));
+
         while (bytesLeft >= 8)
         {
             uint32_t key = 0;
@@ -675,19 +737,89 @@ namespace IOPlugin
 
             if (key == BLOB_KEY_MARKER)
             {
-                HostMarkerInfo newMarker;
-                if (!newMarker.FromBuffer(pPtr, len))
+                HostMarker marker;
+                if (!HostMarkerInfo::s_FromBuffer(pPtr, len, &marker))
                 {
                     return false;
                 }
 
-                m_MarkersMap.emplace(newMarker.GetPositionSeconds(), newMarker);
+                m_Markers.push_back(marker);
             }
 
             pPtr += len;
             bytesLeft -= len;
         }
 
+        // hosts send the markers in time order, sorting is the exception
+        struct ByPosition
+        {
+            bool operator()(const HostMarker& p_Left, const HostMarker& p_Right) const
+            {
+                return (p_Left.positionSeconds < p_Right.positionSeconds);
+            }
+        };
+        if (!std::is_sorted(m_Markers.begin(), m_Markers.end(), ByPosition()))
+        {
+            std::stable_sort(m_Markers.begin(), m_Markers.end(), ByPosition());
+        }
+
+        // group the markers by color, a stable sort keeps each group in time order
+        m_ColorIndex.resize(m_Markers.size());
+        for (size_t i = 0; i < m_ColorIndex.size(); ++i)
+        {
+            m_ColorIndex[i] = static_cast<uint32_t>(i);
+        }
+
+        const std::vector<HostMarker>& markers = m_Markers;
+        std::stable_sort(m_ColorIndex.begin(), m_ColorIndex.end(), [&markers](uint32_t p_Left, uint32_t p_Right) {
+            return (markers[p_Left].color < markers[p_Right].color);
+        });
+
+        for (size_t i = 0; i < m_ColorIndex.size(); ++i)
+        {
+            const HostStringRef& color = m_Markers[m_ColorIndex[i]].color;
+            if (m_Colors.empty() || (m_Colors.back().color < color))
+            {
+                ColorRange range;
+                range.color = color;
+                range.first = static_cast<uint32_t>(i);
+                range.count = 0;
+                m_Colors.push_back(range);
+            }
+
+            ++m_Colors.back().count;
+        }
+
         return true;
     }
+
+    const uint32_t* HostMarkersMap::FindByColor(const std::string& p_Color, size_t* p_pNumFound) const
+    {
+        const HostStringRef color(p_Color.data(), p_Color.size());
+        std::vector<ColorRange>::const_iterator it = std::lower_bound(m_Colors.begin(), m_Colors.end(), color, [](const ColorRange& p_Range, const HostStringRef& p_Color) {
+            return (p_Range.color < p_Color);
+        });
+
+        if ((it == m_Colors.end()) || !(it->color == p_Color))
+        {
+            *p_pNumFound = 0;
+            return NULL;
+        }
+
+        *p_pNumFound = it->count;
+        return m_ColorIndex.data() + it->first;
+    }
+
+    void HostMarkersMap::FindInRange(double p_StartSeconds, double p_EndSeconds, size_t* p_pFirst, size_t* p_pLast) const
+    {
+        std::vector<HostMarker>::const_iterator first = std::lower_bound(m_Markers.begin(), m_Markers.end(), p_StartSeconds, [](const HostMarker& p_Marker, double p_Seconds) {
+            return (p_Marker.positionSeconds < p_Seconds);
+        });
+        std::vector<HostMarker>::const_iterator last = std::lower_bound(first, m_Markers.end(), p_EndSeconds, [](const HostMarker& p_Marker, double p_Seconds) {
+            return (p_Marker.positionSeconds < p_Seconds);
+        });
+
+        *p_pFirst = first - m_Markers.begin();
+        *p_pLast = last - m_Markers.begin();
+    }
 };
@@ -50,6 +50,16 @@ namespace IOPlugin
         ObjectRef m_pOpaque = NULL;
     };
 
+    // timing of one host buffer, the properties that change with every frame
+    struct HostBufferTiming
+    {
+        int64_t pts = -1;
+        int64_t dts = -1; // pts when the host leaves it out
+        int64_t duration = 0; // in time base units, 0 if absent or given in seconds
+        double durationSec = 0.0; // only when given in seconds
+        bool hasPts = false;
+    };
+
     class IPropertyProvider
     {
     public:
@@ -63,6 +73,9 @@ namespace IOPlugin
         bool GetINT64(PropertyID p_ID, int64_t& p_Val);
         bool GetDouble(PropertyID p_ID, double& p_Val);
         bool GetString(PropertyID p_ID, std::string& p_Str);
+
+        // one host call per timing property, the duration type is resolved from that same call
+        bool GetTiming(HostBufferTiming& p_Timing);
     };
 
     class HostPropertyCollectionRef : public IHostObjRef, public IPropertyProvider
@@ -194,6 +207,26 @@ namespace IOPlugin
             return m_Container;
         }
 
+        uint32_t GetSamplingRate() const
+        {
+            return m_SamplingRate;
+        }
+
+        uint32_t GetNumChannels() const
+        {
+            return m_NumChannels;
+        }
+
+        uint32_t GetBitDepth() const
+        {
+            return m_BitDepth;
+        }
+
+        bool IsFloat() const
+        {
+            return m_IsFloat;
+        }
+
     private:
         uint32_t m_Width = 0;
         uint32_t m_Height = 0;
@@ -205,6 +238,10 @@ namespace IOPlugin
         bool m_HasAlpha = false;
         std::string m_Path;
         std::string m_Container;
+        uint32_t m_SamplingRate = 0;
+        uint32_t m_NumChannels = 0;
+        uint32_t m_BitDepth = 0;
+        bool m_IsFloat = false;
     };
 
     class HostUIConfigEntryRef : public HostPropertyCollectionRef
@@ -243,6 +280,68 @@ namespace IOPlugin
         StatusCode m_StatusCode;
     };
 
+    // non-owning view of a string inside a host blob, up to its terminating zero
+    class HostStringRef
+    {
+    public:
+        HostStringRef()
+            : m_pData(NULL)
+            , m_Size(0)
+        {
+        }
+
+        HostStringRef(const char* p_pData, size_t p_Size)
+            : m_pData(p_pData)
+            , m_Size(p_Size)
+        {
+        }
+
+        const char* data() const
+        {
+            return m_pData;
+        }
+
+        size_t size() const
+        {
+            return m_Size;
+        }
+
+        bool empty() const
+        {
+            return (m_Size == 0);
+        }
+
+        std::string ToString() const
+        {
+            return std::string(m_pData, m_Size);
+        }
+
+        int Compare(const char* p_pData, size_t p_Size) const;
+
+        bool operator==(const std::string& p_Other) const
+        {
+            return (Compare(p_Other.data(), p_Other.size()) == 0);
+        }
+
+        bool operator<(const HostStringRef& p_Other) const
+        {
+            return (Compare(p_Other.m_pData, p_Other.m_Size) < 0);
+        }
+
+    private:
+        const char* m_pData;
+        size_t m_Size;
+    };
+
+    // one marker of HostMarkersMap, the strings point into the markers blob
+    struct HostMarker
+    {
+        double positionSeconds;
+        double durationSeconds;
+        HostStringRef name;
+        HostStringRef color;
+    };
+
     class HostMarkerInfo
     {
     private:
@@ -293,6 +392,9 @@ namespace IOPlugin
 
         bool FromBuffer(const uint8_t* p_pBuf, uint32_t p_BufSize);
 
+        // decodes a marker record without copying it, the strings of p_pMarker point into p_pBuf
+        static bool s_FromBuffer(const uint8_t* p_pBuf, uint32_t p_BufSize, HostMarker* p_pMarker);
+
     private:
         std::string m_Name;
         std::string m_Color;
@@ -300,6 +402,8 @@ namespace IOPlugin
         double m_DurationSeconds = 0.0;
     };
 
+    // Flat marker table sorted by position, with the markers of each color indexed. Nothing is copied out of the blob,
+    // which has to outlive the table
     class HostMarkersMap
     {
     private:
@@ -313,12 +417,33 @@ namespace IOPlugin
         ~HostMarkersMap() = default;
 
         bool FromBuffer(const uint8_t* p_pBuf, uint32_t p_BufSize);
-        const std::map<double, HostMarkerInfo>& GetMarkersMap() const
+
+        size_t GetNumMarkers() const
+        {
+            return m_Markers.size();
+        }
+
+        const HostMarker& GetMarker(size_t p_Idx) const
         {
-            return m_MarkersMap;
+            return m_Markers[p_Idx];
         }
 
+        // indices of the markers of color p_Color in time order, p_pNumFound of them
+        const uint32_t* FindByColor(const std::string& p_Color, size_t* p_pNumFound) const;
+
+        // indices [first, last) of the markers starting at p_StartSeconds or later and before p_EndSeconds
+        void FindInRange(double p_StartSeconds, double p_EndSeconds, size_t* p_pFirst, size_t* p_pLast) const;
+
     private:
-        std::map<double, HostMarkerInfo> m_MarkersMap;
+        struct ColorRange
+        {
+            HostStringRef color;
+            uint32_t first; // into m_ColorIndex
+            uint32_t count;
+        };
+
+        std::vector<HostMarker> m_Markers; // by position
+        std::vector<uint32_t> m_ColorIndex; // marker indices grouped by color, by position within each color
+        std::vector<ColorRange> m_Colors; // by color
     };
 }